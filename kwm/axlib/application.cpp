@@ -74,9 +74,7 @@ internal OBSERVER_CALLBACK(AXApplicationCallback)
             AXLibAddApplicationWindow(Application, Window);
 
             /* NOTE(koekeishiya): Triggers an AXEvent_WindowCreated and passes a pointer to the new ax_window */
-            uint32_t *WindowID = (uint32_t *) malloc(sizeof(uint32_t));
-            *WindowID = Window->ID;
-            AXLibConstructEvent(AXEvent_WindowCreated, WindowID, false);
+            AXLibConstructWindowEvent(AXEvent_WindowCreated, Window->ID, false);
 
             /* NOTE(koekeishiya): When a new window is created, we incorrectly receive the kAXFocusedWindowChangedNotification
                                   first, for some reason. We discard that notification and restore it when we have the window to work with. */
@@ -98,9 +96,7 @@ internal OBSERVER_CALLBACK(AXApplicationCallback)
 
             /* NOTE(koekeishiya): The callback is responsible for calling AXLibDestroyWindow(Window);
                                   and AXLibRemoveApplicationWindow(Window->Application, Window->ID); */
-            uint32_t *WindowID = (uint32_t *) malloc(sizeof(uint32_t));
-            *WindowID = Window->ID;
-            AXLibConstructEvent(AXEvent_WindowDestroyed, WindowID, false);
+            AXLibConstructWindowEvent(AXEvent_WindowDestroyed, Window->ID, false);
         }
     }
     else if(CFEqual(Notification, kAXFocusedWindowChangedNotification))
@@ -145,9 +141,7 @@ internal OBSERVER_CALLBACK(AXApplicationCallback)
                    window is visible. Only notify our callback when we know that we can interact with the window in question. */
                 if(!AXLibHasFlags(Window, AXWindow_Minimized))
                 {
-                    uint32_t *WindowID = (uint32_t *) malloc(sizeof(uint32_t));
-                    *WindowID = Window->ID;
-                    AXLibConstructEvent(AXEvent_WindowFocused, WindowID, false);
+                    AXLibConstructWindowEvent(AXEvent_WindowFocused, Window->ID, false);
                 }
 
                 /* NOTE(koekeishiya): If the application corresponding to this window is flagged for activation and
@@ -157,9 +151,7 @@ internal OBSERVER_CALLBACK(AXApplicationCallback)
                     AXLibClearFlags(Window->Application, AXApplication_Activate);
                     if(!AXLibHasFlags(Window, AXWindow_Minimized))
                     {
-                        pid_t *ApplicationPID = (pid_t *) malloc(sizeof(pid_t));
-                        *ApplicationPID = Window->Application->PID;
-                        AXLibConstructEvent(AXEvent_ApplicationActivated, ApplicationPID, false);
+                        AXLibConstructApplicationEvent(AXEvent_ApplicationActivated, Window->Application->PID, false);
                     }
                 }
             }
@@ -172,9 +164,7 @@ internal OBSERVER_CALLBACK(AXApplicationCallback)
         if(Window)
         {
             AXLibAddFlags(Window, AXWindow_Minimized);
-            uint32_t *WindowID = (uint32_t *) malloc(sizeof(uint32_t));
-            *WindowID = Window->ID;
-            AXLibConstructEvent(AXEvent_WindowMinimized, WindowID, false);
+            AXLibConstructWindowEvent(AXEvent_WindowMinimized, Window->ID, false);
         }
     }
     else if(CFEqual(Notification, kAXWindowDeminiaturizedNotification))
@@ -210,17 +200,11 @@ internal OBSERVER_CALLBACK(AXApplicationCallback)
             ax_display *Display = AXLibWindowDisplay(Window);
             if(AXLibSpaceHasWindow(Window, Display->Space->ID))
             {
-                uint32_t *WindowID = (uint32_t *) malloc(sizeof(uint32_t));
-                *WindowID = Window->ID;
-                AXLibConstructEvent(AXEvent_WindowDeminimized, WindowID, false);
+                AXLibConstructWindowEvent(AXEvent_WindowDeminimized, Window->ID, false);
 
-                pid_t *ApplicationPID = (pid_t *) malloc(sizeof(pid_t));
-                *ApplicationPID = Window->Application->PID;
-                AXLibConstructEvent(AXEvent_ApplicationActivated, ApplicationPID, false);
+                AXLibConstructApplicationEvent(AXEvent_ApplicationActivated, Window->Application->PID, false);
 
-                WindowID = (uint32_t *) malloc(sizeof(uint32_t));
-                *WindowID = Window->ID;
-                AXLibConstructEvent(AXEvent_WindowFocused, WindowID, false);
+                AXLibConstructWindowEvent(AXEvent_WindowFocused, Window->ID, false);
             }
         }
     }
@@ -233,11 +217,8 @@ internal OBSERVER_CALLBACK(AXApplicationCallback)
             Window->Position = AXLibGetWindowPosition(Window->Ref);
 
             bool Intrinsic = AXLibHasFlags(Window, AXWindow_MoveIntrinsic);
-            uint32_t *WindowID = (uint32_t *) malloc(sizeof(uint32_t));
-            *WindowID = Window->ID;
-
             AXLibClearFlags(Window, AXWindow_MoveIntrinsic);
-            AXLibConstructEvent(AXEvent_WindowMoved, WindowID, Intrinsic);
+            AXLibConstructWindowEvent(AXEvent_WindowMoved, Window->ID, Intrinsic);
         }
     }
     else if(CFEqual(Notification, kAXWindowResizedNotification))
@@ -250,18 +231,13 @@ internal OBSERVER_CALLBACK(AXApplicationCallback)
             Window->Size = AXLibGetWindowSize(Window->Ref);
 
             bool Intrinsic = AXLibHasFlags(Window, AXWindow_SizeIntrinsic);
-            uint32_t *WindowID = (uint32_t *) malloc(sizeof(uint32_t));
-            *WindowID = Window->ID;
-
             AXLibClearFlags(Window, AXWindow_SizeIntrinsic);
-            AXLibConstructEvent(AXEvent_WindowResized, WindowID, Intrinsic);
+            AXLibConstructWindowEvent(AXEvent_WindowResized, Window->ID, Intrinsic);
         }
     }
     else if(CFEqual(Notification, kAXTitleChangedNotification))
     {
-        uint32_t *WindowID = (uint32_t *) malloc(sizeof(uint32_t));
-        *WindowID = AXLibGetWindowID(Element);
-        AXLibConstructEvent(AXEvent_WindowTitleChanged, WindowID, false);
+        AXLibConstructWindowEvent(AXEvent_WindowTitleChanged, AXLibGetWindowID(Element), false);
     }
 }
 
@@ -367,9 +343,7 @@ bool AXLibInitializeApplication(pid_t PID)
 #ifdef DEBUG_BUILD
                 printf("AX: %s did not respond, remove application reference\n", Application->Name.c_str());
 #endif
-                pid_t *ApplicationPID = (pid_t *) malloc(sizeof(pid_t));
-                *ApplicationPID = Application->PID;
-                AXLibConstructEvent(AXEvent_ApplicationTerminated, ApplicationPID, false);
+                AXLibConstructApplicationEvent(AXEvent_ApplicationTerminated, Application->PID, false);
             }
         }
 
@@ -381,9 +355,7 @@ bool AXLibInitializeApplication(pid_t PID)
 
 void AXLibInitializedApplication(ax_application *Application)
 {
-    pid_t *ApplicationPID = (pid_t *) malloc(sizeof(pid_t));
-    *ApplicationPID = Application->PID;
-    AXLibConstructEvent(AXEvent_ApplicationLaunched, ApplicationPID, false);
+    AXLibConstructApplicationEvent(AXEvent_ApplicationLaunched, Application->PID, false);
 
     if((!Application->Focus) ||
        (AXLibHasFlags(Application->Focus, AXWindow_Minimized)))
@@ -392,9 +364,7 @@ void AXLibInitializedApplication(ax_application *Application)
     }
     else
     {
-        pid_t *ApplicationPID = (pid_t *) malloc(sizeof(pid_t));
-        *ApplicationPID = Application->PID;
-        AXLibConstructEvent(AXEvent_ApplicationActivated, ApplicationPID, false);
+        AXLibConstructApplicationEvent(AXEvent_ApplicationActivated, Application->PID, false);
     }
 }
 
@@ -1,5 +1,6 @@
 #include "axlib.h"
 #include <vector>
+#include <unordered_set>
 
 #define internal static
 #define local_persist static
@@ -19,13 +20,7 @@ internal CGPoint Cursor;
 internal inline AXUIElementRef
 AXLibSystemWideElement()
 {
-    local_persist AXUIElementRef AXLibSystemWideElement;
-    local_persist dispatch_once_t OnceToken;
-
-    dispatch_once(&OnceToken, ^{
-        AXLibSystemWideElement = AXUIElementCreateSystemWide();
-    });
-
+    local_persist AXUIElementRef AXLibSystemWideElement = AXUIElementCreateSystemWide();
     return AXLibSystemWideElement;
 }
 
@@ -140,16 +135,78 @@ std::vector<ax_window *> AXLibGetAllKnownWindows()
     return Windows;
 }
 
-internal inline bool
-AXLibArrayContains(int *WindowList, int WindowCount, uint32_t WindowID)
+/* NOTE(koekeishiya): The set of on-screen window ids only changes when one of the events that
+ *                    affect visibility is dispatched, see AXLibInvalidateOnScreenWindows. The
+ *                    cache is only used by the event-loop worker; any other thread (the daemon
+ *                    interpreter) asks the window server directly, as it always did. */
+struct ax_onscreen_cache
+{
+    bool Valid;
+    std::unordered_set<uint32_t> WindowIDs;
+};
+
+internal ax_onscreen_cache OnScreenCache;
+internal ax_onscreen_stats OnScreenStats;
+
+internal bool
+AXLibQueryOnScreenWindows(std::unordered_set<uint32_t> *WindowIDs)
+{
+    WindowIDs->clear();
+
+    /* NOTE(koekeishiya): Is it necessary to actually decide how many windows are on the screen.
+                          Can we just pass an estimated high enough number such as 200 (?) */
+    int WindowCount = 0;
+    CGError Error = CGSGetOnScreenWindowCount(CGSDefaultConnection, 0, &WindowCount);
+    if(Error != kCGErrorSuccess)
+        return false;
+
+    /* NOTE(koekeishiya): This function seems to be pretty expensive.. Is CGWindowListCopyWindowInfo faster (?) */
+    std::vector<int> WindowList(WindowCount);
+    Error = CGSGetOnScreenWindowList(CGSDefaultConnection, 0, WindowCount, WindowList.data(), &WindowCount);
+    if(Error != kCGErrorSuccess)
+        return false;
+
+    WindowIDs->reserve(WindowCount);
+    for(int Index = 0; Index < WindowCount; ++Index)
+        WindowIDs->insert(WindowList[Index]);
+
+    return true;
+}
+
+internal const std::unordered_set<uint32_t> *
+AXLibOnScreenWindows(std::unordered_set<uint32_t> *Scratch)
 {
-    while(WindowCount > 0)
+    __atomic_add_fetch(&OnScreenStats.Queries, 1, __ATOMIC_RELAXED);
+    if(!AXLibIsEventLoopThread())
     {
-        if(WindowList[--WindowCount] == WindowID)
-            return true;
+        __atomic_add_fetch(&OnScreenStats.Refreshes, 1, __ATOMIC_RELAXED);
+        return AXLibQueryOnScreenWindows(Scratch) ? Scratch : NULL;
     }
 
-    return false;
+    if(!OnScreenCache.Valid)
+    {
+        __atomic_add_fetch(&OnScreenStats.Refreshes, 1, __ATOMIC_RELAXED);
+        OnScreenCache.Valid = AXLibQueryOnScreenWindows(&OnScreenCache.WindowIDs);
+        if(!OnScreenCache.Valid)
+            return NULL;
+    }
+
+    return &OnScreenCache.WindowIDs;
+}
+
+/* NOTE(koekeishiya): Called by the event-loop worker before dispatching an event that can change
+ *                    which windows are on screen. Must only be called from the worker thread. */
+void AXLibInvalidateOnScreenWindows()
+{
+    OnScreenCache.Valid = false;
+}
+
+void AXLibGetOnScreenStats(ax_onscreen_stats *Stats)
+{
+    Stats->Queries = __atomic_load_n(&OnScreenStats.Queries, __ATOMIC_RELAXED);
+    Stats->Refreshes = __atomic_load_n(&OnScreenStats.Refreshes, __ATOMIC_RELAXED);
+    Stats->HitTests = __atomic_load_n(&OnScreenStats.HitTests, __ATOMIC_RELAXED);
+    Stats->HitTestRefreshes = __atomic_load_n(&OnScreenStats.HitTestRefreshes, __ATOMIC_RELAXED);
 }
 
 /* NOTE(koekeishiya): Returns a list of pointer to ax_window structs containing all windows currently visible,
@@ -158,37 +215,29 @@ std::vector<ax_window *> AXLibGetAllVisibleWindows()
 {
     std::vector<ax_window *> Windows;
 
-    /* NOTE(koekeishiya): Is it necessary to actually decide how many windows are on the screen.
-                          Can we just pass an estimated high enough number such as 200 (?) */
-    int WindowCount = 0;
-    CGError Error = CGSGetOnScreenWindowCount(CGSDefaultConnection, 0, &WindowCount);
-    if(Error == kCGErrorSuccess)
+    std::unordered_set<uint32_t> Scratch;
+    const std::unordered_set<uint32_t> *OnScreen = AXLibOnScreenWindows(&Scratch);
+    if(!OnScreen)
+        return Windows;
+
+    std::map<pid_t, ax_application>::iterator It;
+    for(It = AXApplications->begin(); It != AXApplications->end(); ++It)
     {
-        /* NOTE(koekeishiya): This function seems to be pretty expensive.. Is CGWindowListCopyWindowInfo faster (?) */
-        int WindowList[WindowCount];
-        Error = CGSGetOnScreenWindowList(CGSDefaultConnection, 0, WindowCount, WindowList, &WindowCount);
-        if(Error == kCGErrorSuccess)
+        ax_application *Application = &It->second;
+        if(!AXLibIsApplicationHidden(Application))
         {
-            std::map<pid_t, ax_application>::iterator It;
-            for(It = AXApplications->begin(); It != AXApplications->end(); ++It)
+            std::map<uint32_t, ax_window *>::iterator WIt;
+            for(WIt = Application->Windows.begin(); WIt != Application->Windows.end(); ++WIt)
             {
-                ax_application *Application = &It->second;
-                if(!AXLibIsApplicationHidden(Application))
+                ax_window *Window = WIt->second;
+                /* NOTE(koekeishiya): If a window is minimized, the on-screen check should fail
+                                      if(!AXLibIsWindowMinimized(Window->Ref)) */
+
+                if((OnScreen->find(Window->ID) != OnScreen->end()) &&
+                   (AXLibIsWindowStandard(Window) || AXLibIsWindowCustom(Window)) &&
+                   (!AXLibHasFlags(Window, AXWindow_Floating)))
                 {
-                    std::map<uint32_t, ax_window *>::iterator WIt;
-                    for(WIt = Application->Windows.begin(); WIt != Application->Windows.end(); ++WIt)
-                    {
-                        ax_window *Window = WIt->second;
-                        /* NOTE(koekeishiya): If a window is minimized, the ArrayContains check should fail
-                                              if(!AXLibIsWindowMinimized(Window->Ref)) */
-
-                        if((AXLibArrayContains(WindowList, WindowCount, Window->ID)) &&
-                           (AXLibIsWindowStandard(Window) || AXLibIsWindowCustom(Window)) &&
-                           (!AXLibHasFlags(Window, AXWindow_Floating)))
-                        {
-                            Windows.push_back(Window);
-                        }
-                    }
+                    Windows.push_back(Window);
                 }
             }
         }
@@ -197,68 +246,163 @@ std::vector<ax_window *> AXLibGetAllVisibleWindows()
     return Windows;
 }
 
-/* NOTE(koekeishiya): Returns the window id of the window below the cursor. */
 #define CONTEXT_MENU_LAYER 101
-uint32_t AXLibGetWindowBelowCursor()
+
+/* NOTE(koekeishiya): Upper bound (in seconds) on how long the window stack is trusted. Context menus and
+ *                    launchpad open without any notification that reaches us, so the cache can not be kept
+ *                    alive by events alone. */
+#define AX_WINDOW_STACK_TTL 0.25
+
+/* NOTE(koekeishiya): One on-screen window in front-to-back order, as reported by CGWindowListCopyWindowInfo.
+ *                    A blocking entry (context menu, launchpad) means that nothing is below the cursor. */
+struct ax_window_stack_entry
 {
-    uint32_t Result = 0;
+    uint32_t WindowID;
+    pid_t PID;
+    CGRect Rect;
+    bool Blocking;
+};
+
+struct ax_window_stack
+{
+    bool Valid;
+    CFAbsoluteTime Timestamp;
+    std::vector<ax_window_stack_entry> Entries;
+};
+
+internal ax_window_stack WindowStack;
+
+internal void
+AXLibReadWindowStack(std::vector<ax_window_stack_entry> *Entries)
+{
+    Entries->clear();
     CGWindowListOption WindowListOption = kCGWindowListOptionOnScreenOnly |
                                           kCGWindowListExcludeDesktopElements;
-    Cursor = GetCursorPos();
 
     CFArrayRef WindowList = CGWindowListCopyWindowInfo(WindowListOption, kCGNullWindowID);
-    if(WindowList)
+    if(!WindowList)
+        return;
+
+    CFIndex WindowCount = CFArrayGetCount(WindowList);
+    Entries->reserve(WindowCount);
+    for(std::size_t Index = 0; Index < WindowCount; ++Index)
     {
-        CFIndex WindowCount = CFArrayGetCount(WindowList);
-        for(std::size_t Index = 0; Index < WindowCount; ++Index)
+        uint32_t WindowID;
+        uint32_t WindowLayer;
+        pid_t WindowPID = 0;
+        CGRect WindowRect = {};
+        CFNumberRef CFWindowNumber;
+        CFNumberRef CFWindowLayer;
+        CFNumberRef CFWindowPID;
+        CFDictionaryRef CFWindowBounds;
+        CFDictionaryRef Elem = (CFDictionaryRef)CFArrayGetValueAtIndex(WindowList, Index);
+        CFWindowNumber = (CFNumberRef) CFDictionaryGetValue(Elem, CFSTR("kCGWindowNumber"));
+        CFWindowLayer = (CFNumberRef) CFDictionaryGetValue(Elem, CFSTR("kCGWindowLayer"));
+        CFWindowPID = (CFNumberRef) CFDictionaryGetValue(Elem, CFSTR("kCGWindowOwnerPID"));
+        CFWindowBounds = (CFDictionaryRef) CFDictionaryGetValue(Elem, CFSTR("kCGWindowBounds"));
+        CFNumberGetValue(CFWindowNumber, kCFNumberSInt32Type, &WindowID);
+        CFNumberGetValue(CFWindowLayer, kCFNumberSInt32Type, &WindowLayer);
+        if(CFWindowPID)
         {
-            uint32_t WindowID;
-            uint32_t WindowLayer;
-            CGRect WindowRect = {};
-            CFNumberRef CFWindowNumber;
-            CFNumberRef CFWindowLayer;
-            CFDictionaryRef CFWindowBounds;
-            CFDictionaryRef Elem = (CFDictionaryRef)CFArrayGetValueAtIndex(WindowList, Index);
-            CFWindowNumber = (CFNumberRef) CFDictionaryGetValue(Elem, CFSTR("kCGWindowNumber"));
-            CFWindowLayer = (CFNumberRef) CFDictionaryGetValue(Elem, CFSTR("kCGWindowLayer"));
-            CFWindowBounds = (CFDictionaryRef) CFDictionaryGetValue(Elem, CFSTR("kCGWindowBounds"));
-            CFNumberGetValue(CFWindowNumber, kCFNumberSInt32Type, &WindowID);
-            CFNumberGetValue(CFWindowLayer, kCFNumberSInt32Type, &WindowLayer);
-            CFRelease(CFWindowNumber);
-            CFRelease(CFWindowLayer);
-            if(CFWindowBounds)
-            {
-                CGRectMakeWithDictionaryRepresentation(CFWindowBounds, &WindowRect);
-            }
+            CFNumberGetValue(CFWindowPID, kCFNumberSInt32Type, &WindowPID);
+        }
+
+        if(CFWindowBounds)
+        {
+            CGRectMakeWithDictionaryRepresentation(CFWindowBounds, &WindowRect);
+        }
 
-            CFStringRef CFOwner = (CFStringRef) CFDictionaryGetValue(Elem, CFSTR("kCGWindowOwnerName"));
-            CFStringRef CFName = (CFStringRef) CFDictionaryGetValue(Elem, CFSTR("kCGWindowName"));
+        CFStringRef CFOwner = (CFStringRef) CFDictionaryGetValue(Elem, CFSTR("kCGWindowOwnerName"));
+        CFStringRef CFName = (CFStringRef) CFDictionaryGetValue(Elem, CFSTR("kCGWindowName"));
 
-            bool IsKwmOverlay = (CFOwner && CFStringCompare(CFOwner, CFSTR("kwm-overlay"), 0) == kCFCompareEqualTo);
-            bool IsDock = (CFOwner && CFStringCompare(CFOwner, CFSTR("Dock"), 0) == kCFCompareEqualTo);
-            bool IsLaunchpad = (CFName && CFStringCompare(CFName, CFSTR("LPSpringboard"), 0) == kCFCompareEqualTo);
-            bool IsDockBar = (CFName && CFStringCompare(CFName, CFSTR("Dock"), 0) == kCFCompareEqualTo);
+        bool IsKwmOverlay = (CFOwner && CFStringCompare(CFOwner, CFSTR("kwm-overlay"), 0) == kCFCompareEqualTo);
+        bool IsDock = (CFOwner && CFStringCompare(CFOwner, CFSTR("Dock"), 0) == kCFCompareEqualTo);
+        bool IsLaunchpad = (CFName && CFStringCompare(CFName, CFSTR("LPSpringboard"), 0) == kCFCompareEqualTo);
+        bool IsDockBar = (CFName && CFStringCompare(CFName, CFSTR("Dock"), 0) == kCFCompareEqualTo);
 
-            if((IsDock && IsDockBar) || (IsKwmOverlay))
-                continue;
+        if((IsDock && IsDockBar) || (IsKwmOverlay))
+            continue;
 
-            if((IsDock&& IsLaunchpad) || (WindowLayer == CONTEXT_MENU_LAYER))
-            {
-                CFRelease(WindowList);
-                return 0;
-            }
+        ax_window_stack_entry Entry = { WindowID, WindowPID, WindowRect, false };
+        if((IsDock && IsLaunchpad) || (WindowLayer == CONTEXT_MENU_LAYER))
+        {
+            Entry.Blocking = true;
+            Entries->push_back(Entry);
+            break;
+        }
+
+        Entries->push_back(Entry);
+    }
+
+    CFRelease(WindowList);
+}
 
-            if(IsElementBelowCursor(&WindowRect))
+/* NOTE(koekeishiya): With TrackedGeometry set, windows that axlib knows about are tested against the
+ *                    position and size kept up to date by kAXWindowMoved/ResizedNotification, so that a
+ *                    cached stack stays correct while windows are being moved or resized. */
+internal uint32_t
+AXLibHitTestWindowStack(std::vector<ax_window_stack_entry> *Entries, bool TrackedGeometry)
+{
+    for(std::size_t Index = 0; Index < Entries->size(); ++Index)
+    {
+        ax_window_stack_entry *Entry = &(*Entries)[Index];
+        if(Entry->Blocking)
+            return 0;
+
+        CGRect WindowRect = Entry->Rect;
+        if(TrackedGeometry)
+        {
+            ax_application *Application = AXLibGetApplicationByPID(Entry->PID);
+            ax_window *Window = Application ? AXLibFindApplicationWindow(Application, Entry->WindowID) : NULL;
+            if(Window)
             {
-                Result = WindowID;
-                break;
+                WindowRect.origin = Window->Position;
+                WindowRect.size = Window->Size;
             }
         }
 
-        CFRelease(WindowList);
+        if(IsElementBelowCursor(&WindowRect))
+            return Entry->WindowID;
+    }
+
+    return 0;
+}
+
+/* NOTE(koekeishiya): Called by the event-loop worker before dispatching an event that can change the
+ *                    stacking order of on-screen windows. Must only be called from the worker thread. */
+void AXLibInvalidateWindowStack()
+{
+    WindowStack.Valid = false;
+}
+
+/* NOTE(koekeishiya): Returns the window id of the window below the cursor. On the event-loop worker the
+ *                    answer comes from a cached copy of the window stack, see AXLibInvalidateWindowStack. */
+uint32_t AXLibGetWindowBelowCursor()
+{
+    Cursor = GetCursorPos();
+    __atomic_add_fetch(&OnScreenStats.HitTests, 1, __ATOMIC_RELAXED);
+
+    if(!AXLibIsEventLoopThread())
+    {
+        __atomic_add_fetch(&OnScreenStats.HitTestRefreshes, 1, __ATOMIC_RELAXED);
+        std::vector<ax_window_stack_entry> Entries;
+        AXLibReadWindowStack(&Entries);
+        return AXLibHitTestWindowStack(&Entries, false);
+    }
+
+    CFAbsoluteTime Now = CFAbsoluteTimeGetCurrent();
+    if((!WindowStack.Valid) ||
+       (Now - WindowStack.Timestamp > AX_WINDOW_STACK_TTL) ||
+       (Now < WindowStack.Timestamp))
+    {
+        __atomic_add_fetch(&OnScreenStats.HitTestRefreshes, 1, __ATOMIC_RELAXED);
+        AXLibReadWindowStack(&WindowStack.Entries);
+        WindowStack.Timestamp = Now;
+        WindowStack.Valid = true;
+        return AXLibHitTestWindowStack(&WindowStack.Entries, false);
     }
 
-    return Result;
+    return AXLibHitTestWindowStack(&WindowStack.Entries, true);
 }
 
 /* NOTE(koekeishiya): Update state of known applications and their windows, stored inside the ax_state passed to AXLibInit(..). */
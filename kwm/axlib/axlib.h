@@ -34,6 +34,18 @@
  *        transition occurs on the active monitor.
  * */
 
+/* NOTE(koekeishiya): Counters for the cached on-screen window list and window stack. Every refresh
+ *                    of the list costs two CGS calls, every refresh of the stack one full
+ *                    CGWindowListCopyWindowInfo; an answer from either cache costs none. */
+struct ax_onscreen_stats
+{
+    uint64_t Queries;
+    uint64_t Refreshes;
+
+    uint64_t HitTests;
+    uint64_t HitTestRefreshes;
+};
+
 struct ax_state
 {
     carbon_event_handler Carbon;
@@ -48,7 +60,10 @@ void AXLibSetFocusedWindow(ax_window *Window);
 
 std::vector<ax_window *> AXLibGetAllKnownWindows();
 std::vector<ax_window *> AXLibGetAllVisibleWindows();
+void AXLibInvalidateOnScreenWindows();
+void AXLibGetOnScreenStats(ax_onscreen_stats *Stats);
 uint32_t AXLibGetWindowBelowCursor();
+void AXLibInvalidateWindowStack();
 void AXLibRunningApplications();
 void AXLibInit(ax_state *State);
 
@@ -95,9 +95,7 @@ CarbonApplicationTerminated(ProcessSerialNumber PSN)
         if(Application->PSN.lowLongOfPSN == PSN.lowLongOfPSN &&
            Application->PSN.highLongOfPSN == PSN.highLongOfPSN)
         {
-            pid_t *ApplicationPID = (pid_t *) malloc(sizeof(pid_t));
-            *ApplicationPID = Application->PID;
-            AXLibConstructEvent(AXEvent_ApplicationTerminated, ApplicationPID, false);
+            AXLibConstructApplicationEvent(AXEvent_ApplicationTerminated, Application->PID, false);
             break;
         }
     }
@@ -30,9 +30,12 @@ enum ax_space_flags
     AXSpace_FastTransition = (1 << 0),
 };
 
+/* NOTE(koekeishiya): Handle is reserved for user-code to cache its own per-space lookup,
+ *                    it is -1 when an ax_space is constructed. */
 struct ax_space
 {
     std::string Identifier;
+    int Handle;
     CGSSpaceID ID;
     CGSSpaceType Type;
     uint32_t Flags;
@@ -146,6 +146,7 @@ AXLibConstructSpace(CFStringRef Identifier, CGSSpaceID SpaceID, CGSSpaceType Spa
         free(IdentifierC);
     }
 
+    Space.Handle = -1;
     Space.ID = SpaceID;
     Space.Type = SpaceType;
 
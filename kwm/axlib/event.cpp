@@ -1,47 +1,513 @@
 #include "event.h"
 #include "display.h"
+#include "axlib.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
 
 #define internal static
 internal ax_event_loop EventLoop = {};
 
-/* NOTE(koekeishiya): Must be thread-safe! Called through AXLibConstructEvent macro */
+#define AX_EVENT_RING_MASK (AX_EVENT_RING_SIZE - 1)
+
+/* NOTE(koekeishiya): The worker is woken when the space change is observed. This is only the
+ *                    upper bound on how long it sleeps if that never happens, as when a swipe
+ *                    between spaces is cancelled. */
+#define AX_EVENT_TRANSITION_TIMEOUT_NSEC 250000000
+
+/* NOTE(koekeishiya): Maximum number of events the worker pulls off the queue at once.
+ *                    Coalescing only happens between events inside the same batch. */
+#define AX_EVENT_BATCH_SIZE 256
+
+internal const char *AXEventTypeNames[AXEvent_Count] =
+{
+    "application_launched",
+    "application_terminated",
+    "application_activated",
+    "application_visible",
+    "application_hidden",
+
+    "window_created",
+    "window_destroyed",
+
+    "window_focused",
+    "window_moved",
+    "window_resized",
+    "window_minimized",
+    "window_deminimized",
+    "window_title_changed",
+
+    "display_added",
+    "display_removed",
+    "display_moved",
+    "display_resized",
+
+    "display_changed",
+    "space_changed",
+
+    "hotkey_pressed",
+    "mouse_moved",
+
+    "left_mouse_dragged",
+    "left_mouse_down",
+    "left_mouse_up",
+
+    "user",
+};
+
+const char *AXLibEventTypeName(ax_event_type Type)
+{
+    return Type < AXEvent_Count ? AXEventTypeNames[Type] : "unknown";
+}
+
+/* NOTE(koekeishiya): Counters are bumped without a lock and are only meant as statistics. */
+void AXLibGetEventStats(ax_event_stats *Stats)
+{
+    for(int Index = 0; Index < AXEvent_Count; ++Index)
+    {
+        Stats->Enqueued[Index] = __atomic_load_n(&EventLoop.Stats.Enqueued[Index], __ATOMIC_RELAXED);
+        Stats->Coalesced[Index] = __atomic_load_n(&EventLoop.Stats.Coalesced[Index], __ATOMIC_RELAXED);
+        Stats->Dispatched[Index] = __atomic_load_n(&EventLoop.Stats.Dispatched[Index], __ATOMIC_RELAXED);
+    }
+
+    Stats->Spilled = __atomic_load_n(&EventLoop.Stats.Spilled, __ATOMIC_RELAXED);
+    Stats->Dropped = __atomic_load_n(&EventLoop.Stats.Dropped, __ATOMIC_RELAXED);
+}
+
+/* NOTE(koekeishiya): Bumped before every dispatched event that may change state, so that
+ *                    user-code can tell whether state may have changed since it last looked. */
+uint64_t AXLibEventGeneration()
+{
+    return __atomic_load_n(&EventLoop.Generation, __ATOMIC_ACQUIRE);
+}
+
+bool AXLibIsEventLoopThread()
+{
+    return EventLoop.Running && pthread_equal(pthread_self(), EventLoop.Worker);
+}
+
+/* NOTE(koekeishiya): Called on the worker after a batch in which the generation was bumped, with
+ *                    the last such event of the batch. */
+void AXLibSetStateChangedCallback(EventCallback *Callback)
+{
+    EventLoop.StateChanged = Callback;
+}
+
+/* NOTE(koekeishiya): Events that only feed the cursor, hotkeys that user-code accounts for itself
+ *                    as the bound command runs, and the echo of a move or resize that axlib issued
+ *                    itself leave the state that user-code reports unchanged. */
+internal inline bool
+AXLibEventChangesState(ax_event *Event)
+{
+    switch(Event->Type)
+    {
+        case AXEvent_HotkeyPressed:
+        case AXEvent_MouseMoved:
+        case AXEvent_LeftMouseDragged:
+        case AXEvent_LeftMouseDown:
+        case AXEvent_User:
+        {
+            return false;
+        } break;
+        case AXEvent_WindowMoved:
+        case AXEvent_WindowResized:
+        {
+            return !Event->Intrinsic;
+        } break;
+        default:
+        {
+            return true;
+        } break;
+    }
+}
+
+/* NOTE(koekeishiya): Events after which the set of on-screen windows may differ. Everything else
+ *                    (focus, move, resize, title, mouse, hotkeys, user-events) keeps it intact. */
+internal inline bool
+AXLibEventChangesVisibility(ax_event_type Type)
+{
+    switch(Type)
+    {
+        case AXEvent_ApplicationLaunched:
+        case AXEvent_ApplicationTerminated:
+        case AXEvent_ApplicationVisible:
+        case AXEvent_ApplicationHidden:
+        case AXEvent_WindowCreated:
+        case AXEvent_WindowDestroyed:
+        case AXEvent_WindowMinimized:
+        case AXEvent_WindowDeminimized:
+        case AXEvent_DisplayAdded:
+        case AXEvent_DisplayRemoved:
+        case AXEvent_DisplayMoved:
+        case AXEvent_DisplayResized:
+        case AXEvent_DisplayChanged:
+        case AXEvent_SpaceChanged:
+        {
+            return true;
+        } break;
+        default:
+        {
+            return false;
+        } break;
+    }
+}
+
+/* NOTE(koekeishiya): Events after which windows may be stacked in a different order, without the
+ *                    set of on-screen windows changing. Moves and resizes are not included, the
+ *                    window stack reads those from the geometry tracked in ax_window. */
+internal inline bool
+AXLibEventChangesStacking(ax_event_type Type)
+{
+    switch(Type)
+    {
+        case AXEvent_ApplicationActivated:
+        case AXEvent_WindowFocused:
+        case AXEvent_LeftMouseDown:
+        case AXEvent_LeftMouseUp:
+        {
+            return true;
+        } break;
+        default:
+        {
+            return false;
+        } break;
+    }
+}
+
+internal void
+AXLibInitializeEventRing(ax_event_ring *Ring)
+{
+    for(uint32_t Index = 0; Index < AX_EVENT_RING_SIZE; ++Index)
+        Ring->Slots[Index].Sequence = Index;
+
+    Ring->Head = 0;
+    Ring->Tail = 0;
+}
+
+/* NOTE(koekeishiya): Multiple producers race for Tail; the slot sequence tells a producer
+ *                    whether the slot is free (== Pos), still owned by the consumer (< Pos)
+ *                    or already claimed by another producer (> Pos). */
+internal bool
+AXLibEventRingPush(ax_event_ring *Ring, ax_event *Event)
+{
+    ax_event_slot *Slot;
+    uint32_t Pos = __atomic_load_n(&Ring->Tail, __ATOMIC_RELAXED);
+    for(;;)
+    {
+        Slot = &Ring->Slots[Pos & AX_EVENT_RING_MASK];
+        uint32_t Sequence = __atomic_load_n(&Slot->Sequence, __ATOMIC_ACQUIRE);
+        int32_t Diff = (int32_t)Sequence - (int32_t)Pos;
+        if(Diff == 0)
+        {
+            if(__atomic_compare_exchange_n(&Ring->Tail, &Pos, Pos + 1, true,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if(Diff < 0)
+        {
+            return false;
+        }
+        else
+        {
+            Pos = __atomic_load_n(&Ring->Tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    Slot->Event = *Event;
+    __atomic_store_n(&Slot->Sequence, Pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* NOTE(koekeishiya): Only called from the worker thread. */
+internal bool
+AXLibEventRingPop(ax_event_ring *Ring, ax_event *Event)
+{
+    uint32_t Pos = Ring->Head;
+    ax_event_slot *Slot = &Ring->Slots[Pos & AX_EVENT_RING_MASK];
+    if(__atomic_load_n(&Slot->Sequence, __ATOMIC_ACQUIRE) != Pos + 1)
+        return false;
+
+    *Event = Slot->Event;
+    __atomic_store_n(&Slot->Sequence, Pos + AX_EVENT_RING_SIZE, __ATOMIC_RELEASE);
+    Ring->Head = Pos + 1;
+    return true;
+}
+
+internal bool
+AXLibEventRingEmpty(ax_event_ring *Ring)
+{
+    uint32_t Pos = Ring->Head;
+    ax_event_slot *Slot = &Ring->Slots[Pos & AX_EVENT_RING_MASK];
+    return __atomic_load_n(&Slot->Sequence, __ATOMIC_ACQUIRE) != Pos + 1;
+}
+
+/* NOTE(koekeishiya): A ring can be empty while a producer has claimed a slot that it has not
+ *                    published yet; it is only drained once no such slot is left. */
+internal bool
+AXLibEventRingDrained(ax_event_ring *Ring)
+{
+    return __atomic_load_n(&Ring->Tail, __ATOMIC_ACQUIRE) == Ring->Head;
+}
+
+internal bool
+AXLibEventOverflowReady()
+{
+    return AXLibEventRingDrained(&EventLoop.Ring) &&
+           __atomic_load_n(&EventLoop.OverflowCount, __ATOMIC_ACQUIRE) != 0;
+}
+
+internal bool
+AXLibEventQueueEmpty()
+{
+    return AXLibEventRingEmpty(&EventLoop.Ring) &&
+           !AXLibEventOverflowReady();
+}
+
+/* NOTE(koekeishiya): The ring is drained before the overflow queue. Once anything has spilled,
+ *                    producers keep spilling until the worker catches up, to preserve ordering.
+ *                    A claimed slot may hold an event that was produced before the spilled ones,
+ *                    so the overflow queue is not touched until that slot has been consumed. */
+internal bool
+AXLibNextEvent(ax_event *Event)
+{
+    if(AXLibEventRingPop(&EventLoop.Ring, Event))
+        return true;
+
+    if(AXLibEventOverflowReady())
+    {
+        pthread_mutex_lock(&EventLoop.WorkerLock);
+        *Event = EventLoop.Overflow.front();
+        EventLoop.Overflow.pop();
+        __atomic_sub_fetch(&EventLoop.OverflowCount, 1, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&EventLoop.WorkerLock);
+        return true;
+    }
+
+    return false;
+}
+
+/* NOTE(koekeishiya): Must be thread-safe! Called through AXLibConstructEvent macro.
+ *                    The worker is only signalled when it has gone to sleep, or when it waits
+ *                    for a space transition and this is the space change that ends it. */
 void AXLibAddEvent(ax_event Event)
 {
     if(EventLoop.Running && Event.Handle)
     {
-        pthread_mutex_lock(&EventLoop.WorkerLock);
-        EventLoop.Queue.push(Event);
+        __atomic_add_fetch(&EventLoop.Stats.Enqueued[Event.Type], 1, __ATOMIC_RELAXED);
+        if((__atomic_load_n(&EventLoop.OverflowCount, __ATOMIC_ACQUIRE) != 0) ||
+           (!AXLibEventRingPush(&EventLoop.Ring, &Event)))
+        {
+            bool Spilled = false;
+            pthread_mutex_lock(&EventLoop.WorkerLock);
+            if(EventLoop.OverflowCount < AX_EVENT_OVERFLOW_SIZE)
+            {
+                EventLoop.Overflow.push(Event);
+                __atomic_add_fetch(&EventLoop.OverflowCount, 1, __ATOMIC_RELEASE);
+                Spilled = true;
+            }
+            pthread_mutex_unlock(&EventLoop.WorkerLock);
 
-        pthread_cond_signal(&EventLoop.State);
-        pthread_mutex_unlock(&EventLoop.WorkerLock);
+            if(Spilled)
+            {
+                __atomic_add_fetch(&EventLoop.Stats.Spilled, 1, __ATOMIC_RELAXED);
+            }
+            else
+            {
+                if((Event.Payload == AXPayload_Context) && (Event.Context))
+                    free(Event.Context);
+
+                __atomic_add_fetch(&EventLoop.Stats.Dropped, 1, __ATOMIC_RELAXED);
+                return;
+            }
+        }
+
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if((__atomic_load_n(&EventLoop.Sleeping, __ATOMIC_SEQ_CST)) ||
+           ((Event.Type == AXEvent_SpaceChanged) &&
+            (__atomic_load_n(&EventLoop.Transitioning, __ATOMIC_SEQ_CST))))
+        {
+            pthread_mutex_lock(&EventLoop.WorkerLock);
+            pthread_cond_signal(&EventLoop.State);
+            pthread_mutex_unlock(&EventLoop.WorkerLock);
+        }
+    }
+}
+
+/* NOTE(koekeishiya): A transition ends with the space change that it causes, so we sleep until
+ *                    that event is published, with the same handshake as AXLibWaitForEvent. The
+ *                    producer signals under WorkerLock, which we hold from raising Transitioning
+ *                    until we wait, so a space change published after our check is not missed.
+ *                    Stopping the loop wakes us early. */
+internal void
+AXLibWaitForSpaceTransition()
+{
+    pthread_mutex_lock(&EventLoop.WorkerLock);
+    __atomic_store_n(&EventLoop.Transitioning, true, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while(EventLoop.Running && AXLibIsSpaceTransitionInProgress())
+    {
+        struct timeval Now;
+        gettimeofday(&Now, NULL);
+
+        struct timespec Timeout;
+        Timeout.tv_sec = Now.tv_sec;
+        Timeout.tv_nsec = (Now.tv_usec * 1000) + AX_EVENT_TRANSITION_TIMEOUT_NSEC;
+        if(Timeout.tv_nsec >= 1000000000)
+        {
+            Timeout.tv_sec += 1;
+            Timeout.tv_nsec -= 1000000000;
+        }
+
+        pthread_cond_timedwait(&EventLoop.State, &EventLoop.WorkerLock, &Timeout);
+    }
+
+    __atomic_store_n(&EventLoop.Transitioning, false, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&EventLoop.WorkerLock);
+}
+
+/* NOTE(koekeishiya): Sleep until a producer publishes an event. Sleeping is raised before the
+ *                    queue is re-checked, and producers check it after publishing. Both sides
+ *                    put a full fence between their store and their load; without the one here
+ *                    the acquire loads of the queue may be ordered before the store to Sleeping,
+ *                    and the worker and a producer could each miss what the other did. */
+internal void
+AXLibWaitForEvent()
+{
+    pthread_mutex_lock(&EventLoop.WorkerLock);
+    __atomic_store_n(&EventLoop.Sleeping, true, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while(EventLoop.Running && AXLibEventQueueEmpty())
+        pthread_cond_wait(&EventLoop.State, &EventLoop.WorkerLock);
+
+    __atomic_store_n(&EventLoop.Sleeping, false, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&EventLoop.WorkerLock);
+}
+
+/* NOTE(koekeishiya): Only events whose handler reads the current state of its target, rather
+ *                    than data carried by the event, can be merged. Moved and resized events
+ *                    are keyed by their CGWindowID payload, mouse-moved events by type alone. */
+internal bool
+AXLibEventIsCoalescable(ax_event *Event)
+{
+    return Event->Type == AXEvent_WindowMoved ||
+           Event->Type == AXEvent_WindowResized ||
+           Event->Type == AXEvent_MouseMoved;
+}
+
+internal bool
+AXLibEventHasSameTarget(ax_event *A, ax_event *B)
+{
+    if(A->Type != B->Type)
+        return false;
+
+    if(A->Type == AXEvent_MouseMoved)
+        return true;
+
+    return A->WindowID == B->WindowID;
+}
+
+/* NOTE(koekeishiya): Walk the batch backwards so that the latest event for a given type and target
+ *                    is kept and every earlier one is dropped. A merged event is only treated as
+ *                    intrinsic if every event it replaced was intrinsic as well. */
+internal void
+AXLibCoalesceEvents(ax_event *Batch, bool *Dropped, int Count)
+{
+    int Kept[AX_EVENT_BATCH_SIZE];
+    int KeptCount = 0;
+
+    for(int Index = Count - 1; Index >= 0; --Index)
+    {
+        ax_event *Event = &Batch[Index];
+        Dropped[Index] = false;
+        if(!AXLibEventIsCoalescable(Event))
+            continue;
+
+        int Match = 0;
+        for(; Match < KeptCount; ++Match)
+        {
+            if(AXLibEventHasSameTarget(Event, &Batch[Kept[Match]]))
+                break;
+        }
+
+        if(Match == KeptCount)
+        {
+            Kept[KeptCount++] = Index;
+        }
+        else
+        {
+            Batch[Kept[Match]].Intrinsic = Batch[Kept[Match]].Intrinsic && Event->Intrinsic;
+            Dropped[Index] = true;
+
+            if((Event->Payload == AXPayload_Context) && (Event->Context))
+                free(Event->Context);
+
+            __atomic_add_fetch(&EventLoop.Stats.Coalesced[Event->Type], 1, __ATOMIC_RELAXED);
+        }
     }
 }
 
-/* NOTE(koekeishiya): Uses dynamic dispatch to process events of any type. */
+/* NOTE(koekeishiya): Uses dynamic dispatch to process events of any type.
+ *                    StateLock is held for the duration of a callback, so that
+ *                    AXLibPauseEventLoop blocks the worker between two events. */
 internal void *
 AXLibProcessEventQueue(void *)
 {
+    static ax_event Batch[AX_EVENT_BATCH_SIZE];
+    static bool Dropped[AX_EVENT_BATCH_SIZE];
+
     while(EventLoop.Running)
     {
-        pthread_mutex_lock(&EventLoop.StateLock);
-        while(!EventLoop.Queue.empty())
+        int Count = 0;
+        while((Count < AX_EVENT_BATCH_SIZE) &&
+              (AXLibNextEvent(&Batch[Count])))
+            ++Count;
+
+        if(Count == 0)
         {
-            if(!AXLibIsSpaceTransitionInProgress())
+            AXLibWaitForEvent();
+            continue;
+        }
+
+        ax_event *Changed = NULL;
+        AXLibCoalesceEvents(Batch, Dropped, Count);
+        for(int Index = 0; Index < Count; ++Index)
+        {
+            if(Dropped[Index])
+                continue;
+
+            if(AXLibIsSpaceTransitionInProgress())
+                AXLibWaitForSpaceTransition();
+
+            ax_event *Event = &Batch[Index];
+            if(AXLibEventChangesState(Event))
             {
-                pthread_mutex_lock(&EventLoop.WorkerLock);
-                ax_event Event = EventLoop.Queue.front();
-                EventLoop.Queue.pop();
-                pthread_mutex_unlock(&EventLoop.WorkerLock);
+                __atomic_add_fetch(&EventLoop.Generation, 1, __ATOMIC_RELEASE);
+                Changed = Event;
+            }
 
-                (*Event.Handle)(&Event);
+            if(AXLibEventChangesVisibility(Event->Type))
+            {
+                AXLibInvalidateOnScreenWindows();
+                AXLibInvalidateWindowStack();
+            }
+            else if(AXLibEventChangesStacking(Event->Type))
+            {
+                AXLibInvalidateWindowStack();
             }
-        }
 
-        while(EventLoop.Queue.empty() && EventLoop.Running)
-            pthread_cond_wait(&EventLoop.State, &EventLoop.StateLock);
+            pthread_mutex_lock(&EventLoop.StateLock);
+            (*Event->Handle)(Event);
+            pthread_mutex_unlock(&EventLoop.StateLock);
 
-        pthread_mutex_unlock(&EventLoop.StateLock);
+            __atomic_add_fetch(&EventLoop.Stats.Dispatched[Event->Type], 1, __ATOMIC_RELAXED);
+        }
+
+        if(Changed && EventLoop.StateChanged)
+        {
+            pthread_mutex_lock(&EventLoop.StateLock);
+            (*EventLoop.StateChanged)(Changed);
+            pthread_mutex_unlock(&EventLoop.StateLock);
+        }
     }
 
     return NULL;
@@ -107,6 +573,7 @@ bool AXLibStartEventLoop()
 {
     if(!EventLoop.Running && AXLibInitializeEventLoop())
     {
+        AXLibInitializeEventRing(&EventLoop.Ring);
         EventLoop.Running = true;
         pthread_create(&EventLoop.Worker, NULL, &AXLibProcessEventQueue, NULL);
         return true;
@@ -119,8 +586,10 @@ void AXLibStopEventLoop()
 {
     if(EventLoop.Running)
     {
+        pthread_mutex_lock(&EventLoop.WorkerLock);
         EventLoop.Running = false;
         pthread_cond_signal(&EventLoop.State);
+        pthread_mutex_unlock(&EventLoop.WorkerLock);
         pthread_join(EventLoop.Worker, NULL);
         AXLibTerminateEventLoop();
     }
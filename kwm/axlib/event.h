@@ -1,7 +1,9 @@
 #ifndef AXLIB_EVENT_H
 #define AXLIB_EVENT_H
 
+#include <Carbon/Carbon.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <queue>
 
 struct ax_event;
@@ -73,13 +75,84 @@ enum ax_event_type
     AXEvent_LeftMouseDragged,
     AXEvent_LeftMouseDown,
     AXEvent_LeftMouseUp,
+
+    /* NOTE(koekeishiya): Events constructed by user-code on top of axlib. */
+    AXEvent_User,
+
+    AXEvent_Count
+};
+
+/* NOTE(koekeishiya): Describes which member of the ax_event payload union is valid.
+ *                    Only AXPayload_Context refers to memory owned by the receiving callback. */
+enum ax_event_payload
+{
+    AXPayload_None,
+    AXPayload_Context,
+    AXPayload_WindowID,
+    AXPayload_PID,
+    AXPayload_Point,
+    AXPayload_Key,
+};
+
+/* NOTE(koekeishiya): Mode, Binding and Generation identify the binding that user-code resolved
+ *                    for the key press, so that the callback does not have to look it up again. */
+struct ax_event_key
+{
+    uint32_t Flags;
+    CGKeyCode Keycode;
+
+    void *Mode;
+    uint32_t Binding;
+    uint32_t Generation;
 };
 
 struct ax_event
 {
     EventCallback *Handle;
+    ax_event_type Type;
+    ax_event_payload Payload;
     bool Intrinsic;
-    void *Context;
+
+    union
+    {
+        void *Context;
+        uint32_t WindowID;
+        pid_t PID;
+        CGPoint Point;
+        ax_event_key Key;
+    };
+};
+
+struct ax_event_stats
+{
+    uint64_t Enqueued[AXEvent_Count];
+    uint64_t Coalesced[AXEvent_Count];
+    uint64_t Dispatched[AXEvent_Count];
+    uint64_t Spilled;
+    uint64_t Dropped;
+};
+
+/* NOTE(koekeishiya): Must be a power of two. */
+#define AX_EVENT_RING_SIZE 4096
+
+/* NOTE(koekeishiya): Events that arrive while the overflow queue is full are dropped and counted,
+ *                    so that a stalled worker cannot make kwm grow without bound. */
+#define AX_EVENT_OVERFLOW_SIZE 65536
+
+struct ax_event_slot
+{
+    uint32_t Sequence;
+    ax_event Event;
+};
+
+/* NOTE(koekeishiya): Bounded multi-producer / single-consumer ring. A producer claims a slot
+ *                    by advancing Tail and publishes it by bumping the slot sequence, so the
+ *                    common path never takes a lock. Overflow is only used if the ring is full. */
+struct ax_event_ring
+{
+    ax_event_slot Slots[AX_EVENT_RING_SIZE];
+    uint32_t Head;
+    uint32_t Tail;
 };
 
 struct ax_event_loop
@@ -89,7 +162,16 @@ struct ax_event_loop
     pthread_mutex_t WorkerLock;
     pthread_t Worker;
     bool Running;
-    std::queue<ax_event> Queue;
+    bool Sleeping;
+    bool Transitioning;
+
+    ax_event_ring Ring;
+    uint32_t OverflowCount;
+    std::queue<ax_event> Overflow;
+
+    ax_event_stats Stats;
+    uint64_t Generation;
+    EventCallback *StateChanged;
 };
 
 bool AXLibStartEventLoop();
@@ -99,14 +181,37 @@ void AXLibPauseEventLoop();
 void AXLibResumeEventLoop();
 
 void AXLibAddEvent(ax_event Event);
+void AXLibGetEventStats(ax_event_stats *Stats);
+const char *AXLibEventTypeName(ax_event_type Type);
+uint64_t AXLibEventGeneration();
+bool AXLibIsEventLoopThread();
+void AXLibSetStateChangedCallback(EventCallback *Callback);
 
 /* NOTE(koekeishiya): Construct an ax_event with the appropriate callback through macro expansion. */
-#define AXLibConstructEvent(EventType, EventContext, EventIntrinsic) \
+#define AXLibConstructPayloadEvent(EventType, EventPayload, EventMember, EventValue, EventIntrinsic) \
     do { ax_event Event = {}; \
-         Event.Context = EventContext; \
+         Event.Payload = EventPayload; \
+         Event.EventMember = EventValue; \
          Event.Intrinsic = EventIntrinsic; \
+         Event.Type = EventType; \
          Event.Handle = &Callback_##EventType; \
          AXLibAddEvent(Event); \
        } while(0)
 
+#define AXLibConstructEvent(EventType, EventContext, EventIntrinsic) \
+    AXLibConstructPayloadEvent(EventType, AXPayload_Context, Context, EventContext, EventIntrinsic)
+
+/* NOTE(koekeishiya): Scalar payloads are carried inline and must not be freed by the callback. */
+#define AXLibConstructWindowEvent(EventType, EventWindowID, EventIntrinsic) \
+    AXLibConstructPayloadEvent(EventType, AXPayload_WindowID, WindowID, EventWindowID, EventIntrinsic)
+
+#define AXLibConstructApplicationEvent(EventType, EventPID, EventIntrinsic) \
+    AXLibConstructPayloadEvent(EventType, AXPayload_PID, PID, EventPID, EventIntrinsic)
+
+#define AXLibConstructPointEvent(EventType, EventPoint, EventIntrinsic) \
+    AXLibConstructPayloadEvent(EventType, AXPayload_Point, Point, EventPoint, EventIntrinsic)
+
+#define AXLibConstructKeyEvent(EventType, EventKey, EventIntrinsic) \
+    AXLibConstructPayloadEvent(EventType, AXPayload_Key, Key, EventKey, EventIntrinsic)
+
 #endif
@@ -174,9 +174,7 @@ bool SharedWorkspaceIsApplicationHidden(pid_t PID)
         }
         else
         {
-            pid_t *ApplicationPID = (pid_t *) malloc(sizeof(pid_t));
-            *ApplicationPID = Application->PID;
-            AXLibConstructEvent(AXEvent_ApplicationActivated, ApplicationPID, false);
+            AXLibConstructApplicationEvent(AXEvent_ApplicationActivated, Application->PID, false);
         }
     }
 }
@@ -188,9 +186,7 @@ bool SharedWorkspaceIsApplicationHidden(pid_t PID)
     {
         ax_application *Application = &(*Applications)[PID];
 
-        pid_t *ApplicationPID = (pid_t *) malloc(sizeof(pid_t));
-        *ApplicationPID = Application->PID;
-        AXLibConstructEvent(AXEvent_ApplicationHidden, ApplicationPID, false);
+        AXLibConstructApplicationEvent(AXEvent_ApplicationHidden, Application->PID, false);
     }
 }
 
@@ -201,9 +197,7 @@ bool SharedWorkspaceIsApplicationHidden(pid_t PID)
     {
         ax_application *Application = &(*Applications)[PID];
 
-        pid_t *ApplicationPID = (pid_t *) malloc(sizeof(pid_t));
-        *ApplicationPID = Application->PID;
-        AXLibConstructEvent(AXEvent_ApplicationVisible, ApplicationPID, false);
+        AXLibConstructApplicationEvent(AXEvent_ApplicationVisible, Application->PID, false);
     }
 }
 
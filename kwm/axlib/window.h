@@ -21,6 +21,19 @@ struct ax_window_role
     CFTypeRef CustomRole;
 };
 
+/* NOTE(koekeishiya): The last geometry kwm committed to a window, together with the geometry
+                     that was observed right after. Invalid once the window is moved or resized
+                     by something other than kwm. */
+struct ax_window_geometry
+{
+    CGPoint Position;
+    CGSize Size;
+
+    CGPoint ObservedPosition;
+    CGSize ObservedSize;
+    bool Valid;
+};
+
 struct ax_application;
 struct ax_window
 {
@@ -33,6 +46,7 @@ struct ax_window
 
     CGSize Size;
     CGPoint Position;
+    ax_window_geometry Geometry;
     char *Name;
 };
 
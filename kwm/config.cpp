@@ -1021,11 +1021,10 @@ void KwmParseConfig(std::string File)
 internal void
 KwmClearSettings()
 {
-    KWMHotkeys.Modes.clear();
-    KWMSettings.WindowRules.clear();
+    KwmClearHotkeys();
+    KwmClearRules();
     KWMSettings.SpaceSettings.clear();
     KWMSettings.DisplaySettings.clear();
-    KWMHotkeys.ActiveMode = GetBindingMode("default");
 }
 
 void KwmReloadConfig()
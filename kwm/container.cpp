@@ -4,73 +4,172 @@
 
 #define internal static
 
-extern std::map<std::string, space_info> WindowTree;
 extern kwm_settings KWMSettings;
+extern layout_stats LayoutStats;
 
-internal node_container
-LeftVerticalContainerSplit(ax_display *Display, tree_node *Node)
+internal inline geometry_rect
+GeometryRectFromContainer(node_container *Container)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
-    node_container LeftContainer;
+    geometry_rect Rect = { Container->X, Container->Y, Container->Width, Container->Height };
+    return Rect;
+}
 
-    LeftContainer.X = Node->Container.X;
-    LeftContainer.Y = Node->Container.Y;
-    LeftContainer.Width = (Node->Container.Width * Node->SplitRatio) - (SpaceInfo->Settings.Offset.VerticalGap / 2);
-    LeftContainer.Height = Node->Container.Height;
+internal inline void
+SetContainerFromGeometryRect(node_container *Container, geometry_rect Rect)
+{
+    Container->X = Rect.X;
+    Container->Y = Rect.Y;
+    Container->Width = Rect.Width;
+    Container->Height = Rect.Height;
+}
 
-    return LeftContainer;
+internal inline split_type
+GetOptimalSplitOfContainer(node_container *Container, double OptimalRatio)
+{
+    geometry_split Split = GeometryOptimalSplit(GeometryRectFromContainer(Container), OptimalRatio);
+    return Split == GeometrySplit_Vertical ? SPLIT_VERTICAL : SPLIT_HORIZONTAL;
 }
 
-internal node_container
-RightVerticalContainerSplit(ax_display *Display, tree_node *Node)
+/* NOTE(koekeishiya): Computes the container of Node from the container of its parent. A node
+                     is marked dirty when its container changes, so that the caller only has
+                     to move the windows that were affected. */
+internal void
+LayoutNodeContainer(geometry_layout *Layout, tree_node *Node, container_type Type)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
-    node_container RightContainer;
+    node_container Container = Node->Container;
+    if(Node->SplitRatio == 0)
+        Node->SplitRatio = Layout->SplitRatio;
+
+    if(Type != CONTAINER_NONE)
+    {
+        tree_node *Parent = Node->Parent;
+        bool Vertical = Type == CONTAINER_LEFT || Type == CONTAINER_RIGHT;
+
+        geometry_rect First, Second;
+        GeometrySplitRect(GeometryRectFromContainer(&Parent->Container),
+                          Vertical ? GeometrySplit_Vertical : GeometrySplit_Horizontal, Parent->SplitRatio,
+                          Vertical ? Layout->VerticalGap : Layout->HorizontalGap, &First, &Second);
+        SetContainerFromGeometryRect(&Node->Container, Type == CONTAINER_LEFT || Type == CONTAINER_UPPER ? First : Second);
+    }
 
-    RightContainer.X = Node->Container.X + (Node->Container.Width * Node->SplitRatio) + (SpaceInfo->Settings.Offset.VerticalGap / 2);
-    RightContainer.Y = Node->Container.Y;
-    RightContainer.Width = (Node->Container.Width * (1 - Node->SplitRatio)) - (SpaceInfo->Settings.Offset.VerticalGap / 2);
-    RightContainer.Height = Node->Container.Height;
+    if(Node->SplitMode == SPLIT_NONE)
+        Node->SplitMode = GetOptimalSplitOfContainer(&Node->Container, Layout->OptimalRatio);
 
-    return RightContainer;
+    Node->Container.Type = Type;
+    if(Node->Container.X != Container.X ||
+       Node->Container.Y != Container.Y ||
+       Node->Container.Width != Container.Width ||
+       Node->Container.Height != Container.Height ||
+       Node->Container.Type != Container.Type)
+        Node->Dirty = true;
 }
 
-internal node_container
-UpperHorizontalContainerSplit(ax_display *Display, tree_node *Node)
+/* NOTE(koekeishiya): Lays out the subtree below Node from the container that Node already has;
+                     the containers of the leaves are the frames of the windows. The children
+                     of Node are always recomputed, deeper subtrees only when the container of
+                     their root changed or it was marked dirty, unless every split is to be
+                     chosen again from the shape of its container. Returns the number of
+                     containers that were computed. */
+uint32_t LayoutNodeContainers(geometry_layout *Layout, tree_node *Node, bool OptimalSplit)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
-    node_container UpperContainer;
+    uint32_t Computed = 0;
+    std::vector<tree_node *> Stack(1, Node);
+    while(!Stack.empty())
+    {
+        tree_node *Parent = Stack.back();
+        Stack.pop_back();
+
+        if(!Parent->LeftChild || !Parent->RightChild)
+            continue;
+
+        if(OptimalSplit)
+            Parent->SplitMode = GetOptimalSplitOfContainer(&Parent->Container, Layout->OptimalRatio);
+
+        if(Parent->SplitMode == SPLIT_VERTICAL)
+        {
+            LayoutNodeContainer(Layout, Parent->LeftChild, CONTAINER_LEFT);
+            LayoutNodeContainer(Layout, Parent->RightChild, CONTAINER_RIGHT);
+        }
+        else
+        {
+            LayoutNodeContainer(Layout, Parent->LeftChild, CONTAINER_UPPER);
+            LayoutNodeContainer(Layout, Parent->RightChild, CONTAINER_LOWER);
+        }
 
-    UpperContainer.X = Node->Container.X;
-    UpperContainer.Y = Node->Container.Y;
-    UpperContainer.Width = Node->Container.Width;
-    UpperContainer.Height = (Node->Container.Height * Node->SplitRatio) - (SpaceInfo->Settings.Offset.HorizontalGap / 2);
+        Computed += 2;
+        if(OptimalSplit || Parent->RightChild->Dirty)
+            Stack.push_back(Parent->RightChild);
 
-    return UpperContainer;
+        if(OptimalSplit || Parent->LeftChild->Dirty)
+            Stack.push_back(Parent->LeftChild);
+    }
+
+    return Computed;
 }
 
-internal node_container
-LowerHorizontalContainerSplit(ax_display *Display, tree_node *Node)
+/* NOTE(koekeishiya): As LayoutNodeContainers, but every node keeps the side of its parent that
+                     it had, and the windows linked to a node that changed are given its container. */
+uint32_t ResizeNodeContainers(geometry_layout *Layout, tree_node *Node)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
-    node_container LowerContainer;
+    uint32_t Computed = 0;
+    std::vector<tree_node *> Stack(1, Node);
+    while(!Stack.empty())
+    {
+        tree_node *Parent = Stack.back();
+        Stack.pop_back();
 
-    LowerContainer.X = Node->Container.X;
-    LowerContainer.Y = Node->Container.Y + (Node->Container.Height * Node->SplitRatio) + (SpaceInfo->Settings.Offset.HorizontalGap / 2);
-    LowerContainer.Width = Node->Container.Width;
-    LowerContainer.Height = (Node->Container.Height * (1 - Node->SplitRatio)) - (SpaceInfo->Settings.Offset.HorizontalGap / 2);
+        tree_node *Children[2] = { Parent->RightChild, Parent->LeftChild };
+        for(int Index = 0; Index < 2; ++Index)
+        {
+            tree_node *Child = Children[Index];
+            if(!Child)
+                continue;
+
+            LayoutNodeContainer(Layout, Child, Child->Container.Type);
+            ++Computed;
 
-    return LowerContainer;
+            if(Child->Dirty)
+            {
+                for(link_node *Link = Child->List; Link; Link = Link->Next)
+                    Link->Container = Child->Container;
+
+                Stack.push_back(Child);
+            }
+        }
+    }
+
+    return Computed;
 }
 
-void SetRootNodeContainer(ax_display *Display, tree_node *Node)
+/* NOTE(koekeishiya): The layout settings of the given space, looked up once per pass. */
+internal geometry_layout
+GetSpaceGeometryLayout(ax_display *Display)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    container_offset *Offset = &GetSpaceInfo(Display->Space)->Settings.Offset;
+    geometry_layout Layout = { Offset->VerticalGap, Offset->HorizontalGap,
+                               KWMSettings.SplitRatio, KWMSettings.OptimalRatio };
+    return Layout;
+}
+
+internal void
+SetDisplayContainer(ax_display *Display, node_container *Container)
+{
+    container_offset *Offset = &GetSpaceInfo(Display->Space)->Settings.Offset;
+    geometry_rect Frame = { Display->Frame.origin.x, Display->Frame.origin.y,
+                            Display->Frame.size.width, Display->Frame.size.height };
+    geometry_padding Padding = { Offset->PaddingTop, Offset->PaddingBottom,
+                                 Offset->PaddingLeft, Offset->PaddingRight };
+
+    geometry_rect Rect = GeometryPadRect(Frame, Padding);
+    Container->X = Rect.X;
+    Container->Y = Rect.Y;
+    Container->Width = Rect.Width;
+    Container->Height = Rect.Height;
+}
 
-    Node->Container.X = Display->Frame.origin.x + SpaceInfo->Settings.Offset.PaddingLeft;
-    Node->Container.Y = Display->Frame.origin.y + SpaceInfo->Settings.Offset.PaddingTop;
-    Node->Container.Width = Display->Frame.size.width - SpaceInfo->Settings.Offset.PaddingLeft - SpaceInfo->Settings.Offset.PaddingRight;
-    Node->Container.Height = Display->Frame.size.height - SpaceInfo->Settings.Offset.PaddingTop - SpaceInfo->Settings.Offset.PaddingBottom;
+void SetRootNodeContainer(ax_display *Display, tree_node *Node)
+{
+    SetDisplayContainer(Display, &Node->Container);
     Node->SplitMode = GetOptimalSplitMode(Node);
 
     Node->Container.Type = CONTAINER_NONE;
@@ -78,44 +177,14 @@ void SetRootNodeContainer(ax_display *Display, tree_node *Node)
 
 void SetLinkNodeContainer(ax_display *Display, link_node *Link)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
-
-    Link->Container.X = Display->Frame.origin.x + SpaceInfo->Settings.Offset.PaddingLeft;
-    Link->Container.Y = Display->Frame.origin.y + SpaceInfo->Settings.Offset.PaddingTop;
-    Link->Container.Width = Display->Frame.size.width - SpaceInfo->Settings.Offset.PaddingLeft - SpaceInfo->Settings.Offset.PaddingRight;
-    Link->Container.Height = Display->Frame.size.height - SpaceInfo->Settings.Offset.PaddingTop - SpaceInfo->Settings.Offset.PaddingBottom;
+    SetDisplayContainer(Display, &Link->Container);
 }
 
 void CreateNodeContainer(ax_display *Display, tree_node *Node, container_type Type)
 {
-    if(Node->SplitRatio == 0)
-        Node->SplitRatio = KWMSettings.SplitRatio;
-
-    switch(Type)
-    {
-        case CONTAINER_LEFT:
-        {
-            Node->Container = LeftVerticalContainerSplit(Display, Node->Parent);
-        } break;
-        case CONTAINER_RIGHT:
-        {
-            Node->Container = RightVerticalContainerSplit(Display, Node->Parent);
-        } break;
-        case CONTAINER_UPPER:
-        {
-            Node->Container = UpperHorizontalContainerSplit(Display, Node->Parent);
-        } break;
-        case CONTAINER_LOWER:
-        {
-            Node->Container = LowerHorizontalContainerSplit(Display, Node->Parent);
-        } break;
-        default: { /* NOTE(koekeishiya): No container specified. */} break;
-    }
-
-    if(Node->SplitMode == SPLIT_NONE)
-        Node->SplitMode = GetOptimalSplitMode(Node);
-
-    Node->Container.Type = Type;
+    geometry_layout Layout = GetSpaceGeometryLayout(Display);
+    LayoutNodeContainer(&Layout, Node, Type);
+    __atomic_add_fetch(&LayoutStats.NodesRecomputed, 1, __ATOMIC_RELAXED);
 }
 
 void CreateNodeContainerPair(ax_display *Display, tree_node *LeftNode, tree_node *RightNode, split_type SplitMode)
@@ -132,24 +201,17 @@ void CreateNodeContainerPair(ax_display *Display, tree_node *LeftNode, tree_node
     }
 }
 
+/* NOTE(koekeishiya): The children of the given node are always recomputed. Deeper subtrees
+                     are only visited when the container of their root changed, or if the
+                     node was marked dirty by an operation that modified it. */
 void ResizeNodeContainer(ax_display *Display, tree_node *Node)
 {
-    if(Node)
-    {
-        if(Node->LeftChild)
-        {
-            CreateNodeContainer(Display, Node->LeftChild, Node->LeftChild->Container.Type);
-            ResizeNodeContainer(Display, Node->LeftChild);
-            ResizeLinkNodeContainers(Node->LeftChild);
-        }
+    if(!Node)
+        return;
 
-        if(Node->RightChild)
-        {
-            CreateNodeContainer(Display, Node->RightChild, Node->RightChild->Container.Type);
-            ResizeNodeContainer(Display, Node->RightChild);
-            ResizeLinkNodeContainers(Node->RightChild);
-        }
-    }
+    geometry_layout Layout = GetSpaceGeometryLayout(Display);
+    uint32_t Computed = ResizeNodeContainers(&Layout, Node);
+    __atomic_add_fetch(&LayoutStats.NodesRecomputed, Computed, __ATOMIC_RELAXED);
 }
 
 void ResizeLinkNodeContainers(tree_node *Root)
@@ -167,14 +229,12 @@ void ResizeLinkNodeContainers(tree_node *Root)
 
 void CreateNodeContainers(ax_display *Display, tree_node *Node, bool OptimalSplit)
 {
-    if(Node && Node->LeftChild && Node->RightChild)
-    {
-        Node->SplitMode = OptimalSplit ? GetOptimalSplitMode(Node) : Node->SplitMode;
-        CreateNodeContainerPair(Display, Node->LeftChild, Node->RightChild, Node->SplitMode);
+    if(!Node)
+        return;
 
-        CreateNodeContainers(Display, Node->LeftChild, OptimalSplit);
-        CreateNodeContainers(Display, Node->RightChild, OptimalSplit);
-    }
+    geometry_layout Layout = GetSpaceGeometryLayout(Display);
+    uint32_t Computed = LayoutNodeContainers(&Layout, Node, OptimalSplit);
+    __atomic_add_fetch(&LayoutStats.NodesRecomputed, Computed, __ATOMIC_RELAXED);
 }
 
 void CreateDeserializedNodeContainer(ax_display *Display, tree_node *Node)
@@ -2,6 +2,7 @@
 #define CONTAINER_H
 
 #include "types.h"
+#include "geometry.h"
 #include "axlib/display.h"
 
 void SetRootNodeContainer(ax_display *Display, tree_node *Node);
@@ -13,4 +14,7 @@ void ResizeLinkNodeContainers(tree_node *Root);
 void CreateNodeContainers(ax_display *Display, tree_node *Node, bool OptimalSplit);
 void CreateDeserializedNodeContainer(ax_display *Display, tree_node *Node);
 
+uint32_t LayoutNodeContainers(geometry_layout *Layout, tree_node *Node, bool OptimalSplit);
+uint32_t ResizeNodeContainers(geometry_layout *Layout, tree_node *Node);
+
 #endif
@@ -4,10 +4,10 @@
 #include "tree.h"
 #include "space.h"
 #include "border.h"
+#include "snapshot.h"
 #include "axlib/axlib.h"
 
 #define internal static
-extern std::map<std::string, space_info> WindowTree;
 extern ax_state AXState;
 extern ax_application *FocusedApplication;
 extern ax_window *MarkedWindow;
@@ -77,14 +77,14 @@ EVENT_CALLBACK(Callback_AXEvent_LeftMouseUp)
             return;
         }
 
-        space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
-        tree_node *TreeNode = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo->RootNode, FocusedWindow->ID);
+        space_info *SpaceInfo = GetSpaceInfo(Display->Space);
+        tree_node *TreeNode = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo, FocusedWindow->ID);
         if(TreeNode)
         {
-            tree_node *NewFocusNode = GetTreeNodeFromWindowID(SpaceInfo->RootNode, MarkedWindow->ID);
+            tree_node *NewFocusNode = GetTreeNodeFromWindowID(SpaceInfo, MarkedWindow->ID);
             if(NewFocusNode)
             {
-                SwapNodeWindowIDs(TreeNode, NewFocusNode);
+                SwapNodeWindowIDs(SpaceInfo, TreeNode, NewFocusNode);
             }
         }
 
@@ -95,7 +95,7 @@ EVENT_CALLBACK(Callback_AXEvent_LeftMouseUp)
 EVENT_CALLBACK(Callback_AXEvent_LeftMouseDragged)
 {
     DEBUG("AXEvent_LeftMouseDragged");
-    CGPoint *Cursor = (CGPoint *) Event->Context;
+    CGPoint *Cursor = &Event->Point;
 
     if(DragMoveWindow)
     {
@@ -118,14 +118,15 @@ EVENT_CALLBACK(Callback_AXEvent_LeftMouseDragged)
                 ax_window *Window = GetWindowByID(WindowID);
                 if(Window)
                 {
+                    if(MarkedWindow != Window)
+                        KwmMarkStateChanged();
+
                     MarkedWindow = Window;
                     UpdateBorder(&MarkedBorder, MarkedWindow);
                 }
             }
         }
     }
-
-    free(Cursor);
 }
 
 void MoveCursorToCenterOfWindow(ax_window *Window)
@@ -1,60 +1,651 @@
 #include "daemon.h"
 #include "interpreter.h"
 
+#include <poll.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <map>
+#include <vector>
+
 #define internal static
 
+#ifdef MSG_NOSIGNAL
+#define KWM_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define KWM_SEND_FLAGS 0
+#endif
+
+#define KWM_READ_CHUNK_SIZE 4096
+#define KWM_SUBSCRIBER_QUEUE_SIZE 256
+
+/* NOTE(koekeishiya): A client that stops reading while its replies pile up beyond this is
+ *                    disconnected rather than buffered for without bound. */
+#define KWM_CONNECTION_QUEUE_SIZE (1024 * 1024)
+
 internal int KwmSockFD;
 internal bool KwmDaemonIsRunning;
-internal int KwmDaemonPort = 3020;
+internal int KwmDaemonPort = 0;
+internal std::string KwmDaemonSocketPath;
 internal pthread_t KwmDaemonThread;
 
-std::string KwmReadFromSocket(int ClientSockFD)
+/* NOTE(koekeishiya): Replies are written from the event-loop thread while the daemon thread
+ *                    reads new commands, so the reply table and connection references are
+ *                    guarded by KwmReplyLock. */
+internal pthread_mutex_t KwmReplyLock = PTHREAD_MUTEX_INITIALIZER;
+internal std::map<int, kwm_reply> KwmReplies;
+internal int KwmNextReplyHandle;
+
+/* NOTE(koekeishiya): Connections with replies that the socket did not accept yet, each holding
+ *                    a reference, waiting to be picked up by the daemon thread. Also guarded
+ *                    by KwmReplyLock. */
+internal std::vector<kwm_connection *> KwmFlushRequests;
+
+/* NOTE(koekeishiya): Events are published from the event-loop and daemon threads, so the
+ *                    subscriber list and record queues are guarded by KwmSubscriberLock.
+ *                    Only the daemon thread adds or removes subscribers and writes to them,
+ *                    publishers wake it up through KwmWakeFDs. */
+internal pthread_mutex_t KwmSubscriberLock = PTHREAD_MUTEX_INITIALIZER;
+internal std::vector<kwm_subscriber *> KwmSubscribers;
+internal int KwmWakeFDs[2] = { -1, -1 };
+internal uint32_t KwmSubscribedTopics;
+
+internal void
+KwmUpdateSubscribedTopics()
+{
+    uint32_t Topics = 0;
+    for(std::size_t Index = 0; Index < KwmSubscribers.size(); ++Index)
+        Topics |= KwmSubscribers[Index]->Topics;
+
+    __atomic_store_n(&KwmSubscribedTopics, Topics, __ATOMIC_RELAXED);
+}
+
+internal void
+KwmWakeDaemon()
+{
+    if(KwmWakeFDs[1] != -1)
+    {
+        char Wake = 0;
+        write(KwmWakeFDs[1], &Wake, 1);
+    }
+}
+
+/* NOTE(koekeishiya): Must be called with the WriteLock of the connection held. Never blocks;
+ *                    returns whether anything is left to write. A connection that fails, or
+ *                    falls too far behind, is shut down and its output discarded, which the
+ *                    daemon thread then sees as the client going away. */
+internal bool
+KwmFlushConnection(kwm_connection *Connection)
 {
-    char Cur;
-    std::string Message;
-    while(recv(ClientSockFD, &Cur, 1, 0))
+    while(!Connection->Outgoing.empty())
     {
-        if(Cur == '\n')
+        ssize_t Sent = send(Connection->SockFD, Connection->Outgoing.c_str(),
+                            Connection->Outgoing.size(), KWM_SEND_FLAGS | MSG_DONTWAIT);
+        if(Sent > 0)
+        {
+            Connection->Outgoing.erase(0, Sent);
+        }
+        else if((Sent == -1) && (errno == EINTR))
+        {
+            continue;
+        }
+        else
+        {
+            if((Sent == -1) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+                break;
+
+            if(Connection->Outgoing.size() <= KWM_CONNECTION_QUEUE_SIZE)
+                return true;
+
             break;
-        Message += Cur;
+        }
+    }
+
+    if(!Connection->Outgoing.empty())
+    {
+        Connection->Outgoing.clear();
+        shutdown(Connection->SockFD, SHUT_RDWR);
+    }
+
+    return false;
+}
+
+internal kwm_connection *
+KwmCreateConnection(int SockFD)
+{
+#ifdef SO_NOSIGPIPE
+    int _True = 1;
+    setsockopt(SockFD, SOL_SOCKET, SO_NOSIGPIPE, &_True, sizeof(int));
+#endif
+
+    kwm_connection *Connection = new kwm_connection;
+    Connection->SockFD = SockFD;
+    Connection->References = 1;
+    Connection->Open = true;
+    Connection->Flushing = false;
+    pthread_mutex_init(&Connection->WriteLock, NULL);
+    return Connection;
+}
+
+/* NOTE(koekeishiya): The daemon thread holds one reference while it reads from the connection,
+ *                    and one while it writes what is left of its replies. Every outstanding
+ *                    reply holds one. The socket is closed by whoever drops the last reference. */
+internal void
+KwmReleaseConnection(kwm_connection *Connection)
+{
+    pthread_mutex_lock(&KwmReplyLock);
+    bool Destroy = --Connection->References == 0;
+    pthread_mutex_unlock(&KwmReplyLock);
+
+    if(Destroy)
+    {
+        shutdown(Connection->SockFD, SHUT_RDWR);
+        close(Connection->SockFD);
+        pthread_mutex_destroy(&Connection->WriteLock);
+        delete Connection;
+    }
+}
+
+internal int
+KwmCreateReply(kwm_connection *Connection, std::string RequestID)
+{
+    pthread_mutex_lock(&KwmReplyLock);
+    int Handle = ++KwmNextReplyHandle;
+    ++Connection->References;
+
+    kwm_reply Reply = { Connection, RequestID, "" };
+    KwmReplies[Handle] = Reply;
+    pthread_mutex_unlock(&KwmReplyLock);
+
+    return Handle;
+}
+
+internal bool
+KwmTakeReply(int Handle, kwm_reply *Reply)
+{
+    bool Result = false;
+
+    pthread_mutex_lock(&KwmReplyLock);
+    std::map<int, kwm_reply>::iterator It = KwmReplies.find(Handle);
+    if(It != KwmReplies.end())
+    {
+        *Reply = It->second;
+        KwmReplies.erase(It);
+        Result = true;
     }
-    return Message;
+    pthread_mutex_unlock(&KwmReplyLock);
+
+    return Result;
 }
 
 void KwmWriteToSocket(std::string Msg, int ClientSockFD)
 {
-    send(ClientSockFD, Msg.c_str(), Msg.size(), 0);
-    shutdown(ClientSockFD, SHUT_RDWR);
-    close(ClientSockFD);
+    kwm_reply Reply;
+    if(!KwmTakeReply(ClientSockFD, &Reply))
+        return;
+
+    kwm_connection *Connection = Reply.Connection;
+    Msg = Reply.Prefix + Msg;
+    if(!Reply.RequestID.empty())
+        Msg = "#" + Reply.RequestID + " " + std::to_string(Msg.size()) + "\n" + Msg;
+
+    pthread_mutex_lock(&Connection->WriteLock);
+    Connection->Outgoing += Msg;
+    bool Handover = KwmFlushConnection(Connection) && !Connection->Flushing;
+    if(Handover)
+        Connection->Flushing = true;
+    pthread_mutex_unlock(&Connection->WriteLock);
+
+    if(Handover)
+    {
+        pthread_mutex_lock(&KwmReplyLock);
+        ++Connection->References;
+        KwmFlushRequests.push_back(Connection);
+        pthread_mutex_unlock(&KwmReplyLock);
+        KwmWakeDaemon();
+    }
+
+    KwmReleaseConnection(Connection);
+}
+
+void KwmFinishReply(int ClientSockFD)
+{
+    KwmWriteToSocket("", ClientSockFD);
+}
+
+void KwmSetReplyPrefix(int ClientSockFD, std::string Prefix)
+{
+    pthread_mutex_lock(&KwmReplyLock);
+    std::map<int, kwm_reply>::iterator It = KwmReplies.find(ClientSockFD);
+    if(It != KwmReplies.end())
+        It->second.Prefix = Prefix;
+    pthread_mutex_unlock(&KwmReplyLock);
+}
+
+bool KwmReplyPending(int ClientSockFD)
+{
+    pthread_mutex_lock(&KwmReplyLock);
+    bool Result = KwmReplies.find(ClientSockFD) != KwmReplies.end();
+    pthread_mutex_unlock(&KwmReplyLock);
+
+    return Result;
+}
+
+bool KwmSubscribe(int ClientSockFD, uint32_t Topics)
+{
+    kwm_reply Reply;
+    if(!KwmTakeReply(ClientSockFD, &Reply))
+        return false;
+
+    kwm_subscriber *Subscriber = new kwm_subscriber;
+    Subscriber->Connection = Reply.Connection;
+    Subscriber->Topics = Topics;
+    Subscriber->Closed = false;
+    Subscriber->Dropped = 0;
+    Reply.Connection->Open = false;
+
+    pthread_mutex_lock(&KwmSubscriberLock);
+    KwmSubscribers.push_back(Subscriber);
+    KwmUpdateSubscribedTopics();
+    pthread_mutex_unlock(&KwmSubscriberLock);
+
+    return true;
+}
+
+/* NOTE(koekeishiya): Lets publishers skip building a record that nobody is going to read. */
+bool KwmIsSubscribed(kwm_topic Topic)
+{
+    return __atomic_load_n(&KwmSubscribedTopics, __ATOMIC_RELAXED) & Topic;
+}
+
+void KwmPublishEvent(kwm_topic Topic, std::string Record)
+{
+    bool Queued = false;
+
+    pthread_mutex_lock(&KwmSubscriberLock);
+    for(std::size_t Index = 0; Index < KwmSubscribers.size(); ++Index)
+    {
+        kwm_subscriber *Subscriber = KwmSubscribers[Index];
+        if(!(Subscriber->Topics & Topic))
+            continue;
+
+        Subscriber->Records.push_back(Record);
+        if(Subscriber->Records.size() > KWM_SUBSCRIBER_QUEUE_SIZE)
+        {
+            Subscriber->Records.pop_front();
+            ++Subscriber->Dropped;
+        }
+
+        Queued = true;
+    }
+    pthread_mutex_unlock(&KwmSubscriberLock);
+
+    if(Queued)
+        KwmWakeDaemon();
+}
+
+internal bool
+KwmSubscriberHasRecords(kwm_subscriber *Subscriber)
+{
+    pthread_mutex_lock(&KwmSubscriberLock);
+    bool Result = !Subscriber->Records.empty() || Subscriber->Dropped != 0;
+    pthread_mutex_unlock(&KwmSubscriberLock);
+
+    return Result;
+}
+
+/* NOTE(koekeishiya): Never blocks; whatever the socket does not accept stays in Pending. */
+internal void
+KwmFlushSubscriber(kwm_subscriber *Subscriber)
+{
+    if(Subscriber->Pending.empty())
+    {
+        pthread_mutex_lock(&KwmSubscriberLock);
+        if(Subscriber->Dropped != 0)
+        {
+            Subscriber->Pending = "dropped " + std::to_string(Subscriber->Dropped) + "\n";
+            Subscriber->Dropped = 0;
+        }
+
+        while(!Subscriber->Records.empty())
+        {
+            Subscriber->Pending += Subscriber->Records.front() + "\n";
+            Subscriber->Records.pop_front();
+        }
+        pthread_mutex_unlock(&KwmSubscriberLock);
+    }
+
+    while(!Subscriber->Pending.empty())
+    {
+        ssize_t Sent = send(Subscriber->Connection->SockFD, Subscriber->Pending.c_str(),
+                            Subscriber->Pending.size(), KWM_SEND_FLAGS | MSG_DONTWAIT);
+        if(Sent > 0)
+        {
+            Subscriber->Pending.erase(0, Sent);
+        }
+        else
+        {
+            if((Sent == -1) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+                Subscriber->Closed = true;
+
+            break;
+        }
+    }
+}
+
+internal void
+KwmCheckSubscriber(kwm_subscriber *Subscriber, short Events)
+{
+    if(Events & (POLLERR | POLLHUP | POLLNVAL))
+    {
+        Subscriber->Closed = true;
+    }
+    else if(Events & POLLIN)
+    {
+        char Chunk[KWM_READ_CHUNK_SIZE];
+        ssize_t Received = recv(Subscriber->Connection->SockFD, Chunk, sizeof(Chunk), MSG_DONTWAIT);
+        if((Received == 0) ||
+           ((Received == -1) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)))
+            Subscriber->Closed = true;
+    }
+
+    if(!Subscriber->Closed && (Events & POLLOUT))
+        KwmFlushSubscriber(Subscriber);
+}
+
+internal void
+KwmRemoveClosedSubscribers()
+{
+    std::vector<kwm_subscriber *> Closed;
+
+    pthread_mutex_lock(&KwmSubscriberLock);
+    for(std::size_t Index = 0; Index < KwmSubscribers.size();)
+    {
+        if(KwmSubscribers[Index]->Closed)
+        {
+            Closed.push_back(KwmSubscribers[Index]);
+            KwmSubscribers.erase(KwmSubscribers.begin() + Index);
+        }
+        else
+        {
+            ++Index;
+        }
+    }
+    KwmUpdateSubscribedTopics();
+    pthread_mutex_unlock(&KwmSubscriberLock);
+
+    for(std::size_t Index = 0; Index < Closed.size(); ++Index)
+    {
+        KwmReleaseConnection(Closed[Index]->Connection);
+        delete Closed[Index];
+    }
+}
+
+/* NOTE(koekeishiya): A line without a request id is a single-shot command from an old client,
+ *                    so we stop reading from the connection once it has been received. */
+internal void
+KwmHandleRequest(kwm_connection *Connection, std::string Line)
+{
+    if(!Line.empty() && Line[Line.size() - 1] == '\r')
+        Line.erase(Line.size() - 1);
+
+    std::string RequestID;
+    std::string Command = Line;
+    if(!Line.empty() && Line[0] == '#')
+    {
+        std::size_t Split = Line.find(' ');
+        RequestID = Line.substr(1, Split == std::string::npos ? std::string::npos : Split - 1);
+        Command = Split == std::string::npos ? "" : Line.substr(Split + 1);
+    }
+
+    if(RequestID.empty())
+        Connection->Open = false;
+
+    int Handle = KwmCreateReply(Connection, RequestID);
+    if(Command.empty())
+        KwmFinishReply(Handle);
+    else
+        KwmInterpretCommand(Command, Handle);
+}
+
+internal void
+KwmReadFromConnection(kwm_connection *Connection)
+{
+    char Chunk[KWM_READ_CHUNK_SIZE];
+    ssize_t Received = recv(Connection->SockFD, Chunk, sizeof(Chunk), 0);
+    if((Received == -1) && (errno == EINTR))
+        return;
+
+    if(Received > 0)
+        Connection->Buffer.append(Chunk, Received);
+
+    std::size_t Start = 0;
+    std::size_t End;
+    while((Connection->Open) &&
+          ((End = Connection->Buffer.find('\n', Start)) != std::string::npos))
+    {
+        KwmHandleRequest(Connection, Connection->Buffer.substr(Start, End - Start));
+        Start = End + 1;
+    }
+    Connection->Buffer.erase(0, Start);
+
+    if(Received <= 0)
+    {
+        if(Connection->Open && !Connection->Buffer.empty())
+            KwmHandleRequest(Connection, Connection->Buffer);
+
+        Connection->Open = false;
+    }
+}
+
+/* NOTE(koekeishiya): Returns whether everything that was queued for the connection is written,
+ *                    or discarded because the client went away. */
+internal bool
+KwmCheckFlushingConnection(kwm_connection *Connection, short Events)
+{
+    pthread_mutex_lock(&Connection->WriteLock);
+    if(Events & (POLLERR | POLLHUP | POLLNVAL))
+        Connection->Outgoing.clear();
+
+    bool Done = !KwmFlushConnection(Connection);
+    if(Done)
+        Connection->Flushing = false;
+    pthread_mutex_unlock(&Connection->WriteLock);
+
+    return Done;
 }
 
 internal void *
 KwmDaemonHandleConnectionBG(void *)
 {
+    std::vector<kwm_connection *> Connections;
+    std::vector<kwm_connection *> Flushing;
+    std::vector<kwm_subscriber *> Subscribers;
+    std::vector<struct pollfd> PollFDs;
+
     while(KwmDaemonIsRunning)
     {
-        int ClientSockFD;
-        struct sockaddr_in ClientAddr;
-        socklen_t SinSize = sizeof(struct sockaddr);
+        pthread_mutex_lock(&KwmSubscriberLock);
+        Subscribers = KwmSubscribers;
+        pthread_mutex_unlock(&KwmSubscriberLock);
+
+        pthread_mutex_lock(&KwmReplyLock);
+        Flushing.insert(Flushing.end(), KwmFlushRequests.begin(), KwmFlushRequests.end());
+        KwmFlushRequests.clear();
+        pthread_mutex_unlock(&KwmReplyLock);
+
+        std::size_t FlushingOffset = Connections.size() + 2;
+        std::size_t SubscriberOffset = FlushingOffset + Flushing.size();
+        PollFDs.resize(SubscriberOffset + Subscribers.size());
+        PollFDs[0].fd = KwmSockFD;
+        PollFDs[0].events = POLLIN;
+        PollFDs[0].revents = 0;
+        PollFDs[1].fd = KwmWakeFDs[0];
+        PollFDs[1].events = POLLIN;
+        PollFDs[1].revents = 0;
+        for(std::size_t Index = 0; Index < Connections.size(); ++Index)
+        {
+            PollFDs[Index + 2].fd = Connections[Index]->SockFD;
+            PollFDs[Index + 2].events = POLLIN;
+            PollFDs[Index + 2].revents = 0;
+        }
+
+        for(std::size_t Index = 0; Index < Flushing.size(); ++Index)
+        {
+            PollFDs[FlushingOffset + Index].fd = Flushing[Index]->SockFD;
+            PollFDs[FlushingOffset + Index].events = POLLOUT;
+            PollFDs[FlushingOffset + Index].revents = 0;
+        }
+
+        for(std::size_t Index = 0; Index < Subscribers.size(); ++Index)
+        {
+            kwm_subscriber *Subscriber = Subscribers[Index];
+            bool Writable = !Subscriber->Pending.empty() || KwmSubscriberHasRecords(Subscriber);
+            PollFDs[SubscriberOffset + Index].fd = Subscriber->Connection->SockFD;
+            PollFDs[SubscriberOffset + Index].events = POLLIN | (Writable ? POLLOUT : 0);
+            PollFDs[SubscriberOffset + Index].revents = 0;
+        }
+
+        if(poll(&PollFDs[0], PollFDs.size(), -1) == -1)
+            continue;
+
+        if(PollFDs[1].revents & POLLIN)
+        {
+            char Drain[64];
+            while(read(KwmWakeFDs[0], Drain, sizeof(Drain)) > 0);
+        }
+
+        for(std::size_t Index = 0; Index < Connections.size(); ++Index)
+        {
+            if(PollFDs[Index + 2].revents != 0)
+                KwmReadFromConnection(Connections[Index]);
+        }
+
+        std::size_t Remaining = 0;
+        for(std::size_t Index = 0; Index < Flushing.size(); ++Index)
+        {
+            short Events = PollFDs[FlushingOffset + Index].revents;
+            if((Events != 0) && KwmCheckFlushingConnection(Flushing[Index], Events))
+                KwmReleaseConnection(Flushing[Index]);
+            else
+                Flushing[Remaining++] = Flushing[Index];
+        }
+        Flushing.resize(Remaining);
+
+        for(std::size_t Index = 0; Index < Subscribers.size(); ++Index)
+        {
+            if(PollFDs[SubscriberOffset + Index].revents != 0)
+                KwmCheckSubscriber(Subscribers[Index], PollFDs[SubscriberOffset + Index].revents);
+        }
+
+        KwmRemoveClosedSubscribers();
+        for(std::size_t Index = 0; Index < Connections.size();)
+        {
+            if(!Connections[Index]->Open)
+            {
+                KwmReleaseConnection(Connections[Index]);
+                Connections.erase(Connections.begin() + Index);
+            }
+            else
+            {
+                ++Index;
+            }
+        }
 
-        ClientSockFD = accept(KwmSockFD, (struct sockaddr*)&ClientAddr, &SinSize);
-        if(ClientSockFD != -1)
+        if(PollFDs[0].revents & POLLIN)
         {
-            std::string Message = KwmReadFromSocket(ClientSockFD);
-            KwmInterpretCommand(Message, ClientSockFD);
+            struct sockaddr_storage ClientAddr;
+            socklen_t SinSize = sizeof(ClientAddr);
+
+            int ClientSockFD = accept(KwmSockFD, (struct sockaddr*)&ClientAddr, &SinSize);
+            if(ClientSockFD != -1)
+                Connections.push_back(KwmCreateConnection(ClientSockFD));
         }
     }
 
+    for(std::size_t Index = 0; Index < Connections.size(); ++Index)
+        KwmReleaseConnection(Connections[Index]);
+
+    /* NOTE(koekeishiya): Clients and subscribers get whatever their socket accepts right away;
+     *                    we do not wait for a slow client on the way out. */
+    pthread_mutex_lock(&KwmReplyLock);
+    Flushing.insert(Flushing.end(), KwmFlushRequests.begin(), KwmFlushRequests.end());
+    KwmFlushRequests.clear();
+    pthread_mutex_unlock(&KwmReplyLock);
+
+    for(std::size_t Index = 0; Index < Flushing.size(); ++Index)
+    {
+        KwmCheckFlushingConnection(Flushing[Index], 0);
+        KwmReleaseConnection(Flushing[Index]);
+    }
+
+    pthread_mutex_lock(&KwmSubscriberLock);
+    Subscribers = KwmSubscribers;
+    pthread_mutex_unlock(&KwmSubscriberLock);
+
+    for(std::size_t Index = 0; Index < Subscribers.size(); ++Index)
+    {
+        if(!Subscribers[Index]->Closed)
+            KwmFlushSubscriber(Subscribers[Index]);
+
+        Subscribers[Index]->Closed = true;
+    }
+    KwmRemoveClosedSubscribers();
+
     return NULL;
 }
 
+/* NOTE(koekeishiya): Must match the path used by kwmc. The per-user temporary directory that
+ *                    macOS puts in TMPDIR is preferred over the shared /tmp. */
+std::string KwmDefaultDaemonSocketPath()
+{
+    const char *Path = getenv("KWM_SOCKET");
+    if(Path && *Path)
+        return Path;
+
+    std::string Directory = "/tmp/";
+    const char *TempDirectory = getenv("TMPDIR");
+    if(TempDirectory && *TempDirectory)
+    {
+        Directory = TempDirectory;
+        if(Directory[Directory.size() - 1] != '/')
+            Directory += "/";
+    }
+
+    const char *User = getenv("USER");
+    return Directory + "kwm_" + (User ? User : "default") + ".socket";
+}
+
+void KwmSetDaemonSocketPath(std::string Path)
+{
+    KwmDaemonSocketPath = Path;
+    KwmDaemonPort = 0;
+}
+
+void KwmSetDaemonPort(int Port)
+{
+    KwmDaemonPort = Port;
+}
+
 void KwmTerminateDaemon()
 {
+    if(!KwmDaemonIsRunning)
+        return;
+
     KwmDaemonIsRunning = false;
     close(KwmSockFD);
+
+    /* NOTE(koekeishiya): The daemon thread may be asleep in poll, which closing the listening
+     *                    socket does not interrupt. */
+    KwmWakeDaemon();
+
+    if(KwmDaemonPort == 0)
+        unlink(KwmDaemonSocketPath.c_str());
 }
 
-bool KwmStartDaemon()
+internal bool
+KwmBindTCPSocket()
 {
     struct sockaddr_in SrvAddr;
     int _True = 1;
@@ -70,12 +661,104 @@ bool KwmStartDaemon()
     SrvAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
     memset(&SrvAddr.sin_zero, '\0', 8);
 
-    if(bind(KwmSockFD, (struct sockaddr*)&SrvAddr, sizeof(struct sockaddr)) == -1)
+    return bind(KwmSockFD, (struct sockaddr*)&SrvAddr, sizeof(struct sockaddr)) != -1;
+}
+
+/* NOTE(koekeishiya): Only a socket of the current user that nobody listens on any more is
+ *                    removed. Anything else at the path belongs to someone else, or to another
+ *                    instance of kwm, and we refuse to start rather than take it over. */
+internal bool
+KwmClaimUnixSocketPath(struct sockaddr_un *SrvAddr)
+{
+    struct stat Info;
+    if(lstat(SrvAddr->sun_path, &Info) == -1)
+        return errno == ENOENT;
+
+    if(Info.st_uid != getuid())
+    {
+        printf("Socket path is owned by another user: %s\n", SrvAddr->sun_path);
+        return false;
+    }
+
+    if(!S_ISSOCK(Info.st_mode))
+    {
+        printf("Socket path is not a socket: %s\n", SrvAddr->sun_path);
+        return false;
+    }
+
+    int SockFD = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(SockFD == -1)
+        return false;
+
+    bool Listening = connect(SockFD, (struct sockaddr*)SrvAddr, sizeof(*SrvAddr)) != -1;
+    close(SockFD);
+    if(Listening)
+    {
+        printf("Another instance of kwm is listening on %s\n", SrvAddr->sun_path);
+        return false;
+    }
+
+    return unlink(SrvAddr->sun_path) != -1;
+}
+
+/* NOTE(koekeishiya): The socket is created with a umask that leaves it accessible by the current
+ *                    user only, so that there is no window in which others can connect to it. */
+internal bool
+KwmBindUnixSocket()
+{
+    struct sockaddr_un SrvAddr;
+
+    if(KwmDaemonSocketPath.empty())
+        KwmDaemonSocketPath = KwmDefaultDaemonSocketPath();
+
+    if(KwmDaemonSocketPath.size() >= sizeof(SrvAddr.sun_path))
+    {
+        printf("Socket path is too long: %s\n", KwmDaemonSocketPath.c_str());
+        return false;
+    }
+
+    if((KwmSockFD = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+        return false;
+
+    memset(&SrvAddr, 0, sizeof(SrvAddr));
+    SrvAddr.sun_family = AF_UNIX;
+    strncpy(SrvAddr.sun_path, KwmDaemonSocketPath.c_str(), sizeof(SrvAddr.sun_path) - 1);
+    if(!KwmClaimUnixSocketPath(&SrvAddr))
+    {
+        close(KwmSockFD);
+        KwmSockFD = -1;
+        return false;
+    }
+
+    mode_t Mask = umask(S_IRWXG | S_IRWXO);
+    bool Bound = bind(KwmSockFD, (struct sockaddr*)&SrvAddr, sizeof(SrvAddr)) != -1;
+    umask(Mask);
+
+    return Bound;
+}
+
+bool KwmStartDaemon()
+{
+    if((KwmDaemonPort == 0) && (KwmDaemonSocketPath.empty()))
+    {
+        const char *Port = getenv("KWM_PORT");
+        if(Port && *Port)
+            KwmDaemonPort = atoi(Port);
+    }
+
+    bool Bound = KwmDaemonPort != 0 ? KwmBindTCPSocket() : KwmBindUnixSocket();
+    if(!Bound)
         return false;
 
     if(listen(KwmSockFD, 10) == -1)
         return false;
 
+    if(pipe(KwmWakeFDs) == -1)
+        return false;
+
+    fcntl(KwmWakeFDs[0], F_SETFL, O_NONBLOCK);
+    fcntl(KwmWakeFDs[1], F_SETFL, O_NONBLOCK);
+
     KwmDaemonIsRunning = true;
     pthread_create(&KwmDaemonThread, NULL, &KwmDaemonHandleConnectionBG, NULL);
     return true;
@@ -5,15 +5,90 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <string.h>
 #include <string>
+#include <deque>
+
+/* NOTE(koekeishiya): A client connection may carry many newline-delimited commands.
+ *                    A command prefixed with '#<id> ' is answered with '#<id> <length>\n'
+ *                    followed by <length> bytes, and the connection stays open. A command
+ *                    without a request id is answered with the raw reply, after which the
+ *                    connection is closed.
+ *
+ *                    Replies never block the thread that writes them. Whatever the socket
+ *                    does not accept right away is kept in Outgoing and written by the daemon
+ *                    thread once the socket is writable; Flushing is set while it does so. */
+struct kwm_connection
+{
+    int SockFD;
+    int References;
+    bool Open;
+
+    pthread_mutex_t WriteLock;
+    std::string Outgoing;
+    bool Flushing;
+
+    std::string Buffer;
+};
+
+struct kwm_reply
+{
+    kwm_connection *Connection;
+    std::string RequestID;
+    std::string Prefix;
+};
+
+enum kwm_topic
+{
+    KwmTopic_Focus = (1 << 0),
+    KwmTopic_Space = (1 << 1),
+    KwmTopic_Window = (1 << 2),
+    KwmTopic_Mode = (1 << 3),
+    KwmTopic_Tree = (1 << 4),
+
+    KwmTopic_All = (1 << 5) - 1
+};
+
+/* NOTE(koekeishiya): A connection that subscribed no longer accepts commands. Records are
+ *                    queued by the publishing thread and written by the daemon thread once
+ *                    the socket is writable. A subscriber keeps at most KWM_SUBSCRIBER_QUEUE_SIZE
+ *                    records; older records are dropped and reported as 'dropped <count>'. */
+struct kwm_subscriber
+{
+    kwm_connection *Connection;
+    uint32_t Topics;
+    bool Closed;
+
+    std::deque<std::string> Records;
+    uint64_t Dropped;
+    std::string Pending;
+};
 
 bool KwmStartDaemon();
 void KwmTerminateDaemon();
 
-std::string KwmReadFromSocket(int ClientSockFD);
+/* NOTE(koekeishiya): The daemon listens on a unix domain socket by default.
+ *                    Setting a port switches it to TCP on the loopback interface. */
+std::string KwmDefaultDaemonSocketPath();
+void KwmSetDaemonSocketPath(std::string Path);
+void KwmSetDaemonPort(int Port);
+
+/* NOTE(koekeishiya): ClientSockFD is the reply handle passed to KwmInterpretCommand.
+ *                    Every handle must be completed exactly once, either by writing a
+ *                    reply or by calling KwmFinishReply, which sends an empty reply if
+ *                    nothing was written yet. */
 void KwmWriteToSocket(std::string Msg, int ClientSockFD);
+void KwmFinishReply(int ClientSockFD);
+
+/* NOTE(koekeishiya): The prefix is written in front of whatever reply the handle receives. */
+void KwmSetReplyPrefix(int ClientSockFD, std::string Prefix);
+bool KwmReplyPending(int ClientSockFD);
+
+bool KwmSubscribe(int ClientSockFD, uint32_t Topics);
+bool KwmIsSubscribed(kwm_topic Topic);
+void KwmPublishEvent(kwm_topic Topic, std::string Record);
 
 #endif
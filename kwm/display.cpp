@@ -5,7 +5,6 @@
 #include "window.h"
 #include "cursor.h"
 
-extern std::map<std::string, space_info> WindowTree;
 extern kwm_settings KWMSettings;
 
 void SetDefaultPaddingOfDisplay(container_offset Offset)
@@ -28,7 +27,7 @@ void ChangePaddingOfDisplay(const std::string &Side, int Offset)
     if(!Display)
         return;
 
-    space_info *Space = &WindowTree[Display->Space->Identifier];
+    space_info *Space = GetSpaceInfo(Display->Space);
     if(Side == "all")
     {
         if(Space->Settings.Offset.PaddingLeft + Offset >= 0)
@@ -73,7 +72,7 @@ void ChangeGapOfDisplay(const std::string &Side, int Offset)
     if(!Display)
         return;
 
-    space_info *Space = &WindowTree[Display->Space->Identifier];
+    space_info *Space = GetSpaceInfo(Display->Space);
     if(Side == "all")
     {
         if(Space->Settings.Offset.VerticalGap + Offset >= 0)
@@ -156,7 +155,7 @@ void FocusDisplay(ax_display *Display)
 {
     if(Display)
     {
-        space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+        space_info *SpaceInfo = GetSpaceInfo(Display->Space);
         if(SpaceInfo->RootNode)
         {
             ax_window *Window = NULL;
@@ -8,6 +8,9 @@ extern EVENT_CALLBACK(Callback_KWMEvent_QueryTilingMode);
 extern EVENT_CALLBACK(Callback_KWMEvent_QuerySplitMode);
 extern EVENT_CALLBACK(Callback_KWMEvent_QuerySplitRatio);
 extern EVENT_CALLBACK(Callback_KWMEvent_QuerySpawnPosition);
+extern EVENT_CALLBACK(Callback_KWMEvent_QueryLayoutStats);
+extern EVENT_CALLBACK(Callback_KWMEvent_QueryEventStats);
+extern EVENT_CALLBACK(Callback_KWMEvent_QueryRuleCache);
 
 extern EVENT_CALLBACK(Callback_KWMEvent_QueryFocusFollowsMouse);
 extern EVENT_CALLBACK(Callback_KWMEvent_QueryMouseFollowsFocus);
@@ -23,6 +26,7 @@ extern EVENT_CALLBACK(Callback_KWMEvent_QueryCurrentSpaceMode);
 extern EVENT_CALLBACK(Callback_KWMEvent_QueryCurrentSpaceTag);
 extern EVENT_CALLBACK(Callback_KWMEvent_QueryCurrentSpaceId);
 extern EVENT_CALLBACK(Callback_KWMEvent_QueryPreviousSpaceId);
+extern EVENT_CALLBACK(Callback_KWMEvent_QueryCurrentSpacePool);
 
 extern EVENT_CALLBACK(Callback_KWMEvent_QueryFocusedBorder);
 extern EVENT_CALLBACK(Callback_KWMEvent_QueryMarkedBorder);
@@ -42,6 +46,11 @@ extern EVENT_CALLBACK(Callback_KWMEvent_QueryNodePosition);
 extern EVENT_CALLBACK(Callback_KWMEvent_QueryParentNodeState);
 extern EVENT_CALLBACK(Callback_KWMEvent_QueryWindowIdInDirectionOfFocusedWindow);
 extern EVENT_CALLBACK(Callback_KWMEvent_QueryScratchpad);
+extern EVENT_CALLBACK(Callback_KWMEvent_QueryState);
+extern EVENT_CALLBACK(Callback_KWMEvent_QueryFinished);
+
+extern EVENT_CALLBACK(Callback_KWMEvent_PlacementFinished);
+extern EVENT_CALLBACK(Callback_KWMEvent_PublishSnapshot);
 
 enum kwm_event_type
 {
@@ -49,6 +58,9 @@ enum kwm_event_type
     KWMEvent_QuerySplitMode,
     KWMEvent_QuerySplitRatio,
     KWMEvent_QuerySpawnPosition,
+    KWMEvent_QueryLayoutStats,
+    KWMEvent_QueryEventStats,
+    KWMEvent_QueryRuleCache,
 
     KWMEvent_QueryFocusFollowsMouse,
     KWMEvent_QueryMouseFollowsFocus,
@@ -64,6 +76,7 @@ enum kwm_event_type
     KWMEvent_QueryCurrentSpaceTag,
     KWMEvent_QueryPreviousSpaceId,
     KWMEvent_QueryPreviousSpaceName,
+    KWMEvent_QueryCurrentSpacePool,
 
     KWMEvent_QueryFocusedBorder,
     KWMEvent_QueryMarkedBorder,
@@ -83,6 +96,11 @@ enum kwm_event_type
     KWMEvent_QueryParentNodeState,
     KWMEvent_QueryWindowIdInDirectionOfFocusedWindow,
     KWMEvent_QueryScratchpad,
+    KWMEvent_QueryState,
+    KWMEvent_QueryFinished,
+
+    KWMEvent_PlacementFinished,
+    KWMEvent_PublishSnapshot,
 };
 
 inline void *
@@ -96,8 +114,10 @@ KwmCreateContext(int Id)
 /* NOTE(koekeishiya): Construct an ax_event with the appropriate callback through macro expansion. */
 #define KwmConstructEvent(EventType, EventContext) \
     do { ax_event Event = {}; \
+         Event.Payload = AXPayload_Context; \
          Event.Context = EventContext; \
          Event.Intrinsic = false; \
+         Event.Type = AXEvent_User; \
          Event.Handle = &Callback_##EventType; \
          AXLibAddEvent(Event); \
        } while(0)
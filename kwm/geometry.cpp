@@ -0,0 +1,64 @@
+#include "geometry.h"
+#include <math.h>
+
+/* NOTE(koekeishiya): Snapping rounds the edges of a rect rather than its origin and size
+                     separately, so that two rects that share an edge before snapping still
+                     share it afterwards. */
+geometry_rect GeometrySnapRect(geometry_rect Rect)
+{
+    double Left = round(Rect.X);
+    double Top = round(Rect.Y);
+    double Right = round(Rect.X + Rect.Width);
+    double Bottom = round(Rect.Y + Rect.Height);
+
+    geometry_rect Result = { Left, Top, Right - Left, Bottom - Top };
+    return Result;
+}
+
+geometry_rect GeometryPadRect(geometry_rect Rect, geometry_padding Padding)
+{
+    geometry_rect Result;
+    Result.X = Rect.X + Padding.Left;
+    Result.Y = Rect.Y + Padding.Top;
+    Result.Width = Rect.Width - Padding.Left - Padding.Right;
+    Result.Height = Rect.Height - Padding.Top - Padding.Bottom;
+
+    return GeometrySnapRect(Result);
+}
+
+/* NOTE(koekeishiya): Splits Rect in two along Ratio, leaving Gap between the halves. The split
+                     is placed on a whole pixel and the gap is divided as floor(Gap / 2) and the
+                     remainder, so that for a snapped Rect the two halves and the gap add up to
+                     exactly its extent; adjacent windows can then neither overlap nor leave a
+                     stray pixel between them. */
+void GeometrySplitRect(geometry_rect Rect, geometry_split Split, double Ratio, double Gap,
+                       geometry_rect *First, geometry_rect *Second)
+{
+    double Origin = Split == GeometrySplit_Vertical ? Rect.X : Rect.Y;
+    double Extent = Split == GeometrySplit_Vertical ? Rect.Width : Rect.Height;
+
+    double Edge = round(Origin + Extent * Ratio);
+    double FirstGap = floor(round(Gap) / 2);
+    double FirstEnd = Edge - FirstGap;
+    double SecondStart = Edge + (round(Gap) - FirstGap);
+
+    *First = Rect;
+    *Second = Rect;
+    if(Split == GeometrySplit_Vertical)
+    {
+        First->Width = FirstEnd - Origin;
+        Second->X = SecondStart;
+        Second->Width = (Origin + Extent) - SecondStart;
+    }
+    else
+    {
+        First->Height = FirstEnd - Origin;
+        Second->Y = SecondStart;
+        Second->Height = (Origin + Extent) - SecondStart;
+    }
+}
+
+geometry_split GeometryOptimalSplit(geometry_rect Rect, double OptimalRatio)
+{
+    return (Rect.Width / Rect.Height) >= OptimalRatio ? GeometrySplit_Vertical : GeometrySplit_Horizontal;
+}
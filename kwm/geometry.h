@@ -0,0 +1,43 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+/* NOTE(koekeishiya): The layout math of the bsp-tree, kept free of any global state and of the
+                     types of kwm and Carbon, so that it can be compiled and checked anywhere.
+                     Everything is passed in; nothing is looked up. Every edge it produces lies
+                     on a whole pixel. The tree itself is walked by container.cpp. */
+
+struct geometry_rect
+{
+    double X, Y;
+    double Width, Height;
+};
+
+struct geometry_padding
+{
+    double Top, Bottom;
+    double Left, Right;
+};
+
+enum geometry_split
+{
+    GeometrySplit_Vertical,
+    GeometrySplit_Horizontal
+};
+
+/* NOTE(koekeishiya): The settings that a layout of the tree depends on. SplitRatio is given
+                     to nodes that have none, and OptimalRatio decides the split of nodes
+                     that have no split mode, or of every node when the split is optimal. */
+struct geometry_layout
+{
+    double VerticalGap, HorizontalGap;
+    double SplitRatio;
+    double OptimalRatio;
+};
+
+geometry_rect GeometryPadRect(geometry_rect Rect, geometry_padding Padding);
+geometry_rect GeometrySnapRect(geometry_rect Rect);
+void GeometrySplitRect(geometry_rect Rect, geometry_split Split, double Ratio, double Gap,
+                       geometry_rect *First, geometry_rect *Second);
+geometry_split GeometryOptimalSplit(geometry_rect Rect, double OptimalRatio);
+
+#endif
@@ -16,11 +16,17 @@
 #include "cursor.h"
 #include "event.h"
 #include "config.h"
+#include "snapshot.h"
 #include "axlib/axlib.h"
 
 #define internal static
 
-extern std::map<std::string, space_info> WindowTree;
+/* NOTE(koekeishiya): Answer from the latest snapshot if it is current, otherwise queue the query. */
+#define KwmQueryFromSnapshot(EventType, ClientSockFD) \
+    do { if(!KwmAnswerFromSnapshot(EventType, ClientSockFD)) \
+             KwmConstructEvent(EventType, KwmCreateContext(ClientSockFD)); \
+       } while(0)
+
 extern ax_application *FocusedApplication;
 extern ax_window *MarkedWindow;
 
@@ -29,7 +35,7 @@ extern kwm_border FocusedBorder;
 extern kwm_border MarkedBorder;
 
 internal void
-KwmConfigCommand(std::vector<std::string> &Tokens)
+KwmConfigCommand(const std::vector<std::string> &Tokens)
 {
     if(Tokens[1] == "reload")
     {
@@ -305,7 +311,7 @@ KwmConfigCommand(std::vector<std::string> &Tokens)
 }
 
 internal void
-KwmQueryCommand(std::vector<std::string> &Tokens, int ClientSockFD)
+KwmQueryCommand(const std::vector<std::string> &Tokens, int ClientSockFD)
 {
     if(Tokens[1] == "tiling")
     {
@@ -317,19 +323,21 @@ KwmQueryCommand(std::vector<std::string> &Tokens, int ClientSockFD)
             KwmConstructEvent(KWMEvent_QuerySplitMode, KwmCreateContext(ClientSockFD));
         else if(Tokens[2] == "split-ratio")
             KwmConstructEvent(KWMEvent_QuerySplitRatio, KwmCreateContext(ClientSockFD));
+        else if(Tokens[2] == "layout")
+            KwmConstructEvent(KWMEvent_QueryLayoutStats, KwmCreateContext(ClientSockFD));
     }
     else if(Tokens[1] == "window")
     {
         if(Tokens[2] == "focused")
         {
             if(Tokens[3] == "id")
-                KwmConstructEvent(KWMEvent_QueryFocusedWindowId, KwmCreateContext(ClientSockFD));
+                KwmQueryFromSnapshot(KWMEvent_QueryFocusedWindowId, ClientSockFD);
             else if(Tokens[3] == "name")
-                KwmConstructEvent(KWMEvent_QueryFocusedWindowName, KwmCreateContext(ClientSockFD));
+                KwmQueryFromSnapshot(KWMEvent_QueryFocusedWindowName, ClientSockFD);
             else if(Tokens[3] == "split")
-                KwmConstructEvent(KWMEvent_QueryFocusedWindowSplit, KwmCreateContext(ClientSockFD));
+                KwmQueryFromSnapshot(KWMEvent_QueryFocusedWindowSplit, ClientSockFD);
             else if(Tokens[3] == "float")
-                KwmConstructEvent(KWMEvent_QueryFocusedWindowFloat, KwmCreateContext(ClientSockFD));
+                KwmQueryFromSnapshot(KWMEvent_QueryFocusedWindowFloat, ClientSockFD);
             else
             {
                 int *Args = (int *) malloc(sizeof(int) * 2);
@@ -352,13 +360,13 @@ KwmQueryCommand(std::vector<std::string> &Tokens, int ClientSockFD)
         else if(Tokens[2] == "marked")
         {
             if(Tokens[3] == "id")
-                KwmConstructEvent(KWMEvent_QueryMarkedWindowId, KwmCreateContext(ClientSockFD));
+                KwmQueryFromSnapshot(KWMEvent_QueryMarkedWindowId, ClientSockFD);
             else if(Tokens[3] == "name")
-                KwmConstructEvent(KWMEvent_QueryMarkedWindowName, KwmCreateContext(ClientSockFD));
+                KwmQueryFromSnapshot(KWMEvent_QueryMarkedWindowName, ClientSockFD);
             else if(Tokens[3] == "split")
-                KwmConstructEvent(KWMEvent_QueryMarkedWindowSplit, KwmCreateContext(ClientSockFD));
+                KwmQueryFromSnapshot(KWMEvent_QueryMarkedWindowSplit, ClientSockFD);
             else if(Tokens[3] == "float")
-                KwmConstructEvent(KWMEvent_QueryMarkedWindowFloat, KwmCreateContext(ClientSockFD));
+                KwmQueryFromSnapshot(KWMEvent_QueryMarkedWindowFloat, ClientSockFD);
         }
         else if(Tokens[2] == "parent")
         {
@@ -377,7 +385,7 @@ KwmQueryCommand(std::vector<std::string> &Tokens, int ClientSockFD)
         }
         else if(Tokens[2] == "list")
         {
-            KwmConstructEvent(KWMEvent_QueryWindowList, KwmCreateContext(ClientSockFD));
+            KwmQueryFromSnapshot(KWMEvent_QueryWindowList, ClientSockFD);
         }
     }
     else if(Tokens[1] == "scratchpad")
@@ -392,23 +400,25 @@ KwmQueryCommand(std::vector<std::string> &Tokens, int ClientSockFD)
         if(Tokens[2] == "active")
         {
             if(Tokens[3] == "tag")
-                KwmConstructEvent(KWMEvent_QueryCurrentSpaceTag, KwmCreateContext(ClientSockFD));
+                KwmQueryFromSnapshot(KWMEvent_QueryCurrentSpaceTag, ClientSockFD);
             else if(Tokens[3] == "name")
-                KwmConstructEvent(KWMEvent_QueryCurrentSpaceName, KwmCreateContext(ClientSockFD));
+                KwmQueryFromSnapshot(KWMEvent_QueryCurrentSpaceName, ClientSockFD);
             else if(Tokens[3] == "id")
-                KwmConstructEvent(KWMEvent_QueryCurrentSpaceId, KwmCreateContext(ClientSockFD));
+                KwmQueryFromSnapshot(KWMEvent_QueryCurrentSpaceId, ClientSockFD);
             else if(Tokens[3] == "mode")
-                KwmConstructEvent(KWMEvent_QueryCurrentSpaceMode, KwmCreateContext(ClientSockFD));
+                KwmQueryFromSnapshot(KWMEvent_QueryCurrentSpaceMode, ClientSockFD);
+            else if(Tokens[3] == "pool")
+                KwmConstructEvent(KWMEvent_QueryCurrentSpacePool, KwmCreateContext(ClientSockFD));
         }
         else if(Tokens[2] == "previous")
         {
             if(Tokens[3] == "name")
-                KwmConstructEvent(KWMEvent_QueryPreviousSpaceName, KwmCreateContext(ClientSockFD));
+                KwmQueryFromSnapshot(KWMEvent_QueryPreviousSpaceName, ClientSockFD);
             else if(Tokens[3] == "id")
-                KwmConstructEvent(KWMEvent_QueryPreviousSpaceId, KwmCreateContext(ClientSockFD));
+                KwmQueryFromSnapshot(KWMEvent_QueryPreviousSpaceId, ClientSockFD);
         }
         else if(Tokens[2] == "list")
-            KwmConstructEvent(KWMEvent_QuerySpaces, KwmCreateContext(ClientSockFD));
+            KwmQueryFromSnapshot(KWMEvent_QuerySpaces, ClientSockFD);
     }
     else if(Tokens[1] == "border")
     {
@@ -417,6 +427,19 @@ KwmQueryCommand(std::vector<std::string> &Tokens, int ClientSockFD)
         else if(Tokens[2] == "marked")
             KwmConstructEvent(KWMEvent_QueryMarkedBorder, KwmCreateContext(ClientSockFD));
     }
+    else if(Tokens[1] == "rules")
+    {
+        if(Tokens[2] == "cache")
+            KwmConstructEvent(KWMEvent_QueryRuleCache, KwmCreateContext(ClientSockFD));
+    }
+    else if(Tokens[1] == "state")
+    {
+        KwmConstructEvent(KWMEvent_QueryState, KwmCreateContext(ClientSockFD));
+    }
+    else if(Tokens[1] == "events")
+    {
+        KwmConstructEvent(KWMEvent_QueryEventStats, KwmCreateContext(ClientSockFD));
+    }
     else if(Tokens[1] == "cycle-focus")
     {
         KwmConstructEvent(KWMEvent_QueryCycleFocus, KwmCreateContext(ClientSockFD));
@@ -444,11 +467,11 @@ KwmQueryCommand(std::vector<std::string> &Tokens, int ClientSockFD)
 }
 
 internal void
-KwmModeCommand(std::vector<std::string> &Tokens)
+KwmModeCommand(const std::vector<std::string> &Tokens)
 {
     if(Tokens[1] == "activate")
         KwmActivateBindingMode(Tokens[2]);
-    else
+    else if(Tokens.size() > 3)
     {
         std::string Mode = Tokens[1];
         mode *BindingMode = GetBindingMode(Mode);
@@ -476,7 +499,7 @@ KwmModeCommand(std::vector<std::string> &Tokens)
 }
 
 internal void
-KwmBindCommand(std::vector<std::string> &Tokens, bool Passthrough)
+KwmBindCommand(const std::vector<std::string> &Tokens, bool Passthrough)
 {
     bool BindCode = Tokens[0].find("bindcode") != std::string::npos;
 
@@ -487,7 +510,7 @@ KwmBindCommand(std::vector<std::string> &Tokens, bool Passthrough)
 }
 
 internal void
-KwmWindowCommand(std::vector<std::string> &Tokens)
+KwmWindowCommand(const std::vector<std::string> &Tokens)
 {
     if(Tokens[1] == "-f")
     {
@@ -640,7 +663,7 @@ KwmWindowCommand(std::vector<std::string> &Tokens)
             if(MarkedWindow)
                 DetachAndReinsertWindow(MarkedWindow->ID, 0);
         }
-        else
+        else if(Tokens.size() > 3)
         {
             int XOff = ConvertStringToInt(Tokens[2]);
             int YOff = ConvertStringToInt(Tokens[3]);
@@ -668,7 +691,7 @@ KwmWindowCommand(std::vector<std::string> &Tokens)
         else if(Tokens[2] == "west")
             Degrees = 270;
 
-        bool Wrap = Tokens[3] == "wrap" ? true : false;
+        bool Wrap = Tokens.size() > 3 && Tokens[3] == "wrap";
         if((FindClosestWindow(Degrees, &ClosestWindow, Wrap)) &&
            (ClosestWindow))
             MarkWindowContainer(ClosestWindow);
@@ -676,7 +699,7 @@ KwmWindowCommand(std::vector<std::string> &Tokens)
 }
 
 internal void
-KwmSpaceCommand(std::vector<std::string> &Tokens)
+KwmSpaceCommand(const std::vector<std::string> &Tokens)
 {
     if(Tokens[1] == "-fExperimental")
     {
@@ -701,7 +724,7 @@ KwmSpaceCommand(std::vector<std::string> &Tokens)
             ax_display *Display = AXLibMainDisplay();
             if(Display)
             {
-                space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+                space_info *SpaceInfo = GetSpaceInfo(Display->Space);
                 ApplyTreeNodeContainer(SpaceInfo->RootNode);
             }
         }
@@ -746,7 +769,7 @@ KwmSpaceCommand(std::vector<std::string> &Tokens)
 }
 
 internal void
-KwmDisplayCommand(std::vector<std::string> &Tokens)
+KwmDisplayCommand(const std::vector<std::string> &Tokens)
 {
     if(Tokens[1] == "-f")
     {
@@ -782,7 +805,7 @@ KwmDisplayCommand(std::vector<std::string> &Tokens)
 }
 
 internal void
-KwmTreeCommand(std::vector<std::string> &Tokens)
+KwmTreeCommand(const std::vector<std::string> &Tokens)
 {
     if(Tokens[1] == "-pseudo")
     {
@@ -801,7 +824,7 @@ KwmTreeCommand(std::vector<std::string> &Tokens)
     else if(Tokens[1] == "save")
     {
         ax_display *Display = AXLibMainDisplay();
-        space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+        space_info *SpaceInfo = GetSpaceInfo(Display->Space);
         SaveBSPTreeToFile(Display, SpaceInfo, Tokens[2]);
     }
     else if(Tokens[1] == "restore")
@@ -811,7 +834,7 @@ KwmTreeCommand(std::vector<std::string> &Tokens)
 }
 
 internal void
-KwmScratchpadCommand(std::vector<std::string> &Tokens, int ClientSockFD)
+KwmScratchpadCommand(const std::vector<std::string> &Tokens, int ClientSockFD)
 {
     if(Tokens[1] == "show")
     {
@@ -839,46 +862,663 @@ KwmScratchpadCommand(std::vector<std::string> &Tokens, int ClientSockFD)
     }
 }
 
-void KwmInterpretCommand(std::string Message, int ClientSockFD)
+internal void
+KwmQuitCommand(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    KwmQuit();
+}
+
+internal void
+KwmConfigHandler(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    KwmConfigCommand(Tokens);
+}
+
+struct kwm_command_entry;
+internal kwm_command_entry *
+KwmFindCommand(const std::string &Name);
+internal const char *
+KwmMissingTokensUsage(kwm_command_entry *Entry, const std::vector<std::string> &Tokens);
+
+/* NOTE(koekeishiya): 'query --since <version> ...' replies with only the current state version
+ *                    if nothing has changed since <version>, and otherwise with the version
+ *                    on the first line followed by the answer. */
+internal void
+KwmQueryHandler(const std::vector<std::string> &Tokens, int ClientSockFD)
 {
-    std::vector<std::string> Tokens = SplitString(Message, ' ');
+    uint64_t Version = KwmStateVersion();
+    if(Tokens[1] == "version")
+    {
+        KwmWriteToSocket(std::to_string(Version), ClientSockFD);
+        return;
+    }
+
+    if(Tokens[1] == "--since")
+    {
+        if(Tokens.size() < 4)
+        {
+            KwmWriteToSocket("usage: query --since <version> <category> [option]", ClientSockFD);
+            return;
+        }
+
+        if(Version <= std::strtoull(Tokens[2].c_str(), NULL, 10))
+        {
+            KwmWriteToSocket(std::to_string(Version), ClientSockFD);
+            return;
+        }
+
+        /* NOTE(koekeishiya): Tokens may belong to a compiled command, and must not be modified. */
+        std::vector<std::string> QueryTokens(1, Tokens[0]);
+        QueryTokens.insert(QueryTokens.end(), Tokens.begin() + 3, Tokens.end());
+
+        const char *Usage = KwmMissingTokensUsage(KwmFindCommand("query"), QueryTokens);
+        if(Usage)
+        {
+            KwmWriteToSocket(std::string("usage: ") + Usage, ClientSockFD);
+            return;
+        }
 
-    if(Tokens[0] == "quit")
-        KwmQuit();
-    else if(Tokens[0] == "config")
-        KwmConfigCommand(Tokens);
-    else if(Tokens[0] == "query")
+        KwmSetReplyPrefix(ClientSockFD, std::to_string(Version) + "\n");
+        KwmQueryCommand(QueryTokens, ClientSockFD);
+    }
+    else
+    {
         KwmQueryCommand(Tokens, ClientSockFD);
-    else if(Tokens[0] == "window")
-        KwmWindowCommand(Tokens);
-    else if(Tokens[0] == "space")
-        KwmSpaceCommand(Tokens);
+    }
+
+    if(KwmReplyPending(ClientSockFD))
+        KwmConstructEvent(KWMEvent_QueryFinished, KwmCreateContext(ClientSockFD));
+}
+
+internal void
+KwmWindowHandler(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    KwmWindowCommand(Tokens);
+}
+
+internal void
+KwmSpaceHandler(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    KwmSpaceCommand(Tokens);
+}
+
+internal void
+KwmDisplayHandler(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    KwmDisplayCommand(Tokens);
+}
+
+internal void
+KwmTreeHandler(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    KwmTreeCommand(Tokens);
+}
+
+internal void
+KwmWriteCommand(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    KwmEmitKeystrokes(CreateStringFromTokens(Tokens, 1));
+}
+
+internal void
+KwmPressCommand(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    KwmEmitKeystroke(Tokens[1]);
+}
+
+internal void
+KwmModeHandler(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    KwmModeCommand(Tokens);
+}
+
+internal void
+KwmBindHandler(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    KwmBindCommand(Tokens, false);
+}
+
+internal void
+KwmBindPassthroughHandler(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    KwmBindCommand(Tokens, true);
+}
+
+internal void
+KwmUnbindCommand(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    KwmRemoveHotkey(Tokens[1], Tokens[0] == "unbindcode");
+}
+
+internal void
+KwmRuleCommand(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    KwmAddRule(CreateStringFromTokens(Tokens, 1));
+}
+
+internal void
+KwmScratchpadHandler(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    KwmScratchpadCommand(Tokens, ClientSockFD);
+}
+
+internal void
+KwmWhitelistCommand(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    CarbonWhitelistProcess(CreateStringFromTokens(Tokens, 1));
+}
+
+/* NOTE(koekeishiya): Without topics the connection is subscribed to every topic. */
+internal void
+KwmSubscribeCommand(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    uint32_t Topics = Tokens.size() > 1 ? 0 : KwmTopic_All;
+    for(std::size_t TokenIndex = 1; TokenIndex < Tokens.size(); ++TokenIndex)
+    {
+        if(Tokens[TokenIndex] == "focus")
+            Topics |= KwmTopic_Focus;
+        else if(Tokens[TokenIndex] == "space")
+            Topics |= KwmTopic_Space;
+        else if(Tokens[TokenIndex] == "window")
+            Topics |= KwmTopic_Window;
+        else if(Tokens[TokenIndex] == "mode")
+            Topics |= KwmTopic_Mode;
+        else if(Tokens[TokenIndex] == "tree")
+            Topics |= KwmTopic_Tree;
+        else if(Tokens[TokenIndex] == "all")
+            Topics |= KwmTopic_All;
+        else
+        {
+            KwmWriteToSocket("unknown topic: " + Tokens[TokenIndex], ClientSockFD);
+            return;
+        }
+    }
+
+    KwmSubscribe(ClientSockFD, Topics);
+}
+
+internal void
+KwmHelpCommand(const std::vector<std::string> &Tokens, int ClientSockFD);
+
+typedef void (*kwm_command_handler)(const std::vector<std::string> &Tokens, int ClientSockFD);
+
+/* NOTE(koekeishiya): A sub-command applies when the tokens that follow the command name
+ *                    start with its Pattern, in which '*' matches any token. A command must
+ *                    have the MinTokens of every sub-command that applies. */
+struct kwm_subcommand_entry
+{
+    const char *Pattern;
+    std::size_t MinTokens;
+    const char *Usage;
+};
+
+internal kwm_subcommand_entry KwmConfigSubCommands[] =
+{
+    { "optimal-ratio", 3, "config optimal-ratio <ratio>" },
+    { "border", 4, "config border <focused|marked> <on|off|size|color|radius> [value]" },
+    { "border * size", 5, "config border <focused|marked> size <width>" },
+    { "border * color", 5, "config border <focused|marked> color <color>" },
+    { "border * radius", 5, "config border <focused|marked> radius <radius>" },
+    { "float-non-resizable", 3, "config float-non-resizable <on|off>" },
+    { "lock-to-container", 3, "config lock-to-container <on|off>" },
+    { "spawn", 3, "config spawn <left|right>" },
+    { "tiling", 3, "config tiling <bsp|monocle|float>" },
+    { "space", 5, "config space <display> <space> <mode|padding|gap|name|tree> <value>" },
+    { "space * * mode", 6, "config space <display> <space> mode <bsp|monocle|float>" },
+    { "space * * padding", 9, "config space <display> <space> padding <top> <bottom> <left> <right>" },
+    { "space * * gap", 7, "config space <display> <space> gap <vertical> <horizontal>" },
+    { "space * * name", 6, "config space <display> <space> name <name>" },
+    { "space * * tree", 6, "config space <display> <space> tree <file>" },
+    { "display", 4, "config display <display> <mode|padding|gap|float-dim> <value>" },
+    { "display * mode", 5, "config display <display> mode <bsp|monocle|float>" },
+    { "display * padding", 8, "config display <display> padding <top> <bottom> <left> <right>" },
+    { "display * gap", 6, "config display <display> gap <vertical> <horizontal>" },
+    { "display * float-dim", 6, "config display <display> float-dim <width> <height>" },
+    { "focus-follows-mouse", 3, "config focus-follows-mouse <toggle|on|off>" },
+    { "mouse-follows-focus", 3, "config mouse-follows-focus <on|off>" },
+    { "mouse-drag", 3, "config mouse-drag <on|off|mod> [modifier]" },
+    { "mouse-drag mod", 4, "config mouse-drag mod <modifier>" },
+    { "standby-on-float", 3, "config standby-on-float <on|off>" },
+    { "center-on-float", 3, "config center-on-float <on|off>" },
+    { "cycle-focus", 3, "config cycle-focus <on|off>" },
+    { "hotkeys", 3, "config hotkeys <on|off>" },
+    { "padding", 6, "config padding <top> <bottom> <left> <right>" },
+    { "gap", 4, "config gap <vertical> <horizontal>" },
+    { "split-ratio", 3, "config split-ratio <ratio>" },
+    { NULL, 0, NULL },
+};
+
+internal kwm_subcommand_entry KwmQuerySubCommands[] =
+{
+    { "tiling", 3, "query tiling <mode|spawn|split-mode|split-ratio|layout>" },
+    { "window", 3, "query window <focused|marked|parent|child|list> [option]" },
+    { "window focused", 4, "query window focused <id|name|split|float|north|east|south|west>" },
+    { "window marked", 4, "query window marked <id|name|split|float>" },
+    { "window parent", 5, "query window parent <window> <window>" },
+    { "window child", 4, "query window child <window>" },
+    { "scratchpad", 3, "query scratchpad list" },
+    { "space", 3, "query space <active|previous|list> [option]" },
+    { "space active", 4, "query space active <tag|name|id|mode|pool>" },
+    { "space previous", 4, "query space previous <name|id>" },
+    { "border", 3, "query border <focused|marked>" },
+    { "rules", 3, "query rules cache" },
+    { NULL, 0, NULL },
+};
+
+internal kwm_subcommand_entry KwmWindowSubCommands[] =
+{
+    { "-c", 4, "window -c <split-mode|type|reduce|expand> <argument> [direction]" },
+    { "-m space", 4, "window -m space <space|previous>" },
+    { "-m display", 4, "window -m display <prev|next|display>" },
+    { NULL, 0, NULL },
+};
+
+internal kwm_subcommand_entry KwmSpaceSubCommands[] =
+{
+    { "-p", 4, "space -p <increase|decrease> <left|right|top|bottom|all>" },
+    { "-g", 4, "space -g <increase|decrease> <vertical|horizontal|all>" },
+    { NULL, 0, NULL },
+};
+
+internal kwm_subcommand_entry KwmTreeSubCommands[] =
+{
+    { "-pseudo", 3, "tree -pseudo <create|destroy>" },
+    { "rotate", 3, "tree rotate <90|180|270>" },
+    { "save", 3, "tree save <file>" },
+    { "restore", 3, "tree restore <file>" },
+    { NULL, 0, NULL },
+};
+
+internal kwm_subcommand_entry KwmScratchpadSubCommands[] =
+{
+    { "show", 3, "scratchpad show <index>" },
+    { "toggle", 3, "scratchpad toggle <index>" },
+    { "hide", 3, "scratchpad hide <index>" },
+    { NULL, 0, NULL },
+};
+
+/* NOTE(koekeishiya): MinTokens includes the command name itself. A handler that
+ *                    sets Replies is responsible for completing the reply handle. */
+struct kwm_command_entry
+{
+    const char *Name;
+    std::size_t MinTokens;
+    bool Replies;
+    kwm_command_handler Handler;
+    const char *Usage;
+    kwm_subcommand_entry *SubCommands;
+};
+
+internal kwm_command_entry KwmCommands[] =
+{
+    { "quit", 1, false, KwmQuitCommand, "quit", NULL },
+    { "config", 2, false, KwmConfigHandler, "config <option> [value]", KwmConfigSubCommands },
+    { "query", 2, true, KwmQueryHandler, "query [--since <version>] <category> [option]", KwmQuerySubCommands },
+    { "window", 3, false, KwmWindowHandler, "window <-f|-fm|-s|-z|-t|-r|-c|-m|-mk> <argument>", KwmWindowSubCommands },
+    { "space", 3, false, KwmSpaceHandler, "space <-fExperimental|-t|-r|-p|-g|-n> <argument>", KwmSpaceSubCommands },
+    { "display", 3, false, KwmDisplayHandler, "display <-f|-c> <argument>", NULL },
+    { "tree", 2, false, KwmTreeHandler, "tree <option> [argument]", KwmTreeSubCommands },
+    { "write", 1, false, KwmWriteCommand, "write <text>", NULL },
+    { "press", 2, false, KwmPressCommand, "press <keysym>", NULL },
+    { "mode", 3, false, KwmModeHandler, "mode <activate|name> <argument> [value]", NULL },
+    { "bindsym", 2, false, KwmBindHandler, "bindsym <keysym> [command]", NULL },
+    { "bindcode", 2, false, KwmBindHandler, "bindcode <keycode> [command]", NULL },
+    { "bindsym_passthrough", 2, false, KwmBindPassthroughHandler, "bindsym_passthrough <keysym> [command]", NULL },
+    { "bindcode_passthrough", 2, false, KwmBindPassthroughHandler, "bindcode_passthrough <keycode> [command]", NULL },
+    { "unbindsym", 2, false, KwmUnbindCommand, "unbindsym <keysym>", NULL },
+    { "unbindcode", 2, false, KwmUnbindCommand, "unbindcode <keycode>", NULL },
+    { "rule", 2, false, KwmRuleCommand, "rule <properties>", NULL },
+    { "scratchpad", 2, false, KwmScratchpadHandler, "scratchpad <show|toggle|hide|add|remove> [index]", KwmScratchpadSubCommands },
+    { "whitelist", 2, false, KwmWhitelistCommand, "whitelist <application>", NULL },
+    { "subscribe", 1, true, KwmSubscribeCommand, "subscribe [focus|space|window|mode|tree|all ...]", NULL },
+    { "help", 1, true, KwmHelpCommand, "help [command]", NULL },
+};
+
+internal std::unordered_map<std::string, kwm_command_entry *>
+KwmBuildCommandRegistry()
+{
+    std::unordered_map<std::string, kwm_command_entry *> Registry;
+    for(std::size_t Index = 0; Index < sizeof(KwmCommands) / sizeof(KwmCommands[0]); ++Index)
+        Registry[KwmCommands[Index].Name] = &KwmCommands[Index];
+
+    return Registry;
+}
+
+internal kwm_command_entry *
+KwmFindCommand(const std::string &Name)
+{
+    static std::unordered_map<std::string, kwm_command_entry *> Registry = KwmBuildCommandRegistry();
+    std::unordered_map<std::string, kwm_command_entry *>::iterator It = Registry.find(Name);
+    return It != Registry.end() ? It->second : NULL;
+}
+
+internal bool
+KwmSubCommandApplies(const char *Pattern, const std::vector<std::string> &Tokens)
+{
+    std::size_t TokenIndex = 1;
+    while(*Pattern)
+    {
+        const char *End = strchr(Pattern, ' ');
+        std::size_t Length = End ? End - Pattern : strlen(Pattern);
+        if(TokenIndex == Tokens.size())
+            return false;
+
+        if(!(Length == 1 && *Pattern == '*') &&
+           Tokens[TokenIndex].compare(0, std::string::npos, Pattern, Length) != 0)
+            return false;
+
+        ++TokenIndex;
+        Pattern += End ? Length + 1 : Length;
+    }
+
+    return true;
+}
+
+/* NOTE(koekeishiya): Returns the usage of the command or sub-command that Tokens is too short
+ *                    for, or NULL if the handler can index every token it reads. */
+internal const char *
+KwmMissingTokensUsage(kwm_command_entry *Entry, const std::vector<std::string> &Tokens)
+{
+    if(Tokens.size() < Entry->MinTokens)
+        return Entry->Usage;
+
+    for(kwm_subcommand_entry *SubCommand = Entry->SubCommands;
+        SubCommand && SubCommand->Pattern;
+        ++SubCommand)
+    {
+        if((Tokens.size() < SubCommand->MinTokens) &&
+           (KwmSubCommandApplies(SubCommand->Pattern, Tokens)))
+            return SubCommand->Usage;
+    }
+
+    return NULL;
+}
+
+internal void
+KwmHelpCommand(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    std::string Output;
+    if(Tokens.size() > 1)
+    {
+        kwm_command_entry *Entry = KwmFindCommand(Tokens[1]);
+        Output = Entry ? Entry->Usage : "unknown command: " + Tokens[1];
+    }
+    else
+    {
+        for(std::size_t Index = 0; Index < sizeof(KwmCommands) / sizeof(KwmCommands[0]); ++Index)
+        {
+            if(!Output.empty())
+                Output += "\n";
+
+            Output += KwmCommands[Index].Usage;
+        }
+    }
+
+    KwmWriteToSocket(Output, ClientSockFD);
+}
+
+/* NOTE(koekeishiya): Splits on single spaces with the same result as SplitString,
+ *                    without going through a stringstream. */
+internal void
+KwmTokenizeCommand(const std::string &Message, std::vector<std::string> *Tokens)
+{
+    std::size_t Start = 0;
+    while(Start < Message.size())
+    {
+        std::size_t End = Message.find(' ', Start);
+        if(End == std::string::npos)
+            End = Message.size();
+
+        Tokens->push_back(Message.substr(Start, End - Start));
+        Start = End + 1;
+    }
+}
+
+internal void
+KwmInterpretTokens(const std::vector<std::string> &Tokens, int ClientSockFD)
+{
+    kwm_command_entry *Entry = Tokens.empty() ? NULL : KwmFindCommand(Tokens[0]);
+    const char *Usage = Entry ? KwmMissingTokensUsage(Entry, Tokens) : NULL;
+    if(!Entry)
+    {
+        DEBUG("KwmInterpretTokens() Unknown command");
+        KwmFinishReply(ClientSockFD);
+    }
+    else if(Usage)
+    {
+        KwmWriteToSocket(std::string("usage: ") + Usage, ClientSockFD);
+    }
+    else
+    {
+        Entry->Handler(Tokens, ClientSockFD);
+        if(!Entry->Replies)
+        {
+            KwmMarkStateChanged();
+            KwmFinishReply(ClientSockFD);
+        }
+    }
+}
+
+void KwmInterpretCommand(std::string Message, int ClientSockFD)
+{
+    std::vector<std::string> Tokens;
+    KwmTokenizeCommand(Message, &Tokens);
+    KwmInterpretTokens(Tokens, ClientSockFD);
+}
+
+internal int
+DegreesFromDirection(const std::string &Direction)
+{
+    if(Direction == "north")
+        return 0;
+    else if(Direction == "east")
+        return 90;
+    else if(Direction == "south")
+        return 180;
+    else if(Direction == "west")
+        return 270;
+
+    return -1;
+}
+
+internal int
+StepFromDirection(const std::string &Direction)
+{
+    if(Direction == "prev")
+        return -1;
+    else if(Direction == "next")
+        return 1;
+
+    return 0;
+}
+
+/* NOTE(koekeishiya): Only forms that KwmWindowCommand and KwmDisplayCommand handle without
+ *                    further input are given an opcode. Anything else, including malformed
+ *                    commands, falls back to the interpreter so that it behaves exactly as
+ *                    if it had been sent through kwmc. */
+internal void
+KwmCompileTokens(const std::vector<std::string> &Tokens, kwm_command *Command)
+{
+    Command->Opcode = KwmOpcode_Interpret;
+    if(Tokens.size() < 3)
+        return;
+
+    int Degrees = DegreesFromDirection(Tokens[2]);
+    int Step = StepFromDirection(Tokens[2]);
+    if(Tokens[0] == "window")
+    {
+        if(Tokens[1] == "-f" && Degrees != -1)
+        {
+            Command->Opcode = KwmOpcode_FocusDirected;
+            Command->Value = Degrees;
+        }
+        else if(Tokens[1] == "-f" && Step != 0)
+        {
+            Command->Opcode = KwmOpcode_FocusStep;
+            Command->Value = Step;
+        }
+        else if(Tokens[1] == "-fm" && Step != 0)
+        {
+            Command->Opcode = KwmOpcode_FocusSubTreeStep;
+            Command->Value = Step;
+        }
+        else if(Tokens[1] == "-s" && Degrees != -1)
+        {
+            Command->Opcode = KwmOpcode_SwapDirected;
+            Command->Value = Degrees;
+        }
+        else if(Tokens[1] == "-s" && Step != 0)
+        {
+            Command->Opcode = KwmOpcode_SwapStep;
+            Command->Value = Step;
+        }
+        else if(Tokens[1] == "-s" && Tokens[2] == "mark")
+        {
+            Command->Opcode = KwmOpcode_SwapMarked;
+        }
+        else if(Tokens[1] == "-z" && Tokens[2] == "fullscreen")
+        {
+            Command->Opcode = KwmOpcode_ToggleFullscreen;
+        }
+        else if(Tokens[1] == "-z" && Tokens[2] == "parent")
+        {
+            Command->Opcode = KwmOpcode_ToggleParent;
+        }
+        else if(Tokens[1] == "-t" && Tokens[2] == "focused")
+        {
+            Command->Opcode = KwmOpcode_ToggleFloating;
+        }
+        else if(Tokens[1] == "-m" && Degrees != -1)
+        {
+            Command->Opcode = KwmOpcode_DetachDirected;
+            Command->Value = Degrees;
+        }
+        else if(Tokens[1] == "-c" && Tokens.size() >= 4 &&
+                (Tokens[2] == "reduce" || Tokens[2] == "expand"))
+        {
+            double Ratio = ConvertStringToDouble(Tokens[3]);
+            Command->Ratio = Tokens[2] == "reduce" ? -Ratio : Ratio;
+            if(Tokens.size() == 5)
+            {
+                int SplitDegrees = DegreesFromDirection(Tokens[4]);
+                if(SplitDegrees != -1)
+                {
+                    Command->Opcode = KwmOpcode_SplitRatioDirected;
+                    Command->Value = SplitDegrees;
+                }
+            }
+            else
+            {
+                Command->Opcode = KwmOpcode_SplitRatio;
+            }
+        }
+    }
     else if(Tokens[0] == "display")
-        KwmDisplayCommand(Tokens);
-    else if(Tokens[0] == "tree")
-        KwmTreeCommand(Tokens);
-    else if(Tokens[0] == "write")
-        KwmEmitKeystrokes(CreateStringFromTokens(Tokens, 1));
-    else if(Tokens[0] == "press")
-        KwmEmitKeystroke(Tokens[1]);
-    else if(Tokens[0] == "mode")
-        KwmModeCommand(Tokens);
-    else if(Tokens[0] == "bindsym" || Tokens[0] == "bindcode")
-        KwmBindCommand(Tokens, false);
-    else if(Tokens[0] == "bindsym_passthrough" || Tokens[0] == "bindcode_passthrough")
-        KwmBindCommand(Tokens, true);
-    else if(Tokens[0] == "unbindsym" || Tokens[0] == "unbindcode")
-        KwmRemoveHotkey(Tokens[1], Tokens[0] == "unbindcode");
-    else if(Tokens[0] == "rule")
-        KwmAddRule(CreateStringFromTokens(Tokens, 1));
-    else if(Tokens[0] == "scratchpad")
-        KwmScratchpadCommand(Tokens, ClientSockFD);
-    else if(Tokens[0] == "whitelist")
-        CarbonWhitelistProcess(CreateStringFromTokens(Tokens, 1));
-
-    if(Tokens[0] != "query")
-    {
-        shutdown(ClientSockFD, SHUT_RDWR);
-        close(ClientSockFD);
+    {
+        if(Tokens[1] == "-f" && Step != 0)
+        {
+            Command->Opcode = KwmOpcode_FocusDisplayStep;
+            Command->Value = Step;
+        }
+    }
+}
+
+bool KwmCompileCommand(std::string Text, kwm_command *Command)
+{
+    Command->Opcode = KwmOpcode_Interpret;
+    Command->Value = 0;
+    Command->Ratio = 0;
+    Command->Text = TrimString(Text);
+    Command->Tokens.clear();
+    if(Command->Text.empty())
+        return false;
+
+    if(IsPrefixOfString(Command->Text, "exec"))
+    {
+        Command->Opcode = KwmOpcode_Exec;
     }
+    else
+    {
+        KwmTokenizeCommand(Command->Text, &Command->Tokens);
+        KwmCompileTokens(Command->Tokens, Command);
+    }
+
+    return true;
+}
+
+void KwmExecuteCommand(kwm_command *Command)
+{
+    switch(Command->Opcode)
+    {
+        case KwmOpcode_Interpret:
+        {
+            KwmInterpretTokens(Command->Tokens, 0);
+        } break;
+        case KwmOpcode_Exec:
+        {
+            KwmExecuteSystemCommand(Command->Text);
+        } break;
+        case KwmOpcode_FocusDirected:
+        {
+            ShiftWindowFocusDirected(Command->Value);
+        } break;
+        case KwmOpcode_FocusStep:
+        {
+            ShiftWindowFocus(Command->Value);
+        } break;
+        case KwmOpcode_FocusSubTreeStep:
+        {
+            ShiftSubTreeWindowFocus(Command->Value);
+        } break;
+        case KwmOpcode_SwapDirected:
+        {
+            SwapFocusedWindowDirected(Command->Value);
+        } break;
+        case KwmOpcode_SwapStep:
+        {
+            SwapFocusedWindowWithNearest(Command->Value);
+        } break;
+        case KwmOpcode_SwapMarked:
+        {
+            SwapFocusedWindowWithMarked();
+        } break;
+        case KwmOpcode_ToggleFullscreen:
+        {
+            ToggleFocusedWindowFullscreen();
+        } break;
+        case KwmOpcode_ToggleParent:
+        {
+            ToggleFocusedWindowParentContainer();
+        } break;
+        case KwmOpcode_ToggleFloating:
+        {
+            ToggleFocusedWindowFloating();
+        } break;
+        case KwmOpcode_SplitRatio:
+        {
+            ModifyContainerSplitRatio(Command->Ratio);
+        } break;
+        case KwmOpcode_SplitRatioDirected:
+        {
+            ModifyContainerSplitRatio(Command->Ratio, Command->Value);
+        } break;
+        case KwmOpcode_DetachDirected:
+        {
+            ax_window *Window = FocusedApplication ? FocusedApplication->Focus : NULL;
+            if(Window)
+                DetachAndReinsertWindow(Window->ID, Command->Value);
+        } break;
+        case KwmOpcode_FocusDisplayStep:
+        {
+            ax_display *Display = AXLibMainDisplay();
+            if(Display)
+                FocusDisplay(Command->Value < 0 ? AXLibPreviousDisplay(Display) : AXLibNextDisplay(Display));
+        } break;
+    }
+
+    /* NOTE(koekeishiya): Interpreted commands account for themselves, and a shell command can only
+     *                    change state through a command of its own. */
+    if((Command->Opcode != KwmOpcode_Interpret) &&
+       (Command->Opcode != KwmOpcode_Exec))
+        KwmMarkStateChanged();
 }
@@ -3,6 +3,10 @@
 
 #include <string>
 
+struct kwm_command;
+
 void KwmInterpretCommand(std::string Message, int ClientSockFD);
+bool KwmCompileCommand(std::string Text, kwm_command *Command);
+void KwmExecuteCommand(kwm_command *Command);
 
 #endif
@@ -0,0 +1,162 @@
+#include "json.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+
+#define internal static
+
+internal inline void
+JsonSeparate(json_writer *Writer)
+{
+    if(Writer->NeedComma)
+        Writer->Buffer.push_back(',');
+}
+
+void JsonBeginObject(json_writer *Writer)
+{
+    JsonSeparate(Writer);
+    Writer->Buffer.push_back('{');
+    Writer->NeedComma = false;
+}
+
+void JsonEndObject(json_writer *Writer)
+{
+    Writer->Buffer.push_back('}');
+    Writer->NeedComma = true;
+}
+
+void JsonBeginArray(json_writer *Writer)
+{
+    JsonSeparate(Writer);
+    Writer->Buffer.push_back('[');
+    Writer->NeedComma = false;
+}
+
+void JsonEndArray(json_writer *Writer)
+{
+    Writer->Buffer.push_back(']');
+    Writer->NeedComma = true;
+}
+
+/* NOTE(koekeishiya): Runs of characters that need no escaping are appended in one go. */
+internal void
+JsonWriteEscaped(json_writer *Writer, const char *Value, std::size_t Length)
+{
+    Writer->Buffer.push_back('"');
+
+    std::size_t Start = 0;
+    for(std::size_t Index = 0; Index < Length; ++Index)
+    {
+        unsigned char Char = Value[Index];
+        if(Char >= 0x20 && Char != '"' && Char != '\\')
+            continue;
+
+        Writer->Buffer.append(Value + Start, Index - Start);
+        Start = Index + 1;
+
+        switch(Char)
+        {
+            case '"': { Writer->Buffer.append("\\\""); } break;
+            case '\\': { Writer->Buffer.append("\\\\"); } break;
+            case '\n': { Writer->Buffer.append("\\n"); } break;
+            case '\r': { Writer->Buffer.append("\\r"); } break;
+            case '\t': { Writer->Buffer.append("\\t"); } break;
+            default:
+            {
+                char Escape[8];
+                snprintf(Escape, sizeof(Escape), "\\u%04x", Char);
+                Writer->Buffer.append(Escape);
+            } break;
+        }
+    }
+
+    Writer->Buffer.append(Value + Start, Length - Start);
+    Writer->Buffer.push_back('"');
+}
+
+void JsonKey(json_writer *Writer, const char *Key)
+{
+    JsonSeparate(Writer);
+    JsonWriteEscaped(Writer, Key, strlen(Key));
+    Writer->Buffer.push_back(':');
+    Writer->NeedComma = false;
+}
+
+void JsonString(json_writer *Writer, const char *Value, std::size_t Length)
+{
+    JsonSeparate(Writer);
+    JsonWriteEscaped(Writer, Value, Length);
+    Writer->NeedComma = true;
+}
+
+void JsonString(json_writer *Writer, const char *Value)
+{
+    if(Value)
+        JsonString(Writer, Value, strlen(Value));
+    else
+        JsonNull(Writer);
+}
+
+void JsonString(json_writer *Writer, const std::string &Value)
+{
+    JsonString(Writer, Value.c_str(), Value.size());
+}
+
+void JsonInteger(json_writer *Writer, int64_t Value)
+{
+    char Number[24];
+    char *End = Number + sizeof(Number);
+    char *At = End;
+
+    uint64_t Magnitude = Value < 0 ? 0 - (uint64_t) Value : (uint64_t) Value;
+    do
+    {
+        *--At = '0' + (Magnitude % 10);
+        Magnitude /= 10;
+    } while(Magnitude != 0);
+
+    if(Value < 0)
+        *--At = '-';
+
+    JsonSeparate(Writer);
+    Writer->Buffer.append(At, End - At);
+    Writer->NeedComma = true;
+}
+
+void JsonDouble(json_writer *Writer, double Value)
+{
+    if(!std::isfinite(Value))
+    {
+        JsonNull(Writer);
+        return;
+    }
+
+    /* NOTE(koekeishiya): Most coordinates are whole numbers and do not need snprintf. */
+    if(Value == (double)(int64_t) Value && std::fabs(Value) < 1e15)
+    {
+        JsonInteger(Writer, (int64_t) Value);
+        return;
+    }
+
+    char Number[32];
+    int Length = snprintf(Number, sizeof(Number), "%.10g", Value);
+
+    JsonSeparate(Writer);
+    Writer->Buffer.append(Number, Length);
+    Writer->NeedComma = true;
+}
+
+void JsonBool(json_writer *Writer, bool Value)
+{
+    JsonSeparate(Writer);
+    Writer->Buffer.append(Value ? "true" : "false");
+    Writer->NeedComma = true;
+}
+
+void JsonNull(json_writer *Writer)
+{
+    JsonSeparate(Writer);
+    Writer->Buffer.append("null");
+    Writer->NeedComma = true;
+}
@@ -0,0 +1,20 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include "types.h"
+
+void JsonBeginObject(json_writer *Writer);
+void JsonEndObject(json_writer *Writer);
+void JsonBeginArray(json_writer *Writer);
+void JsonEndArray(json_writer *Writer);
+
+void JsonKey(json_writer *Writer, const char *Key);
+void JsonString(json_writer *Writer, const char *Value, std::size_t Length);
+void JsonString(json_writer *Writer, const char *Value);
+void JsonString(json_writer *Writer, const std::string &Value);
+void JsonInteger(json_writer *Writer, int64_t Value);
+void JsonDouble(json_writer *Writer, double Value);
+void JsonBool(json_writer *Writer, bool Value);
+void JsonNull(json_writer *Writer);
+
+#endif
@@ -2,6 +2,7 @@
 #include "helpers.h"
 #include "interpreter.h"
 #include "border.h"
+#include "daemon.h"
 #include "axlib/event.h"
 
 #define internal static
@@ -250,6 +251,77 @@ HotkeysAreEqual(hotkey *A, hotkey *B)
     return false;
 }
 
+#define HOTKEY_MODIFIER_MASK (Hotkey_Modifier_Flag_Passthrough - 1)
+
+internal inline uint64_t
+HotkeyLookupKey(uint32_t Flags, CGKeyCode Keycode)
+{
+    return ((uint64_t) Keycode << 32) | (Flags & HOTKEY_MODIFIER_MASK);
+}
+
+/* NOTE(koekeishiya): A key press carries at most one of the generic, left or right flag for
+ *                    each modifier. List the ones that CompareCmdKey and friends accept. */
+internal int
+ExpandHotkeyModifier(uint32_t Flags, uint32_t Generic, uint32_t Left, uint32_t Right, uint32_t *Variants)
+{
+    uint32_t Bound = Flags & (Generic | Left | Right);
+    if(Bound & Generic)
+    {
+        Variants[0] = Generic;
+        Variants[1] = Left;
+        Variants[2] = Right;
+        return 3;
+    }
+
+    if((Bound == 0) || (Bound == Left) || (Bound == Right))
+    {
+        Variants[0] = Bound;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* NOTE(koekeishiya): An existing entry is never replaced, so that the first matching
+ *                    binding wins, as it did with a linear scan. */
+internal void
+AddHotkeyToLookup(mode *BindingMode, std::size_t Index)
+{
+    hotkey *Hotkey = &BindingMode->Hotkeys[Index];
+    uint32_t Control = Hotkey->Flags & Hotkey_Modifier_Flag_Control;
+
+    uint32_t Cmd[3], Shift[3], Alt[3];
+    int CmdCount = ExpandHotkeyModifier(Hotkey->Flags, Hotkey_Modifier_Flag_Cmd, Hotkey_Modifier_Flag_LCmd, Hotkey_Modifier_Flag_RCmd, Cmd);
+    int ShiftCount = ExpandHotkeyModifier(Hotkey->Flags, Hotkey_Modifier_Flag_Shift, Hotkey_Modifier_Flag_LShift, Hotkey_Modifier_Flag_RShift, Shift);
+    int AltCount = ExpandHotkeyModifier(Hotkey->Flags, Hotkey_Modifier_Flag_Alt, Hotkey_Modifier_Flag_LAlt, Hotkey_Modifier_Flag_RAlt, Alt);
+
+    for(int CmdIndex = 0; CmdIndex < CmdCount; ++CmdIndex)
+    {
+        for(int ShiftIndex = 0; ShiftIndex < ShiftCount; ++ShiftIndex)
+        {
+            for(int AltIndex = 0; AltIndex < AltCount; ++AltIndex)
+            {
+                uint32_t Flags = Cmd[CmdIndex] | Shift[ShiftIndex] | Alt[AltIndex] | Control;
+                BindingMode->Lookup.insert(std::make_pair(HotkeyLookupKey(Flags, Hotkey->Key), Index));
+            }
+        }
+    }
+}
+
+internal inline void
+InvalidateHotkeyBindings()
+{
+    __atomic_add_fetch(&KWMHotkeys.Generation, 1, __ATOMIC_RELEASE);
+}
+
+internal void
+RebuildHotkeyLookup(mode *BindingMode)
+{
+    BindingMode->Lookup.clear();
+    for(std::size_t HotkeyIndex = 0; HotkeyIndex < BindingMode->Hotkeys.size(); ++HotkeyIndex)
+        AddHotkeyToLookup(BindingMode, HotkeyIndex);
+}
+
 internal void
 CheckPrefixTimeout()
 {
@@ -265,6 +337,19 @@ CheckPrefixTimeout()
     }
 }
 
+internal void
+CheckPrefixTimeoutCallback(void *Context)
+{
+    CheckPrefixTimeout();
+}
+
+internal void
+SchedulePrefixTimeout(mode *BindingMode)
+{
+    BindingMode->Time = std::chrono::steady_clock::now();
+    dispatch_after_f(dispatch_time(DISPATCH_TIME_NOW, BindingMode->Timeout * NSEC_PER_SEC),
+                     dispatch_get_main_queue(), NULL, CheckPrefixTimeoutCallback);
+}
 
 internal bool
 IsHotkeyStateReqFulfilled(hotkey *Hotkey)
@@ -294,31 +379,33 @@ IsHotkeyStateReqFulfilled(hotkey *Hotkey)
 internal void
 KwmExecuteHotkey(hotkey *Hotkey)
 {
+    DEBUG("KwmExecuteHotkey: Number of commands " << Hotkey->Program.size());
+    for(std::size_t CmdIndex = 0; CmdIndex < Hotkey->Program.size(); ++CmdIndex)
+    {
+        kwm_command *Command = &Hotkey->Program[CmdIndex];
+        DEBUG("KwmExecuteHotkey() " << Command->Text);
+        KwmExecuteCommand(Command);
+
+        if(KWMHotkeys.ActiveMode->Prefix)
+        {
+            SchedulePrefixTimeout(KWMHotkeys.ActiveMode);
+        }
+    }
+}
+
+internal void
+CompileHotkeyCommand(hotkey *Hotkey)
+{
+    Hotkey->Program.clear();
     if(Hotkey->Command.empty())
         return;
 
     std::vector<std::string> Commands = SplitString(Hotkey->Command, ';');
-    DEBUG("KwmExecuteHotkey: Number of commands " << Commands.size());
-    for(int CmdIndex = 0; CmdIndex < Commands.size(); ++CmdIndex)
+    for(std::size_t CmdIndex = 0; CmdIndex < Commands.size(); ++CmdIndex)
     {
-        std::string &Command = TrimString(Commands[CmdIndex]);
-        if(!Command.empty())
-        {
-            DEBUG("KwmExecuteHotkey() " << Command);
-            if(IsPrefixOfString(Command, "exec"))
-                KwmExecuteSystemCommand(Command);
-            else
-                KwmInterpretCommand(Command, 0);
-
-            if(KWMHotkeys.ActiveMode->Prefix)
-            {
-                KWMHotkeys.ActiveMode->Time = std::chrono::steady_clock::now();
-                dispatch_after(dispatch_time(DISPATCH_TIME_NOW, KWMHotkeys.ActiveMode->Timeout * NSEC_PER_SEC), dispatch_get_main_queue(),
-                ^{
-                    CheckPrefixTimeout();
-                });
-            }
-        }
+        kwm_command Command = {};
+        if(KwmCompileCommand(Commands[CmdIndex], &Command))
+            Hotkey->Program.push_back(Command);
     }
 }
 
@@ -396,6 +483,7 @@ KwmParseHotkey(std::string KeySym, std::string Command, hotkey *Hotkey, bool Pas
     KwmParseHotkeyModifiers(Hotkey, KeyTokens[0]);
     DetermineHotkeyState(Hotkey, Command);
     Hotkey->Command = Command;
+    CompileHotkeyCommand(Hotkey);
     if(Passthrough)
         AddFlags(Hotkey, Hotkey_Modifier_Flag_Passthrough);
 
@@ -428,7 +516,12 @@ void KwmAddHotkey(std::string KeySym, std::string Command, bool Passthrough, boo
     hotkey Hotkey = {};
     if(KwmParseHotkey(KeySym, Command, &Hotkey, Passthrough, KeycodeInHex) &&
        !HotkeyExists(Hotkey.Flags, Hotkey.Key, NULL, Hotkey.Mode))
-        KWMHotkeys.Modes[Hotkey.Mode].Hotkeys.push_back(Hotkey);
+    {
+        mode *BindingMode = GetBindingMode(Hotkey.Mode);
+        InvalidateHotkeyBindings();
+        BindingMode->Hotkeys.push_back(Hotkey);
+        AddHotkeyToLookup(BindingMode, BindingMode->Hotkeys.size() - 1);
+    }
 }
 
 void KwmRemoveHotkey(std::string KeySym, bool KeycodeInHex)
@@ -442,13 +535,22 @@ void KwmRemoveHotkey(std::string KeySym, bool KeycodeInHex)
             hotkey *CurrentHotkey = &BindingMode->Hotkeys[HotkeyIndex];
             if(HotkeysAreEqual(CurrentHotkey, &NewHotkey))
             {
+                InvalidateHotkeyBindings();
                 BindingMode->Hotkeys.erase(BindingMode->Hotkeys.begin() + HotkeyIndex);
+                RebuildHotkeyLookup(BindingMode);
                 break;
             }
         }
     }
 }
 
+void KwmClearHotkeys()
+{
+    InvalidateHotkeyBindings();
+    KWMHotkeys.Modes.clear();
+    KWMHotkeys.ActiveMode = GetBindingMode("default");
+}
+
 mode *GetBindingMode(std::string Mode)
 {
     std::map<std::string, mode>::iterator It = KWMHotkeys.Modes.find(Mode);
@@ -469,15 +571,43 @@ void KwmActivateBindingMode(std::string Mode)
         BindingMode = GetBindingMode("default");
 
     KWMHotkeys.ActiveMode = BindingMode;
+    if(KwmIsSubscribed(KwmTopic_Mode))
+        KwmPublishEvent(KwmTopic_Mode, "mode " + BindingMode->Name);
     UpdateBorder(&FocusedBorder, FocusedApplication->Focus);
     if(BindingMode->Prefix)
     {
-        BindingMode->Time = std::chrono::steady_clock::now();
-        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, BindingMode->Timeout * NSEC_PER_SEC), dispatch_get_main_queue(),
-        ^{
-            CheckPrefixTimeout();
-        });
+        SchedulePrefixTimeout(BindingMode);
+    }
+}
+
+internal hotkey *
+FindHotkeyInModeLinear(mode *BindingMode, uint32_t Flags, CGKeyCode Keycode)
+{
+    hotkey TempHotkey = {};
+    TempHotkey.Flags = Flags;
+    TempHotkey.Key = Keycode;
+
+    for(std::size_t HotkeyIndex = 0; HotkeyIndex < BindingMode->Hotkeys.size(); ++HotkeyIndex)
+    {
+        hotkey *CheckHotkey = &BindingMode->Hotkeys[HotkeyIndex];
+        if(HotkeysAreEqual(CheckHotkey, &TempHotkey))
+            return CheckHotkey;
     }
+
+    return NULL;
+}
+
+/* NOTE(koekeishiya): Flags must describe a key press, see CreateHotkeyFromCGEvent. */
+internal hotkey *
+FindHotkeyInMode(mode *BindingMode, uint32_t Flags, CGKeyCode Keycode)
+{
+    hotkey *Result = NULL;
+    std::unordered_map<uint64_t, std::size_t>::iterator It = BindingMode->Lookup.find(HotkeyLookupKey(Flags, Keycode));
+    if(It != BindingMode->Lookup.end())
+        Result = &BindingMode->Hotkeys[It->second];
+
+    Assert(Result == FindHotkeyInModeLinear(BindingMode, Flags, Keycode));
+    return Result;
 }
 
 internal hotkey
@@ -523,10 +653,28 @@ CreateHotkeyFromCGEvent(CGEventRef Event)
     return Eventkey;
 }
 
-bool HotkeyForCGEvent(CGEventRef Event, hotkey *Hotkey)
+/* NOTE(koekeishiya): Called from the event tap for every key press, and must not allocate.
+ *                    The generation is read before the lookup, so that a binding that changes
+ *                    while the event is queued is detected when the event is dispatched. */
+bool HotkeyForCGEvent(CGEventRef Event, ax_event_key *Key, bool *Passthrough)
 {
+    uint32_t Generation = __atomic_load_n(&KWMHotkeys.Generation, __ATOMIC_ACQUIRE);
+    mode *BindingMode = KWMHotkeys.ActiveMode;
+
     hotkey Eventkey = CreateHotkeyFromCGEvent(Event);
-    return HotkeyExists(Eventkey.Flags, Eventkey.Key, Hotkey, KWMHotkeys.ActiveMode->Name);
+    hotkey *Hotkey = FindHotkeyInMode(BindingMode, Eventkey.Flags, Eventkey.Key);
+    if(Hotkey)
+    {
+        Key->Flags = Eventkey.Flags;
+        Key->Keycode = Eventkey.Key;
+        Key->Mode = BindingMode;
+        Key->Binding = Hotkey - &BindingMode->Hotkeys[0];
+        Key->Generation = Generation;
+        *Passthrough = Hotkey->Flags & Hotkey_Modifier_Flag_Passthrough;
+        return true;
+    }
+
+    return false;
 }
 
 bool MouseDragKeyMatchesCGEvent(CGEventRef Event)
@@ -540,35 +688,31 @@ bool MouseDragKeyMatchesCGEvent(CGEventRef Event)
 
 bool HotkeyExists(uint32_t Flags, CGKeyCode Keycode, hotkey *Hotkey, std::string &Mode)
 {
-    hotkey TempHotkey = {};
-    TempHotkey.Flags = Flags;
-    TempHotkey.Key = Keycode;
-
-    mode *BindingMode = GetBindingMode(Mode);
-    for(std::size_t HotkeyIndex = 0; HotkeyIndex < BindingMode->Hotkeys.size(); ++HotkeyIndex)
-    {
-        hotkey *CheckHotkey = &BindingMode->Hotkeys[HotkeyIndex];
-        if(HotkeysAreEqual(CheckHotkey, &TempHotkey))
-        {
-            if(Hotkey)
-                *Hotkey = *CheckHotkey;
-
-            return true;
-        }
-    }
+    hotkey *CheckHotkey = FindHotkeyInModeLinear(GetBindingMode(Mode), Flags, Keycode);
+    if(CheckHotkey && Hotkey)
+        *Hotkey = *CheckHotkey;
 
-    return false;
+    return CheckHotkey != NULL;
 }
 
+/* NOTE(koekeishiya): Event payload is the binding that the event tap matched, in the mode that
+ *                    was active at the time of the key press. If the bindings have changed since
+ *                    then, the key press is dropped rather than run a different binding.
+ *                    The binding is copied, as executing it may modify the binding mode. */
 EVENT_CALLBACK(Callback_AXEvent_HotkeyPressed)
 {
-    hotkey *Hotkey = (hotkey *) Event->Context;
-    DEBUG("AXEvent_HotkeyPressed: Hotkey activated");
+    if(Event->Key.Generation != __atomic_load_n(&KWMHotkeys.Generation, __ATOMIC_ACQUIRE))
+    {
+        DEBUG("AXEvent_HotkeyPressed: Bindings changed, key press dropped");
+        return;
+    }
 
-    if(IsHotkeyStateReqFulfilled(Hotkey))
-        KwmExecuteHotkey(Hotkey);
+    mode *BindingMode = (mode *) Event->Key.Mode;
+    hotkey Hotkey = BindingMode->Hotkeys[Event->Key.Binding];
+    DEBUG("AXEvent_HotkeyPressed: Hotkey activated");
 
-    delete Hotkey;
+    if(IsHotkeyStateReqFulfilled(&Hotkey))
+        KwmExecuteHotkey(&Hotkey);
 }
 
 internal void
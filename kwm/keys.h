@@ -3,6 +3,8 @@
 
 #include "types.h"
 
+struct ax_event_key;
+
 /* Taken from: /Applications/Xcode.app/Contents/Developer/Platforms/MacOSX.platform/
 				Developer/SDKs/MacOSX10.11.sdk/System/Library/Frameworks/IOKit.framework/
 				Versions/A/Headers/hidsystem/IOLLEvent.h
@@ -45,7 +47,7 @@ enum hotkey_modifier_flag
     Hotkey_Modifier_Flag_Passthrough = (1 << 10),
 };
 
-bool HotkeyForCGEvent(CGEventRef Event, hotkey *Hotkey);
+bool HotkeyForCGEvent(CGEventRef Event, ax_event_key *Key, bool *Passthrough);
 bool MouseDragKeyMatchesCGEvent(CGEventRef Event);
 
 void KwmAddHotkey(std::string KeySym, std::string Command, bool Passthrough, bool KeycodeInHex);
@@ -55,6 +57,7 @@ void KwmEmitKeystrokes(std::string Text);
 void KwmEmitKeystroke(std::string KeySym);
 void KwmSetMouseDragKey(std::string KeySym);
 
+void KwmClearHotkeys();
 mode *GetBindingMode(std::string Mode);
 void KwmActivateBindingMode(std::string Mode);
 void KwmExecuteSystemCommand(std::string Command);
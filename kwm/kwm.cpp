@@ -6,12 +6,13 @@
 #include "scratchpad.h"
 #include "border.h"
 #include "config.h"
+#include "event.h"
 #include "axlib/axlib.h"
 #include <getopt.h>
 
 #define internal static
 const char *KwmVersion = "Kwm Version 3.1.0";
-std::map<std::string, space_info> WindowTree;
+space_table WindowTree;
 
 ax_state AXState = {};
 ax_display *FocusedDisplay = NULL;
@@ -25,6 +26,39 @@ kwm_hotkeys KWMHotkeys = {};
 kwm_border FocusedBorder = {};
 kwm_border MarkedBorder = {};
 scratchpad Scratchpad = {};
+layout_stats LayoutStats = {};
+
+#ifdef DEBUG_BUILD
+/* NOTE(koekeishiya): Counts operator new calls made by the current thread, so that
+ *                    we can verify that the event tap does not allocate on key press. */
+internal __thread uint64_t ThreadAllocations;
+
+void *operator new(std::size_t Size)
+{
+    ++ThreadAllocations;
+    void *Memory = malloc(Size ? Size : 1);
+    if(!Memory)
+        throw std::bad_alloc();
+
+    return Memory;
+}
+
+void *operator new(std::size_t Size, const std::nothrow_t &) noexcept
+{
+    ++ThreadAllocations;
+    return malloc(Size ? Size : 1);
+}
+
+void operator delete(void *Memory) noexcept
+{
+    free(Memory);
+}
+
+void operator delete(void *Memory, const std::nothrow_t &) noexcept
+{
+    free(Memory);
+}
+#endif
 
 internal CGEventRef
 CGEventCallback(CGEventTapProxy Proxy, CGEventType Type, CGEventRef Event, void *Refcon)
@@ -41,20 +75,22 @@ CGEventCallback(CGEventTapProxy Proxy, CGEventType Type, CGEventRef Event, void
         {
             if(HasFlags(&KWMSettings, Settings_BuiltinHotkeys))
             {
-                hotkey *Hotkey = new(std::nothrow) hotkey;
-                if(Hotkey)
-                {
-                    if(HotkeyForCGEvent(Event, Hotkey))
-                    {
-                        AXLibConstructEvent(AXEvent_HotkeyPressed, Hotkey, false);
-                        if(!(Hotkey->Flags & Hotkey_Modifier_Flag_Passthrough))
-                            return NULL;
-                    }
-                    else
-                    {
-                        delete Hotkey;
-                    }
-                }
+#ifdef DEBUG_BUILD
+                uint64_t Allocations = ThreadAllocations;
+#endif
+                ax_event_key Key;
+                bool Passthrough = false;
+                bool Result = HotkeyForCGEvent(Event, &Key, &Passthrough);
+                if(Result)
+                    AXLibConstructKeyEvent(AXEvent_HotkeyPressed, Key, false);
+
+#ifdef DEBUG_BUILD
+                if(ThreadAllocations != Allocations)
+                    DEBUG("CGEventCallback: " << ThreadAllocations - Allocations << " allocations on key press");
+#endif
+
+                if(Result && !Passthrough)
+                    return NULL;
             }
         } break;
         case kCGEventMouseMoved:
@@ -82,9 +118,8 @@ CGEventCallback(CGEventTapProxy Proxy, CGEventType Type, CGEventRef Event, void
         {
             if(HasFlags(&KWMSettings, Settings_MouseDrag))
             {
-                CGPoint *Cursor = (CGPoint *) malloc(sizeof(CGPoint));
-                *Cursor = CGEventGetLocation(Event);
-                AXLibConstructEvent(AXEvent_LeftMouseDragged, Cursor, false);
+                CGPoint Cursor = CGEventGetLocation(Event);
+                AXLibConstructPointEvent(AXEvent_LeftMouseDragged, Cursor, false);
             }
         } break;
         default: {} break;
@@ -233,11 +268,13 @@ internal inline bool
 ParseArguments(int argc, char **argv)
 {
     int Option;
-    const char *ShortOptions = "vc:";
+    const char *ShortOptions = "vc:s:p:";
     struct option LongOptions[] =
     {
         {"version", no_argument, NULL, 'v'},
         {"config", required_argument, NULL, 'c'},
+        {"socket", required_argument, NULL, 's'},
+        {"port", required_argument, NULL, 'p'},
         {NULL, 0, NULL, 0}
     };
 
@@ -255,6 +292,16 @@ ParseArguments(int argc, char **argv)
                 DEBUG("Notice: Using config file " << optarg);
                 KWMPath.Config = optarg;
             } break;
+            case 's':
+            {
+                DEBUG("Notice: Using socket " << optarg);
+                KwmSetDaemonSocketPath(optarg);
+            } break;
+            case 'p':
+            {
+                DEBUG("Notice: Using TCP port " << optarg);
+                KwmSetDaemonPort(atoi(optarg));
+            } break;
         }
     }
 
@@ -289,6 +336,7 @@ int main(int argc, char **argv)
         Fatal("Error: 'Displays have separate spaces' must be enabled!");
 
     AXLibInit(&AXState);
+    AXLibSetStateChangedCallback(&Callback_KWMEvent_PublishSnapshot);
     AXLibStartEventLoop();
     if(!KwmStartDaemon())
         Fatal("Error: Could not start daemon!");
@@ -3,15 +3,17 @@
 #include "tree.h"
 #include "space.h"
 #include "window.h"
+#include "pool.h"
+#include "geometry.h"
 #include "axlib/axlib.h"
 
-extern std::map<std::string, space_info> WindowTree;
 extern ax_application *FocusedApplication;
 extern kwm_settings KWMSettings;
+extern layout_stats LayoutStats;
 
-tree_node *CreateRootNode()
+tree_node *CreateRootNode(space_info *Space)
 {
-    tree_node *RootNode = (tree_node*) malloc(sizeof(tree_node));
+    tree_node *RootNode = (tree_node*) NodePoolAllocate(&Space->TreeNodePool, sizeof(tree_node));
     memset(RootNode, 0, sizeof(tree_node));
 
     RootNode->WindowID = 0;
@@ -25,9 +27,9 @@ tree_node *CreateRootNode()
     return RootNode;
 }
 
-link_node *CreateLinkNode()
+link_node *CreateLinkNode(space_info *Space)
 {
-    link_node *Link = (link_node*) malloc(sizeof(link_node));
+    link_node *Link = (link_node*) NodePoolAllocate(&Space->LinkNodePool, sizeof(link_node));
     memset(Link, 0, sizeof(link_node));
 
     Link->WindowID = 0;
@@ -37,9 +39,20 @@ link_node *CreateLinkNode()
     return Link;
 }
 
+void FreeTreeNode(space_info *Space, tree_node *Node)
+{
+    NodePoolFree(&Space->TreeNodePool, Node);
+}
+
+void FreeLinkNode(space_info *Space, link_node *Link)
+{
+    NodePoolFree(&Space->LinkNodePool, Link);
+}
+
 tree_node *CreateLeafNode(ax_display *Display, tree_node *Parent, uint32_t WindowID, container_type Type)
 {
-    tree_node *Leaf = (tree_node*) malloc(sizeof(tree_node));
+    space_info *Space = GetSpaceInfo(Display->Space);
+    tree_node *Leaf = (tree_node*) NodePoolAllocate(&Space->TreeNodePool, sizeof(tree_node));
     memset(Leaf, 0, sizeof(tree_node));
 
     Leaf->Parent = Parent;
@@ -56,6 +69,11 @@ tree_node *CreateLeafNode(ax_display *Display, tree_node *Parent, uint32_t Windo
 
 void CreateLeafNodePair(ax_display *Display, tree_node *Parent, uint32_t FirstWindowID, uint32_t SecondWindowID, split_type SplitMode)
 {
+    /* NOTE(koekeishiya): The windows of Parent move to its new children, so the node is left
+                         untouched unless it can actually be split. */
+    if(SplitMode != SPLIT_VERTICAL && SplitMode != SPLIT_HORIZONTAL)
+        return;
+
     Parent->WindowID = 0;
     Parent->SplitMode = SplitMode;
     Parent->SplitRatio = KWMSettings.SplitRatio;
@@ -93,6 +111,7 @@ void CreateLeafNodePair(ax_display *Display, tree_node *Parent, uint32_t FirstWi
         Node->Type = ParentType;
         Node->List = ParentList;
         ResizeLinkNodeContainers(Node);
+        AddNodeTreeToIndex(GetSpaceInfo(Display->Space), Parent);
     }
     else if(SplitMode == SPLIT_HORIZONTAL)
     {
@@ -108,20 +127,14 @@ void CreateLeafNodePair(ax_display *Display, tree_node *Parent, uint32_t FirstWi
         Node->Type = ParentType;
         Node->List = ParentList;
         ResizeLinkNodeContainers(Node);
-    }
-    else
-    {
-        Parent->Parent = NULL;
-        Parent->LeftChild = NULL;
-        Parent->RightChild = NULL;
-        Parent = NULL;
+        AddNodeTreeToIndex(GetSpaceInfo(Display->Space), Parent);
     }
 }
 
 void CreatePseudoNode()
 {
     ax_display *Display = AXLibMainDisplay();
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(!FocusedApplication)
         return;
 
@@ -129,19 +142,20 @@ void CreatePseudoNode()
     if(!Window)
         return;
 
-    tree_node *Node = GetTreeNodeFromWindowID(SpaceInfo->RootNode, Window->ID);
+    tree_node *Node = GetTreeNodeFromWindowID(SpaceInfo, Window->ID);
     if(Node)
     {
         split_type SplitMode = KWMSettings.SplitMode == SPLIT_OPTIMAL ? GetOptimalSplitMode(Node) : KWMSettings.SplitMode;
         CreateLeafNodePair(Display, Node, Node->WindowID, 0, SplitMode);
-        ApplyTreeNodeContainer(Node);
+        ValidateNodeIndex(SpaceInfo);
+        ApplyDirtyTreeNodeContainer(Node);
     }
 }
 
 void RemovePseudoNode()
 {
     ax_display *Display = AXLibMainDisplay();
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(!FocusedApplication)
         return;
 
@@ -149,7 +163,7 @@ void RemovePseudoNode()
     if(!Window)
         return;
 
-    tree_node *Node = GetTreeNodeFromWindowID(SpaceInfo->RootNode, Window->ID);
+    tree_node *Node = GetTreeNodeFromWindowID(SpaceInfo, Window->ID);
     if(Node && Node->Parent)
     {
         tree_node *Parent = Node->Parent;
@@ -158,11 +172,17 @@ void RemovePseudoNode()
             return;
 
         Parent->WindowID = Node->WindowID;
+        Parent->Type = Node->Type;
+        Parent->List = Node->List;
         Parent->LeftChild = NULL;
         Parent->RightChild = NULL;
-        free(Node);
-        free(PseudoNode);
-        ApplyTreeNodeContainer(Parent);
+        AddNodeTreeToIndex(SpaceInfo, Parent);
+        ValidateNodeIndex(SpaceInfo);
+        ResizeLinkNodeContainers(Parent);
+        FreeTreeNode(SpaceInfo, Node);
+        FreeTreeNode(SpaceInfo, PseudoNode);
+        Parent->Dirty = true;
+        ApplyDirtyTreeNodeContainer(Parent);
     }
 }
 
@@ -201,7 +221,7 @@ bool IsRightChild(tree_node *Node)
 void ToggleFocusedNodeSplitMode()
 {
     ax_display *Display = AXLibMainDisplay();
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(!FocusedApplication)
         return;
 
@@ -209,7 +229,7 @@ void ToggleFocusedNodeSplitMode()
     if(!Window)
         return;
 
-    tree_node *Node = GetTreeNodeFromWindowID(SpaceInfo->RootNode, Window->ID);
+    tree_node *Node = GetTreeNodeFromWindowID(SpaceInfo, Window->ID);
     if(!Node)
         return;
 
@@ -218,8 +238,9 @@ void ToggleFocusedNodeSplitMode()
         return;
 
     Parent->SplitMode = Parent->SplitMode == SPLIT_VERTICAL ? SPLIT_HORIZONTAL : SPLIT_VERTICAL;
+    Parent->Dirty = true;
     CreateNodeContainers(Display, Parent, false);
-    ApplyTreeNodeContainer(Parent);
+    ApplyDirtyTreeNodeContainer(Parent);
 }
 
 void ToggleTypeOfFocusedNode()
@@ -232,8 +253,8 @@ void ToggleTypeOfFocusedNode()
     if(!Display)
         return;
 
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
-    tree_node *TreeNode = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo->RootNode, Window->ID);
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
+    tree_node *TreeNode = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo, Window->ID);
     if(TreeNode && TreeNode != SpaceInfo->RootNode)
         TreeNode->Type = TreeNode->Type == NodeTypeTree ? NodeTypeLink : NodeTypeTree;
 }
@@ -248,17 +269,27 @@ void ChangeTypeOfFocusedNode(node_type Type)
     if(!Display)
         return;
 
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
-    tree_node *TreeNode = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo->RootNode, Window->ID);
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
+    tree_node *TreeNode = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo, Window->ID);
     if(TreeNode && TreeNode != SpaceInfo->RootNode)
         TreeNode->Type = Type;
 }
 
-void SwapNodeWindowIDs(tree_node *A, tree_node *B)
+void SwapNodeWindowIDs(space_info *Space, tree_node *A, tree_node *B)
+{
+    SwapNodeWindowIDs(Space, A, Space, B);
+}
+
+/* NOTE(koekeishiya): A and B can belong to the trees of different spaces, when a
+                     window is swapped with one on another display. */
+void SwapNodeWindowIDs(space_info *SpaceA, tree_node *A, space_info *SpaceB, tree_node *B)
 {
     if(A && B)
     {
         DEBUG("SwapNodeWindowIDs() " << A->WindowID << " with " << B->WindowID);
+        RemoveNodeTreeFromIndex(SpaceA, A);
+        RemoveNodeTreeFromIndex(SpaceB, B);
+
         int TempWindowID = A->WindowID;
         A->WindowID = B->WindowID;
         B->WindowID = TempWindowID;
@@ -271,6 +302,11 @@ void SwapNodeWindowIDs(tree_node *A, tree_node *B)
         A->List = B->List;
         B->List = TempLinkList;
 
+        AddNodeTreeToIndex(SpaceA, A);
+        AddNodeTreeToIndex(SpaceB, B);
+        ValidateNodeIndex(SpaceA);
+        ValidateNodeIndex(SpaceB);
+
         ResizeLinkNodeContainers(A);
         ResizeLinkNodeContainers(B);
         ApplyTreeNodeContainer(A);
@@ -278,14 +314,21 @@ void SwapNodeWindowIDs(tree_node *A, tree_node *B)
     }
 }
 
-void SwapNodeWindowIDs(link_node *A, link_node *B)
+void SwapNodeWindowIDs(space_info *Space, link_node *A, link_node *B)
 {
     if(A && B)
     {
         DEBUG("SwapNodeWindowIDs() " << A->WindowID << " with " << B->WindowID);
+        tree_node *RootA = GetTreeNodeFromLink(Space, A);
+        tree_node *RootB = GetTreeNodeFromLink(Space, B);
+
         int TempWindowID = A->WindowID;
         A->WindowID = B->WindowID;
         B->WindowID = TempWindowID;
+
+        AddLinkNodeToIndex(Space, RootA, A);
+        AddLinkNodeToIndex(Space, RootB, B);
+        ValidateNodeIndex(Space);
         ResizeWindowToContainerSize(A);
         ResizeWindowToContainerSize(B);
     }
@@ -293,7 +336,8 @@ void SwapNodeWindowIDs(link_node *A, link_node *B)
 
 split_type GetOptimalSplitMode(tree_node *Node)
 {
-    return (Node->Container.Width / Node->Container.Height) >= KWMSettings.OptimalRatio ? SPLIT_VERTICAL : SPLIT_HORIZONTAL;
+    geometry_rect Rect = { Node->Container.X, Node->Container.Y, Node->Container.Width, Node->Container.Height };
+    return GeometryOptimalSplit(Rect, KWMSettings.OptimalRatio) == GeometrySplit_Vertical ? SPLIT_VERTICAL : SPLIT_HORIZONTAL;
 }
 
 void ResizeWindowToContainerSize(tree_node *Node)
@@ -301,6 +345,7 @@ void ResizeWindowToContainerSize(tree_node *Node)
     ax_window *Window = GetWindowByID((unsigned int)Node->WindowID);
     if(Window)
     {
+        __atomic_add_fetch(&LayoutStats.WindowsTouched, 1, __ATOMIC_RELAXED);
         SetWindowDimensions(Window, Node->Container.X, Node->Container.Y,
                             Node->Container.Width, Node->Container.Height);
     }
@@ -311,6 +356,7 @@ void ResizeWindowToContainerSize(link_node *Link)
     ax_window *Window = GetWindowByID((unsigned int)Link->WindowID);
     if(Window)
     {
+        __atomic_add_fetch(&LayoutStats.WindowsTouched, 1, __ATOMIC_RELAXED);
         SetWindowDimensions(Window, Link->Container.X, Link->Container.Y,
                             Link->Container.Width, Link->Container.Height);
     }
@@ -328,14 +374,14 @@ void ResizeWindowToContainerSize(ax_window *Window)
         if(!Display)
             return;
 
-        space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
-        tree_node *Node = GetTreeNodeFromWindowID(SpaceInfo->RootNode, Window->ID);
+        space_info *SpaceInfo = GetSpaceInfo(Display->Space);
+        tree_node *Node = GetTreeNodeFromWindowID(SpaceInfo, Window->ID);
         if(Node)
             ResizeWindowToContainerSize(Node);
 
         if(!Node)
         {
-            link_node *Link = GetLinkNodeFromWindowID(SpaceInfo->RootNode, Window->ID);
+            link_node *Link = GetLinkNodeFromWindowID(SpaceInfo, Window->ID);
             if(Link)
                 ResizeWindowToContainerSize(Link);
         }
@@ -364,20 +410,21 @@ void ModifyContainerSplitRatio(double Offset)
     if(!Display)
         return;
 
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     tree_node *Root = SpaceInfo->RootNode;
     if(!Root || IsLeafNode(Root) || Root->WindowID != 0)
         return;
 
-    tree_node *Node = GetTreeNodeFromWindowIDOrLinkNode(Root, Window->ID);
+    tree_node *Node = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo, Window->ID);
     if(Node && Node->Parent)
     {
         if(Node->Parent->SplitRatio + Offset > 0.0 &&
            Node->Parent->SplitRatio + Offset < 1.0)
         {
             Node->Parent->SplitRatio += Offset;
+            Node->Parent->Dirty = true;
             ResizeNodeContainer(Display, Node->Parent);
-            ApplyTreeNodeContainer(Node->Parent);
+            ApplyDirtyTreeNodeContainer(Node->Parent);
         }
     }
 }
@@ -395,18 +442,18 @@ void ModifyContainerSplitRatio(double Offset, int Degrees)
     if(!Display)
         return;
 
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     tree_node *Root = SpaceInfo->RootNode;
     if(!Root || IsLeafNode(Root) || Root->WindowID != 0)
         return;
 
-    tree_node *Node = GetTreeNodeFromWindowIDOrLinkNode(Root, Window->ID);
+    tree_node *Node = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo, Window->ID);
     if(Node)
     {
         ax_window *ClosestWindow = NULL;
         if(FindClosestWindow(Degrees, &ClosestWindow, false))
         {
-            tree_node *Target = GetTreeNodeFromWindowIDOrLinkNode(Root, ClosestWindow->ID);
+            tree_node *Target = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo, ClosestWindow->ID);
             tree_node *Ancestor = FindLowestCommonAncestor(Node, Target);
 
             if(Ancestor)
@@ -418,8 +465,9 @@ void ModifyContainerSplitRatio(double Offset, int Degrees)
                    Ancestor->SplitRatio + Offset < 1.0)
                 {
                     Ancestor->SplitRatio += Offset;
+                    Ancestor->Dirty = true;
                     ResizeNodeContainer(Display, Ancestor);
-                    ApplyTreeNodeContainer(Ancestor);
+                    ApplyDirtyTreeNodeContainer(Ancestor);
                 }
             }
         }
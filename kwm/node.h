@@ -5,8 +5,10 @@
 #include "axlib/display.h"
 #include "axlib/window.h"
 
-tree_node *CreateRootNode();
-link_node *CreateLinkNode();
+tree_node *CreateRootNode(space_info *Space);
+link_node *CreateLinkNode(space_info *Space);
+void FreeTreeNode(space_info *Space, tree_node *Node);
+void FreeLinkNode(space_info *Space, link_node *Link);
 tree_node *CreateLeafNode(ax_display *Display, tree_node *Parent, uint32_t WindowID, container_type Type);
 void CreateLeafNodePair(ax_display *Display, tree_node *Parent, uint32_t FirstWindowID, uint32_t SecondWindowID, split_type SplitMode);
 void CreatePseudoNode();
@@ -16,8 +18,9 @@ bool IsPseudoNode(tree_node *Node);
 bool IsLeftChild(tree_node *Node);
 bool IsRightChild(tree_node *Node);
 void ToggleFocusedNodeSplitMode();
-void SwapNodeWindowIDs(tree_node *A, tree_node *B);
-void SwapNodeWindowIDs(link_node *A, link_node *B);
+void SwapNodeWindowIDs(space_info *Space, tree_node *A, tree_node *B);
+void SwapNodeWindowIDs(space_info *SpaceA, tree_node *A, space_info *SpaceB, tree_node *B);
+void SwapNodeWindowIDs(space_info *Space, link_node *A, link_node *B);
 split_type GetOptimalSplitMode(tree_node *Node);
 void ResizeWindowToContainerSize(tree_node *Node);
 void ResizeWindowToContainerSize(link_node *Node);
@@ -0,0 +1,311 @@
+#include "placement.h"
+#include "window.h"
+#include "event.h"
+#include "axlib/element.h"
+#include "axlib/application.h"
+
+#include <sys/time.h>
+#include <errno.h>
+
+#define internal static
+#define WINDOW_PLACEMENT_WORKERS 4
+#define WINDOW_PLACEMENT_DEADLINE_MS 200
+
+extern layout_stats LayoutStats;
+
+/* NOTE(koekeishiya): Every AX request is a synchronous round trip to the process that owns the window.
+                     While a batch is open (see ApplyTreeNodeContainer), placements are collected and
+                     handed to a small pool of workers with one queue per process, so that requests to
+                     different applications overlap, while requests to the same application keep
+                     their order. The thread that commits the batch waits at most
+                     WINDOW_PLACEMENT_DEADLINE_MS; placements that are still pending after that are
+                     left to the workers and the thread moves on, so a slow application only
+                     delays its own windows. Once the workers are running, every placement goes
+                     through the queue of its process, so a placement can never overtake one that
+                     was abandoned earlier. Abandoned placements are completed on the thread that
+                     owns the window state, after the worker has finished them. */
+struct placement_queue
+{
+    std::queue<window_placement *> Placements;
+    bool Scheduled;
+};
+
+struct placement_batch
+{
+    std::vector<window_placement *> Placements;
+    int Depth;
+};
+
+struct placement_pool
+{
+    pthread_t Workers[WINDOW_PLACEMENT_WORKERS];
+    pthread_mutex_t Lock;
+    pthread_cond_t Work;
+    pthread_cond_t Done;
+    bool Running;
+
+    std::map<pid_t, placement_queue> Queues;
+    std::queue<pid_t> Ready;
+    std::vector<window_placement *> Finished;
+};
+
+internal placement_pool PlacementPool;
+internal pthread_mutex_t PlacementPoolStartLock = PTHREAD_MUTEX_INITIALIZER;
+internal __thread placement_batch *PlacementBatch;
+
+internal void
+FreeWindowPlacement(window_placement *Placement)
+{
+    CFRelease(Placement->Ref);
+    free(Placement);
+}
+
+internal void
+PlaceWindow(window_placement *Placement)
+{
+    if(Placement->Move)
+    {
+        Placement->Moved = AXLibSetWindowPosition(Placement->Ref, Placement->X, Placement->Y);
+        ++Placement->CallsIssued;
+    }
+
+    if(Placement->Resize)
+    {
+        Placement->Resized = AXLibSetWindowSize(Placement->Ref, Placement->Width, Placement->Height);
+        ++Placement->CallsIssued;
+    }
+
+    Placement->Position = AXLibGetWindowPosition(Placement->Ref);
+    Placement->Size = AXLibGetWindowSize(Placement->Ref);
+}
+
+internal void *
+WindowPlacementWorker(void *)
+{
+    placement_pool *Pool = &PlacementPool;
+    pthread_mutex_lock(&Pool->Lock);
+    while(Pool->Running)
+    {
+        if(Pool->Ready.empty())
+        {
+            pthread_cond_wait(&Pool->Work, &Pool->Lock);
+            continue;
+        }
+
+        pid_t PID = Pool->Ready.front();
+        Pool->Ready.pop();
+
+        placement_queue *Queue = &Pool->Queues[PID];
+        while(!Queue->Placements.empty())
+        {
+            window_placement *Placement = Queue->Placements.front();
+            Queue->Placements.pop();
+
+            pthread_mutex_unlock(&Pool->Lock);
+            PlaceWindow(Placement);
+            pthread_mutex_lock(&Pool->Lock);
+
+            Placement->Done = true;
+            if(Placement->Abandoned)
+            {
+                Pool->Finished.push_back(Placement);
+                pthread_mutex_unlock(&Pool->Lock);
+                KwmConstructEvent(KWMEvent_PlacementFinished, NULL);
+                pthread_mutex_lock(&Pool->Lock);
+            }
+            else
+            {
+                pthread_cond_broadcast(&Pool->Done);
+            }
+        }
+
+        Pool->Queues.erase(PID);
+    }
+
+    pthread_mutex_unlock(&Pool->Lock);
+    return NULL;
+}
+
+internal bool
+StartWindowPlacementWorkers()
+{
+    placement_pool *Pool = &PlacementPool;
+    pthread_mutex_lock(&PlacementPoolStartLock);
+    if(!Pool->Running)
+    {
+        pthread_mutex_init(&Pool->Lock, NULL);
+        pthread_cond_init(&Pool->Work, NULL);
+        pthread_cond_init(&Pool->Done, NULL);
+        Pool->Running = true;
+
+        for(int Index = 0; Index < WINDOW_PLACEMENT_WORKERS; ++Index)
+        {
+            if(pthread_create(&Pool->Workers[Index], NULL, &WindowPlacementWorker, NULL) != 0)
+            {
+                /* NOTE(koekeishiya): Without any worker every batch is placed on the calling thread. */
+                if(Index == 0)
+                    Pool->Running = false;
+
+                break;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&PlacementPoolStartLock);
+    return Pool->Running;
+}
+
+internal void
+CompleteWindowPlacements(std::vector<window_placement *> &Placements)
+{
+    for(std::size_t Index = 0; Index < Placements.size(); ++Index)
+    {
+        window_placement *Placement = Placements[Index];
+        CompleteWindowPlacement(GetWindowByID(Placement->WindowID), Placement);
+        FreeWindowPlacement(Placement);
+    }
+}
+
+/* NOTE(koekeishiya): Abandoned placements are completed in the order the workers finished them,
+                     which for a single window is the order they were queued in. */
+internal void
+CompleteFinishedWindowPlacements()
+{
+    placement_pool *Pool = &PlacementPool;
+    if(!Pool->Running)
+        return;
+
+    std::vector<window_placement *> Finished;
+    pthread_mutex_lock(&Pool->Lock);
+    Finished.swap(Pool->Finished);
+    pthread_mutex_unlock(&Pool->Lock);
+
+    CompleteWindowPlacements(Finished);
+}
+
+EVENT_CALLBACK(Callback_KWMEvent_PlacementFinished)
+{
+    CompleteFinishedWindowPlacements();
+}
+
+internal bool
+PlacementBatchHasMultipleApplications(std::vector<window_placement *> &Placements)
+{
+    for(std::size_t Index = 1; Index < Placements.size(); ++Index)
+    {
+        if(Placements[Index]->PID != Placements[0]->PID)
+            return true;
+    }
+
+    return false;
+}
+
+internal void
+RunPlacementBatch(std::vector<window_placement *> &Placements)
+{
+    placement_pool *Pool = &PlacementPool;
+    if((!Pool->Running) &&
+       (!PlacementBatchHasMultipleApplications(Placements) ||
+        !StartWindowPlacementWorkers()))
+    {
+        for(std::size_t Index = 0; Index < Placements.size(); ++Index)
+            PlaceWindow(Placements[Index]);
+
+        CompleteWindowPlacements(Placements);
+        return;
+    }
+
+    pthread_mutex_lock(&Pool->Lock);
+    for(std::size_t Index = 0; Index < Placements.size(); ++Index)
+    {
+        window_placement *Placement = Placements[Index];
+        placement_queue *Queue = &Pool->Queues[Placement->PID];
+        Queue->Placements.push(Placement);
+        if(!Queue->Scheduled)
+        {
+            Queue->Scheduled = true;
+            Pool->Ready.push(Placement->PID);
+        }
+    }
+
+    pthread_cond_broadcast(&Pool->Work);
+
+    struct timeval Now;
+    gettimeofday(&Now, NULL);
+    long Nanoseconds = (Now.tv_usec * 1000) + (WINDOW_PLACEMENT_DEADLINE_MS * 1000000L);
+
+    struct timespec Deadline;
+    Deadline.tv_sec = Now.tv_sec + (Nanoseconds / 1000000000L);
+    Deadline.tv_nsec = Nanoseconds % 1000000000L;
+
+    bool Finished = true;
+    for(std::size_t Index = 0; Index < Placements.size(); ++Index)
+    {
+        while(!Placements[Index]->Done)
+        {
+            if(pthread_cond_timedwait(&Pool->Done, &Pool->Lock, &Deadline) == ETIMEDOUT)
+            {
+                Finished = false;
+                break;
+            }
+        }
+
+        if(!Finished)
+            break;
+    }
+
+    std::vector<window_placement *> Completed;
+    for(std::size_t Index = 0; Index < Placements.size(); ++Index)
+    {
+        window_placement *Placement = Placements[Index];
+        if(Placement->Done)
+        {
+            Completed.push_back(Placement);
+        }
+        else
+        {
+            Placement->Abandoned = true;
+            __atomic_add_fetch(&LayoutStats.PlacementsAbandoned, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    pthread_mutex_unlock(&Pool->Lock);
+    CompleteFinishedWindowPlacements();
+    CompleteWindowPlacements(Completed);
+}
+
+void BeginWindowPlacementBatch()
+{
+    if(!PlacementBatch)
+        PlacementBatch = new placement_batch();
+
+    ++PlacementBatch->Depth;
+}
+
+bool QueueWindowPlacement(ax_window *Window, window_placement *Placement)
+{
+    if(!PlacementBatch || PlacementBatch->Depth == 0)
+        return false;
+
+    window_placement *Queued = (window_placement *) malloc(sizeof(window_placement));
+    *Queued = *Placement;
+    Queued->Ref = (AXUIElementRef) CFRetain(Window->Ref);
+    Queued->WindowID = Window->ID;
+    Queued->PID = Window->Application->PID;
+
+    PlacementBatch->Placements.push_back(Queued);
+    return true;
+}
+
+void CommitWindowPlacementBatch()
+{
+    if(!PlacementBatch || PlacementBatch->Depth == 0)
+        return;
+
+    if(--PlacementBatch->Depth == 0 && !PlacementBatch->Placements.empty())
+    {
+        std::vector<window_placement *> Placements;
+        Placements.swap(PlacementBatch->Placements);
+        RunPlacementBatch(Placements);
+    }
+}
@@ -0,0 +1,11 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include "types.h"
+#include "axlib/window.h"
+
+void BeginWindowPlacementBatch();
+bool QueueWindowPlacement(ax_window *Window, window_placement *Placement);
+void CommitWindowPlacementBatch();
+
+#endif
@@ -0,0 +1,82 @@
+#include "pool.h"
+
+#define internal static
+#define NODE_POOL_SLAB_COUNT 64
+
+/* NOTE(koekeishiya): A node_pool hands out fixed-size objects from slabs of NODE_POOL_SLAB_COUNT
+                     objects, so that the nodes of a tree are kept close together in memory.
+                     Freed objects go on a free-list and are reused before the next slab is touched.
+                     Slabs are never returned to the system; resetting a pool makes all of its
+                     slabs available again without freeing the individual objects. */
+internal std::size_t
+NodePoolObjectSize(std::size_t Size)
+{
+    std::size_t Alignment = sizeof(void *) * 2;
+    if(Size < sizeof(void *))
+        Size = sizeof(void *);
+
+    return (Size + Alignment - 1) & ~(Alignment - 1);
+}
+
+void *NodePoolAllocate(node_pool *Pool, std::size_t Size)
+{
+    if(!Pool->ObjectSize)
+        Pool->ObjectSize = NodePoolObjectSize(Size);
+
+    Assert(Pool->ObjectSize >= Size);
+
+    void *Object = NULL;
+    if(Pool->FreeList)
+    {
+        Object = Pool->FreeList;
+        Pool->FreeList = *(void **) Object;
+    }
+    else
+    {
+        if(Pool->SlabOffset == NODE_POOL_SLAB_COUNT)
+        {
+            ++Pool->SlabIndex;
+            Pool->SlabOffset = 0;
+        }
+
+        if(Pool->SlabIndex == Pool->Slabs.size())
+        {
+            char *Slab = (char *) malloc(Pool->ObjectSize * NODE_POOL_SLAB_COUNT);
+            if(!Slab)
+                return NULL;
+
+            Pool->Slabs.push_back(Slab);
+        }
+
+        Object = Pool->Slabs[Pool->SlabIndex] + (Pool->SlabOffset++ * Pool->ObjectSize);
+    }
+
+    ++Pool->Allocations;
+    ++Pool->TotalAllocations;
+    return Object;
+}
+
+void NodePoolFree(node_pool *Pool, void *Object)
+{
+    if(Object)
+    {
+        *(void **) Object = Pool->FreeList;
+        Pool->FreeList = Object;
+
+        Assert(Pool->Allocations > 0);
+        --Pool->Allocations;
+    }
+}
+
+void NodePoolReset(node_pool *Pool)
+{
+    Pool->FreeList = NULL;
+    Pool->SlabIndex = 0;
+    Pool->SlabOffset = 0;
+    Pool->Allocations = 0;
+}
+
+std::size_t NodePoolReservedBytes(node_pool *Pool)
+{
+    return Pool->Slabs.size() * NODE_POOL_SLAB_COUNT * Pool->ObjectSize;
+}
@@ -0,0 +1,11 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "types.h"
+
+void *NodePoolAllocate(node_pool *Pool, std::size_t Size);
+void NodePoolFree(node_pool *Pool, void *Object);
+void NodePoolReset(node_pool *Pool);
+std::size_t NodePoolReservedBytes(node_pool *Pool);
+
+#endif
@@ -4,13 +4,18 @@
 #include "daemon.h"
 #include "tree.h"
 #include "node.h"
+#include "pool.h"
+#include "snapshot.h"
+#include "json.h"
+#include "event.h"
 
 #include "axlib/axlib.h"
 
 #define internal static
 
-extern std::map<std::string, space_info> WindowTree;
 extern ax_window *MarkedWindow;
+extern ax_state AXState;
+extern kwm_hotkeys KWMHotkeys;
 
 extern kwm_settings KWMSettings;
 extern kwm_border FocusedBorder;
@@ -28,8 +33,8 @@ GetSplitModeOfWindow(ax_window *Window)
     if(!Display)
         return "";
 
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
-    tree_node *Node = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo->RootNode, Window->ID);
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
+    tree_node *Node = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo, Window->ID);
     if(Node)
     {
         if(Node->SplitMode == SPLIT_VERTICAL)
@@ -85,6 +90,84 @@ EVENT_CALLBACK(Callback_KWMEvent_QuerySplitRatio)
     free(SockFD);
 }
 
+EVENT_CALLBACK(Callback_KWMEvent_QueryLayoutStats)
+{
+    int *SockFD = (int *) Event->Context;
+    layout_stats Stats;
+    GetLayoutStats(&Stats);
+
+    std::string Output = "last: " + std::to_string(Stats.LastNodesRecomputed) + " nodes recomputed, " +
+                                    std::to_string(Stats.LastWindowsTouched) + " windows touched\n" +
+                         "total: " + std::to_string(Stats.TotalNodesRecomputed) + " nodes recomputed, " +
+                                     std::to_string(Stats.TotalWindowsTouched) + " windows touched in " +
+                                     std::to_string(Stats.Operations) + " operations\n" +
+                         "ax: " + std::to_string(Stats.AXCallsIssued) + " calls issued, " +
+                                  std::to_string(Stats.AXCallsElided) + " calls elided, " +
+                                  std::to_string(Stats.PlacementsAbandoned) + " placements past deadline";
+
+    KwmWriteToSocket(Output, *SockFD);
+    free(SockFD);
+}
+
+EVENT_CALLBACK(Callback_KWMEvent_QueryRuleCache)
+{
+    int *SockFD = (int *) Event->Context;
+    window_rule_cache *Cache = &KWMSettings.WindowRuleCache;
+
+    std::string Output = "entries: " + std::to_string(Cache->Entries.size()) + "/" +
+                                       std::to_string(WINDOW_RULE_CACHE_SIZE) + "\n" +
+                         "hits: " + std::to_string(Cache->Hits) + ", " +
+                         "misses: " + std::to_string(Cache->Misses) + "\n" +
+                         "evictions: " + std::to_string(Cache->Evictions) + ", " +
+                         "invalidations: " + std::to_string(Cache->Invalidations);
+
+    KwmWriteToSocket(Output, *SockFD);
+    free(SockFD);
+}
+
+/* NOTE(koekeishiya): Only event types that have been seen at least once are listed. */
+EVENT_CALLBACK(Callback_KWMEvent_QueryEventStats)
+{
+    int *SockFD = (int *) Event->Context;
+
+    ax_event_stats Stats;
+    AXLibGetEventStats(&Stats);
+
+    std::string Output;
+    for(int Index = 0; Index < AXEvent_Count; ++Index)
+    {
+        if(Stats.Enqueued[Index] == 0)
+            continue;
+
+        if(!Output.empty())
+            Output += "\n";
+
+        Output += std::string(AXLibEventTypeName((ax_event_type) Index)) + ": " +
+                  std::to_string(Stats.Enqueued[Index]) + " enqueued, " +
+                  std::to_string(Stats.Coalesced[Index]) + " coalesced, " +
+                  std::to_string(Stats.Dispatched[Index]) + " dispatched";
+    }
+
+    if(!Output.empty())
+        Output += "\n";
+
+    Output += "overflow: " + std::to_string(Stats.Spilled) + " spilled, " +
+              std::to_string(Stats.Dropped) + " dropped\n";
+
+    ax_onscreen_stats OnScreen;
+    AXLibGetOnScreenStats(&OnScreen);
+
+    Output += "onscreen_window_list: " + std::to_string(OnScreen.Queries) + " queries, " +
+              std::to_string(OnScreen.Refreshes) + " refreshed, " +
+              std::to_string(2 * (OnScreen.Queries - OnScreen.Refreshes)) + " cgs calls saved\n";
+    Output += "window_below_cursor: " + std::to_string(OnScreen.HitTests) + " queries, " +
+              std::to_string(OnScreen.HitTestRefreshes) + " refreshed, " +
+              std::to_string(OnScreen.HitTests - OnScreen.HitTestRefreshes) + " cg window lists saved";
+
+    KwmWriteToSocket(Output, *SockFD);
+    free(SockFD);
+}
+
 EVENT_CALLBACK(Callback_KWMEvent_QuerySpawnPosition)
 {
     int *SockFD = (int *) Event->Context;
@@ -153,10 +236,24 @@ EVENT_CALLBACK(Callback_KWMEvent_QueryStandbyOnFloat)
     free(SockFD);
 }
 
-EVENT_CALLBACK(Callback_KWMEvent_QuerySpaces)
+/* NOTE(koekeishiya): The queries that are answered from the snapshot. Each answer is computed from
+ *                    state alone, so that the event-loop can publish all of them at once. */
+typedef std::string (snapshot_answer)();
+
+internal void
+KwmWriteSnapshotAnswer(int Query, snapshot_answer *Answer, int *SockFD)
 {
-    int *SockFD = (int *) Event->Context;
+    uint64_t Version = KwmStateVersion();
+    std::string Output = (*Answer)();
+
+    KwmPublishSnapshotAnswer(Query, Version, Output);
+    KwmWriteToSocket(Output, *SockFD);
+    free(SockFD);
+}
 
+internal std::string
+GetSpacesAnswer()
+{
     std::string Output;
     ax_display *Display = AXLibMainDisplay();
     if(Display)
@@ -183,55 +280,71 @@ EVENT_CALLBACK(Callback_KWMEvent_QuerySpaces)
             }
         }
 
-        if(Output[Output.size()-1] == '\n')
+        if(!Output.empty() && Output[Output.size()-1] == '\n')
             Output.erase(Output.begin() + Output.size()-1);
     }
 
-    KwmWriteToSocket(Output, *SockFD);
-    free(SockFD);
+    return Output;
 }
 
-EVENT_CALLBACK(Callback_KWMEvent_QueryCurrentSpaceName)
+EVENT_CALLBACK(Callback_KWMEvent_QuerySpaces)
 {
-    int *SockFD = (int *) Event->Context;
-    std::string Output;
+    KwmWriteSnapshotAnswer(KWMEvent_QuerySpaces, &GetSpacesAnswer, (int *) Event->Context);
+}
 
+internal std::string
+GetCurrentSpaceNameAnswer()
+{
+    std::string Output;
     ax_display *Display = AXLibMainDisplay();
-    Output = GetNameOfSpace(Display, Display->Space);
+    if(Display && Display->Space)
+        Output = GetNameOfSpace(Display, Display->Space);
 
-    KwmWriteToSocket(Output, *SockFD);
-    free(SockFD);
+    return Output;
 }
 
-EVENT_CALLBACK(Callback_KWMEvent_QueryPreviousSpaceName)
+EVENT_CALLBACK(Callback_KWMEvent_QueryCurrentSpaceName)
 {
-    int *SockFD = (int *) Event->Context;
+    KwmWriteSnapshotAnswer(KWMEvent_QueryCurrentSpaceName, &GetCurrentSpaceNameAnswer, (int *) Event->Context);
+}
 
+internal std::string
+GetPreviousSpaceNameAnswer()
+{
     std::string Output;
     ax_display *Display = AXLibMainDisplay();
-    if(Display)
+    if(Display && Display->PrevSpace)
         Output = GetNameOfSpace(Display, Display->PrevSpace);
 
-    KwmWriteToSocket(Output, *SockFD);
-    free(SockFD);
+    return Output;
 }
 
-EVENT_CALLBACK(Callback_KWMEvent_QueryCurrentSpaceMode)
+EVENT_CALLBACK(Callback_KWMEvent_QueryPreviousSpaceName)
 {
-    int *SockFD = (int *) Event->Context;
+    KwmWriteSnapshotAnswer(KWMEvent_QueryPreviousSpaceName, &GetPreviousSpaceNameAnswer, (int *) Event->Context);
+}
 
+internal std::string
+GetCurrentSpaceModeAnswer()
+{
     std::string Output;
-    GetTagForCurrentSpace(Output);
-    KwmWriteToSocket(Output, *SockFD);
-    free(SockFD);
+    if(AXLibMainDisplay())
+        GetTagForCurrentSpace(Output);
+
+    return Output;
 }
 
-EVENT_CALLBACK(Callback_KWMEvent_QueryCurrentSpaceTag)
+EVENT_CALLBACK(Callback_KWMEvent_QueryCurrentSpaceMode)
 {
-    int *SockFD = (int *) Event->Context;
+    KwmWriteSnapshotAnswer(KWMEvent_QueryCurrentSpaceMode, &GetCurrentSpaceModeAnswer, (int *) Event->Context);
+}
 
+internal std::string
+GetCurrentSpaceTagAnswer()
+{
     std::string Output;
-    GetTagForCurrentSpace(Output);
+    if(AXLibMainDisplay())
+        GetTagForCurrentSpace(Output);
 
     ax_application *Application = AXLibGetFocusedApplication();
     if(Application)
@@ -242,36 +355,71 @@ EVENT_CALLBACK(Callback_KWMEvent_QueryCurrentSpaceTag)
             Output += " - " + std::string(Window->Name);
     }
 
-    KwmWriteToSocket(Output, *SockFD);
-    free(SockFD);
+    return Output;
 }
 
-EVENT_CALLBACK(Callback_KWMEvent_QueryCurrentSpaceId)
+EVENT_CALLBACK(Callback_KWMEvent_QueryCurrentSpaceTag)
 {
-    int *SockFD = (int *) Event->Context;
+    KwmWriteSnapshotAnswer(KWMEvent_QueryCurrentSpaceTag, &GetCurrentSpaceTagAnswer, (int *) Event->Context);
+}
 
+internal std::string
+GetCurrentSpaceIdAnswer()
+{
     std::string Output = "-1";
     ax_display *Display = AXLibMainDisplay();
     if(Display)
         Output = std::to_string(AXLibDesktopIDFromCGSSpaceID(Display, Display->Space->ID));
 
-    KwmWriteToSocket(Output, *SockFD);
-    free(SockFD);
+    return Output;
 }
 
-EVENT_CALLBACK(Callback_KWMEvent_QueryPreviousSpaceId)
+EVENT_CALLBACK(Callback_KWMEvent_QueryCurrentSpaceId)
+{
+    KwmWriteSnapshotAnswer(KWMEvent_QueryCurrentSpaceId, &GetCurrentSpaceIdAnswer, (int *) Event->Context);
+}
+
+internal std::string
+GetNodePoolStatistics(std::string Name, node_pool *Pool)
+{
+    return Name + ": " + std::to_string(Pool->Allocations) + " live, " +
+                         std::to_string(Pool->TotalAllocations) + " allocated, " +
+                         std::to_string(NodePoolReservedBytes(Pool)) + " bytes reserved";
+}
+
+EVENT_CALLBACK(Callback_KWMEvent_QueryCurrentSpacePool)
 {
     int *SockFD = (int *) Event->Context;
 
-    std::string Output = "-1";
+    std::string Output;
     ax_display *Display = AXLibMainDisplay();
     if(Display)
-        Output = std::to_string(AXLibDesktopIDFromCGSSpaceID(Display, Display->PrevSpace->ID));
+    {
+        space_info *SpaceInfo = GetSpaceInfo(Display->Space);
+        Output = GetNodePoolStatistics("tree_node", &SpaceInfo->TreeNodePool) + "\n" +
+                 GetNodePoolStatistics("link_node", &SpaceInfo->LinkNodePool);
+    }
 
     KwmWriteToSocket(Output, *SockFD);
     free(SockFD);
 }
 
+internal std::string
+GetPreviousSpaceIdAnswer()
+{
+    std::string Output = "-1";
+    ax_display *Display = AXLibMainDisplay();
+    if(Display && Display->PrevSpace)
+        Output = std::to_string(AXLibDesktopIDFromCGSSpaceID(Display, Display->PrevSpace->ID));
+
+    return Output;
+}
+
+EVENT_CALLBACK(Callback_KWMEvent_QueryPreviousSpaceId)
+{
+    KwmWriteSnapshotAnswer(KWMEvent_QueryPreviousSpaceId, &GetPreviousSpaceIdAnswer, (int *) Event->Context);
+}
+
 EVENT_CALLBACK(Callback_KWMEvent_QueryFocusedBorder)
 {
     int *SockFD = (int *) Event->Context;
@@ -290,88 +438,101 @@ EVENT_CALLBACK(Callback_KWMEvent_QueryMarkedBorder)
     free(SockFD);
 }
 
-EVENT_CALLBACK(Callback_KWMEvent_QueryFocusedWindowId)
+internal std::string
+GetFocusedWindowIdAnswer()
 {
-    int *SockFD = (int *) Event->Context;
+    ax_application *Application = AXLibGetFocusedApplication();
+    return Application && Application->Focus ? std::to_string(Application->Focus->ID) : "-1";
+}
 
+EVENT_CALLBACK(Callback_KWMEvent_QueryFocusedWindowId)
+{
+    KwmWriteSnapshotAnswer(KWMEvent_QueryFocusedWindowId, &GetFocusedWindowIdAnswer, (int *) Event->Context);
+}
 
+internal std::string
+GetFocusedWindowNameAnswer()
+{
     ax_application *Application = AXLibGetFocusedApplication();
-    std::string Output = Application && Application->Focus ? std::to_string(Application->Focus->ID) : "-1";
-    KwmWriteToSocket(Output, *SockFD);
-    free(SockFD);
+    return Application && Application->Focus && Application->Focus->Name ? Application->Focus->Name : "";
 }
 
 EVENT_CALLBACK(Callback_KWMEvent_QueryFocusedWindowName)
 {
-    int *SockFD = (int *) Event->Context;
-
+    KwmWriteSnapshotAnswer(KWMEvent_QueryFocusedWindowName, &GetFocusedWindowNameAnswer, (int *) Event->Context);
+}
 
+internal std::string
+GetFocusedWindowSplitAnswer()
+{
     ax_application *Application = AXLibGetFocusedApplication();
-    std::string Output = Application && Application->Focus ? Application->Focus->Name : "";
-    KwmWriteToSocket(Output, *SockFD);
-    free(SockFD);
+    return Application ? GetSplitModeOfWindow(Application->Focus) : "";
 }
 
 EVENT_CALLBACK(Callback_KWMEvent_QueryFocusedWindowSplit)
 {
-    int *SockFD = (int *) Event->Context;
+    KwmWriteSnapshotAnswer(KWMEvent_QueryFocusedWindowSplit, &GetFocusedWindowSplitAnswer, (int *) Event->Context);
+}
 
+internal std::string
+GetFocusedWindowFloatAnswer()
+{
     ax_application *Application = AXLibGetFocusedApplication();
-    std::string Output = Application ? GetSplitModeOfWindow(Application->Focus) : "";
-    KwmWriteToSocket(Output, *SockFD);
-    free(SockFD);
+    return Application && Application->Focus ? (AXLibHasFlags(Application->Focus, AXWindow_Floating) ? "true" : "false") : "false";
 }
 
 EVENT_CALLBACK(Callback_KWMEvent_QueryFocusedWindowFloat)
 {
-    int *SockFD = (int *) Event->Context;
+    KwmWriteSnapshotAnswer(KWMEvent_QueryFocusedWindowFloat, &GetFocusedWindowFloatAnswer, (int *) Event->Context);
+}
 
-    ax_application *Application = AXLibGetFocusedApplication();
-    std::string Output = Application && Application->Focus ? (AXLibHasFlags(Application->Focus, AXWindow_Floating) ? "true" : "false") : "false";
-    KwmWriteToSocket(Output, *SockFD);
-    free(SockFD);
+internal std::string
+GetMarkedWindowIdAnswer()
+{
+    return MarkedWindow ? std::to_string(MarkedWindow->ID) : "-1";
 }
 
 EVENT_CALLBACK(Callback_KWMEvent_QueryMarkedWindowId)
 {
-    int *SockFD = (int *) Event->Context;
+    KwmWriteSnapshotAnswer(KWMEvent_QueryMarkedWindowId, &GetMarkedWindowIdAnswer, (int *) Event->Context);
+}
 
-    std::string Output = MarkedWindow ? std::to_string(MarkedWindow->ID) : "-1";
-    KwmWriteToSocket(Output, *SockFD);
-    free(SockFD);
+internal std::string
+GetMarkedWindowNameAnswer()
+{
+    return MarkedWindow && MarkedWindow->Name ? MarkedWindow->Name : "";
 }
 
 EVENT_CALLBACK(Callback_KWMEvent_QueryMarkedWindowName)
 {
-    int *SockFD = (int *) Event->Context;
+    KwmWriteSnapshotAnswer(KWMEvent_QueryMarkedWindowName, &GetMarkedWindowNameAnswer, (int *) Event->Context);
+}
 
-    std::string Output = MarkedWindow && MarkedWindow->Name ? MarkedWindow->Name : "";
-    KwmWriteToSocket(Output, *SockFD);
-    free(SockFD);
+internal std::string
+GetMarkedWindowSplitAnswer()
+{
+    return GetSplitModeOfWindow(MarkedWindow);
 }
 
 EVENT_CALLBACK(Callback_KWMEvent_QueryMarkedWindowSplit)
 {
-    int *SockFD = (int *) Event->Context;
+    KwmWriteSnapshotAnswer(KWMEvent_QueryMarkedWindowSplit, &GetMarkedWindowSplitAnswer, (int *) Event->Context);
+}
 
-    std::string Output = GetSplitModeOfWindow(MarkedWindow);
-    KwmWriteToSocket(Output, *SockFD);
-    free(SockFD);
+internal std::string
+GetMarkedWindowFloatAnswer()
+{
+    return MarkedWindow ? (AXLibHasFlags(MarkedWindow, AXWindow_Floating) ? "true" : "false") : "";
 }
 
 EVENT_CALLBACK(Callback_KWMEvent_QueryMarkedWindowFloat)
 {
-    int *SockFD = (int *) Event->Context;
-
-    std::string Output = MarkedWindow ? (AXLibHasFlags(MarkedWindow, AXWindow_Floating) ? "true" : "false") : "";
-    KwmWriteToSocket(Output, *SockFD);
-    free(SockFD);
+    KwmWriteSnapshotAnswer(KWMEvent_QueryMarkedWindowFloat, &GetMarkedWindowFloatAnswer, (int *) Event->Context);
 }
 
-EVENT_CALLBACK(Callback_KWMEvent_QueryWindowList)
+internal std::string
+GetWindowListAnswer()
 {
-    int *SockFD = (int *) Event->Context;
-
     std::string Output;
     std::vector<ax_window *> Windows = AXLibGetAllVisibleWindows();
     for(std::size_t Index = 0; Index < Windows.size(); ++Index)
@@ -384,8 +545,53 @@ EVENT_CALLBACK(Callback_KWMEvent_QueryWindowList)
             Output += "\n";
     }
 
-    KwmWriteToSocket(Output, *SockFD);
-    free(SockFD);
+    return Output;
+}
+
+EVENT_CALLBACK(Callback_KWMEvent_QueryWindowList)
+{
+    KwmWriteSnapshotAnswer(KWMEvent_QueryWindowList, &GetWindowListAnswer, (int *) Event->Context);
+}
+
+struct snapshot_query
+{
+    int Query;
+    snapshot_answer *Answer;
+};
+
+internal snapshot_query SnapshotQueries[] =
+{
+    { KWMEvent_QuerySpaces, &GetSpacesAnswer },
+    { KWMEvent_QueryCurrentSpaceName, &GetCurrentSpaceNameAnswer },
+    { KWMEvent_QueryPreviousSpaceName, &GetPreviousSpaceNameAnswer },
+    { KWMEvent_QueryCurrentSpaceMode, &GetCurrentSpaceModeAnswer },
+    { KWMEvent_QueryCurrentSpaceTag, &GetCurrentSpaceTagAnswer },
+    { KWMEvent_QueryCurrentSpaceId, &GetCurrentSpaceIdAnswer },
+    { KWMEvent_QueryPreviousSpaceId, &GetPreviousSpaceIdAnswer },
+    { KWMEvent_QueryFocusedWindowId, &GetFocusedWindowIdAnswer },
+    { KWMEvent_QueryFocusedWindowName, &GetFocusedWindowNameAnswer },
+    { KWMEvent_QueryFocusedWindowSplit, &GetFocusedWindowSplitAnswer },
+    { KWMEvent_QueryFocusedWindowFloat, &GetFocusedWindowFloatAnswer },
+    { KWMEvent_QueryMarkedWindowId, &GetMarkedWindowIdAnswer },
+    { KWMEvent_QueryMarkedWindowName, &GetMarkedWindowNameAnswer },
+    { KWMEvent_QueryMarkedWindowSplit, &GetMarkedWindowSplitAnswer },
+    { KWMEvent_QueryMarkedWindowFloat, &GetMarkedWindowFloatAnswer },
+    { KWMEvent_QueryWindowList, &GetWindowListAnswer },
+};
+
+/* NOTE(koekeishiya): Runs on the event-loop after a batch of events that changed state, and is
+ *                    queued by every command that did. Several changes in a row publish once. */
+EVENT_CALLBACK(Callback_KWMEvent_PublishSnapshot)
+{
+    if(KwmSnapshotIsCurrent())
+        return;
+
+    uint64_t Version = KwmStateVersion();
+    std::map<int, std::string> Answers;
+    for(std::size_t Index = 0; Index < sizeof(SnapshotQueries) / sizeof(SnapshotQueries[0]); ++Index)
+        Answers[SnapshotQueries[Index].Query] = (*SnapshotQueries[Index].Answer)();
+
+    KwmPublishSnapshot(Version, Answers);
 }
 
 EVENT_CALLBACK(Callback_KWMEvent_QueryNodePosition)
@@ -398,8 +604,8 @@ EVENT_CALLBACK(Callback_KWMEvent_QueryNodePosition)
     ax_display *Display = AXLibMainDisplay();
     if(Display)
     {
-        space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
-        tree_node *Node = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo->RootNode, WindowID);
+        space_info *SpaceInfo = GetSpaceInfo(Display->Space);
+        tree_node *Node = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo, WindowID);
         if(Node)
             Output = IsLeftChild(Node) ? "left" : "right";
     }
@@ -419,9 +625,9 @@ EVENT_CALLBACK(Callback_KWMEvent_QueryParentNodeState)
     ax_display *Display = AXLibMainDisplay();
     if(Display)
     {
-        space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
-        tree_node *FirstNode = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo->RootNode, FirstID);
-        tree_node *SecondNode = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo->RootNode, SecondID);
+        space_info *SpaceInfo = GetSpaceInfo(Display->Space);
+        tree_node *FirstNode = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo, FirstID);
+        tree_node *SecondNode = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo, SecondID);
         if(FirstNode && SecondNode)
             Output = SecondNode->Parent == FirstNode->Parent ? "true" : "false";
     }
@@ -467,3 +673,208 @@ EVENT_CALLBACK(Callback_KWMEvent_QueryScratchpad)
     KwmWriteToSocket(Result, *SockFD);
     free(SockFD);
 }
+
+internal void
+WriteJsonRect(json_writer *Writer, const char *Key, double X, double Y, double Width, double Height)
+{
+    JsonKey(Writer, Key);
+    JsonBeginObject(Writer);
+    JsonKey(Writer, "x"); JsonDouble(Writer, X);
+    JsonKey(Writer, "y"); JsonDouble(Writer, Y);
+    JsonKey(Writer, "width"); JsonDouble(Writer, Width);
+    JsonKey(Writer, "height"); JsonDouble(Writer, Height);
+    JsonEndObject(Writer);
+}
+
+internal void
+WriteJsonWindowID(json_writer *Writer, uint32_t WindowID)
+{
+    if(WindowID != 0)
+        JsonInteger(Writer, WindowID);
+    else
+        JsonNull(Writer);
+}
+
+internal const char *
+GetSplitModeName(split_type SplitMode)
+{
+    if(SplitMode == SPLIT_VERTICAL)
+        return "vertical";
+    else if(SplitMode == SPLIT_HORIZONTAL)
+        return "horizontal";
+    else
+        return "optimal";
+}
+
+internal const char *
+GetSpaceModeName(space_tiling_option Mode)
+{
+    if(Mode == SpaceModeBSP)
+        return "bsp";
+    else if(Mode == SpaceModeMonocle)
+        return "monocle";
+    else if(Mode == SpaceModeFloating)
+        return "float";
+    else
+        return "default";
+}
+
+internal void
+WriteJsonTreeNode(json_writer *Writer, tree_node *Node)
+{
+    JsonBeginObject(Writer);
+    JsonKey(Writer, "type"); JsonString(Writer, Node->Type == NodeTypeLink ? "monocle" : "bsp");
+    JsonKey(Writer, "window"); WriteJsonWindowID(Writer, Node->WindowID);
+    JsonKey(Writer, "split"); JsonString(Writer, GetSplitModeName(Node->SplitMode));
+    JsonKey(Writer, "ratio"); JsonDouble(Writer, Node->SplitRatio);
+    WriteJsonRect(Writer, "container", Node->Container.X, Node->Container.Y,
+                  Node->Container.Width, Node->Container.Height);
+
+    if(Node->List)
+    {
+        JsonKey(Writer, "links");
+        JsonBeginArray(Writer);
+        for(link_node *Link = Node->List; Link; Link = Link->Next)
+        {
+            JsonBeginObject(Writer);
+            JsonKey(Writer, "window"); WriteJsonWindowID(Writer, Link->WindowID);
+            WriteJsonRect(Writer, "container", Link->Container.X, Link->Container.Y,
+                          Link->Container.Width, Link->Container.Height);
+            JsonEndObject(Writer);
+        }
+        JsonEndArray(Writer);
+    }
+
+    if(Node->LeftChild)
+    {
+        JsonKey(Writer, "left");
+        WriteJsonTreeNode(Writer, Node->LeftChild);
+    }
+
+    if(Node->RightChild)
+    {
+        JsonKey(Writer, "right");
+        WriteJsonTreeNode(Writer, Node->RightChild);
+    }
+
+    JsonEndObject(Writer);
+}
+
+internal void
+WriteJsonDisplay(json_writer *Writer, ax_display *Display)
+{
+    JsonBeginObject(Writer);
+    JsonKey(Writer, "id"); JsonInteger(Writer, Display->ID);
+    JsonKey(Writer, "arrangement"); JsonInteger(Writer, Display->ArrangementID);
+    WriteJsonRect(Writer, "frame", Display->Frame.origin.x, Display->Frame.origin.y,
+                  Display->Frame.size.width, Display->Frame.size.height);
+
+    JsonKey(Writer, "spaces");
+    JsonBeginArray(Writer);
+    for(std::map<CGSSpaceID, ax_space>::iterator It = Display->Spaces.begin(); It != Display->Spaces.end(); ++It)
+    {
+        ax_space *Space = &It->second;
+        JsonBeginObject(Writer);
+        JsonKey(Writer, "id"); JsonInteger(Writer, Space->ID);
+        JsonKey(Writer, "desktop"); JsonInteger(Writer, AXLibDesktopIDFromCGSSpaceID(Display, Space->ID));
+        JsonKey(Writer, "identifier"); JsonString(Writer, Space->Identifier);
+        JsonKey(Writer, "user"); JsonBool(Writer, Space->Type == kCGSSpaceUser);
+        JsonKey(Writer, "active"); JsonBool(Writer, Space == Display->Space);
+        JsonKey(Writer, "previous"); JsonBool(Writer, Space == Display->PrevSpace);
+        JsonKey(Writer, "focused_window"); WriteJsonWindowID(Writer, Space->FocusedWindow);
+
+        space_info *SpaceInfo = FindSpaceInfo(Space);
+        if(SpaceInfo)
+        {
+            JsonKey(Writer, "name"); JsonString(Writer, SpaceInfo->Settings.Name);
+            JsonKey(Writer, "mode"); JsonString(Writer, GetSpaceModeName(SpaceInfo->Settings.Mode));
+            JsonKey(Writer, "tree");
+            if(SpaceInfo->RootNode)
+                WriteJsonTreeNode(Writer, SpaceInfo->RootNode);
+            else
+                JsonNull(Writer);
+        }
+
+        JsonEndObject(Writer);
+    }
+    JsonEndArray(Writer);
+
+    JsonEndObject(Writer);
+}
+
+internal void
+WriteJsonWindow(json_writer *Writer, ax_window *Window)
+{
+    JsonBeginObject(Writer);
+    JsonKey(Writer, "id"); JsonInteger(Writer, Window->ID);
+    JsonKey(Writer, "pid"); JsonInteger(Writer, Window->Application->PID);
+    JsonKey(Writer, "application"); JsonString(Writer, Window->Application->Name);
+    JsonKey(Writer, "name"); JsonString(Writer, Window->Name);
+    WriteJsonRect(Writer, "frame", Window->Position.x, Window->Position.y,
+                  Window->Size.width, Window->Size.height);
+    JsonKey(Writer, "floating"); JsonBool(Writer, AXLibHasFlags(Window, AXWindow_Floating));
+    JsonKey(Writer, "minimized"); JsonBool(Writer, AXLibHasFlags(Window, AXWindow_Minimized));
+    JsonKey(Writer, "movable"); JsonBool(Writer, AXLibHasFlags(Window, AXWindow_Movable));
+    JsonKey(Writer, "resizable"); JsonBool(Writer, AXLibHasFlags(Window, AXWindow_Resizable));
+    JsonEndObject(Writer);
+}
+
+/* NOTE(koekeishiya): The whole state is written into one buffer in a single pass. */
+EVENT_CALLBACK(Callback_KWMEvent_QueryState)
+{
+    int *SockFD = (int *) Event->Context;
+
+    json_writer Writer = {};
+    Writer.Buffer.reserve(64 * 1024);
+
+    JsonBeginObject(&Writer);
+    JsonKey(&Writer, "version"); JsonInteger(&Writer, KwmStateVersion());
+    JsonKey(&Writer, "mode"); JsonString(&Writer, KWMHotkeys.ActiveMode->Name);
+    JsonKey(&Writer, "tiling"); JsonString(&Writer, GetSpaceModeName(KWMSettings.Space));
+
+    ax_application *Application = AXLibGetFocusedApplication();
+    JsonKey(&Writer, "focused_window");
+    WriteJsonWindowID(&Writer, Application && Application->Focus ? Application->Focus->ID : 0);
+    JsonKey(&Writer, "marked_window");
+    WriteJsonWindowID(&Writer, MarkedWindow ? MarkedWindow->ID : 0);
+
+    JsonKey(&Writer, "displays");
+    JsonBeginArray(&Writer);
+    for(std::map<CGDirectDisplayID, ax_display>::iterator It = AXState.Displays.begin(); It != AXState.Displays.end(); ++It)
+        WriteJsonDisplay(&Writer, &It->second);
+    JsonEndArray(&Writer);
+
+    JsonKey(&Writer, "windows");
+    JsonBeginArray(&Writer);
+    for(std::map<pid_t, ax_application>::iterator It = AXState.Applications.begin(); It != AXState.Applications.end(); ++It)
+    {
+        std::map<uint32_t, ax_window *>::iterator WindowIt;
+        for(WindowIt = It->second.Windows.begin(); WindowIt != It->second.Windows.end(); ++WindowIt)
+            WriteJsonWindow(&Writer, WindowIt->second);
+    }
+    JsonEndArray(&Writer);
+
+    JsonKey(&Writer, "scratchpad");
+    JsonBeginArray(&Writer);
+    for(std::map<int, ax_window *>::iterator It = Scratchpad.Windows.begin(); It != Scratchpad.Windows.end(); ++It)
+    {
+        JsonBeginObject(&Writer);
+        JsonKey(&Writer, "index"); JsonInteger(&Writer, It->first);
+        JsonKey(&Writer, "window"); JsonInteger(&Writer, It->second->ID);
+        JsonEndObject(&Writer);
+    }
+    JsonEndArray(&Writer);
+    JsonEndObject(&Writer);
+
+    KwmWriteToSocket(Writer.Buffer, *SockFD);
+    free(SockFD);
+}
+
+/* NOTE(koekeishiya): Queued behind every query. If the query was not recognized,
+ *                    no callback has answered it yet, so send an empty reply. */
+EVENT_CALLBACK(Callback_KWMEvent_QueryFinished)
+{
+    int *SockFD = (int *) Event->Context;
+    KwmFinishReply(*SockFD);
+    free(SockFD);
+}
@@ -6,7 +6,6 @@
 #include "tree.h"
 #include "helpers.h"
 #include "scratchpad.h"
-#include <regex>
 
 #define internal static
 extern kwm_settings KWMSettings;
@@ -171,71 +170,328 @@ KwmParseRule(std::string RuleSym, window_rule *Rule)
     return Result;
 }
 
+internal CFStringRef
+CreateRoleString(const std::string &Role)
+{
+    if(Role.empty())
+        return NULL;
+
+    return CFStringCreateWithCString(NULL, Role.c_str(), kCFStringEncodingMacRoman);
+}
+
+internal void
+ReleaseRoleString(CFStringRef Role)
+{
+    if(Role)
+        CFRelease(Role);
+}
+
+internal bool
+IsLiteralPattern(const std::string &Pattern)
+{
+    return Pattern.find_first_of(".^$|()[]{}*+?\\") == std::string::npos;
+}
+
+internal bool
+KwmCompilePattern(const std::string &Pattern, int *Index)
+{
+    *Index = -1;
+    if(Pattern.empty())
+        return true;
+
+    window_rule_patterns *Patterns = &KWMSettings.WindowRulePatterns;
+    std::unordered_map<std::string, int>::iterator It = Patterns->Lookup.find(Pattern);
+    if(It != Patterns->Lookup.end())
+    {
+        *Index = It->second;
+        return true;
+    }
+
+    try
+    {
+        std::regex Regex(Pattern, std::regex::ECMAScript | std::regex::optimize);
+        Patterns->Regex.push_back(Regex);
+    }
+    catch(const std::regex_error &Error)
+    {
+        ReportInvalidRule("Invalid regex: " + std::string(Error.what()));
+        return false;
+    }
+
+    *Index = Patterns->Regex.size() - 1;
+    Patterns->Lookup[Pattern] = *Index;
+    return true;
+}
+
+/* NOTE(koekeishiya): Compile the patterns of a rule once, so that matching a window does
+ *                    not have to build a std::regex or a CFString. An invalid pattern
+ *                    rejects the rule, instead of throwing when a window is matched. */
+internal bool
+KwmCompileRule(window_rule *Rule)
+{
+    Rule->OwnerIsLiteral = !Rule->Owner.empty() && IsLiteralPattern(Rule->Owner);
+    if(!KwmCompilePattern(Rule->OwnerIsLiteral ? std::string() : Rule->Owner, &Rule->OwnerPattern) ||
+       !KwmCompilePattern(Rule->Name, &Rule->NamePattern) ||
+       !KwmCompilePattern(Rule->Except, &Rule->ExceptPattern))
+        return false;
+
+    Rule->AXRole = CreateRoleString(Rule->Role);
+    Rule->AXCustomRole = CreateRoleString(Rule->CustomRole);
+    Rule->Properties.AXRole = CreateRoleString(Rule->Properties.Role);
+    return true;
+}
+
+/* NOTE(koekeishiya): Results holds one entry per pattern for the window that is being
+ *                    matched: 0 when the pattern has not been tested yet, 1 when it
+ *                    matched and 2 when it did not. */
+internal bool
+MatchWindowRulePattern(int Pattern, const char *Subject, std::vector<char> *Results)
+{
+    char *Result = &(*Results)[Pattern];
+    if(*Result == 0)
+        *Result = std::regex_match(Subject, KWMSettings.WindowRulePatterns.Regex[Pattern]) ? 1 : 2;
+
+    return *Result == 1;
+}
+
+/* NOTE(koekeishiya): Tests everything except crole. The result only depends on the
+ *                    owner, title, role and subrole of the window, and can be cached. */
+internal bool
+MatchWindowRuleProperties(window_rule *Rule, ax_window *Window, std::vector<char> *Results)
+{
+    bool Match = true;
+    if(Rule->OwnerIsLiteral)
+        Match = Window->Application->Name == Rule->Owner;
+    else if(Rule->OwnerPattern != -1)
+        Match = MatchWindowRulePattern(Rule->OwnerPattern, Window->Application->Name.c_str(), Results);
+
+    if(Match && Rule->NamePattern != -1 && Window->Name)
+        Match = MatchWindowRulePattern(Rule->NamePattern, Window->Name, Results);
+
+    if(Match && Rule->AXRole)
+        Match = AXLibWindowHasRole(Window, Rule->AXRole);
+
+    if(Match && Rule->ExceptPattern != -1 && Window->Name)
+        Match = !MatchWindowRulePattern(Rule->ExceptPattern, Window->Name, Results);
+
+    return Match;
+}
+
+internal bool
+MatchWindowRuleCustomRole(window_rule *Rule, ax_window *Window)
+{
+    return !Rule->AXCustomRole || AXLibWindowHasCustomRole(Window, Rule->AXCustomRole);
+}
+
+#ifdef DEBUG_BUILD
 internal bool
 MatchWindowRule(window_rule *Rule, ax_window *Window)
 {
     if(!Window)
         return false;
 
-    bool Match = true;
-    if(!Rule->Owner.empty())
+    std::vector<char> Results(KWMSettings.WindowRulePatterns.Regex.size(), 0);
+    return MatchWindowRuleProperties(Rule, Window, &Results) &&
+           MatchWindowRuleCustomRole(Rule, Window);
+}
+#endif
+
+/* NOTE(koekeishiya): Only the rules indexed by the owner of the window and the generic rules
+ *                    can match. The two lists are merged, so that rules are still applied in
+ *                    the order in which they were added. */
+internal void
+GetCandidateWindowRules(ax_window *Window, std::vector<int> *Candidates)
+{
+    window_rule_index *RuleIndex = &KWMSettings.WindowRuleIndex;
+    static const std::vector<int> NoRules;
+    const std::vector<int> *Owned = &NoRules;
+
+    std::unordered_map<std::string, std::vector<int> >::iterator It = RuleIndex->Owners.find(Window->Application->Name);
+    if(It != RuleIndex->Owners.end())
+        Owned = &It->second;
+
+    std::size_t OwnedIndex = 0;
+    std::size_t GenericIndex = 0;
+    while(OwnedIndex < Owned->size() || GenericIndex < RuleIndex->Generic.size())
     {
-        std::regex Exp(Rule->Owner);
-        Match = std::regex_match(Window->Application->Name, Exp);
+        if((GenericIndex == RuleIndex->Generic.size()) ||
+           ((OwnedIndex < Owned->size()) && ((*Owned)[OwnedIndex] < RuleIndex->Generic[GenericIndex])))
+            Candidates->push_back((*Owned)[OwnedIndex++]);
+        else
+            Candidates->push_back(RuleIndex->Generic[GenericIndex++]);
     }
+}
+
+internal void
+AppendRoleToKey(std::string *Key, CFTypeRef Role)
+{
+    *Key += '\0';
+    if(!Role)
+        return;
 
-    if(!Rule->Name.empty() && Window->Name)
+    char Buffer[256];
+    const char *String = CFStringGetCStringPtr((CFStringRef) Role, kCFStringEncodingUTF8);
+    if(!String && CFStringGetCString((CFStringRef) Role, Buffer, sizeof(Buffer), kCFStringEncodingUTF8))
+        String = Buffer;
+
+    if(String)
+        *Key += String;
+}
+
+internal std::string
+GetWindowRuleCacheKey(ax_window *Window)
+{
+    std::string Key = Window->Application->Name;
+    Key += '\0';
+    if(Window->Name)
+    {
+        Key += '1';
+        Key += Window->Name;
+    }
+    else
     {
-        std::regex Exp(Rule->Name);
-        Match = Match && std::regex_match(Window->Name, Exp);
+        Key += '0';
     }
 
-    if(!Rule->Role.empty())
+    AppendRoleToKey(&Key, Window->Type.Role);
+    AppendRoleToKey(&Key, Window->Type.Subrole);
+    return Key;
+}
+
+internal void
+InvalidateWindowRuleCache()
+{
+    window_rule_cache *Cache = &KWMSettings.WindowRuleCache;
+    Cache->Entries.clear();
+    Cache->Lookup.clear();
+    ++Cache->Invalidations;
+}
+
+internal void
+GetCachedWindowRules(ax_window *Window, std::vector<int> *Rules)
+{
+    window_rule_cache *Cache = &KWMSettings.WindowRuleCache;
+    std::string Key = GetWindowRuleCacheKey(Window);
+
+    std::unordered_map<std::string, std::list<window_rule_cache_entry>::iterator>::iterator It = Cache->Lookup.find(Key);
+    if(It != Cache->Lookup.end())
     {
-        CFTypeRef AXRole = CFStringCreateWithCString(NULL, Rule->Role.c_str(), kCFStringEncodingMacRoman);
-        Match = Match && AXLibWindowHasRole(Window, AXRole);
-        CFRelease(AXRole);
+        ++Cache->Hits;
+        Cache->Entries.splice(Cache->Entries.begin(), Cache->Entries, It->second);
+        *Rules = It->second->Rules;
+        return;
     }
 
-    if(!Rule->CustomRole.empty())
+    ++Cache->Misses;
+    std::vector<int> Candidates;
+    GetCandidateWindowRules(Window, &Candidates);
+    std::vector<char> Results(KWMSettings.WindowRulePatterns.Regex.size(), 0);
+    for(std::size_t Index = 0; Index < Candidates.size(); ++Index)
     {
-        CFTypeRef AXRole = CFStringCreateWithCString(NULL, Rule->CustomRole.c_str(), kCFStringEncodingMacRoman);
-        Match = Match && AXLibWindowHasCustomRole(Window, AXRole);
-        CFRelease(AXRole);
+        if(MatchWindowRuleProperties(&KWMSettings.WindowRules[Candidates[Index]], Window, &Results))
+            Rules->push_back(Candidates[Index]);
     }
 
-    if(!Rule->Except.empty() && Window->Name)
+    if(Cache->Entries.size() == WINDOW_RULE_CACHE_SIZE)
     {
-        std::regex Exp(Rule->Except);
-        Match = Match && !std::regex_match(Window->Name, Exp);
+        Cache->Lookup.erase(Cache->Entries.back().Key);
+        Cache->Entries.pop_back();
+        ++Cache->Evictions;
     }
 
-    return Match;
+    window_rule_cache_entry Entry = { Key, *Rules };
+    Cache->Entries.push_front(Entry);
+    Cache->Lookup[Key] = Cache->Entries.begin();
 }
 
+#ifdef DEBUG_BUILD
+/* NOTE(koekeishiya): Reference check, every rule that was filtered out by the owner index
+ *                    or the cache must also be rejected when tested on its own. */
+internal void
+ValidateCandidateWindowRules(ax_window *Window, std::vector<int> *Candidates)
+{
+    std::size_t CandidateIndex = 0;
+    for(int Index = 0; Index < KWMSettings.WindowRules.size(); ++Index)
+    {
+        if((CandidateIndex < Candidates->size()) &&
+           ((*Candidates)[CandidateIndex] == Index))
+        {
+            ++CandidateIndex;
+            continue;
+        }
+
+        Assert(!MatchWindowRule(&KWMSettings.WindowRules[Index], Window));
+    }
+
+    Assert(CandidateIndex == Candidates->size());
+}
+#endif
+
 void KwmAddRule(std::string RuleSym)
 {
     window_rule Rule = {};
-    if(!RuleSym.empty() && KwmParseRule(RuleSym, &Rule))
+    if(!RuleSym.empty() && KwmParseRule(RuleSym, &Rule) && KwmCompileRule(&Rule))
+    {
+        int Index = KWMSettings.WindowRules.size();
         KWMSettings.WindowRules.push_back(Rule);
+
+        if(Rule.OwnerIsLiteral)
+            KWMSettings.WindowRuleIndex.Owners[Rule.Owner].push_back(Index);
+        else
+            KWMSettings.WindowRuleIndex.Generic.push_back(Index);
+
+        InvalidateWindowRuleCache();
+    }
+}
+
+void KwmClearRules()
+{
+    for(std::size_t Index = 0; Index < KWMSettings.WindowRules.size(); ++Index)
+    {
+        window_rule *Rule = &KWMSettings.WindowRules[Index];
+        ReleaseRoleString(Rule->AXRole);
+        ReleaseRoleString(Rule->AXCustomRole);
+        ReleaseRoleString(Rule->Properties.AXRole);
+    }
+
+    KWMSettings.WindowRules.clear();
+    KWMSettings.WindowRuleIndex.Owners.clear();
+    KWMSettings.WindowRuleIndex.Generic.clear();
+    KWMSettings.WindowRulePatterns.Regex.clear();
+    KWMSettings.WindowRulePatterns.Lookup.clear();
+    InvalidateWindowRuleCache();
 }
 
 /* TODO(koekeishiya): This entire system is just stupid. Reimplement in a proper way. */
 bool ApplyWindowRules(ax_window *Window)
 {
+    if(!Window)
+        return false;
+
     bool Skip = false;
-    for(int Index = 0; Index < KWMSettings.WindowRules.size(); ++Index)
+    std::vector<int> Candidates;
+    GetCachedWindowRules(Window, &Candidates);
+#ifdef DEBUG_BUILD
+    ValidateCandidateWindowRules(Window, &Candidates);
+#endif
+
+    /* NOTE(koekeishiya): A rule is tested only when we get to it, because an earlier
+     *                    rule may have assigned a custom role to the window. */
+    for(std::size_t CandidateIndex = 0; CandidateIndex < Candidates.size(); ++CandidateIndex)
     {
-        window_rule *Rule = &KWMSettings.WindowRules[Index];
-        if(MatchWindowRule(Rule, Window))
+        window_rule *Rule = &KWMSettings.WindowRules[Candidates[CandidateIndex]];
+        if(MatchWindowRuleCustomRole(Rule, Window))
         {
             if(Rule->Properties.Float == 1)
                 AXLibAddFlags(Window, AXWindow_Floating);
 
-            if(!Rule->Properties.Role.empty())
-                Window->Type.CustomRole = CFStringCreateWithCString(NULL,
-                                                                    Rule->Properties.Role.c_str(),
-                                                                    kCFStringEncodingMacRoman);
+            if(Rule->Properties.AXRole)
+            {
+                if(Window->Type.CustomRole)
+                    CFRelease(Window->Type.CustomRole);
+
+                Window->Type.CustomRole = CFRetain(Rule->Properties.AXRole);
+            }
 
             if(Rule->Properties.Scratchpad != -1)
             {
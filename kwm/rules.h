@@ -6,5 +6,6 @@
 
 bool ApplyWindowRules(ax_window *Window);
 void KwmAddRule(std::string RuleSym);
+void KwmClearRules();
 
 #endif
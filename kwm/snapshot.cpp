@@ -0,0 +1,96 @@
+#include "snapshot.h"
+#include "daemon.h"
+#include "event.h"
+
+#include "axlib/event.h"
+
+#include <memory>
+
+#define internal static
+
+/* NOTE(koekeishiya): The state version is the number of AX events dispatched by the event-loop
+ *                    that may change state, plus the number of commands run by the interpreter
+ *                    that do. Both only increase, so a snapshot is current exactly when its
+ *                    version equals the state version. Cursor movement and the echoes of our own
+ *                    moves and resizes do not count.
+ *
+ *                    The event-loop publishes a snapshot with every answer it holds after each
+ *                    batch of events that changed state, and after each command that did. Query
+ *                    callbacks add their answer to it as well. The daemon thread answers a query
+ *                    from the snapshot if it is current and holds that query, and otherwise
+ *                    queues it as before. A status bar that polls between two changes is thus
+ *                    served without touching the event-loop. */
+internal uint64_t CommandGeneration;
+internal pthread_mutex_t SnapshotLock = PTHREAD_MUTEX_INITIALIZER;
+internal std::shared_ptr<const kwm_snapshot> Snapshot;
+
+uint64_t KwmStateVersion()
+{
+    return AXLibEventGeneration() + __atomic_load_n(&CommandGeneration, __ATOMIC_ACQUIRE);
+}
+
+void KwmMarkStateChanged()
+{
+    __atomic_add_fetch(&CommandGeneration, 1, __ATOMIC_RELEASE);
+    KwmConstructEvent(KWMEvent_PublishSnapshot, NULL);
+}
+
+internal std::shared_ptr<const kwm_snapshot>
+KwmCurrentSnapshot()
+{
+    pthread_mutex_lock(&SnapshotLock);
+    std::shared_ptr<const kwm_snapshot> Result = Snapshot;
+    pthread_mutex_unlock(&SnapshotLock);
+
+    return Result;
+}
+
+bool KwmSnapshotIsCurrent()
+{
+    std::shared_ptr<const kwm_snapshot> Current = KwmCurrentSnapshot();
+    return Current && Current->Version == KwmStateVersion();
+}
+
+bool KwmAnswerFromSnapshot(int Query, int ClientSockFD)
+{
+    std::shared_ptr<const kwm_snapshot> Current = KwmCurrentSnapshot();
+    if(!Current || Current->Version != KwmStateVersion())
+        return false;
+
+    std::map<int, std::string>::const_iterator It = Current->Answers.find(Query);
+    if(It == Current->Answers.end())
+        return false;
+
+    KwmWriteToSocket(It->second, ClientSockFD);
+    return true;
+}
+
+/* NOTE(koekeishiya): Answers for the version of the current snapshot are added to a copy of it,
+ *                    a newer version starts a new snapshot and an older one is discarded. */
+void KwmPublishSnapshotAnswer(int Query, uint64_t Version, std::string &Answer)
+{
+    pthread_mutex_lock(&SnapshotLock);
+    if(!Snapshot || Snapshot->Version <= Version)
+    {
+        std::shared_ptr<kwm_snapshot> Next = std::make_shared<kwm_snapshot>();
+        if(Snapshot && Snapshot->Version == Version)
+            *Next = *Snapshot;
+
+        Next->Version = Version;
+        Next->Answers[Query] = Answer;
+        Snapshot = Next;
+    }
+    pthread_mutex_unlock(&SnapshotLock);
+}
+
+void KwmPublishSnapshot(uint64_t Version, std::map<int, std::string> &Answers)
+{
+    std::shared_ptr<kwm_snapshot> Next = std::make_shared<kwm_snapshot>();
+    Next->Version = Version;
+    Next->Answers.swap(Answers);
+
+    pthread_mutex_lock(&SnapshotLock);
+    if(!Snapshot || Snapshot->Version <= Version)
+        Snapshot = Next;
+    pthread_mutex_unlock(&SnapshotLock);
+}
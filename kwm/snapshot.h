@@ -0,0 +1,14 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "types.h"
+
+uint64_t KwmStateVersion();
+void KwmMarkStateChanged();
+
+bool KwmSnapshotIsCurrent();
+bool KwmAnswerFromSnapshot(int Query, int ClientSockFD);
+void KwmPublishSnapshotAnswer(int Query, uint64_t Version, std::string &Answer);
+void KwmPublishSnapshot(uint64_t Version, std::map<int, std::string> &Answers);
+
+#endif
@@ -7,10 +7,53 @@
 #include "helpers.h"
 #include "axlib/axlib.h"
 
-extern std::map<std::string, space_info> WindowTree;
+#define internal static
+
+extern space_table WindowTree;
 extern ax_application *FocusedApplication;
 extern kwm_settings KWMSettings;
 
+internal space_info *
+InternSpaceInfo(ax_space *Space, bool Create)
+{
+    std::unordered_map<std::string, int>::iterator It = WindowTree.Handles.find(Space->Identifier);
+    if(It != WindowTree.Handles.end())
+    {
+        Space->Handle = It->second;
+        return &WindowTree.Spaces[Space->Handle];
+    }
+
+    if(!Create)
+        return NULL;
+
+    Space->Handle = WindowTree.Spaces.size();
+    WindowTree.Handles[Space->Identifier] = Space->Handle;
+    WindowTree.Spaces.emplace_back();
+    return &WindowTree.Spaces[Space->Handle];
+}
+
+/* NOTE(koekeishiya): Returns the space_info of a space, creating it the first time the space is seen.
+ *                    Once an ax_space carries its handle this is a plain index into the table. */
+space_info *GetSpaceInfo(ax_space *Space)
+{
+    if(Space->Handle >= 0)
+    {
+        Assert(WindowTree.Handles[Space->Identifier] == Space->Handle);
+        return &WindowTree.Spaces[Space->Handle];
+    }
+
+    return InternSpaceInfo(Space, true);
+}
+
+/* NOTE(koekeishiya): Like GetSpaceInfo, but returns NULL instead of creating a space_info. */
+space_info *FindSpaceInfo(ax_space *Space)
+{
+    if(Space->Handle >= 0)
+        return &WindowTree.Spaces[Space->Handle];
+
+    return InternSpaceInfo(Space, false);
+}
+
 void GetTagForMonocleSpace(space_info *Space, std::string &Tag)
 {
     tree_node *Node = Space->RootNode;
@@ -50,7 +93,7 @@ void GetTagForMonocleSpace(space_info *Space, std::string &Tag)
 void GetTagForCurrentSpace(std::string &Tag)
 {
     ax_display *Display = AXLibMainDisplay();
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(SpaceInfo->Initialized)
     {
         if(SpaceInfo->Settings.Mode == SpaceModeBSP)
@@ -105,7 +148,7 @@ int GetSpaceFromName(ax_display *Display, std::string Name)
     for(It = Display->Spaces.begin(); It != Display->Spaces.end(); ++It)
     {
         ax_space *Space = &It->second;
-        space_info *SpaceInfo = &WindowTree[Space->Identifier];
+        space_info *SpaceInfo = GetSpaceInfo(Space);
         if(SpaceInfo->Settings.Name == Name)
             return Space->ID;
     }
@@ -115,13 +158,13 @@ int GetSpaceFromName(ax_display *Display, std::string Name)
 
 void SetNameOfActiveSpace(ax_display *Display, std::string Name)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(SpaceInfo) SpaceInfo->Settings.Name = Name;
 }
 
 std::string GetNameOfSpace(ax_display *Display, ax_space *Space)
 {
-    space_info *SpaceInfo = &WindowTree[Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Space);
     std::string Result = "[no tag]";
 
     if(!SpaceInfo->Settings.Name.empty())
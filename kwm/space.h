@@ -4,6 +4,9 @@
 #include "types.h"
 #include "axlib/axlib.h"
 
+space_info *GetSpaceInfo(ax_space *Space);
+space_info *FindSpaceInfo(ax_space *Space);
+
 void GetTagForMonocleSpace(space_info *Space, std::string &Tag);
 void GetTagForCurrentSpace(std::string &Tag);
 
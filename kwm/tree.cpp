@@ -6,10 +6,13 @@
 #include "space.h"
 #include "window.h"
 #include "border.h"
+#include "pool.h"
+#include "placement.h"
+#include "daemon.h"
 #include "axlib/axlib.h"
 
 #define internal static
-extern std::map<std::string, space_info> WindowTree;
+extern layout_stats LayoutStats;
 
 internal bool
 CreateBSPTree(tree_node *RootNode, ax_display *Display, std::vector<uint32_t> *WindowsPtr)
@@ -50,8 +53,9 @@ CreateMonocleTree(tree_node *RootNode, ax_display *Display, std::vector<uint32_t
 
     if(!Windows.empty())
     {
+        space_info *SpaceInfo = GetSpaceInfo(Display->Space);
         tree_node *Root = RootNode;
-        Root->List = CreateLinkNode();
+        Root->List = CreateLinkNode(SpaceInfo);
 
         SetLinkNodeContainer(Display, Root->List);
         Root->List->WindowID = Windows[0];
@@ -59,7 +63,7 @@ CreateMonocleTree(tree_node *RootNode, ax_display *Display, std::vector<uint32_t
         link_node *Link = Root->List;
         for(std::size_t Index = 1; Index < Windows.size(); ++Index)
         {
-            link_node *Next = CreateLinkNode();
+            link_node *Next = CreateLinkNode(SpaceInfo);
             SetLinkNodeContainer(Display, Next);
             Next->WindowID = Windows[Index];
 
@@ -76,11 +80,11 @@ CreateMonocleTree(tree_node *RootNode, ax_display *Display, std::vector<uint32_t
 
 tree_node *CreateTreeFromWindowIDList(ax_display *Display, std::vector<uint32_t> *Windows)
 {
-    tree_node *RootNode = CreateRootNode();
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
+    tree_node *RootNode = CreateRootNode(SpaceInfo);
     SetRootNodeContainer(Display, RootNode);
     bool Result = false;
 
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
     if(SpaceInfo->Settings.Mode == SpaceModeBSP)
         Result = CreateBSPTree(RootNode, Display, Windows);
     else if(SpaceInfo->Settings.Mode == SpaceModeMonocle)
@@ -88,7 +92,7 @@ tree_node *CreateTreeFromWindowIDList(ax_display *Display, std::vector<uint32_t>
 
     if(!Result)
     {
-        free(RootNode);
+        FreeTreeNode(SpaceInfo, RootNode);
         RootNode = NULL;
     }
 
@@ -103,56 +107,114 @@ tree_node *GetNearestLeafNodeNeighbour(tree_node *Node)
     return NULL;
 }
 
-tree_node *GetTreeNodeFromWindowID(tree_node *Node, uint32_t WindowID)
+/* NOTE(koekeishiya): Every space keeps an index of WindowID -> leaf node / link node, so
+                     that looking up the node of a window does not require a walk of the tree.
+                     Functions that create, move or free leaf and link nodes must keep it exact,
+                     because an entry may point to a node that has been returned to the pool of
+                     the space; lookups trust the index and never dereference the node to check.
+                     Internal nodes that hold the WindowID of a zoomed window are not indexed. */
+void AddNodeTreeToIndex(space_info *Space, tree_node *Node)
 {
     if(Node)
     {
-        tree_node *CurrentNode = NULL;
-        GetFirstLeafNode(Node, (void**)&CurrentNode);
-        while(CurrentNode)
+        if(IsLeafNode(Node))
         {
-            if(CurrentNode->WindowID == WindowID)
-                return CurrentNode;
+            if(Node->WindowID != 0)
+                Space->NodeIndex[Node->WindowID] = { Node, NULL };
 
-            CurrentNode = GetNearestTreeNodeToTheRight(CurrentNode);
+            link_node *Link = Node->List;
+            while(Link)
+            {
+                Space->NodeIndex[Link->WindowID] = { Node, Link };
+                Link = Link->Next;
+            }
+        }
+        else
+        {
+            AddNodeTreeToIndex(Space, Node->LeftChild);
+            AddNodeTreeToIndex(Space, Node->RightChild);
         }
     }
-
-    return NULL;
 }
 
-tree_node *GetTreeNodeFromWindowIDOrLinkNode(tree_node *Node, uint32_t WindowID)
+void AddLinkNodeToIndex(space_info *Space, tree_node *Root, link_node *Link)
 {
-    tree_node *Result = NULL;
-    Result = GetTreeNodeFromWindowID(Node, WindowID);
-    if(!Result)
-    {
-        link_node *Link = GetLinkNodeFromWindowID(Node, WindowID);
-        Result = GetTreeNodeFromLink(Node, Link);
-    }
+    if(Root && Link)
+        Space->NodeIndex[Link->WindowID] = { Root, Link };
+}
 
-    return Result;
+void RemoveWindowFromIndex(space_info *Space, uint32_t WindowID)
+{
+    Space->NodeIndex.erase(WindowID);
 }
 
-link_node *GetLinkNodeFromWindowID(tree_node *Root, uint32_t WindowID)
+void RemoveNodeTreeFromIndex(space_info *Space, tree_node *Node)
 {
-    if(Root)
+    if(Node)
     {
-        tree_node *Node = NULL;
-        GetFirstLeafNode(Root, (void**)&Node);
-        while(Node)
+        std::unordered_map<uint32_t, node_index_entry>::iterator It = Space->NodeIndex.find(Node->WindowID);
+        if(It != Space->NodeIndex.end() && It->second.Node == Node && !It->second.Link)
+            Space->NodeIndex.erase(It);
+
+        link_node *Link = Node->List;
+        while(Link)
         {
-            link_node *Link = GetLinkNodeFromTree(Node, WindowID);
-            if(Link)
-                return Link;
+            It = Space->NodeIndex.find(Link->WindowID);
+            if(It != Space->NodeIndex.end() && It->second.Link == Link)
+                Space->NodeIndex.erase(It);
 
-            Node = GetNearestTreeNodeToTheRight(Node);
+            Link = Link->Next;
         }
+
+        RemoveNodeTreeFromIndex(Space, Node->LeftChild);
+        RemoveNodeTreeFromIndex(Space, Node->RightChild);
+    }
+}
+
+void RebuildNodeIndex(space_info *Space)
+{
+    Space->NodeIndex.clear();
+    AddNodeTreeToIndex(Space, Space->RootNode);
+}
+
+internal node_index_entry *
+GetNodeIndexEntry(space_info *Space, uint32_t WindowID)
+{
+    if(Space && Space->RootNode)
+    {
+        std::unordered_map<uint32_t, node_index_entry>::iterator It = Space->NodeIndex.find(WindowID);
+        if(It != Space->NodeIndex.end())
+            return &It->second;
     }
 
     return NULL;
 }
 
+tree_node *GetTreeNodeFromWindowID(space_info *Space, uint32_t WindowID)
+{
+    node_index_entry *Entry = GetNodeIndexEntry(Space, WindowID);
+    return Entry && !Entry->Link ? Entry->Node : NULL;
+}
+
+tree_node *GetTreeNodeFromWindowIDOrLinkNode(space_info *Space, uint32_t WindowID)
+{
+    tree_node *Result = NULL;
+    Result = GetTreeNodeFromWindowID(Space, WindowID);
+    if(!Result)
+    {
+        link_node *Link = GetLinkNodeFromWindowID(Space, WindowID);
+        Result = GetTreeNodeFromLink(Space, Link);
+    }
+
+    return Result;
+}
+
+link_node *GetLinkNodeFromWindowID(space_info *Space, uint32_t WindowID)
+{
+    node_index_entry *Entry = GetNodeIndexEntry(Space, WindowID);
+    return Entry ? Entry->Link : NULL;
+}
+
 link_node *GetLinkNodeFromTree(tree_node *Root, uint32_t WindowID)
 {
     if(Root)
@@ -170,24 +232,69 @@ link_node *GetLinkNodeFromTree(tree_node *Root, uint32_t WindowID)
     return NULL;
 }
 
-tree_node *GetTreeNodeFromLink(tree_node *Root, link_node *Link)
+tree_node *GetTreeNodeFromLink(space_info *Space, link_node *Link)
 {
-    if(Root && Link)
+    if(Link)
     {
-        tree_node *Node = NULL;
-        GetFirstLeafNode(Root, (void**)&Node);
-        while(Node)
-        {
-            if(GetLinkNodeFromTree(Node, Link->WindowID) == Link)
-                return Node;
-
-            Node = GetNearestTreeNodeToTheRight(Node);
-        }
+        node_index_entry *Entry = GetNodeIndexEntry(Space, Link->WindowID);
+        if(Entry && Entry->Link == Link)
+            return Entry->Node;
     }
 
     return NULL;
 }
 
+internal bool
+CheckNodeIndexOfTree(space_info *Space, tree_node *Node, std::size_t *Count)
+{
+    if(!Node)
+        return true;
+
+    if(!IsLeafNode(Node))
+        return CheckNodeIndexOfTree(Space, Node->LeftChild, Count) &&
+               CheckNodeIndexOfTree(Space, Node->RightChild, Count);
+
+    std::unordered_map<uint32_t, node_index_entry>::iterator It;
+    if(Node->WindowID != 0)
+    {
+        It = Space->NodeIndex.find(Node->WindowID);
+        if(It == Space->NodeIndex.end() || It->second.Node != Node || It->second.Link)
+            return false;
+
+        ++*Count;
+    }
+
+    link_node *Link = Node->List;
+    while(Link)
+    {
+        It = Space->NodeIndex.find(Link->WindowID);
+        if(It == Space->NodeIndex.end() || It->second.Node != Node || It->second.Link != Link)
+            return false;
+
+        ++*Count;
+        Link = Link->Next;
+    }
+
+    return true;
+}
+
+/* NOTE(koekeishiya): Compares the index of the given space against a full walk of its tree;
+                     every window in the tree must have an entry that points to its node and
+                     the index may not hold any other entries. */
+bool CheckNodeIndex(space_info *Space)
+{
+    std::size_t Count = 0;
+    if(!CheckNodeIndexOfTree(Space, Space->RootNode, &Count))
+        return false;
+
+    return Count == Space->NodeIndex.size();
+}
+
+void ValidateNodeIndex(space_info *Space)
+{
+    Assert(CheckNodeIndex(Space));
+}
+
 tree_node *GetNearestTreeNodeToTheLeft(tree_node *Node)
 {
     if(Node)
@@ -279,7 +386,7 @@ void FocusFirstLeafNode(ax_display *Display)
 {
     if(Display)
     {
-        space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+        space_info *SpaceInfo = GetSpaceInfo(Display->Space);
         if(!SpaceInfo->RootNode)
             return;
 
@@ -301,7 +408,7 @@ void FocusLastLeafNode(ax_display *Display)
 {
     if(Display)
     {
-        space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+        space_info *SpaceInfo = GetSpaceInfo(Display->Space);
         if(!SpaceInfo->RootNode)
             return;
 
@@ -342,53 +449,90 @@ void ApplyLinkNodeContainer(link_node *Link)
     }
 }
 
-void ApplyTreeNodeContainer(tree_node *Node)
+internal void
+ApplyNodeContainer(tree_node *Node)
+{
+    if(Node->WindowID != 0)
+        ResizeWindowToContainerSize(Node);
+
+    if(Node->List)
+        ApplyLinkNodeContainer(Node->List);
+
+    Node->Dirty = false;
+}
+
+internal void
+ApplyNodeContainers(tree_node *Node, bool OnlyDirty)
 {
     if(Node)
     {
-        if(Node->WindowID != 0)
-            ResizeWindowToContainerSize(Node);
-
-        if(Node->List)
-            ApplyLinkNodeContainer(Node->List);
+        if(!OnlyDirty || Node->Dirty)
+            ApplyNodeContainer(Node);
 
         if(Node->LeftChild)
-            ApplyTreeNodeContainer(Node->LeftChild);
+            ApplyNodeContainers(Node->LeftChild, OnlyDirty);
 
         if(Node->RightChild)
-            ApplyTreeNodeContainer(Node->RightChild);
+            ApplyNodeContainers(Node->RightChild, OnlyDirty);
     }
 }
 
+/* NOTE(koekeishiya): LayoutStats is counted on both the daemon thread and the event-loop thread,
+                     so every field is only accessed through atomic operations. */
 internal void
-DestroyLinkList(link_node *Link)
+CommitLayoutStats()
 {
-    if(Link)
-    {
-        if(Link->Next)
-            DestroyLinkList(Link->Next);
+    uint32_t NodesRecomputed = __atomic_exchange_n(&LayoutStats.NodesRecomputed, 0, __ATOMIC_RELAXED);
+    uint32_t WindowsTouched = __atomic_exchange_n(&LayoutStats.WindowsTouched, 0, __ATOMIC_RELAXED);
 
-        free(Link);
-        Link = NULL;
-    }
+    __atomic_store_n(&LayoutStats.LastNodesRecomputed, NodesRecomputed, __ATOMIC_RELAXED);
+    __atomic_store_n(&LayoutStats.LastWindowsTouched, WindowsTouched, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&LayoutStats.TotalNodesRecomputed, NodesRecomputed, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&LayoutStats.TotalWindowsTouched, WindowsTouched, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&LayoutStats.Operations, 1, __ATOMIC_RELAXED);
+
+    if(KwmIsSubscribed(KwmTopic_Tree))
+        KwmPublishEvent(KwmTopic_Tree, "tree " + std::to_string(WindowsTouched));
 }
 
-void DestroyNodeTree(tree_node *Node)
+void GetLayoutStats(layout_stats *Stats)
 {
-    if(Node)
-    {
-        if(Node->List)
-            DestroyLinkList(Node->List);
+    Stats->NodesRecomputed = __atomic_load_n(&LayoutStats.NodesRecomputed, __ATOMIC_RELAXED);
+    Stats->WindowsTouched = __atomic_load_n(&LayoutStats.WindowsTouched, __ATOMIC_RELAXED);
+    Stats->LastNodesRecomputed = __atomic_load_n(&LayoutStats.LastNodesRecomputed, __ATOMIC_RELAXED);
+    Stats->LastWindowsTouched = __atomic_load_n(&LayoutStats.LastWindowsTouched, __ATOMIC_RELAXED);
+    Stats->TotalNodesRecomputed = __atomic_load_n(&LayoutStats.TotalNodesRecomputed, __ATOMIC_RELAXED);
+    Stats->TotalWindowsTouched = __atomic_load_n(&LayoutStats.TotalWindowsTouched, __ATOMIC_RELAXED);
+    Stats->Operations = __atomic_load_n(&LayoutStats.Operations, __ATOMIC_RELAXED);
+    Stats->AXCallsIssued = __atomic_load_n(&LayoutStats.AXCallsIssued, __ATOMIC_RELAXED);
+    Stats->AXCallsElided = __atomic_load_n(&LayoutStats.AXCallsElided, __ATOMIC_RELAXED);
+    Stats->PlacementsAbandoned = __atomic_load_n(&LayoutStats.PlacementsAbandoned, __ATOMIC_RELAXED);
+}
 
-        if(Node->LeftChild)
-            DestroyNodeTree(Node->LeftChild);
+void ApplyTreeNodeContainer(tree_node *Node)
+{
+    BeginWindowPlacementBatch();
+    ApplyNodeContainers(Node, false);
+    CommitWindowPlacementBatch();
+    CommitLayoutStats();
+}
 
-        if(Node->RightChild)
-            DestroyNodeTree(Node->RightChild);
+void ApplyDirtyTreeNodeContainer(tree_node *Node)
+{
+    BeginWindowPlacementBatch();
+    ApplyNodeContainers(Node, true);
+    CommitWindowPlacementBatch();
+    CommitLayoutStats();
+}
 
-        free(Node);
-        Node = NULL;
-    }
+/* NOTE(koekeishiya): All nodes of a tree are allocated from the pools of its space,
+                     so the whole tree is released by resetting those pools. */
+void DestroyNodeTree(space_info *Space)
+{
+    NodePoolReset(&Space->TreeNodePool);
+    NodePoolReset(&Space->LinkNodePool);
+    Space->NodeIndex.clear();
+    Space->RootNode = NULL;
 }
 
 internal void
@@ -412,6 +556,8 @@ RotateTree(tree_node *Node, int Deg)
     if(Deg != 180)
         Node->SplitMode = Node->SplitMode == SPLIT_HORIZONTAL ? SPLIT_VERTICAL : SPLIT_HORIZONTAL;
 
+    Node->Dirty = true;
+
     RotateTree(Node->LeftChild, Deg);
     RotateTree(Node->RightChild, Deg);
 }
@@ -419,12 +565,12 @@ RotateTree(tree_node *Node, int Deg)
 void RotateBSPTree(int Deg)
 {
     ax_display *Display = AXLibMainDisplay();
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(SpaceInfo->Settings.Mode == SpaceModeBSP)
     {
         RotateTree(SpaceInfo->RootNode, Deg);
         CreateNodeContainers(Display, SpaceInfo->RootNode, false);
-        ApplyTreeNodeContainer(SpaceInfo->RootNode);
+        ApplyDirtyTreeNodeContainer(SpaceInfo->RootNode);
     }
 }
 
@@ -462,4 +608,5 @@ void FillDeserializedTree(tree_node *RootNode, ax_display *Display, std::vector<
             Root = RootNode;
         }
     }
+    RebuildNodeIndex(GetSpaceInfo(Display->Space));
 }
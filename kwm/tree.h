@@ -8,11 +8,18 @@ tree_node *CreateTreeFromWindowIDList(ax_display *Display, std::vector<uint32_t>
 void FillDeserializedTree(tree_node *RootNode, ax_display *Display, std::vector<uint32_t> *WindowsPtr);
 void RotateBSPTree(int Deg);
 tree_node *GetNearestLeafNodeNeighbour(tree_node *Node);
-tree_node *GetTreeNodeFromWindowID(tree_node *Node, uint32_t WindowID);
-tree_node *GetTreeNodeFromWindowIDOrLinkNode(tree_node *Node, uint32_t WindowID);
-link_node *GetLinkNodeFromWindowID(tree_node *Root, uint32_t WindowID);
+void AddNodeTreeToIndex(space_info *Space, tree_node *Node);
+void AddLinkNodeToIndex(space_info *Space, tree_node *Root, link_node *Link);
+void RemoveNodeTreeFromIndex(space_info *Space, tree_node *Node);
+void RemoveWindowFromIndex(space_info *Space, uint32_t WindowID);
+void RebuildNodeIndex(space_info *Space);
+bool CheckNodeIndex(space_info *Space);
+void ValidateNodeIndex(space_info *Space);
+tree_node *GetTreeNodeFromWindowID(space_info *Space, uint32_t WindowID);
+tree_node *GetTreeNodeFromWindowIDOrLinkNode(space_info *Space, uint32_t WindowID);
+link_node *GetLinkNodeFromWindowID(space_info *Space, uint32_t WindowID);
 link_node *GetLinkNodeFromTree(tree_node *Root, uint32_t WindowID);
-tree_node *GetTreeNodeFromLink(tree_node *Root, link_node *Link);
+tree_node *GetTreeNodeFromLink(space_info *Space, link_node *Link);
 tree_node *GetNearestTreeNodeToTheLeft(tree_node *Node);
 tree_node *GetNearestTreeNodeToTheRight(tree_node *Node);
 void GetFirstLeafNode(tree_node *Node, void **Result);
@@ -22,6 +29,8 @@ void FocusLastLeafNode(ax_display *Display);
 tree_node *GetFirstPseudoLeafNode(tree_node *Node);
 void ApplyLinkNodeContainer(link_node *Link);
 void ApplyTreeNodeContainer(tree_node *Node);
-void DestroyNodeTree(tree_node *Node);
+void ApplyDirtyTreeNodeContainer(tree_node *Node);
+void DestroyNodeTree(space_info *Space);
+void GetLayoutStats(layout_stats *Stats);
 
 #endif
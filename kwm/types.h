@@ -6,11 +6,15 @@
 #include <iostream>
 #include <vector>
 #include <queue>
+#include <deque>
 #include <stack>
 #include <map>
+#include <list>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <regex>
 #include <chrono>
 
 #include <stdlib.h>
@@ -31,12 +35,21 @@ struct space_identifier;
 struct color;
 struct mode;
 struct hotkey;
+struct kwm_command;
 struct space_settings;
 struct container_offset;
 
 struct window_properties;
 struct window_rule;
+struct window_rule_index;
+struct window_rule_cache;
 struct space_info;
+struct node_index_entry;
+struct node_pool;
+struct layout_stats;
+struct kwm_snapshot;
+struct json_writer;
+struct window_placement;
 struct node_container;
 struct tree_node;
 struct scratchpad;
@@ -122,6 +135,26 @@ enum hotkey_state
     HotkeyStateExclude
 };
 
+enum kwm_opcode
+{
+    KwmOpcode_Interpret,
+    KwmOpcode_Exec,
+
+    KwmOpcode_FocusDirected,
+    KwmOpcode_FocusStep,
+    KwmOpcode_FocusSubTreeStep,
+    KwmOpcode_SwapDirected,
+    KwmOpcode_SwapStep,
+    KwmOpcode_SwapMarked,
+    KwmOpcode_ToggleFullscreen,
+    KwmOpcode_ToggleParent,
+    KwmOpcode_ToggleFloating,
+    KwmOpcode_SplitRatio,
+    KwmOpcode_SplitRatioDirected,
+    KwmOpcode_DetachDirected,
+    KwmOpcode_FocusDisplayStep,
+};
+
 enum token_type
 {
     Token_Colon,
@@ -170,6 +203,19 @@ struct space_identifier
     }
 };
 
+/* NOTE(koekeishiya): A command compiled when its hotkey is bound. Commands that are common
+ *                    in hotkeys get their own opcode and typed argument, everything else is
+ *                    kept as pre-split tokens and dispatched through the interpreter. */
+struct kwm_command
+{
+    kwm_opcode Opcode;
+    int Value;
+    double Ratio;
+
+    std::string Text;
+    std::vector<std::string> Tokens;
+};
+
 struct hotkey
 {
     std::vector<std::string> List;
@@ -180,6 +226,7 @@ struct hotkey
 
     std::string Mode;
     std::string Command;
+    std::vector<kwm_command> Program;
 };
 
 struct container_offset
@@ -199,9 +246,13 @@ struct color
     std::string Format;
 };
 
+/* NOTE(koekeishiya): Lookup maps (keycode, modifier flags of a key press) to an index in Hotkeys.
+ *                    Generic modifiers are expanded into their left and right variants when a
+ *                    hotkey is bound, so that a key press is resolved with a single probe. */
 struct mode
 {
     std::vector<hotkey> Hotkeys;
+    std::unordered_map<uint64_t, std::size_t> Lookup;
     std::string Name;
     color Color;
 
@@ -241,6 +292,7 @@ struct tree_node
 
     split_type SplitMode;
     double SplitRatio;
+    bool Dirty;
 };
 
 struct window_properties
@@ -250,8 +302,12 @@ struct window_properties
     int Float;
     int Scratchpad;
     std::string Role;
+    CFStringRef AXRole;
 };
 
+/* NOTE(koekeishiya): The patterns and CFStrings are built once by KwmAddRule,
+ *                    and the CFStrings are released by KwmClearRules. A pattern
+ *                    is an index into window_rule_patterns, or -1 if unset. */
 struct window_rule
 {
     window_properties Properties;
@@ -260,6 +316,52 @@ struct window_rule
     std::string Name;
     std::string Role;
     std::string CustomRole;
+
+    int ExceptPattern;
+    int OwnerPattern;
+    int NamePattern;
+    CFStringRef AXRole;
+    CFStringRef AXCustomRole;
+    bool OwnerIsLiteral;
+};
+
+/* NOTE(koekeishiya): Rules whose owner is a plain string are grouped by that string.
+ *                    All other rules have to be tested against every window.
+ *                    Both lists hold indices into WindowRules in ascending order. */
+struct window_rule_index
+{
+    std::unordered_map<std::string, std::vector<int> > Owners;
+    std::vector<int> Generic;
+};
+
+/* NOTE(koekeishiya): Every distinct pattern is compiled once, however many rules use it,
+ *                    and is tested at most once per window. */
+struct window_rule_patterns
+{
+    std::vector<std::regex> Regex;
+    std::unordered_map<std::string, int> Lookup;
+};
+
+#define WINDOW_RULE_CACHE_SIZE 256
+
+/* NOTE(koekeishiya): Maps (owner, title, role, subrole) to the rules that pass every test
+ *                    except crole, which depends on roles assigned by earlier rules.
+ *                    Most recently used entries are kept at the front of Entries. */
+struct window_rule_cache_entry
+{
+    std::string Key;
+    std::vector<int> Rules;
+};
+
+struct window_rule_cache
+{
+    std::list<window_rule_cache_entry> Entries;
+    std::unordered_map<std::string, std::list<window_rule_cache_entry>::iterator> Lookup;
+
+    uint64_t Hits;
+    uint64_t Misses;
+    uint64_t Evictions;
+    uint64_t Invalidations;
 };
 
 struct ax_window;
@@ -278,6 +380,76 @@ struct space_settings
     std::string Name;
 };
 
+struct node_index_entry
+{
+    tree_node *Node;
+    link_node *Link;
+};
+
+struct node_pool
+{
+    std::size_t ObjectSize;
+    std::vector<char *> Slabs;
+    std::size_t SlabIndex;
+    std::size_t SlabOffset;
+    void *FreeList;
+
+    uint32_t Allocations;
+    uint64_t TotalAllocations;
+};
+
+/* NOTE(koekeishiya): Answers to kwmc queries, keyed by kwm_event_type, that were computed while
+ *                    the state was at Version. A published snapshot is never modified. */
+struct kwm_snapshot
+{
+    uint64_t Version;
+    std::map<int, std::string> Answers;
+};
+
+/* NOTE(koekeishiya): Appends JSON to a single buffer as it is written; NeedComma tracks
+ *                    whether the next key or value has to be separated from the last one. */
+struct json_writer
+{
+    std::string Buffer;
+    bool NeedComma;
+};
+
+struct layout_stats
+{
+    uint32_t NodesRecomputed;
+    uint32_t WindowsTouched;
+
+    uint32_t LastNodesRecomputed;
+    uint32_t LastWindowsTouched;
+
+    uint64_t TotalNodesRecomputed;
+    uint64_t TotalWindowsTouched;
+    uint64_t Operations;
+
+    uint64_t AXCallsIssued;
+    uint64_t AXCallsElided;
+    uint64_t PlacementsAbandoned;
+};
+
+struct window_placement
+{
+    AXUIElementRef Ref;
+    uint32_t WindowID;
+    pid_t PID;
+
+    int X, Y;
+    int Width, Height;
+    bool Move, Resize;
+
+    bool Moved, Resized;
+    CGPoint Position;
+    CGSize Size;
+    uint32_t CallsIssued;
+
+    bool Done;
+    bool Abandoned;
+};
+
 struct space_info
 {
     space_settings Settings;
@@ -285,6 +457,19 @@ struct space_info
     bool Initialized;
 
     tree_node *RootNode;
+    std::unordered_map<uint32_t, node_index_entry> NodeIndex;
+    node_pool TreeNodePool;
+    node_pool LinkNodePool;
+};
+
+/* NOTE(koekeishiya): Spaces are interned to dense integer handles the first time they are seen.
+ *                    The string identifier is only needed to find the handle of a space again,
+ *                    after axlib has reconstructed its ax_space structs. A deque keeps pointers
+ *                    to space_info stable as new spaces are added. */
+struct space_table
+{
+    std::unordered_map<std::string, int> Handles;
+    std::deque<space_info> Spaces;
 };
 
 struct kwm_mach
@@ -305,11 +490,14 @@ struct kwm_border
     int Width;
 };
 
+/* NOTE(koekeishiya): Generation is bumped whenever a binding is added or removed, or the modes
+ *                    are cleared, which invalidates the position of a binding inside its mode. */
 struct kwm_hotkeys
 {
     std::map<std::string, mode> Modes;
     hotkey MouseDragKey;
     mode *ActiveMode;
+    uint32_t Generation;
 };
 
 struct kwm_path
@@ -340,6 +528,9 @@ struct kwm_settings
     std::map<unsigned int, space_settings> DisplaySettings;
     std::map<space_identifier, space_settings> SpaceSettings;
     std::vector<window_rule> WindowRules;
+    window_rule_index WindowRuleIndex;
+    window_rule_patterns WindowRulePatterns;
+    window_rule_cache WindowRuleCache;
 };
 
 enum kwm_toggleable
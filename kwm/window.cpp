@@ -5,19 +5,22 @@
 #include "space.h"
 #include "tree.h"
 #include "border.h"
+#include "placement.h"
 #include "helpers.h"
 #include "rules.h"
 #include "serializer.h"
 #include "cursor.h"
 #include "scratchpad.h"
+#include "daemon.h"
 #include "axlib/axlib.h"
 
 #include <cmath>
+#include <algorithm>
+#include <unordered_set>
 
 #define internal static
 #define local_persist static
 
-extern std::map<std::string, space_info> WindowTree;
 extern ax_state AXState;
 extern ax_display *FocusedDisplay;
 extern ax_application *FocusedApplication;
@@ -26,6 +29,7 @@ extern ax_window *MarkedWindow;
 extern kwm_settings KWMSettings;
 extern kwm_border MarkedBorder;
 extern kwm_border FocusedBorder;
+extern layout_stats LayoutStats;
 
 internal void
 DrawFocusedBorder(ax_display *Display, ax_window *Window)
@@ -110,7 +114,7 @@ ResizeDisplay(ax_display *Display)
     for(It = Display->Spaces.begin(); It != Display->Spaces.end(); ++It)
     {
         ax_space *Space = &It->second;
-        space_info *SpaceInfo = &WindowTree[Space->Identifier];
+        space_info *SpaceInfo = GetSpaceInfo(Space);
         if(Space == Display->Space)
             UpdateSpaceOfDisplay(Display, SpaceInfo);
         else
@@ -153,6 +157,19 @@ EVENT_CALLBACK(Callback_AXEvent_DisplayChanged)
     ClearBorderIfFullscreenSpace(FocusedDisplay);
 }
 
+internal void
+PublishFocusedWindow(ax_window *Window)
+{
+    if(KwmIsSubscribed(KwmTopic_Focus))
+    {
+        std::string Record = "focus " + std::to_string(Window->ID) + " " + Window->Application->Name;
+        if(Window->Name)
+            Record += " - " + std::string(Window->Name);
+
+        KwmPublishEvent(KwmTopic_Focus, Record);
+    }
+}
+
 /* NOTE(koekeishiya): Event context is a pointer to the display whos space was changed. */
 EVENT_CALLBACK(Callback_AXEvent_SpaceChanged)
 {
@@ -163,7 +180,7 @@ EVENT_CALLBACK(Callback_AXEvent_SpaceChanged)
     ClearMarkedWindow();
 
     FocusedDisplay = Display;
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
 
     AXLibRunningApplications();
     CreateWindowNodeTree(Display);
@@ -214,14 +231,14 @@ EVENT_CALLBACK(Callback_AXEvent_SpaceChanged)
     }
 
     ClearBorderIfFullscreenSpace(Display);
+    if(KwmIsSubscribed(KwmTopic_Space))
+        KwmPublishEvent(KwmTopic_Space, "space " + std::to_string(AXLibDesktopIDFromCGSSpaceID(Display, Display->Space->ID)));
 }
 
-/* NOTE(koekeishiya): Event context is a pointer to the PID of the launched application. */
+/* NOTE(koekeishiya): Event payload is the PID of the launched application. */
 EVENT_CALLBACK(Callback_AXEvent_ApplicationLaunched)
 {
-    pid_t *ApplicationPID = (pid_t *) Event->Context;
-    ax_application *Application = AXLibGetApplicationByPID(*ApplicationPID);
-    free(ApplicationPID);
+    ax_application *Application = AXLibGetApplicationByPID(Event->PID);
 
     if(Application)
     {
@@ -245,12 +262,10 @@ EVENT_CALLBACK(Callback_AXEvent_ApplicationLaunched)
     }
 }
 
-/* NOTE(koekeishiya): Event context is a pointer to the PID of the application. */
+/* NOTE(koekeishiya): Event payload is the PID of the application. */
 EVENT_CALLBACK(Callback_AXEvent_ApplicationHidden)
 {
-    pid_t *ApplicationPID = (pid_t *) Event->Context;
-    ax_application *Application = AXLibGetApplicationByPID(*ApplicationPID);
-    free(ApplicationPID);
+    ax_application *Application = AXLibGetApplicationByPID(Event->PID);
 
     if(Application)
     {
@@ -266,12 +281,10 @@ EVENT_CALLBACK(Callback_AXEvent_ApplicationHidden)
     }
 }
 
-/* NOTE(koekeishiya): Event context is a pointer to the PID of the application. */
+/* NOTE(koekeishiya): Event payload is the PID of the application. */
 EVENT_CALLBACK(Callback_AXEvent_ApplicationVisible)
 {
-    pid_t *ApplicationPID = (pid_t *) Event->Context;
-    ax_application *Application = AXLibGetApplicationByPID(*ApplicationPID);
-    free(ApplicationPID);
+    ax_application *Application = AXLibGetApplicationByPID(Event->PID);
 
     if(Application)
     {
@@ -287,12 +300,10 @@ EVENT_CALLBACK(Callback_AXEvent_ApplicationVisible)
     }
 }
 
-/* NOTE(koekeishiya): Event context is NULL */
+/* NOTE(koekeishiya): Event payload is the PID of the terminated application. */
 EVENT_CALLBACK(Callback_AXEvent_ApplicationTerminated)
 {
-    pid_t *ApplicationPID = (pid_t *) Event->Context;
-    ax_application *Application = AXLibGetApplicationByPID(*ApplicationPID);
-    free(ApplicationPID);
+    ax_application *Application = AXLibGetApplicationByPID(Event->PID);
 
     if(Application)
     {
@@ -312,12 +323,10 @@ EVENT_CALLBACK(Callback_AXEvent_ApplicationTerminated)
     }
 }
 
-/* NOTE(koekeishiya): Event context is a pointer to the PID of the activated application. */
+/* NOTE(koekeishiya): Event payload is the PID of the activated application. */
 EVENT_CALLBACK(Callback_AXEvent_ApplicationActivated)
 {
-    pid_t *ApplicationPID = (pid_t *) Event->Context;
-    ax_application *Application = AXLibGetApplicationByPID(*ApplicationPID);
-    free(ApplicationPID);
+    ax_application *Application = AXLibGetApplicationByPID(Event->PID);
 
     if(Application)
     {
@@ -339,16 +348,16 @@ EVENT_CALLBACK(Callback_AXEvent_ApplicationActivated)
                     Display->Space->FocusedWindow = Application->Focus->ID;
                 }
             }
+
+            PublishFocusedWindow(Application->Focus);
         }
     }
 }
 
-/* NOTE(koekeishiya): Event context is a pointer to the CGWindowID of the new window. */
+/* NOTE(koekeishiya): Event payload is the CGWindowID of the new window. */
 EVENT_CALLBACK(Callback_AXEvent_WindowCreated)
 {
-    uint32_t *WindowID = (uint32_t *) Event->Context;
-    ax_window *Window = GetWindowByID(*WindowID);
-    free(WindowID);
+    ax_window *Window = GetWindowByID(Event->WindowID);
 
     if(Window)
     {
@@ -357,6 +366,9 @@ EVENT_CALLBACK(Callback_AXEvent_WindowCreated)
         else
             DEBUG("AXEvent_WindowCreated: " << Window->Application->Name << " - [Unknown]");
 
+        if(KwmIsSubscribed(KwmTopic_Window))
+            KwmPublishEvent(KwmTopic_Window, "window created " + std::to_string(Window->ID));
+
         if(ApplyWindowRules(Window))
             return;
 
@@ -372,13 +384,11 @@ EVENT_CALLBACK(Callback_AXEvent_WindowCreated)
     }
 }
 
-/* NOTE(koekeishiya): Event context is a pointer to the CGWindowID of the closed window.
+/* NOTE(koekeishiya): Event payload is the CGWindowID of the closed window.
                       Must call AXLibRemoveApplicationWindow() and AXLibDestroyWindow() */
 EVENT_CALLBACK(Callback_AXEvent_WindowDestroyed)
 {
-    uint32_t *WindowID = (uint32_t *) Event->Context;
-    ax_window *Window = GetWindowByID(*WindowID);
-    free(WindowID);
+    ax_window *Window = GetWindowByID(Event->WindowID);
 
     if(Window)
     {
@@ -387,6 +397,9 @@ EVENT_CALLBACK(Callback_AXEvent_WindowDestroyed)
         else
             DEBUG("AXEvent_WindowDestroyed: " << Window->Application->Name << " - [Unknown]");
 
+        if(KwmIsSubscribed(KwmTopic_Window))
+            KwmPublishEvent(KwmTopic_Window, "window destroyed " + std::to_string(Window->ID));
+
         ax_display *Display = AXLibWindowDisplay(Window);
         if(Display)
         {
@@ -411,12 +424,10 @@ EVENT_CALLBACK(Callback_AXEvent_WindowDestroyed)
     }
 }
 
-/* NOTE(koekeishiya): Event context is a pointer to the CGWindowID of the minimized window. */
+/* NOTE(koekeishiya): Event payload is the CGWindowID of the minimized window. */
 EVENT_CALLBACK(Callback_AXEvent_WindowMinimized)
 {
-    uint32_t *WindowID = (uint32_t *) Event->Context;
-    ax_window *Window = GetWindowByID(*WindowID);
-    free(WindowID);
+    ax_window *Window = GetWindowByID(Event->WindowID);
 
     if(Window)
     {
@@ -435,12 +446,10 @@ EVENT_CALLBACK(Callback_AXEvent_WindowMinimized)
     }
 }
 
-/* NOTE(koekeishiya): Event context is a pointer to the CGWindowID of the deminimized window. */
+/* NOTE(koekeishiya): Event payload is the CGWindowID of the deminimized window. */
 EVENT_CALLBACK(Callback_AXEvent_WindowDeminimized)
 {
-    uint32_t *WindowID = (uint32_t *) Event->Context;
-    ax_window *Window = GetWindowByID(*WindowID);
-    free(WindowID);
+    ax_window *Window = GetWindowByID(Event->WindowID);
 
     if(Window)
     {
@@ -460,12 +469,10 @@ EVENT_CALLBACK(Callback_AXEvent_WindowDeminimized)
     }
 }
 
-/* NOTE(koekeishiya): Event context is a pointer to the CGWindowID of the focused window. */
+/* NOTE(koekeishiya): Event payload is the CGWindowID of the focused window. */
 EVENT_CALLBACK(Callback_AXEvent_WindowFocused)
 {
-    uint32_t *WindowID = (uint32_t *) Event->Context;
-    ax_window *Window = GetWindowByID(*WindowID);
-    free(WindowID);
+    ax_window *Window = GetWindowByID(Event->WindowID);
 
     if(Window)
     {
@@ -489,17 +496,17 @@ EVENT_CALLBACK(Callback_AXEvent_WindowFocused)
                     DrawFocusedBorder(Display, Window);
                     Display->Space->FocusedWindow = Window->ID;
                 }
+
+                PublishFocusedWindow(Window);
             }
         }
     }
 }
 
-/* NOTE(koekeishiya): Event context is a pointer to the CGWindowID of the moved window. */
+/* NOTE(koekeishiya): Event payload is the CGWindowID of the moved window. */
 EVENT_CALLBACK(Callback_AXEvent_WindowMoved)
 {
-    uint32_t *WindowID = (uint32_t *) Event->Context;
-    ax_window *Window = GetWindowByID(*WindowID);
-    free(WindowID);
+    ax_window *Window = GetWindowByID(Event->WindowID);
 
     if(Window)
     {
@@ -508,6 +515,9 @@ EVENT_CALLBACK(Callback_AXEvent_WindowMoved)
         else
             DEBUG("AXEvent_WindowMoved: " << Window->Application->Name << " - [Unknown]");
 
+        if(!Event->Intrinsic)
+            Window->Geometry.Valid = false;
+
         if(!Event->Intrinsic && HasFlags(&KWMSettings, Settings_LockToContainer))
             LockWindowToContainerSize(Window);
 
@@ -524,12 +534,10 @@ EVENT_CALLBACK(Callback_AXEvent_WindowMoved)
     }
 }
 
-/* NOTE(koekeishiya): Event context is a pointer to the CGWindowID of the resized window. */
+/* NOTE(koekeishiya): Event payload is the CGWindowID of the resized window. */
 EVENT_CALLBACK(Callback_AXEvent_WindowResized)
 {
-    uint32_t *WindowID = (uint32_t *) Event->Context;
-    ax_window *Window = GetWindowByID(*WindowID);
-    free(WindowID);
+    ax_window *Window = GetWindowByID(Event->WindowID);
 
     if(Window)
     {
@@ -538,6 +546,9 @@ EVENT_CALLBACK(Callback_AXEvent_WindowResized)
         else
             DEBUG("AXEvent_WindowResized: " << Window->Application->Name << " - [Unknown]");
 
+        if(!Event->Intrinsic)
+            Window->Geometry.Valid = false;
+
         if(!Event->Intrinsic && HasFlags(&KWMSettings, Settings_LockToContainer))
             LockWindowToContainerSize(Window);
 
@@ -554,12 +565,10 @@ EVENT_CALLBACK(Callback_AXEvent_WindowResized)
     }
 }
 
-/* NOTE(koekeishiya): Event context is a pointer to the CGWindowID of the window. */
+/* NOTE(koekeishiya): Event payload is the CGWindowID of the window. */
 EVENT_CALLBACK(Callback_AXEvent_WindowTitleChanged)
 {
-    uint32_t *WindowID = (uint32_t *) Event->Context;
-    ax_window *Window = GetWindowByID(*WindowID);
-    free(WindowID);
+    ax_window *Window = GetWindowByID(Event->WindowID);
 
     if(Window)
     {
@@ -612,44 +621,30 @@ GetAllWindowIDsInTree(space_info *Space)
 internal std::vector<uint32_t>
 GetAllAXWindowIDsToRemoveFromTree(std::vector<ax_window *> &VisibleWindows, std::vector<uint32_t> &WindowIDsInTree)
 {
+    std::unordered_set<uint32_t> VisibleWindowIDs;
+    VisibleWindowIDs.reserve(VisibleWindows.size());
+    for(std::size_t WindowIndex = 0; WindowIndex < VisibleWindows.size(); ++WindowIndex)
+        VisibleWindowIDs.insert(VisibleWindows[WindowIndex]->ID);
+
     std::vector<uint32_t> Windows;
     for(std::size_t IDIndex = 0; IDIndex < WindowIDsInTree.size(); ++IDIndex)
     {
-        bool Found = false;
-        for(std::size_t WindowIndex = 0; WindowIndex < VisibleWindows.size(); ++WindowIndex)
-        {
-            if(VisibleWindows[WindowIndex]->ID == WindowIDsInTree[IDIndex])
-            {
-                Found = true;
-                break;
-            }
-        }
-
-        if(!Found)
+        if(VisibleWindowIDs.find(WindowIDsInTree[IDIndex]) == VisibleWindowIDs.end())
             Windows.push_back(WindowIDsInTree[IDIndex]);
     }
 
     return Windows;
 }
 
+/* NOTE(koekeishiya): The node index of the space holds exactly the windows in its tree. */
 internal std::vector<ax_window *>
-GetAllAXWindowsNotInTree(ax_display *Display, std::vector<ax_window *> &VisibleWindows, std::vector<uint32_t> &WindowIDsInTree)
+GetAllAXWindowsNotInTree(ax_display *Display, space_info *SpaceInfo, std::vector<ax_window *> &VisibleWindows)
 {
     std::vector<ax_window *> Windows;
     for(std::size_t WindowIndex = 0; WindowIndex < VisibleWindows.size(); ++WindowIndex)
     {
-        bool Found = false;
         ax_window *Window = VisibleWindows[WindowIndex];
-        for(std::size_t IDIndex = 0; IDIndex < WindowIDsInTree.size(); ++IDIndex)
-        {
-            if(Window->ID == WindowIDsInTree[IDIndex])
-            {
-                Found = true;
-                break;
-            }
-        }
-
-        if((!Found) &&
+        if((SpaceInfo->NodeIndex.find(Window->ID) == SpaceInfo->NodeIndex.end()) &&
            (AXLibSpaceHasWindow(Window, Display->Space->ID)) &&
            (!AXLibStickyWindow(Window)))
             Windows.push_back(Window);
@@ -671,11 +666,11 @@ GetAllWindowIDSOnDisplay(ax_display *Display)
         {
             if(DisplayOfWindow != Display)
             {
-                space_info *SpaceOfWindow = &WindowTree[DisplayOfWindow->Space->Identifier];
+                space_info *SpaceOfWindow = GetSpaceInfo(DisplayOfWindow->Space);
                 if(!SpaceOfWindow->Initialized ||
                    SpaceOfWindow->Settings.Mode == SpaceModeFloating ||
-                   GetTreeNodeFromWindowID(SpaceOfWindow->RootNode, Window->ID) ||
-                   GetLinkNodeFromWindowID(SpaceOfWindow->RootNode, Window->ID))
+                   GetTreeNodeFromWindowID(SpaceOfWindow, Window->ID) ||
+                   GetLinkNodeFromWindowID(SpaceOfWindow, Window->ID))
                     continue;
             }
 
@@ -691,8 +686,14 @@ GetAllWindowIDSOnDisplay(ax_display *Display)
 internal inline bool
 IsWindowInTree(space_info *SpaceInfo, uint32_t WindowID)
 {
+    bool Result = SpaceInfo->NodeIndex.find(WindowID) != SpaceInfo->NodeIndex.end();
+
+#ifdef DEBUG_BUILD
     std::vector<uint32_t> WindowIDs = GetAllWindowIDsInTree(SpaceInfo);
-    return std::find(WindowIDs.begin(), WindowIDs.end(), WindowID) != WindowIDs.end();
+    Assert(Result == (std::find(WindowIDs.begin(), WindowIDs.end(), WindowID) != WindowIDs.end()));
+#endif
+
+    return Result;
 }
 
 /* TODO(koekeishiya): Fix how these settings are stored. */
@@ -727,6 +728,8 @@ AddWindowToBSPTree(ax_display *Display, space_info *SpaceInfo, uint32_t WindowID
         tree_node *Insert = GetFirstPseudoLeafNode(SpaceInfo->RootNode);
         if(Insert && (Insert->WindowID = WindowID))
         {
+            AddNodeTreeToIndex(SpaceInfo, Insert);
+            ValidateNodeIndex(SpaceInfo);
             ApplyTreeNodeContainer(Insert);
             return;
         }
@@ -735,10 +738,10 @@ AddWindowToBSPTree(ax_display *Display, space_info *SpaceInfo, uint32_t WindowID
         ax_application *Application = FocusedApplication ? FocusedApplication : AXLibGetFocusedApplication();
         ax_window *Window = Application ? Application->Focus : NULL;
         if(MarkedWindow && MarkedWindow->ID != WindowID)
-            CurrentNode = GetTreeNodeFromWindowIDOrLinkNode(RootNode, MarkedWindow->ID);
+            CurrentNode = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo, MarkedWindow->ID);
 
         if(!CurrentNode && Window && Window->ID != WindowID)
-            CurrentNode = GetTreeNodeFromWindowIDOrLinkNode(RootNode, Window->ID);
+            CurrentNode = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo, Window->ID);
 
         if(!CurrentNode)
             GetFirstLeafNode(RootNode, (void**)&CurrentNode);
@@ -752,7 +755,7 @@ AddWindowToBSPTree(ax_display *Display, space_info *SpaceInfo, uint32_t WindowID
             {
                 split_type SplitMode = KWMSettings.SplitMode == SPLIT_OPTIMAL ? GetOptimalSplitMode(CurrentNode) : KWMSettings.SplitMode;
                 CreateLeafNodePair(Display, CurrentNode, CurrentNode->WindowID, WindowID, SplitMode);
-                ApplyTreeNodeContainer(CurrentNode);
+                ApplyDirtyTreeNodeContainer(CurrentNode);
             }
             else if(CurrentNode->Type == NodeTypeLink)
             {
@@ -762,19 +765,21 @@ AddWindowToBSPTree(ax_display *Display, space_info *SpaceInfo, uint32_t WindowID
                     while(Link->Next)
                         Link = Link->Next;
 
-                    link_node *NewLink = CreateLinkNode();
+                    link_node *NewLink = CreateLinkNode(SpaceInfo);
                     NewLink->Container = CurrentNode->Container;
 
                     NewLink->WindowID = WindowID;
                     Link->Next = NewLink;
                     NewLink->Prev = Link;
+                    AddLinkNodeToIndex(SpaceInfo, CurrentNode, NewLink);
                     ResizeWindowToContainerSize(NewLink);
                 }
                 else
                 {
-                    CurrentNode->List = CreateLinkNode();
+                    CurrentNode->List = CreateLinkNode(SpaceInfo);
                     CurrentNode->List->Container = CurrentNode->Container;
                     CurrentNode->List->WindowID = WindowID;
+                    AddLinkNodeToIndex(SpaceInfo, CurrentNode, CurrentNode->List);
                     ResizeWindowToContainerSize(CurrentNode->List);
                 }
             }
@@ -785,6 +790,8 @@ AddWindowToBSPTree(ax_display *Display, space_info *SpaceInfo, uint32_t WindowID
                 CurrentNode->WindowID = CurrentNodeWindowID;
                 ResizeWindowToContainerSize(CurrentNode);
             }
+
+            ValidateNodeIndex(SpaceInfo);
         }
     }
 }
@@ -792,11 +799,11 @@ AddWindowToBSPTree(ax_display *Display, space_info *SpaceInfo, uint32_t WindowID
 internal void
 RemoveWindowFromBSPTree(ax_display *Display, uint32_t WindowID)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(!SpaceInfo->RootNode)
         return;
 
-    tree_node *WindowNode = GetTreeNodeFromWindowID(SpaceInfo->RootNode, WindowID);
+    tree_node *WindowNode = GetTreeNodeFromWindowID(SpaceInfo, WindowID);
     if(WindowNode)
     {
         if((SpaceInfo->RootNode != WindowNode) &&
@@ -817,6 +824,7 @@ RemoveWindowFromBSPTree(ax_display *Display, uint32_t WindowID)
             Parent->WindowID = AccessChild->WindowID;
             Parent->Type = AccessChild->Type;
             Parent->List = AccessChild->List;
+            Parent->Dirty = true;
 
             if(AccessChild->LeftChild && AccessChild->RightChild)
             {
@@ -829,21 +837,23 @@ RemoveWindowFromBSPTree(ax_display *Display, uint32_t WindowID)
                 CreateNodeContainers(Display, Parent, true);
             }
 
+            RemoveNodeTreeFromIndex(SpaceInfo, WindowNode);
+            AddNodeTreeToIndex(SpaceInfo, Parent);
+            ValidateNodeIndex(SpaceInfo);
             ResizeLinkNodeContainers(Parent);
-            ApplyTreeNodeContainer(Parent);
-            free(AccessChild);
-            free(WindowNode);
+            ApplyDirtyTreeNodeContainer(Parent);
+            FreeTreeNode(SpaceInfo, AccessChild);
+            FreeTreeNode(SpaceInfo, WindowNode);
         }
         else if(!Parent)
         {
-            free(SpaceInfo->RootNode);
-            SpaceInfo->RootNode = NULL;
+            DestroyNodeTree(SpaceInfo);
         }
     }
     else
     {
-        link_node *Link = GetLinkNodeFromWindowID(SpaceInfo->RootNode, WindowID);
-        tree_node *Root = GetTreeNodeFromLink(SpaceInfo->RootNode, Link);
+        link_node *Link = GetLinkNodeFromWindowID(SpaceInfo, WindowID);
+        tree_node *Root = GetTreeNodeFromLink(SpaceInfo, Link);
         if(Link)
         {
             if(SpaceInfo->RootNode->WindowID == WindowID)
@@ -867,7 +877,9 @@ RemoveWindowFromBSPTree(ax_display *Display, uint32_t WindowID)
             if(Link == Root->List)
                 Root->List = NULL;
 
-            free(Link);
+            RemoveWindowFromIndex(SpaceInfo, WindowID);
+            ValidateNodeIndex(SpaceInfo);
+            FreeLinkNode(SpaceInfo, Link);
         }
     }
 }
@@ -881,13 +893,15 @@ AddWindowToMonocleTree(ax_display *Display, space_info *SpaceInfo, uint32_t Wind
         while(Link->Next)
             Link = Link->Next;
 
-        link_node *NewLink = CreateLinkNode();
+        link_node *NewLink = CreateLinkNode(SpaceInfo);
         SetLinkNodeContainer(Display, NewLink);
 
         NewLink->WindowID = WindowID;
         Link->Next = NewLink;
         NewLink->Prev = Link;
 
+        AddLinkNodeToIndex(SpaceInfo, SpaceInfo->RootNode, NewLink);
+        ValidateNodeIndex(SpaceInfo);
         ResizeWindowToContainerSize(NewLink);
     }
 }
@@ -895,7 +909,7 @@ AddWindowToMonocleTree(ax_display *Display, space_info *SpaceInfo, uint32_t Wind
 internal void
 RemoveWindowFromMonocleTree(ax_display *Display, uint32_t WindowID)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(SpaceInfo->RootNode && SpaceInfo->RootNode->List)
     {
         link_node *Link = GetLinkNodeFromTree(SpaceInfo->RootNode, WindowID);
@@ -916,11 +930,14 @@ RemoveWindowFromMonocleTree(ax_display *Display, uint32_t WindowID)
 
                 if(!SpaceInfo->RootNode->List)
                 {
-                    free(SpaceInfo->RootNode);
-                    SpaceInfo->RootNode = NULL;
+                    DestroyNodeTree(SpaceInfo);
+                    return;
                 }
             }
-            free(Link);
+
+            RemoveWindowFromIndex(SpaceInfo, WindowID);
+            ValidateNodeIndex(SpaceInfo);
+            FreeLinkNode(SpaceInfo, Link);
         }
     }
 }
@@ -940,15 +957,18 @@ CreateSpaceInfoWithWindowTree(ax_display *Display, space_info *SpaceInfo, std::v
     else
     {
         SpaceInfo->RootNode = CreateTreeFromWindowIDList(Display, Windows);
+        RebuildNodeIndex(SpaceInfo);
     }
 
+    ValidateNodeIndex(SpaceInfo);
+
     if(SpaceInfo->RootNode)
         ApplyTreeNodeContainer(SpaceInfo->RootNode);
 }
 
 void CreateWindowNodeTree(ax_display *Display)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(!SpaceInfo->Initialized && !SpaceInfo->RootNode)
     {
         std::vector<ax_window *> KnownWindows = AXLibGetAllKnownWindows();
@@ -974,12 +994,13 @@ void LoadWindowNodeTree(ax_display *Display, std::string Layout)
 {
     if(Display)
     {
-        space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+        space_info *SpaceInfo = GetSpaceInfo(Display->Space);
         if(SpaceInfo->Settings.Mode == SpaceModeBSP)
         {
             std::vector<uint32_t> Windows = GetAllWindowIDSOnDisplay(Display);
             LoadBSPTreeFromFile(Display, SpaceInfo, Layout);
             FillDeserializedTree(SpaceInfo->RootNode, Display, &Windows);
+            ValidateNodeIndex(SpaceInfo);
             ApplyTreeNodeContainer(SpaceInfo->RootNode);
         }
     }
@@ -992,12 +1013,11 @@ void ResetWindowNodeTree(ax_display *Display, space_tiling_option Mode)
         if(AXLibIsSpaceTransitionInProgress())
             return;
 
-        space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+        space_info *SpaceInfo = GetSpaceInfo(Display->Space);
         if(SpaceInfo->Settings.Mode == Mode)
             return;
 
-        DestroyNodeTree(SpaceInfo->RootNode);
-        SpaceInfo->RootNode = NULL;
+        DestroyNodeTree(SpaceInfo);
         SpaceInfo->Initialized = true;
         SpaceInfo->Settings.Mode = Mode;
         CreateWindowNodeTree(Display);
@@ -1006,7 +1026,7 @@ void ResetWindowNodeTree(ax_display *Display, space_tiling_option Mode)
 
 void AddWindowToNodeTree(ax_display *Display, uint32_t WindowID)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(!SpaceInfo->RootNode)
         CreateWindowNodeTree(Display);
     else if((SpaceInfo->Settings.Mode == SpaceModeBSP) &&
@@ -1019,7 +1039,7 @@ void AddWindowToNodeTree(ax_display *Display, uint32_t WindowID)
 
 void RemoveWindowFromNodeTree(ax_display *Display, uint32_t WindowID)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(SpaceInfo->Settings.Mode == SpaceModeBSP)
         RemoveWindowFromBSPTree(Display, WindowID);
     else if(SpaceInfo->Settings.Mode == SpaceModeMonocle)
@@ -1029,12 +1049,12 @@ void RemoveWindowFromNodeTree(ax_display *Display, uint32_t WindowID)
 internal void
 RebalanceBSPTree(ax_display *Display)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(SpaceInfo->RootNode)
     {
         std::vector<ax_window *> VisibleWindows = AXLibGetAllVisibleWindows();
         std::vector<uint32_t> WindowIDsInTree = GetAllWindowIDsInTree(SpaceInfo);
-        std::vector<ax_window *> WindowsToAdd = GetAllAXWindowsNotInTree(Display, VisibleWindows, WindowIDsInTree);
+        std::vector<ax_window *> WindowsToAdd = GetAllAXWindowsNotInTree(Display, SpaceInfo, VisibleWindows);
         std::vector<uint32_t> WindowsToRemove = GetAllAXWindowIDsToRemoveFromTree(VisibleWindows, WindowIDsInTree);
 
         for(std::size_t WindowIndex = 0; WindowIndex < WindowsToRemove.size(); ++WindowIndex)
@@ -1054,12 +1074,12 @@ RebalanceBSPTree(ax_display *Display)
 internal void
 RebalanceMonocleTree(ax_display *Display)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(SpaceInfo->RootNode && SpaceInfo->RootNode->List)
     {
         std::vector<ax_window *> VisibleWindows = AXLibGetAllVisibleWindows();
         std::vector<uint32_t> WindowIDsInTree = GetAllWindowIDsInTree(SpaceInfo);
-        std::vector<ax_window *> WindowsToAdd = GetAllAXWindowsNotInTree(Display, VisibleWindows, WindowIDsInTree);
+        std::vector<ax_window *> WindowsToAdd = GetAllAXWindowsNotInTree(Display, SpaceInfo, VisibleWindows);
         std::vector<uint32_t> WindowsToRemove = GetAllAXWindowIDsToRemoveFromTree(VisibleWindows, WindowIDsInTree);
 
         for(std::size_t WindowIndex = 0; WindowIndex < WindowsToRemove.size(); ++WindowIndex)
@@ -1081,7 +1101,7 @@ RebalanceMonocleTree(ax_display *Display)
  * Also attempt to tile any untiled window that is not marked as  floating. */
 void RebalanceNodeTree(ax_display *Display)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(!SpaceInfo->Initialized)
         return;
 
@@ -1093,7 +1113,7 @@ void RebalanceNodeTree(ax_display *Display)
 
 void CreateInactiveWindowNodeTree(ax_display *Display, std::vector<uint32_t> *Windows)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(!SpaceInfo->Initialized && !SpaceInfo->RootNode)
     {
         SpaceInfo->Initialized = true;
@@ -1108,7 +1128,7 @@ void CreateInactiveWindowNodeTree(ax_display *Display, std::vector<uint32_t> *Wi
 
 void AddWindowToInactiveNodeTree(ax_display *Display, uint32_t WindowID)
 {
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(!SpaceInfo->RootNode)
     {
         std::vector<uint32_t> Windows;
@@ -1123,7 +1143,8 @@ void AddWindowToInactiveNodeTree(ax_display *Display, uint32_t WindowID)
         split_type SplitMode = KWMSettings.SplitMode == SPLIT_OPTIMAL ? GetOptimalSplitMode(CurrentNode) : KWMSettings.SplitMode;
 
         CreateLeafNodePair(Display, CurrentNode, CurrentNode->WindowID, WindowID, SplitMode);
-        ApplyTreeNodeContainer(CurrentNode);
+        ValidateNodeIndex(SpaceInfo);
+        ApplyDirtyTreeNodeContainer(CurrentNode);
     }
     else if(SpaceInfo->Settings.Mode == SpaceModeMonocle)
     {
@@ -1132,12 +1153,14 @@ void AddWindowToInactiveNodeTree(ax_display *Display, uint32_t WindowID)
         while(Link->Next)
             Link = Link->Next;
 
-        link_node *NewLink = CreateLinkNode();
+        link_node *NewLink = CreateLinkNode(SpaceInfo);
         SetLinkNodeContainer(Display, NewLink);
 
         NewLink->WindowID = WindowID;
         Link->Next = NewLink;
         NewLink->Prev = Link;
+        AddLinkNodeToIndex(SpaceInfo, SpaceInfo->RootNode, NewLink);
+        ValidateNodeIndex(SpaceInfo);
         ResizeWindowToContainerSize(NewLink);
     }
 }
@@ -1190,14 +1213,14 @@ void ToggleFocusedWindowParentContainer()
     if(!Display)
         return;
 
-    space_info *Space = &WindowTree[Display->Space->Identifier];
+    space_info *Space = GetSpaceInfo(Display->Space);
     if(!Space->RootNode)
         return;
 
     if(Space->Settings.Mode != SpaceModeBSP)
         return;
 
-    tree_node *Node = GetTreeNodeFromWindowID(Space->RootNode, Window->ID);
+    tree_node *Node = GetTreeNodeFromWindowID(Space, Window->ID);
     if(Node && Node->Parent)
     {
         if(IsLeafNode(Node) && Node->Parent->WindowID == 0)
@@ -1225,7 +1248,7 @@ void ToggleFocusedWindowFullscreen()
     if(!Display)
         return;
 
-    space_info *Space = &WindowTree[Display->Space->Identifier];
+    space_info *Space = GetSpaceInfo(Display->Space);
     if(!Space->RootNode)
         return;
 
@@ -1235,7 +1258,7 @@ void ToggleFocusedWindowFullscreen()
     tree_node *Node = NULL;
     if(Space->RootNode->WindowID == 0)
     {
-        Node = GetTreeNodeFromWindowID(Space->RootNode, Window->ID);
+        Node = GetTreeNodeFromWindowID(Space, Window->ID);
         if(Node)
         {
             DEBUG("ToggleFocusedWindowFullscreen() Set fullscreen");
@@ -1247,7 +1270,7 @@ void ToggleFocusedWindowFullscreen()
     {
         DEBUG("ToggleFocusedWindowFullscreen() Restore old size");
         Space->RootNode->WindowID = 0;
-        Node = GetTreeNodeFromWindowID(Space->RootNode, Window->ID);
+        Node = GetTreeNodeFromWindowID(Space, Window->ID);
         if(Node)
         {
             ResizeWindowToContainerSize(Node);
@@ -1261,7 +1284,7 @@ bool IsWindowFullscreen(ax_window *Window)
     if(!Display)
         return false;
 
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     return SpaceInfo->RootNode && SpaceInfo->RootNode->WindowID == Window->ID;
 }
 
@@ -1271,8 +1294,8 @@ bool IsWindowParentContainer(ax_window *Window)
     if(!Display)
         return false;
 
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
-    tree_node *Node = GetTreeNodeFromWindowID(SpaceInfo->RootNode, Window->ID);
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
+    tree_node *Node = GetTreeNodeFromWindowID(SpaceInfo, Window->ID);
     return Node && Node->Parent && Node->Parent->WindowID == Window->ID;
 }
 
@@ -1284,8 +1307,8 @@ void LockWindowToContainerSize(ax_window *Window)
         if(!Display)
             return;
 
-        space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
-        tree_node *Node = GetTreeNodeFromWindowID(SpaceInfo->RootNode, Window->ID);
+        space_info *SpaceInfo = GetSpaceInfo(Display->Space);
+        tree_node *Node = GetTreeNodeFromWindowID(SpaceInfo, Window->ID);
         if(Node)
         {
             if(IsWindowFullscreen(Window))
@@ -1348,14 +1371,14 @@ void SwapFocusedWindowWithMarked()
     if(!Display)
         return;
 
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
-    tree_node *TreeNode = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo->RootNode, FocusedWindow->ID);
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
+    tree_node *TreeNode = GetTreeNodeFromWindowIDOrLinkNode(SpaceInfo, FocusedWindow->ID);
     if(TreeNode)
     {
-        tree_node *NewFocusNode = GetTreeNodeFromWindowID(SpaceInfo->RootNode, MarkedWindow->ID);
+        tree_node *NewFocusNode = GetTreeNodeFromWindowID(SpaceInfo, MarkedWindow->ID);
         if(NewFocusNode)
         {
-            SwapNodeWindowIDs(TreeNode, NewFocusNode);
+            SwapNodeWindowIDs(SpaceInfo, TreeNode, NewFocusNode);
             MoveCursorToCenterOfFocusedWindow();
         }
     }
@@ -1373,7 +1396,7 @@ void SwapFocusedWindowWithNearest(int Shift)
     if(!Display)
         return;
 
-    space_info *Space = &WindowTree[Display->Space->Identifier];
+    space_info *Space = GetSpaceInfo(Display->Space);
     if(!Space)
         return;
 
@@ -1395,14 +1418,14 @@ void SwapFocusedWindowWithNearest(int Shift)
 
             if(ShiftNode)
             {
-                SwapNodeWindowIDs(Link, ShiftNode);
+                SwapNodeWindowIDs(Space, Link, ShiftNode);
                 MoveCursorToCenterOfWindow(Window);
             }
         }
     }
     else if(Space->Settings.Mode == SpaceModeBSP)
     {
-        tree_node *TreeNode = GetTreeNodeFromWindowIDOrLinkNode(Space->RootNode, Window->ID);
+        tree_node *TreeNode = GetTreeNodeFromWindowIDOrLinkNode(Space, Window->ID);
         if(TreeNode)
         {
             tree_node *NewFocusNode = NULL;;
@@ -1414,7 +1437,7 @@ void SwapFocusedWindowWithNearest(int Shift)
 
             if(NewFocusNode)
             {
-                SwapNodeWindowIDs(TreeNode, NewFocusNode);
+                SwapNodeWindowIDs(Space, TreeNode, NewFocusNode);
                 MoveCursorToCenterOfWindow(Window);
             }
         }
@@ -1431,23 +1454,28 @@ void SwapFocusedWindowDirected(int Degrees)
     if(!Display)
         return;
 
-    space_info *Space = &WindowTree[Display->Space->Identifier];
+    space_info *Space = GetSpaceInfo(Display->Space);
     if(!Space)
         return;
 
     if(Space->Settings.Mode == SpaceModeBSP)
     {
-        tree_node *TreeNode = GetTreeNodeFromWindowIDOrLinkNode(Space->RootNode, Window->ID);
+        tree_node *TreeNode = GetTreeNodeFromWindowIDOrLinkNode(Space, Window->ID);
         if(TreeNode)
         {
             tree_node *NewFocusNode = NULL;
+            space_info *NewFocusSpace = NULL;
             ax_window *ClosestWindow = NULL;
             if(FindClosestWindow(Degrees, &ClosestWindow, KWMSettings.Cycle == CycleModeScreen))
-                NewFocusNode = GetTreeNodeFromWindowID(Space->RootNode, ClosestWindow->ID);
+            {
+                ax_display *NewFocusDisplay = AXLibWindowDisplay(ClosestWindow);
+                NewFocusSpace = NewFocusDisplay ? GetSpaceInfo(NewFocusDisplay->Space) : NULL;
+                NewFocusNode = GetTreeNodeFromWindowID(NewFocusSpace, ClosestWindow->ID);
+            }
 
             if(NewFocusNode)
             {
-                SwapNodeWindowIDs(TreeNode, NewFocusNode);
+                SwapNodeWindowIDs(Space, TreeNode, NewFocusSpace, NewFocusNode);
                 Window->Position = AXLibGetWindowPosition(Window->Ref);
                 Window->Size = AXLibGetWindowSize(Window->Ref);
                 MoveCursorToCenterOfWindow(Window);
@@ -1463,36 +1491,56 @@ void SwapFocusedWindowDirected(int Degrees)
     }
 }
 
+internal inline bool
+ContainersOverlapInDirection(node_container *A, node_container *B, int Degrees)
+{
+    if(Degrees == 0 || Degrees == 180)
+        return fmax(A->X, B->X) < fmin(B->X + B->Width, A->X + A->Width);
+    else if(Degrees == 90 || Degrees == 270)
+        return fmax(A->Y, B->Y) < fmin(B->Y + B->Height, A->Y + A->Height);
+
+    return false;
+}
+
+internal inline bool
+ContainerIsInDirection(node_container *A, node_container *B, int Degrees)
+{
+    if(Degrees == 0 || Degrees == 180)
+        return A->Y != B->Y && ContainersOverlapInDirection(A, B, Degrees);
+    else if(Degrees == 90 || Degrees == 270)
+        return A->X != B->X && ContainersOverlapInDirection(A, B, Degrees);
+
+    return false;
+}
+
 bool WindowIsInDirection(ax_window *WindowA, ax_window *WindowB, int Degrees)
 {
     ax_display *Display = AXLibWindowDisplay(WindowA);
-    space_info *Space = &WindowTree[Display->Space->Identifier];
-    tree_node *NodeA = GetTreeNodeFromWindowIDOrLinkNode(Space->RootNode, WindowA->ID);
-    tree_node *NodeB = GetTreeNodeFromWindowIDOrLinkNode(Space->RootNode, WindowB->ID);
+    space_info *Space = GetSpaceInfo(Display->Space);
+    tree_node *NodeA = GetTreeNodeFromWindowIDOrLinkNode(Space, WindowA->ID);
+    tree_node *NodeB = GetTreeNodeFromWindowIDOrLinkNode(Space, WindowB->ID);
 
     if(!NodeA || !NodeB || NodeA == NodeB)
         return false;
 
-    node_container *A = &NodeA->Container;
-    node_container *B = &NodeB->Container;
-
-    if(Degrees == 0 || Degrees == 180)
-        return A->Y != B->Y && fmax(A->X, B->X) < fmin(B->X + B->Width, A->X + A->Width);
-    else if(Degrees == 90 || Degrees == 270)
-        return A->X != B->X && fmax(A->Y, B->Y) < fmin(B->Y + B->Height, A->Y + A->Height);
+    return ContainerIsInDirection(&NodeA->Container, &NodeB->Container, Degrees);
+}
 
-    return false;
+internal inline void
+GetCenterOfContainer(node_container *Container, int *X, int *Y)
+{
+    *X = Container->X + Container->Width / 2;
+    *Y = Container->Y + Container->Height / 2;
 }
 
 void GetCenterOfWindow(ax_window *Window, int *X, int *Y)
 {
     ax_display *Display = AXLibWindowDisplay(Window);
-    space_info *Space = &WindowTree[Display->Space->Identifier];
-    tree_node *Node = GetTreeNodeFromWindowIDOrLinkNode(Space->RootNode, Window->ID);
+    space_info *Space = GetSpaceInfo(Display->Space);
+    tree_node *Node = GetTreeNodeFromWindowIDOrLinkNode(Space, Window->ID);
     if(Node)
     {
-        *X = Node->Container.X + Node->Container.Width / 2;
-        *Y = Node->Container.Y + Node->Container.Height / 2;
+        GetCenterOfContainer(&Node->Container, X, Y);
     }
     else
     {
@@ -1501,15 +1549,10 @@ void GetCenterOfWindow(ax_window *Window, int *X, int *Y)
     }
 }
 
-double GetWindowDistance(ax_window *A, ax_window *B, int Degrees, bool Wrap)
+internal double
+GetCenterDistance(int X1, int Y1, int X2, int Y2, ax_display *Display, int Degrees, bool Wrap)
 {
-    ax_display *Display = AXLibWindowDisplay(A);
     double Rank = INT_MAX;
-
-    int X1, Y1, X2, Y2;
-    GetCenterOfWindow(A, &X1, &Y1);
-    GetCenterOfWindow(B, &X2, &Y2);
-
     if(Wrap)
     {
         if(Degrees == 0 && Y1 < Y2)
@@ -1547,31 +1590,182 @@ double GetWindowDistance(ax_window *A, ax_window *B, int Degrees, bool Wrap)
     return Rank;
 }
 
-bool FindClosestWindow(int Degrees, ax_window **ClosestWindow, bool Wrap)
+double GetWindowDistance(ax_window *A, ax_window *B, int Degrees, bool Wrap)
 {
-    ax_window *Match = FocusedApplication->Focus;
-    std::vector<ax_window*> Windows = AXLibGetAllVisibleWindows();
+    ax_display *Display = AXLibWindowDisplay(A);
+
+    int X1, Y1, X2, Y2;
+    GetCenterOfWindow(A, &X1, &Y1);
+    GetCenterOfWindow(B, &X2, &Y2);
+
+    return GetCenterDistance(X1, Y1, X2, Y2, Display, Degrees, Wrap);
+}
+
+struct directed_candidate
+{
+    double Dist;
+    tree_node *Node;
+};
+
+struct directed_search
+{
+    node_container Origin;
+    ax_display *Display;
+    int Degrees;
+    bool Wrap;
+    int X, Y;
+
+    std::vector<directed_candidate> Candidates;
+};
+
+/* NOTE(koekeishiya): The bsp-tree doubles as a bounding volume hierarchy; every
+ * container encloses the containers of its children, so a subtree that does not
+ * overlap the origin on the axis orthogonal to the direction can never hold a
+ * candidate and is skipped without visiting its leaves. Containers are updated by
+ * the tree itself, so there is nothing extra to keep in sync. Pseudo leaves hold
+ * no window and are never a candidate. */
+internal void
+SearchClosestLeafNode(tree_node *Node, directed_search *Search)
+{
+    if(!Node)
+        return;
+
+    if(!ContainersOverlapInDirection(&Search->Origin, &Node->Container, Search->Degrees))
+        return;
 
-    int MatchX, MatchY;
-    GetCenterOfWindow(Match, &MatchX, &MatchY);
+    if(IsLeafNode(Node))
+    {
+        if((Node->WindowID == 0 && !Node->List) ||
+           (!ContainerIsInDirection(&Search->Origin, &Node->Container, Search->Degrees)))
+            return;
+
+        int X, Y;
+        GetCenterOfContainer(&Node->Container, &X, &Y);
+        double Dist = GetCenterDistance(Search->X, Search->Y, X, Y,
+                                        Search->Display, Search->Degrees, Search->Wrap);
+        if(Dist != INT_MAX)
+            Search->Candidates.push_back({ Dist, Node });
+
+        return;
+    }
+
+    SearchClosestLeafNode(Node->LeftChild, Search);
+    SearchClosestLeafNode(Node->RightChild, Search);
+}
+
+internal inline bool
+LeafNodeContainsWindow(tree_node *Node, uint32_t WindowID)
+{
+    if(Node->WindowID == WindowID)
+        return true;
+
+    for(link_node *Link = Node->List; Link; Link = Link->Next)
+    {
+        if(Link->WindowID == WindowID)
+            return true;
+    }
+
+    return false;
+}
+
+internal inline bool
+DirectedCandidateIsCloser(const directed_candidate &A, const directed_candidate &B)
+{
+    return A.Dist < B.Dist;
+}
 
-    double MinDist = INT_MAX;
-    for(int Index = 0; Index < Windows.size(); ++Index)
+/* NOTE(koekeishiya): Several windows can share a rank, either because they are
+ * stacked in the same leaf through link-nodes or because the layout is symmetric.
+ * Those ties are resolved by the window order reported by the window server, so we
+ * only ask for it in that (rare) case. A leaf whose window is gone or minimized is
+ * passed over, and the next rank is tried instead. */
+internal ax_window *
+ResolveClosestWindow(std::vector<directed_candidate> &Candidates)
+{
+    std::stable_sort(Candidates.begin(), Candidates.end(), DirectedCandidateIsCloser);
+
+    bool HasVisibleWindows = false;
+    std::vector<ax_window*> Windows;
+    for(std::size_t First = 0; First < Candidates.size();)
     {
-        ax_window *Window = Windows[Index];
-        if(Match->ID != Window->ID &&
-           WindowIsInDirection(Match, Window, Degrees))
+        std::size_t Last = First + 1;
+        while(Last < Candidates.size() && Candidates[Last].Dist == Candidates[First].Dist)
+            ++Last;
+
+        tree_node *Node = Candidates[First].Node;
+        if(Last == First + 1 && !Node->List)
+        {
+            ax_window *Window = GetWindowByID(Node->WindowID);
+            if(Window && !AXLibHasFlags(Window, AXWindow_Minimized))
+                return Window;
+        }
+        else
         {
-            double Dist = GetWindowDistance(Match, Window, Degrees, Wrap);
-            if(Dist < MinDist)
+            if(!HasVisibleWindows)
             {
-                MinDist = Dist;
-                *ClosestWindow = Window;
+                Windows = AXLibGetAllVisibleWindows();
+                HasVisibleWindows = true;
+            }
+
+            for(std::size_t WindowIndex = 0; WindowIndex < Windows.size(); ++WindowIndex)
+            {
+                for(std::size_t Index = First; Index < Last; ++Index)
+                {
+                    if(LeafNodeContainsWindow(Candidates[Index].Node, Windows[WindowIndex]->ID))
+                        return Windows[WindowIndex];
+                }
             }
         }
+
+        First = Last;
+    }
+
+    return NULL;
+}
+
+/* NOTE(koekeishiya): Containers are in global coordinates, so the trees of the
+ * spaces that are active on the other displays are searched as well, the way the
+ * scan over all visible windows used to reach them. Wrapping only applies to the
+ * display of the focused window. */
+bool FindClosestWindow(int Degrees, ax_window **ClosestWindow, bool Wrap)
+{
+    ax_window *Match = FocusedApplication->Focus;
+    ax_display *Display = AXLibWindowDisplay(Match);
+    if(!Display)
+        return false;
+
+    space_info *Space = GetSpaceInfo(Display->Space);
+    tree_node *Origin = GetTreeNodeFromWindowIDOrLinkNode(Space, Match->ID);
+    if(!Origin)
+        return false;
+
+    directed_search Search = {};
+    Search.Origin = Origin->Container;
+    Search.Display = Display;
+    Search.Degrees = Degrees;
+    Search.Wrap = Wrap;
+    GetCenterOfContainer(&Origin->Container, &Search.X, &Search.Y);
+
+    SearchClosestLeafNode(Space->RootNode, &Search);
+    Search.Wrap = false;
+    std::map<CGDirectDisplayID, ax_display>::iterator It;
+    for(It = AXState.Displays.begin(); It != AXState.Displays.end(); ++It)
+    {
+        ax_display *Other = &It->second;
+        if(Other == Display || !Other->Space)
+            continue;
+
+        space_info *OtherSpace = FindSpaceInfo(Other->Space);
+        if(OtherSpace && OtherSpace->Settings.Mode == SpaceModeBSP)
+            SearchClosestLeafNode(OtherSpace->RootNode, &Search);
     }
 
-    return MinDist != INT_MAX;
+    ax_window *Window = ResolveClosestWindow(Search.Candidates);
+    if(!Window)
+        return false;
+
+    *ClosestWindow = Window;
+    return true;
 }
 
 void ShiftWindowFocusDirected(int Degrees)
@@ -1592,7 +1786,7 @@ void ShiftWindowFocusDirected(int Degrees)
     if(!Display)
         return;
 
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(SpaceInfo->Settings.Mode == SpaceModeBSP)
     {
         ax_window *ClosestWindow = NULL;
@@ -1632,7 +1826,7 @@ void ShiftWindowFocus(int Shift)
     if(!Display)
         return;
 
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(SpaceInfo->Settings.Mode == SpaceModeMonocle)
     {
         link_node *Link = GetLinkNodeFromTree(SpaceInfo->RootNode, Window->ID);
@@ -1658,7 +1852,7 @@ void ShiftWindowFocus(int Shift)
     }
     else if(SpaceInfo->Settings.Mode == SpaceModeBSP)
     {
-        tree_node *TreeNode = GetTreeNodeFromWindowID(SpaceInfo->RootNode, Window->ID);
+        tree_node *TreeNode = GetTreeNodeFromWindowID(SpaceInfo, Window->ID);
         if(TreeNode)
         {
             tree_node *FocusNode = NULL;
@@ -1706,11 +1900,11 @@ void ShiftSubTreeWindowFocus(int Shift)
     if(!Display)
         return;
 
-    space_info *SpaceInfo = &WindowTree[Display->Space->Identifier];
+    space_info *SpaceInfo = GetSpaceInfo(Display->Space);
     if(SpaceInfo->Settings.Mode == SpaceModeBSP)
     {
-        link_node *Link = GetLinkNodeFromWindowID(SpaceInfo->RootNode, Window->ID);
-        tree_node *Root = GetTreeNodeFromLink(SpaceInfo->RootNode, Link);
+        link_node *Link = GetLinkNodeFromWindowID(SpaceInfo, Window->ID);
+        tree_node *Root = GetTreeNodeFromLink(SpaceInfo, Link);
         if(Link)
         {
             link_node *FocusNode = NULL;
@@ -1732,7 +1926,7 @@ void ShiftSubTreeWindowFocus(int Shift)
         }
         else if(Shift == 1)
         {
-            tree_node *Root = GetTreeNodeFromWindowID(SpaceInfo->RootNode, Window->ID);
+            tree_node *Root = GetTreeNodeFromWindowID(SpaceInfo, Window->ID);
             if(Root)
             {
                 SetWindowFocusByNode(Root->List);
@@ -1806,10 +2000,12 @@ void SetWindowFocusByNode(link_node *Link)
     }
 }
 
+/* NOTE(koekeishiya): Expects Window->Position and Window->Size to hold the geometry the window
+                     actually ended up with after the last placement. */
 void CenterWindowInsideNodeContainer(ax_window *Window, int *Xptr, int *Yptr, int *Wptr, int *Hptr)
 {
-    CGPoint WindowOrigin = AXLibGetWindowPosition(Window->Ref);
-    CGSize WindowOGSize = AXLibGetWindowSize(Window->Ref);
+    CGPoint WindowOrigin = Window->Position;
+    CGSize WindowOGSize = Window->Size;
 
     int &X = *Xptr, &Y = *Yptr, &Width = *Wptr, &Height = *Hptr;
     int XDiff = (X + Width) - (WindowOrigin.x + WindowOGSize.width);
@@ -1832,32 +2028,97 @@ void CenterWindowInsideNodeContainer(ax_window *Window, int *Xptr, int *Yptr, in
         AXLibAddFlags(Window, AXWindow_SizeIntrinsic);
         if(!AXLibSetWindowSize(Window->Ref, Width, Height))
             AXLibClearFlags(Window, AXWindow_SizeIntrinsic);
+
+        __atomic_add_fetch(&LayoutStats.AXCallsIssued, 2, __ATOMIC_RELAXED);
     }
 }
 
+/* NOTE(koekeishiya): A window that refuses the requested geometry (e.g. because of a minimum size)
+                     would otherwise be sent the same AX requests on every layout pass. */
+internal bool
+IsWindowGeometryCommitted(ax_window *Window, int X, int Y, int Width, int Height)
+{
+    ax_window_geometry *Geometry = &Window->Geometry;
+    return Geometry->Valid &&
+           Geometry->Position.x == X &&
+           Geometry->Position.y == Y &&
+           Geometry->Size.width == Width &&
+           Geometry->Size.height == Height &&
+           Geometry->ObservedPosition.x == Window->Position.x &&
+           Geometry->ObservedPosition.y == Window->Position.y &&
+           Geometry->ObservedSize.width == Window->Size.width &&
+           Geometry->ObservedSize.height == Window->Size.height;
+}
+
+internal void
+CommitWindowGeometry(ax_window *Window, int X, int Y, int Width, int Height)
+{
+    ax_window_geometry *Geometry = &Window->Geometry;
+    Geometry->Position = CGPointMake(X, Y);
+    Geometry->Size = CGSizeMake(Width, Height);
+    Geometry->ObservedPosition = Window->Position;
+    Geometry->ObservedSize = Window->Size;
+    Geometry->Valid = true;
+}
+
+void CompleteWindowPlacement(ax_window *Window, window_placement *Placement)
+{
+    __atomic_add_fetch(&LayoutStats.AXCallsIssued, Placement->CallsIssued, __ATOMIC_RELAXED);
+    if(!Window)
+        return;
+
+    if(Placement->Move && !Placement->Moved)
+        AXLibClearFlags(Window, AXWindow_MoveIntrinsic);
+
+    if(Placement->Resize && !Placement->Resized)
+        AXLibClearFlags(Window, AXWindow_SizeIntrinsic);
+
+    Window->Position = Placement->Position;
+    Window->Size = Placement->Size;
+
+    int X = Placement->X, Y = Placement->Y;
+    int Width = Placement->Width, Height = Placement->Height;
+    CenterWindowInsideNodeContainer(Window, &X, &Y, &Width, &Height);
+    CommitWindowGeometry(Window, Placement->X, Placement->Y, Placement->Width, Placement->Height);
+}
+
 void SetWindowDimensions(ax_window *Window, int X, int Y, int Width, int Height)
 {
-    bool Changed = false;
-    if((Window->Position.x != X) ||
-       (Window->Position.y != Y))
+    if(IsWindowGeometryCommitted(Window, X, Y, Width, Height))
     {
-        Changed = true;
-        AXLibAddFlags(Window, AXWindow_MoveIntrinsic);
-        if(!AXLibSetWindowPosition(Window->Ref, X, Y))
-            AXLibClearFlags(Window, AXWindow_MoveIntrinsic);
+        __atomic_add_fetch(&LayoutStats.AXCallsElided, 2, __ATOMIC_RELAXED);
+        return;
     }
 
-    if((Window->Size.width != Width) ||
-       (Window->Size.height != Height))
-    {
-        Changed = true;
+    window_placement Placement = {};
+    Placement.X = X;
+    Placement.Y = Y;
+    Placement.Width = Width;
+    Placement.Height = Height;
+    Placement.Move = (Window->Position.x != X) || (Window->Position.y != Y);
+    Placement.Resize = (Window->Size.width != Width) || (Window->Size.height != Height);
+
+    if(Placement.Move)
+        AXLibAddFlags(Window, AXWindow_MoveIntrinsic);
+    else
+        __atomic_add_fetch(&LayoutStats.AXCallsElided, 1, __ATOMIC_RELAXED);
+
+    if(Placement.Resize)
         AXLibAddFlags(Window, AXWindow_SizeIntrinsic);
-        if(!AXLibSetWindowSize(Window->Ref, Width, Height))
-            AXLibClearFlags(Window, AXWindow_SizeIntrinsic);
+    else
+        __atomic_add_fetch(&LayoutStats.AXCallsElided, 1, __ATOMIC_RELAXED);
+
+    if(!Placement.Move && !Placement.Resize)
+    {
+        CommitWindowGeometry(Window, X, Y, Width, Height);
+        return;
     }
 
-    if(Changed)
-        CenterWindowInsideNodeContainer(Window, &X, &Y, &Width, &Height);
+    /* NOTE(koekeishiya): A placement outside of a batch is sent as a batch of its own, so that
+                         it is ordered after placements of the same application that are pending. */
+    BeginWindowPlacementBatch();
+    QueueWindowPlacement(Window, &Placement);
+    CommitWindowPlacementBatch();
 }
 
 void CenterWindow(ax_display *Display, ax_window *Window)
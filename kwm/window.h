@@ -38,6 +38,7 @@ void SetWindowFocusByNode(tree_node *Node);
 void SetWindowFocusByNode(link_node *Link);
 void CenterWindowInsideNodeContainer(ax_window *Window, int *Xptr, int *Yptr, int *Wptr, int *Hptr);
 void SetWindowDimensions(ax_window *Window, int X, int Y, int Width, int Height);
+void CompleteWindowPlacement(ax_window *Window, window_placement *Placement);
 bool IsWindowFullscreen(ax_window *Window);
 bool IsWindowParentContainer(ax_window *Window);
 void LockWindowToContainerSize(ax_window *Window);
@@ -1,14 +1,16 @@
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <map>
 
 #include <libproc.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
-#include <netdb.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <unistd.h>
-
-#define KwmDaemonPort 3020
+#include <pthread.h>
 
 int KwmcSockFD;
 
@@ -56,36 +58,235 @@ void KwmcForwardMessageThroughSocket(int argc, char **argv)
     WriteToSocket(Msg);
 }
 
+/* NOTE(koekeishiya): Records are printed as they arrive until the daemon closes the connection. */
+void KwmcSubscribe(int argc, char **argv)
+{
+    std::string Msg = "subscribe";
+    for(int i = 2; i < argc; ++i)
+        Msg += " " + std::string(argv[i]);
+
+    Msg += "\n";
+    send(KwmcSockFD, Msg.c_str(), Msg.size(), 0);
+
+    char Chunk[4096];
+    ssize_t Received;
+    while((Received = recv(KwmcSockFD, Chunk, sizeof(Chunk), 0)) > 0)
+    {
+        std::cout.write(Chunk, Received);
+        std::cout.flush();
+    }
+
+    shutdown(KwmcSockFD, SHUT_RDWR);
+    close(KwmcSockFD);
+}
+
+/* NOTE(koekeishiya): Buffered reader for replies to requests sent with a request id.
+ *                    Every reply is framed as '#<id> <length>\n' followed by <length> bytes. */
+struct kwmc_reader
+{
+    std::string Buffer;
+    std::size_t Offset;
+};
+
+bool ReadReply(kwmc_reader *Reader, unsigned long *RequestID, std::string *Reply)
+{
+    while(true)
+    {
+        std::size_t End = Reader->Buffer.find('\n', Reader->Offset);
+        if(End != std::string::npos)
+        {
+            std::string Header = Reader->Buffer.substr(Reader->Offset, End - Reader->Offset);
+            std::size_t Split = Header.find(' ');
+            if(Header.empty() || Header[0] != '#' || Split == std::string::npos)
+                Fatal("Malformed reply from daemon!");
+
+            std::size_t Length = std::stoul(Header.substr(Split + 1));
+            if(Reader->Buffer.size() - (End + 1) >= Length)
+            {
+                *RequestID = std::stoul(Header.substr(1, Split - 1));
+                *Reply = Reader->Buffer.substr(End + 1, Length);
+                Reader->Offset = End + 1 + Length;
+
+                if(Reader->Offset > 4096)
+                {
+                    Reader->Buffer.erase(0, Reader->Offset);
+                    Reader->Offset = 0;
+                }
+
+                return true;
+            }
+        }
+
+        char Chunk[4096];
+        ssize_t Received = recv(KwmcSockFD, Chunk, sizeof(Chunk), 0);
+        if(Received <= 0)
+            return false;
+
+        Reader->Buffer.append(Chunk, Received);
+    }
+}
+
+void SendRequest(unsigned long RequestID, const std::string &Command)
+{
+    std::string Msg = "#" + std::to_string(RequestID) + " " + Command + "\n";
+
+    const char *Data = Msg.c_str();
+    std::size_t Size = Msg.size();
+    while(Size > 0)
+    {
+        ssize_t Sent = send(KwmcSockFD, Data, Size, 0);
+        if(Sent <= 0)
+            Fatal("Connection lost!");
+
+        Data += Sent;
+        Size -= Sent;
+    }
+}
+
+/* NOTE(koekeishiya): Replies can arrive out of order, because queries are answered by the
+ *                    event-loop of kwm, while other commands are answered immediately.
+ *                    Print them in the order that the commands were sent. */
+void *BatchReadReplies(void *)
+{
+    kwmc_reader Reader = {};
+    std::map<unsigned long, std::string> Pending;
+    unsigned long NextRequestID = 1;
+
+    unsigned long RequestID;
+    std::string Reply;
+    while(ReadReply(&Reader, &RequestID, &Reply))
+    {
+        Pending[RequestID] = Reply;
+
+        std::map<unsigned long, std::string>::iterator It;
+        while((It = Pending.find(NextRequestID)) != Pending.end())
+        {
+            if(!It->second.empty())
+                std::cout << It->second << std::endl;
+
+            Pending.erase(It);
+            ++NextRequestID;
+        }
+    }
+
+    return NULL;
+}
+
+/* NOTE(koekeishiya): Stream every command over a single connection without waiting for
+ *                    replies. Empty lines and lines starting with '#' are skipped. */
+void KwmcBatch(std::istream &Input)
+{
+    pthread_t ReaderThread;
+    pthread_create(&ReaderThread, NULL, &BatchReadReplies, NULL);
+
+    unsigned long RequestID = 0;
+    std::string Command;
+    while(std::getline(Input, Command))
+    {
+        if(Command.empty() || Command[0] == '#')
+            continue;
+
+        SendRequest(++RequestID, Command);
+    }
+
+    shutdown(KwmcSockFD, SHUT_WR);
+    pthread_join(ReaderThread, NULL);
+    close(KwmcSockFD);
+}
+
+/* NOTE(koekeishiya): Connects to the unix domain socket of kwm, unless KWM_PORT is set, in which
+ *                    case we use TCP on the loopback interface. The socket path defaults to
+ *                    $TMPDIR/kwm_$USER.socket, or /tmp/kwm_$USER.socket if TMPDIR is not set,
+ *                    and can be overridden through KWM_SOCKET. A socket that belongs to another
+ *                    user is not connected to, as it would receive our commands. */
 void KwmcConnectToDaemon()
 {
-    struct sockaddr_in srv_addr;
-    struct hostent *server;
+    const char *Port = getenv("KWM_PORT");
+    if(Port && *Port)
+    {
+        struct sockaddr_in srv_addr;
+        if((KwmcSockFD = socket(PF_INET, SOCK_STREAM, 0)) == -1)
+            Fatal("Could not create socket!");
+
+        srv_addr.sin_family = AF_INET;
+        srv_addr.sin_port = htons(atoi(Port));
+        srv_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        std::memset(&srv_addr.sin_zero, '\0', 8);
+
+        if(connect(KwmcSockFD, (struct sockaddr*) &srv_addr, sizeof(struct sockaddr)) == -1)
+            Fatal("Connection failed!");
+    }
+    else
+    {
+        std::string Path;
+        const char *SocketPath = getenv("KWM_SOCKET");
+        if(SocketPath && *SocketPath)
+        {
+            Path = SocketPath;
+        }
+        else
+        {
+            std::string Directory = "/tmp/";
+            const char *TempDirectory = getenv("TMPDIR");
+            if(TempDirectory && *TempDirectory)
+            {
+                Directory = TempDirectory;
+                if(Directory[Directory.size() - 1] != '/')
+                    Directory += "/";
+            }
+
+            const char *User = getenv("USER");
+            Path = Directory + "kwm_" + (User ? User : "default") + ".socket";
+        }
 
-    if((KwmcSockFD = socket(PF_INET, SOCK_STREAM, 0)) == -1)
-        Fatal("Could not create socket!");
+        struct stat Info;
+        if((lstat(Path.c_str(), &Info) == 0) && (Info.st_uid != getuid()))
+            Fatal("Socket is owned by another user!");
 
-    server = gethostbyname("localhost");
-    srv_addr.sin_family = AF_INET;
-    srv_addr.sin_port = htons(KwmDaemonPort);
-    std::memcpy(&srv_addr.sin_addr.s_addr, server->h_addr, server->h_length);
-    std::memset(&srv_addr.sin_zero, '\0', 8);
+        struct sockaddr_un srv_addr;
+        if(Path.size() >= sizeof(srv_addr.sun_path))
+            Fatal("Socket path is too long!");
 
-    if(connect(KwmcSockFD, (struct sockaddr*) &srv_addr, sizeof(struct sockaddr)) == -1)
-        Fatal("Connection failed!");
+        if((KwmcSockFD = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+            Fatal("Could not create socket!");
+
+        std::memset(&srv_addr, 0, sizeof(srv_addr));
+        srv_addr.sun_family = AF_UNIX;
+        std::strncpy(srv_addr.sun_path, Path.c_str(), sizeof(srv_addr.sun_path) - 1);
+
+        if(connect(KwmcSockFD, (struct sockaddr*) &srv_addr, sizeof(srv_addr)) == -1)
+            Fatal("Connection failed!");
+    }
 }
 
 void KwmcInterpreter()
 {
+    KwmcConnectToDaemon();
+
+    kwmc_reader Reader = {};
+    unsigned long RequestID = 0;
     while(true)
     {
         std::string Msg;
-        std::getline(std::cin, Msg);
-        if(Msg  == "/quit" || Msg == "/q")
+        if(!std::getline(std::cin, Msg) || Msg  == "/quit" || Msg == "/q")
             break;
 
-        KwmcConnectToDaemon();
-        WriteToSocket(Msg);
+        if(Msg.empty())
+            continue;
+
+        SendRequest(++RequestID, Msg);
+
+        unsigned long ReplyID;
+        std::string Reply;
+        if(!ReadReply(&Reader, &ReplyID, &Reply))
+            Fatal("Connection lost!");
+
+        if(!Reply.empty())
+            std::cout << Reply << std::endl;
     }
+
+    shutdown(KwmcSockFD, SHUT_RDWR);
+    close(KwmcSockFD);
 }
 
 int main(int argc, char **argv)
@@ -94,7 +295,31 @@ int main(int argc, char **argv)
     {
         std::string Command = argv[1];
         if(Command == "interpret")
+        {
             KwmcInterpreter();
+        }
+        else if(Command == "batch")
+        {
+            if(argc >= 3 && std::string(argv[2]) != "-")
+            {
+                std::ifstream File(argv[2]);
+                if(!File.is_open())
+                    Fatal("Could not open file: " + std::string(argv[2]));
+
+                KwmcConnectToDaemon();
+                KwmcBatch(File);
+            }
+            else
+            {
+                KwmcConnectToDaemon();
+                KwmcBatch(std::cin);
+            }
+        }
+        else if(Command == "subscribe")
+        {
+            KwmcConnectToDaemon();
+            KwmcSubscribe(argc, argv);
+        }
         else
         {
             KwmcConnectToDaemon();
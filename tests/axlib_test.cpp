@@ -0,0 +1,750 @@
+#include "test.h"
+#include "fake/fake.h"
+#include "axlib/event.h"
+
+#include <algorithm>
+#include <ctime>
+#include <random>
+#include <thread>
+
+extern ax_state AXState;
+
+/* NOTE(koekeishiya): The window server: the ids of the windows on screen, front to back, and the
+ *                    number of times kwm asked for them. */
+static std::vector<int> OnScreenWindows;
+static uint64_t WindowServerCalls;
+
+extern "C" CGError CGSGetOnScreenWindowCount(const int CID, int TID, int *Count)
+{
+    __atomic_add_fetch(&WindowServerCalls, 1, __ATOMIC_RELAXED);
+    *Count = OnScreenWindows.size();
+    return kCGErrorSuccess;
+}
+
+extern "C" CGError CGSGetOnScreenWindowList(const int CID, int TID, int Count, int *List, int *OutCount)
+{
+    __atomic_add_fetch(&WindowServerCalls, 1, __ATOMIC_RELAXED);
+    *OutCount = std::min(Count, (int) OnScreenWindows.size());
+    std::copy(OnScreenWindows.begin(), OnScreenWindows.begin() + *OutCount, List);
+    return kCGErrorSuccess;
+}
+
+/* NOTE(koekeishiya): The visible windows as they were found before the on-screen ids were kept in a
+ *                    set: every known window is looked for in the list that the window server
+ *                    returned. */
+static std::vector<ax_window *>
+ReferenceVisibleWindows()
+{
+    std::vector<ax_window *> Windows;
+    std::map<pid_t, ax_application>::iterator It;
+    for(It = AXState.Applications.begin(); It != AXState.Applications.end(); ++It)
+    {
+        std::map<uint32_t, ax_window *>::iterator WindowIt;
+        for(WindowIt = It->second.Windows.begin(); WindowIt != It->second.Windows.end(); ++WindowIt)
+        {
+            ax_window *Window = WindowIt->second;
+            if((std::find(OnScreenWindows.begin(), OnScreenWindows.end(), (int) Window->ID) != OnScreenWindows.end()) &&
+               (!AXLibHasFlags(Window, AXWindow_Floating)))
+                Windows.push_back(Window);
+        }
+    }
+
+    return Windows;
+}
+
+/* NOTE(koekeishiya): The events after which the window server may report other windows on screen. */
+static bool
+EventChangesOnScreenWindows(ax_event_type Type)
+{
+    switch(Type)
+    {
+        case AXEvent_ApplicationLaunched:
+        case AXEvent_ApplicationTerminated:
+        case AXEvent_ApplicationVisible:
+        case AXEvent_ApplicationHidden:
+        case AXEvent_WindowCreated:
+        case AXEvent_WindowDestroyed:
+        case AXEvent_WindowMinimized:
+        case AXEvent_WindowDeminimized:
+        case AXEvent_DisplayAdded:
+        case AXEvent_DisplayRemoved:
+        case AXEvent_DisplayMoved:
+        case AXEvent_DisplayResized:
+        case AXEvent_DisplayChanged:
+        case AXEvent_SpaceChanged:
+        {
+            return true;
+        } break;
+        default:
+        {
+            return false;
+        } break;
+    }
+}
+
+/* NOTE(koekeishiya): Everything below runs on the event-loop worker. A window is created, destroyed,
+ *                    taken off or brought back on screen, or a window of another process (the dock,
+ *                    the menu bar) comes and goes, and the window server reflects it before the
+ *                    notification is dispatched. */
+struct event_stream
+{
+    std::mt19937 Random;
+    uint32_t NextWindowID;
+    uint32_t QueriesPerEvent;
+    bool Check;
+
+    uint64_t Queries;
+    uint64_t ExpectedCalls;
+    uint64_t Mismatches;
+    bool Valid;
+    CFAbsoluteTime Timestamp;
+    bool Done;
+};
+
+static event_stream Stream;
+
+static void
+ChangeOnScreenWindows()
+{
+    std::vector<ax_window *> Known = AXLibGetAllKnownWindows();
+    uint32_t Change = Stream.Random() % 5;
+    if(Change == 0 || Known.empty())
+    {
+        uint32_t WindowID = Stream.NextWindowID++;
+        ax_window *Window = FakeAddApplicationWindow(1 + Stream.Random() % 5, WindowID);
+        if(Stream.Random() % 4 == 0)
+            AXLibAddFlags(Window, AXWindow_Floating);
+
+        OnScreenWindows.insert(OnScreenWindows.begin(), WindowID);
+    }
+    else if(Change == 1)
+    {
+        uint32_t WindowID = Known[Stream.Random() % Known.size()]->ID;
+        OnScreenWindows.erase(std::remove(OnScreenWindows.begin(), OnScreenWindows.end(), (int) WindowID), OnScreenWindows.end());
+        FakeRemoveWindow(WindowID);
+    }
+    else if(Change == 2)
+    {
+        uint32_t WindowID = Known[Stream.Random() % Known.size()]->ID;
+        OnScreenWindows.erase(std::remove(OnScreenWindows.begin(), OnScreenWindows.end(), (int) WindowID), OnScreenWindows.end());
+    }
+    else if(Change == 3)
+    {
+        uint32_t WindowID = Known[Stream.Random() % Known.size()]->ID;
+        if(std::find(OnScreenWindows.begin(), OnScreenWindows.end(), (int) WindowID) == OnScreenWindows.end())
+            OnScreenWindows.push_back(WindowID);
+    }
+    else
+    {
+        int WindowID = 1000000 + Stream.Random() % 4;
+        std::vector<int>::iterator It = std::find(OnScreenWindows.begin(), OnScreenWindows.end(), WindowID);
+        if(It == OnScreenWindows.end())
+            OnScreenWindows.push_back(WindowID);
+        else
+            OnScreenWindows.erase(It);
+    }
+}
+
+static EVENT_CALLBACK(Callback_StreamEvent)
+{
+    if(EventChangesOnScreenWindows(Event->Type))
+    {
+        Stream.Valid = false;
+        ChangeOnScreenWindows();
+    }
+
+    for(uint32_t Query = 0; Query < Stream.QueriesPerEvent; ++Query)
+    {
+        std::vector<ax_window *> Windows = AXLibGetAllVisibleWindows();
+        ++Stream.Queries;
+        if(!Stream.Valid)
+        {
+            Stream.ExpectedCalls += 2;
+            Stream.Valid = true;
+        }
+
+        if(Stream.Check && Windows != ReferenceVisibleWindows())
+            ++Stream.Mismatches;
+    }
+}
+
+static EVENT_CALLBACK(Callback_StreamDone)
+{
+    __atomic_store_n(&Stream.Done, true, __ATOMIC_RELEASE);
+}
+
+/* NOTE(koekeishiya): A session as the event tap and the observers deliver it: mostly mouse movement,
+ *                    focus changes and windows being dragged, with a window created, destroyed or
+ *                    minimized, an application hidden or a space changed now and then. */
+static ax_event_type
+RandomEventType(std::mt19937 *Random)
+{
+    static const ax_event_type Frequent[] =
+    {
+        AXEvent_MouseMoved, AXEvent_MouseMoved, AXEvent_MouseMoved, AXEvent_MouseMoved,
+        AXEvent_WindowFocused, AXEvent_WindowFocused, AXEvent_ApplicationActivated,
+        AXEvent_WindowMoved, AXEvent_WindowResized, AXEvent_WindowTitleChanged,
+        AXEvent_LeftMouseDown, AXEvent_LeftMouseDragged, AXEvent_LeftMouseUp, AXEvent_HotkeyPressed,
+    };
+
+    if((*Random)() % 10 != 0)
+        return Frequent[(*Random)() % (sizeof(Frequent) / sizeof(Frequent[0]))];
+
+    ax_event_type Type;
+    do { Type = (ax_event_type) ((*Random)() % AXEvent_User); } while(!EventChangesOnScreenWindows(Type));
+    return Type;
+}
+
+static void
+PushEvent(ax_event_type Type, uint32_t WindowID, EventCallback *Handle)
+{
+    ax_event Event = {};
+    Event.Type = Type;
+    Event.Payload = AXPayload_WindowID;
+    Event.WindowID = WindowID;
+    Event.Handle = Handle;
+    AXLibAddEvent(Event);
+}
+
+static void
+RunOnWorker(ax_event_type Type, EventCallback *Handle)
+{
+    Stream.Done = false;
+    PushEvent(Type, 0, Handle);
+    while(!__atomic_load_n(&Stream.Done, __ATOMIC_ACQUIRE))
+        std::this_thread::yield();
+}
+
+/* NOTE(koekeishiya): Moved and resized events carry distinct window ids and are not merged, but
+ *                    mouse-moved events may be; the stream only counts what was dispatched. */
+static void
+RunEventStream(uint32_t Seed, uint32_t Events, uint32_t QueriesPerEvent, bool Check, EventCallback *Handle)
+{
+    Stream.Random.seed(Seed);
+    Stream.QueriesPerEvent = QueriesPerEvent;
+    Stream.Check = Check;
+
+    std::mt19937 Random(Seed + 1);
+    for(uint32_t Index = 0; Index < Events; ++Index)
+        PushEvent(RandomEventType(&Random), Index, Handle);
+
+    RunOnWorker(AXEvent_User, &Callback_StreamDone);
+}
+
+static void
+ResetWindowServer(uint32_t Windows)
+{
+    FakeResetAXLib();
+    OnScreenWindows.clear();
+    for(uint32_t WindowID = 1; WindowID <= Windows; ++WindowID)
+    {
+        FakeAddApplicationWindow(1 + WindowID % 5, WindowID);
+        if(WindowID % 3 != 0)
+            OnScreenWindows.push_back(WindowID);
+    }
+
+    Stream.NextWindowID = Windows + 1;
+    Stream.Queries = 0;
+    Stream.ExpectedCalls = 0;
+    Stream.Mismatches = 0;
+    Stream.Valid = false;
+    WindowServerCalls = 0;
+
+    /* NOTE(koekeishiya): Whatever the worker cached from the previous run is dropped by this event. */
+    RunOnWorker(AXEvent_SpaceChanged, &Callback_StreamDone);
+}
+
+/* NOTE(koekeishiya): Every query on the worker must see the windows that the window server reports,
+ *                    and the window server must only be asked again after an event that can change
+ *                    them. */
+static void
+TestVisibleWindowsFollowTheWindowServer()
+{
+    for(uint32_t Seed = 1; Seed <= 8; ++Seed)
+    {
+        ResetWindowServer(40);
+
+        ax_onscreen_stats Before;
+        AXLibGetOnScreenStats(&Before);
+        RunEventStream(Seed, 5000, 1 + Seed % 3, true, &Callback_StreamEvent);
+
+        ax_onscreen_stats After;
+        AXLibGetOnScreenStats(&After);
+
+        TestCheck(Stream.Mismatches == 0);
+        TestCheck(WindowServerCalls == Stream.ExpectedCalls);
+        TestCheck(After.Queries - Before.Queries == Stream.Queries);
+        TestCheck(2 * (After.Refreshes - Before.Refreshes) == Stream.ExpectedCalls);
+        TestCheck(Stream.ExpectedCalls < Stream.Queries);
+    }
+}
+
+/* NOTE(koekeishiya): Other threads, such as the daemon running a command, always ask the window
+ *                    server, since the worker may be about to change what it has cached. */
+static void
+TestOtherThreadsAskTheWindowServer()
+{
+    ResetWindowServer(20);
+
+    uint64_t Calls = WindowServerCalls;
+    std::vector<ax_window *> Windows = AXLibGetAllVisibleWindows();
+    TestCheck(Windows == ReferenceVisibleWindows());
+    TestCheck(WindowServerCalls == Calls + 2);
+
+    OnScreenWindows.erase(OnScreenWindows.begin());
+    Windows = AXLibGetAllVisibleWindows();
+    TestCheck(Windows == ReferenceVisibleWindows());
+    TestCheck(WindowServerCalls == Calls + 4);
+}
+
+static EVENT_CALLBACK(Callback_BenchmarkCached)
+{
+    TestBenchmark("visible windows, 200 windows, cached", 20000,
+    {
+        AXLibGetAllVisibleWindows();
+    });
+
+    __atomic_store_n(&Stream.Done, true, __ATOMIC_RELEASE);
+}
+
+/* NOTE(koekeishiya): 100000 events with two queries each, which is what a rebalance and a focus
+ *                    change cost. Without the cache every query makes two calls to the window
+ *                    server. The lookups are timed on the worker, where they hit the cache, and on
+ *                    the main thread, where they ask the window server every time. */
+static void
+BenchmarkEventStream()
+{
+    ResetWindowServer(200);
+
+    double Start = TestSeconds();
+    RunEventStream(1, 100000, 2, false, &Callback_StreamEvent);
+    double Elapsed = TestSeconds() - Start;
+
+    uint64_t Saved = (2 * Stream.Queries) - WindowServerCalls;
+    printf("  %-48s %12llu\n", "events dispatched, after coalescing", (unsigned long long) (Stream.Queries / 2));
+    printf("  %-48s %12llu\n", "window server calls, uncached", (unsigned long long) (2 * Stream.Queries));
+    printf("  %-48s %12llu\n", "window server calls, cached", (unsigned long long) WindowServerCalls);
+    printf("  %-48s %12.0f\n", "window server calls saved per second", Saved / Elapsed);
+    printf("  %-48s %12.3f us\n", "stream, per event", (Elapsed * 1e6) / (Stream.Queries / 2));
+
+    ResetWindowServer(200);
+    RunOnWorker(AXEvent_User, &Callback_BenchmarkCached);
+
+    TestBenchmark("visible windows, 200 windows, window server", 20000,
+    {
+        AXLibGetAllVisibleWindows();
+    });
+
+    TestBenchmark("visible windows, 200 windows, linear scan", 20000,
+    {
+        ReferenceVisibleWindows();
+    });
+}
+
+/* NOTE(koekeishiya): The window list that CGWindowListCopyWindowInfo reports, front to back. Every
+ *                    window is a dictionary of its number, layer, owner pid, bounds, owner name and
+ *                    title. The cursor and the clock are set by the test. */
+#define WINDOW_STACK_TTL 0.25
+#define CONTEXT_MENU_LAYER 101
+
+struct fake_cg_window
+{
+    int32_t Number;
+    int32_t Layer;
+    int32_t PID;
+    CGRect Bounds;
+    CFStringRef Owner;
+    CFStringRef Name;
+};
+
+static std::vector<fake_cg_window> WindowList;
+static uint64_t WindowListCalls;
+static CGPoint CursorPoint;
+static CFAbsoluteTime Now;
+
+CFArrayRef CGWindowListCopyWindowInfo(CGWindowListOption Option, CGWindowID WindowID)
+{
+    __atomic_add_fetch(&WindowListCalls, 1, __ATOMIC_RELAXED);
+    return (CFArrayRef) &WindowList;
+}
+
+CFIndex CFArrayGetCount(CFArrayRef Array)
+{
+    return ((const std::vector<fake_cg_window> *) Array)->size();
+}
+
+const void *CFArrayGetValueAtIndex(CFArrayRef Array, CFIndex Index)
+{
+    return &(*(const std::vector<fake_cg_window> *) Array)[Index];
+}
+
+const void *CFDictionaryGetValue(CFDictionaryRef Dictionary, const void *Key)
+{
+    static CFStringRef Number = CFSTR("kCGWindowNumber");
+    static CFStringRef Layer = CFSTR("kCGWindowLayer");
+    static CFStringRef PID = CFSTR("kCGWindowOwnerPID");
+    static CFStringRef Bounds = CFSTR("kCGWindowBounds");
+    static CFStringRef Owner = CFSTR("kCGWindowOwnerName");
+    static CFStringRef Name = CFSTR("kCGWindowName");
+
+    const fake_cg_window *Window = (const fake_cg_window *) Dictionary;
+    if(Key == Number) return &Window->Number;
+    if(Key == Layer) return &Window->Layer;
+    if(Key == PID) return &Window->PID;
+    if(Key == Bounds) return &Window->Bounds;
+    if(Key == Owner) return Window->Owner;
+    if(Key == Name) return Window->Name;
+    return NULL;
+}
+
+bool CFNumberGetValue(CFNumberRef Number, int Type, void *Value)
+{
+    *(int32_t *) Value = *(const int32_t *) Number;
+    return true;
+}
+
+bool CGRectMakeWithDictionaryRepresentation(CFDictionaryRef Dictionary, CGRect *Rect)
+{
+    *Rect = *(const CGRect *) Dictionary;
+    return true;
+}
+
+CGPoint CGEventGetLocation(CGEventRef Event)
+{
+    return CursorPoint;
+}
+
+CFAbsoluteTime CFAbsoluteTimeGetCurrent()
+{
+    return Now;
+}
+
+/* NOTE(koekeishiya): The window below the cursor as it was found before the window stack was cached:
+ *                    the window list is read on every call, and the first window that contains the
+ *                    cursor wins, unless a context menu or launchpad is in front of it. */
+static uint32_t
+ReferenceWindowBelowCursor()
+{
+    for(std::size_t Index = 0; Index < WindowList.size(); ++Index)
+    {
+        fake_cg_window *Window = &WindowList[Index];
+        bool IsKwmOverlay = Window->Owner == FakeString("kwm-overlay");
+        bool IsDock = Window->Owner == FakeString("Dock");
+        bool IsLaunchpad = Window->Name == FakeString("LPSpringboard");
+        bool IsDockBar = Window->Name == FakeString("Dock");
+
+        if((IsDock && IsDockBar) || (IsKwmOverlay))
+            continue;
+
+        if((IsDock && IsLaunchpad) || (Window->Layer == CONTEXT_MENU_LAYER))
+            return 0;
+
+        CGRect *Rect = &Window->Bounds;
+        if(CursorPoint.x >= Rect->origin.x &&
+           CursorPoint.x <= Rect->origin.x + Rect->size.width &&
+           CursorPoint.y >= Rect->origin.y &&
+           CursorPoint.y <= Rect->origin.y + Rect->size.height)
+            return Window->Number;
+    }
+
+    return 0;
+}
+
+/* NOTE(koekeishiya): The events after which windows may be in a different order. */
+static bool
+EventChangesStacking(ax_event_type Type)
+{
+    return Type == AXEvent_ApplicationActivated ||
+           Type == AXEvent_WindowFocused ||
+           Type == AXEvent_LeftMouseDown ||
+           Type == AXEvent_LeftMouseUp ||
+           EventChangesOnScreenWindows(Type);
+}
+
+static CGRect
+RandomRect()
+{
+    CGRect Rect = { { (double) (Stream.Random() % 1440), (double) (Stream.Random() % 900) },
+                    { (double) (100 + Stream.Random() % 700), (double) (100 + Stream.Random() % 500) } };
+    return Rect;
+}
+
+static ax_window *
+ManagedWindow(fake_cg_window *Entry)
+{
+    ax_application *Application = AXLibGetApplicationByPID(Entry->PID);
+    return Application ? AXLibFindApplicationWindow(Application, Entry->Number) : NULL;
+}
+
+static fake_cg_window *
+RandomManagedEntry()
+{
+    std::vector<fake_cg_window *> Managed;
+    for(std::size_t Index = 0; Index < WindowList.size(); ++Index)
+    {
+        if(ManagedWindow(&WindowList[Index]))
+            Managed.push_back(&WindowList[Index]);
+    }
+
+    return Managed.empty() ? NULL : Managed[Stream.Random() % Managed.size()];
+}
+
+static void
+AddManagedWindow()
+{
+    uint32_t WindowID = Stream.NextWindowID++;
+    pid_t PID = 1 + Stream.Random() % 5;
+    ax_window *Window = FakeAddApplicationWindow(PID, WindowID);
+
+    fake_cg_window Entry = { (int32_t) WindowID, 0, PID, RandomRect(), FakeString("Application"), NULL };
+    Window->Position = Entry.Bounds.origin;
+    Window->Size = Entry.Bounds.size;
+    WindowList.insert(WindowList.begin() + Stream.Random() % (WindowList.size() + 1), Entry);
+}
+
+/* NOTE(koekeishiya): Move and resize notifications update the geometry tracked in ax_window at the
+ *                    same time as the window server. */
+static void
+MoveManagedWindow()
+{
+    fake_cg_window *Entry = RandomManagedEntry();
+    if(Entry)
+    {
+        ax_window *Window = ManagedWindow(Entry);
+        Entry->Bounds = RandomRect();
+        Window->Position = Entry->Bounds.origin;
+        Window->Size = Entry->Bounds.size;
+    }
+}
+
+static void
+ChangeVisibleWindows()
+{
+    fake_cg_window *Entry = RandomManagedEntry();
+    if(!Entry || Stream.Random() % 2)
+    {
+        AddManagedWindow();
+    }
+    else
+    {
+        FakeRemoveWindow(Entry->Number);
+        WindowList.erase(WindowList.begin() + (Entry - &WindowList[0]));
+    }
+}
+
+static void
+RaiseWindow()
+{
+    std::size_t Index = Stream.Random() % WindowList.size();
+    fake_cg_window Entry = WindowList[Index];
+    WindowList.erase(WindowList.begin() + Index);
+    WindowList.insert(WindowList.begin(), Entry);
+}
+
+static void
+ToggleWindow(fake_cg_window Entry)
+{
+    for(std::size_t Index = 0; Index < WindowList.size(); ++Index)
+    {
+        if(WindowList[Index].Number == Entry.Number)
+        {
+            WindowList.erase(WindowList.begin() + Index);
+            return;
+        }
+    }
+
+    WindowList.insert(WindowList.begin(), Entry);
+}
+
+/* NOTE(koekeishiya): Context menus, launchpad and windows of processes that axlib does not observe
+ *                    change without a notification, so the change is only seen once the window
+ *                    stack is older than its time to live. */
+static void
+ChangeWindowListUnnotified()
+{
+    Now += WINDOW_STACK_TTL + 0.01;
+    switch(Stream.Random() % 3)
+    {
+        case 0:
+        {
+            fake_cg_window Menu = { 900000, CONTEXT_MENU_LAYER, 3, { { 600, 400 }, { 200, 300 } }, FakeString("Application"), NULL };
+            ToggleWindow(Menu);
+        } break;
+        case 1:
+        {
+            fake_cg_window Launchpad = { 900001, 27, 900, { { 0, 0 }, { 1440, 900 } }, FakeString("Dock"), FakeString("LPSpringboard") };
+            ToggleWindow(Launchpad);
+        } break;
+        case 2:
+        {
+            for(std::size_t Index = 0; Index < WindowList.size(); ++Index)
+            {
+                if(WindowList[Index].PID == 902)
+                    WindowList[Index].Bounds = RandomRect();
+            }
+        } break;
+    }
+}
+
+/* NOTE(koekeishiya): Every event moves the clock by one tick of a 250 Hz mouse, and ends with the
+ *                    hit test that focus-follows-mouse and dragging make. */
+static EVENT_CALLBACK(Callback_CursorEvent)
+{
+    Now += 0.004;
+    if(EventChangesStacking(Event->Type))
+        Stream.Valid = false;
+
+    if(Stream.Random() % 20 == 0)
+        ChangeWindowListUnnotified();
+
+    if(EventChangesOnScreenWindows(Event->Type))
+        ChangeVisibleWindows();
+    else if(EventChangesStacking(Event->Type))
+        RaiseWindow();
+    else if(Event->Type == AXEvent_WindowMoved || Event->Type == AXEvent_WindowResized)
+        MoveManagedWindow();
+    else if(Event->Type == AXEvent_MouseMoved || Event->Type == AXEvent_LeftMouseDragged)
+        CursorPoint = CGPointMake(Stream.Random() % 1440, Stream.Random() % 900);
+
+    uint32_t WindowID = AXLibGetWindowBelowCursor();
+    ++Stream.Queries;
+    if(!Stream.Valid || Now - Stream.Timestamp > WINDOW_STACK_TTL)
+    {
+        ++Stream.ExpectedCalls;
+        Stream.Valid = true;
+        Stream.Timestamp = Now;
+    }
+
+    if(Stream.Check && WindowID != ReferenceWindowBelowCursor())
+        ++Stream.Mismatches;
+}
+
+/* NOTE(koekeishiya): The dock bar and kwm-overlay are never hit, and a window of another process
+ *                    covers part of the screen in front of the managed windows. */
+static void
+ResetWindowList(uint32_t Windows)
+{
+    FakeResetAXLib();
+    WindowList.clear();
+
+    fake_cg_window Overlay = { 800000, 0, 901, { { 0, 0 }, { 1440, 900 } }, FakeString("kwm-overlay"), NULL };
+    fake_cg_window Other = { 800001, 0, 902, { { 1000, 0 }, { 440, 300 } }, FakeString("Notification Center"), NULL };
+    fake_cg_window DockBar = { 800002, 20, 900, { { 0, 850 }, { 1440, 50 } }, FakeString("Dock"), FakeString("Dock") };
+    WindowList.push_back(Overlay);
+    WindowList.push_back(Other);
+    WindowList.push_back(DockBar);
+
+    Stream.Random.seed(Windows);
+    Stream.NextWindowID = 1;
+    for(uint32_t Index = 0; Index < Windows; ++Index)
+        AddManagedWindow();
+
+    Now = 1000;
+    CursorPoint = CGPointMake(700, 450);
+    Stream.Queries = 0;
+    Stream.ExpectedCalls = 0;
+    Stream.Mismatches = 0;
+    Stream.Valid = false;
+    WindowListCalls = 0;
+
+    /* NOTE(koekeishiya): Whatever the worker cached from the previous run is dropped by this event. */
+    RunOnWorker(AXEvent_SpaceChanged, &Callback_StreamDone);
+}
+
+/* NOTE(koekeishiya): Every hit test on the worker must find the window that a fresh read of the window
+ *                    list finds, and the list must only be read again after an event that can change
+ *                    the stacking order, or once the stack is older than its time to live. */
+static void
+TestWindowBelowCursorFollowsTheWindowList()
+{
+    for(uint32_t Seed = 1; Seed <= 8; ++Seed)
+    {
+        ResetWindowList(30);
+
+        ax_onscreen_stats Before;
+        AXLibGetOnScreenStats(&Before);
+        RunEventStream(Seed, 5000, 1, true, &Callback_CursorEvent);
+
+        ax_onscreen_stats After;
+        AXLibGetOnScreenStats(&After);
+
+        TestCheck(Stream.Mismatches == 0);
+        TestCheck(WindowListCalls == Stream.ExpectedCalls);
+        TestCheck(After.HitTests - Before.HitTests == Stream.Queries);
+        TestCheck(After.HitTestRefreshes - Before.HitTestRefreshes == Stream.ExpectedCalls);
+        TestCheck(Stream.ExpectedCalls < Stream.Queries);
+    }
+}
+
+static void
+TestOtherThreadsReadTheWindowList()
+{
+    ResetWindowList(10);
+
+    CursorPoint = WindowList.back().Bounds.origin;
+    TestCheck(AXLibGetWindowBelowCursor() == ReferenceWindowBelowCursor());
+    TestCheck(WindowListCalls == 1);
+
+    WindowList.back().Bounds.origin.x += 1;
+    TestCheck(AXLibGetWindowBelowCursor() == ReferenceWindowBelowCursor());
+    TestCheck(WindowListCalls == 2);
+}
+
+/* NOTE(koekeishiya): The cursor sweeps the screen at 250 Hz for 400 seconds over 100 windows. */
+static void
+MoveMouse(const char *Name)
+{
+    uint64_t Calls = WindowListCalls;
+    std::clock_t Start = std::clock();
+    for(int Move = 0; Move < 100000; ++Move)
+    {
+        Now += 0.004;
+        CursorPoint = CGPointMake((Move * 7) % 1440, (Move * 3) % 900);
+        AXLibGetWindowBelowCursor();
+    }
+
+    double Seconds = (double) (std::clock() - Start) / CLOCKS_PER_SEC;
+    printf("  %-48s %12.3f us\n", Name, (Seconds * 1e6) / 100000);
+    printf("  %-48s %12.3f %%\n", "  cpu of one core while the mouse moves", (Seconds / 400.0) * 100.0);
+    printf("  %-48s %12llu\n", "  window list reads", (unsigned long long) (WindowListCalls - Calls));
+}
+
+static EVENT_CALLBACK(Callback_BenchmarkMouseMovement)
+{
+    MoveMouse("window below cursor, 100 windows, cached");
+    __atomic_store_n(&Stream.Done, true, __ATOMIC_RELEASE);
+}
+
+/* NOTE(koekeishiya): On the worker the stack is read at most every 250ms; on the main thread it is read
+ *                    on every move, as it was before. The fake window list is read without the round
+ *                    trip to the window server that the real one costs, so the difference is a lower
+ *                    bound. */
+static void
+BenchmarkMouseMovement()
+{
+    ResetWindowList(100);
+    RunOnWorker(AXEvent_User, &Callback_BenchmarkMouseMovement);
+
+    ResetWindowList(100);
+    MoveMouse("window below cursor, 100 windows, window list");
+}
+
+int main(int Count, char **Args)
+{
+    AXLibInit(&AXState);
+    TestCheck(AXLibStartEventLoop());
+
+    TestVisibleWindowsFollowTheWindowServer();
+    TestOtherThreadsAskTheWindowServer();
+    TestWindowBelowCursorFollowsTheWindowList();
+    TestOtherThreadsReadTheWindowList();
+
+    if(TestWantsBenchmarks(Count, Args))
+    {
+        BenchmarkEventStream();
+        BenchmarkMouseMovement();
+    }
+
+    AXLibStopEventLoop();
+    return TestReport("axlib_test");
+}
@@ -0,0 +1,284 @@
+#include "test.h"
+#include "container.h"
+
+#include <math.h>
+#include <deque>
+#include <random>
+
+/* NOTE(koekeishiya): The trees are built here rather than through the node functions, and laid out
+ *                    with the settings that are passed in, so that no display or space is needed. */
+
+struct test_tree
+{
+    std::deque<tree_node> Nodes;
+    std::vector<tree_node *> Leaves;
+    tree_node *Root;
+};
+
+static geometry_rect
+RectOf(tree_node *Node)
+{
+    geometry_rect Rect = { Node->Container.X, Node->Container.Y, Node->Container.Width, Node->Container.Height };
+    return Rect;
+}
+
+static bool
+IsWhole(double Value)
+{
+    return Value == floor(Value);
+}
+
+static bool
+RectsOverlap(geometry_rect A, geometry_rect B)
+{
+    return A.X < B.X + B.Width && B.X < A.X + A.Width &&
+           A.Y < B.Y + B.Height && B.Y < A.Y + A.Height;
+}
+
+static tree_node *
+CreateNode(test_tree *Tree, tree_node *Parent)
+{
+    tree_node Node = {};
+    Node.Type = NodeTypeTree;
+    Node.Parent = Parent;
+    Tree->Nodes.push_back(Node);
+    return &Tree->Nodes.back();
+}
+
+/* NOTE(koekeishiya): Grows a tree the way windows are added to a space: a random leaf that is still
+ *                    large enough is split in two, along a random axis and at a random ratio, until
+ *                    the tree has Splits + 1 leaves or no leaf is left to split. */
+static void
+CreateRandomTree(std::mt19937 &Random, test_tree *Tree, geometry_rect Root, geometry_layout *Layout, int Splits)
+{
+    Tree->Nodes.clear();
+    Tree->Root = CreateNode(Tree, NULL);
+    Tree->Root->Container.X = Root.X;
+    Tree->Root->Container.Y = Root.Y;
+    Tree->Root->Container.Width = Root.Width;
+    Tree->Root->Container.Height = Root.Height;
+    Tree->Root->SplitMode = SPLIT_VERTICAL;
+    Tree->Root->SplitRatio = 0.5;
+
+    Tree->Leaves.assign(1, Tree->Root);
+    for(int Attempt = 0; Attempt < 64 * Splits && Tree->Leaves.size() <= Splits; ++Attempt)
+    {
+        std::size_t Index = Random() % Tree->Leaves.size();
+        tree_node *Leaf = Tree->Leaves[Index];
+        if(Leaf->Container.Width < 120 || Leaf->Container.Height < 120)
+            continue;
+
+        Leaf->SplitMode = Random() % 2 ? SPLIT_VERTICAL : SPLIT_HORIZONTAL;
+        Leaf->SplitRatio = 0.25 + (Random() % 1000) / 2000.0;
+        Leaf->LeftChild = CreateNode(Tree, Leaf);
+        Leaf->RightChild = CreateNode(Tree, Leaf);
+        LayoutNodeContainers(Layout, Leaf, false);
+
+        Tree->Leaves[Index] = Leaf->LeftChild;
+        Tree->Leaves.push_back(Leaf->RightChild);
+    }
+}
+
+/* NOTE(koekeishiya): The layout as a recursion over the tree, splitting every container by the split
+ *                    mode and ratio of its node. */
+static void
+ReferenceLayout(geometry_layout *Layout, tree_node *Node, geometry_rect Rect, std::vector<geometry_rect> *Leaves)
+{
+    if(!Node->LeftChild)
+    {
+        Leaves->push_back(Rect);
+        return;
+    }
+
+    geometry_rect First, Second;
+    if(Node->SplitMode == SPLIT_VERTICAL)
+        GeometrySplitRect(Rect, GeometrySplit_Vertical, Node->SplitRatio, Layout->VerticalGap, &First, &Second);
+    else
+        GeometrySplitRect(Rect, GeometrySplit_Horizontal, Node->SplitRatio, Layout->HorizontalGap, &First, &Second);
+
+    ReferenceLayout(Layout, Node->LeftChild, First, Leaves);
+    ReferenceLayout(Layout, Node->RightChild, Second, Leaves);
+}
+
+static void
+LeafRects(tree_node *Node, std::vector<geometry_rect> *Leaves)
+{
+    if(!Node->LeftChild)
+    {
+        Leaves->push_back(RectOf(Node));
+        return;
+    }
+
+    LeafRects(Node->LeftChild, Leaves);
+    LeafRects(Node->RightChild, Leaves);
+}
+
+static bool
+SameRects(const std::vector<geometry_rect> &A, const std::vector<geometry_rect> &B)
+{
+    if(A.size() != B.size())
+        return false;
+
+    for(std::size_t Index = 0; Index < A.size(); ++Index)
+    {
+        if(A[Index].X != B[Index].X || A[Index].Y != B[Index].Y ||
+           A[Index].Width != B[Index].Width || A[Index].Height != B[Index].Height)
+            return false;
+    }
+
+    return true;
+}
+
+/* NOTE(koekeishiya): A tree laid out on the whole display is laid out again once the padding of the
+ *                    space is applied. With fractional padding and gaps, every leaf has whole-pixel
+ *                    edges, lies inside the root, and no two leaves overlap; the children of every
+ *                    node and the gap between them cover exactly the container of their parent. */
+static void
+TestRandomTreesTileTheRoot()
+{
+    std::mt19937 Random(1);
+    test_tree Tree;
+    uint32_t Layouts = 0;
+    uint32_t Failures = 0;
+
+    for(int Round = 0; Round < 500; ++Round)
+    {
+        geometry_layout Layout = { (Random() % 400) / 10.0, (Random() % 400) / 10.0, 0.5, 1.618 };
+        geometry_padding Padding = { (Random() % 600) / 10.0, (Random() % 600) / 10.0,
+                                     (Random() % 600) / 10.0, (Random() % 600) / 10.0 };
+        geometry_rect Frame = { 0, 0, 1440, 900 };
+        CreateRandomTree(Random, &Tree, Frame, &Layout, 1 + Random() % 64);
+        for(std::size_t Index = 0; Index < Tree.Nodes.size(); ++Index)
+            Tree.Nodes[Index].Dirty = false;
+
+        geometry_rect Root = GeometryPadRect(Frame, Padding);
+        Tree.Root->Container.X = Root.X;
+        Tree.Root->Container.Y = Root.Y;
+        Tree.Root->Container.Width = Root.Width;
+        Tree.Root->Container.Height = Root.Height;
+        LayoutNodeContainers(&Layout, Tree.Root, false);
+        ++Layouts;
+
+        bool Valid = true;
+        for(std::size_t Index = 0; Index < Tree.Nodes.size(); ++Index)
+        {
+            tree_node *Node = &Tree.Nodes[Index];
+            geometry_rect Rect = RectOf(Node);
+            Valid = Valid && IsWhole(Rect.X) && IsWhole(Rect.Y) && IsWhole(Rect.Width) && IsWhole(Rect.Height);
+            if(!Node->LeftChild)
+                continue;
+
+            geometry_rect Left = RectOf(Node->LeftChild);
+            geometry_rect Right = RectOf(Node->RightChild);
+            if(Node->SplitMode == SPLIT_VERTICAL)
+            {
+                Valid = Valid && Left.X == Rect.X && Left.Width + round(Layout.VerticalGap) + Right.Width == Rect.Width;
+                Valid = Valid && Right.X + Right.Width == Rect.X + Rect.Width;
+                Valid = Valid && Left.Y == Rect.Y && Right.Y == Rect.Y && Left.Height == Rect.Height && Right.Height == Rect.Height;
+            }
+            else
+            {
+                Valid = Valid && Left.Y == Rect.Y && Left.Height + round(Layout.HorizontalGap) + Right.Height == Rect.Height;
+                Valid = Valid && Right.Y + Right.Height == Rect.Y + Rect.Height;
+                Valid = Valid && Left.X == Rect.X && Right.X == Rect.X && Left.Width == Rect.Width && Right.Width == Rect.Width;
+            }
+        }
+
+        std::vector<geometry_rect> Leaves;
+        LeafRects(Tree.Root, &Leaves);
+        for(std::size_t A = 0; A < Leaves.size(); ++A)
+        {
+            Valid = Valid && Leaves[A].X >= Root.X && Leaves[A].Y >= Root.Y;
+            Valid = Valid && Leaves[A].X + Leaves[A].Width <= Root.X + Root.Width;
+            Valid = Valid && Leaves[A].Y + Leaves[A].Height <= Root.Y + Root.Height;
+            for(std::size_t B = A + 1; B < Leaves.size(); ++B)
+                Valid = Valid && !RectsOverlap(Leaves[A], Leaves[B]);
+        }
+
+        std::vector<geometry_rect> Expected;
+        ReferenceLayout(&Layout, Tree.Root, Root, &Expected);
+        Valid = Valid && SameRects(Leaves, Expected);
+
+        if(!Valid)
+            ++Failures;
+    }
+
+    TestCheck(Layouts == 500);
+    TestCheck(Failures == 0);
+}
+
+/* NOTE(koekeishiya): Moving one split only recomputes the subtree below it, and gives the same leaves
+ *                    as laying out the whole tree again. The windows linked to a node follow it. */
+static void
+TestResizeRecomputesTheSubtree()
+{
+    std::mt19937 Random(2);
+    test_tree Tree;
+    geometry_layout Layout = { 15, 15, 0.5, 1.618 };
+    geometry_rect Root = { 20, 40, 1400, 840 };
+    CreateRandomTree(Random, &Tree, Root, &Layout, 64);
+    LayoutNodeContainers(&Layout, Tree.Root, false);
+
+    tree_node *Node = Tree.Root->LeftChild;
+    while(Node->LeftChild && Node->LeftChild->LeftChild)
+        Node = Node->LeftChild;
+
+    link_node Link = {};
+    Node->LeftChild->List = &Link;
+    for(std::size_t Index = 0; Index < Tree.Nodes.size(); ++Index)
+        Tree.Nodes[Index].Dirty = false;
+
+    Node->SplitRatio = 0.7;
+    uint32_t Computed = ResizeNodeContainers(&Layout, Node);
+    TestCheck(Computed > 0 && Computed < Tree.Nodes.size() - 1);
+    TestCheck(Node->LeftChild->Dirty && !Tree.Root->Dirty);
+    TestCheck(Link.Container.Width == Node->LeftChild->Container.Width);
+    TestCheck(Link.Container.X == Node->LeftChild->Container.X);
+
+    std::vector<geometry_rect> Leaves, Expected;
+    LeafRects(Tree.Root, &Leaves);
+    ReferenceLayout(&Layout, Tree.Root, Root, &Expected);
+    TestCheck(SameRects(Leaves, Expected));
+}
+
+/* NOTE(koekeishiya): A full layout of a space of 256 windows, as after a change of padding or gaps,
+ *                    and the resize of a split near the root, as while a user drags it. */
+static void
+BenchmarkLayout()
+{
+    std::mt19937 Random(3);
+    test_tree Tree;
+    geometry_layout Layout = { 10, 10, 0.5, 1.618 };
+    geometry_rect Root = { 0, 0, 5120, 2880 };
+    CreateRandomTree(Random, &Tree, Root, &Layout, 255);
+
+    std::vector<geometry_rect> Leaves;
+    LeafRects(Tree.Root, &Leaves);
+    printf("  %-48s %12zu\n", "windows", Leaves.size());
+
+    uint32_t Computed = 0;
+    TestBenchmark("layout, whole tree", 10000,
+    {
+        Computed = LayoutNodeContainers(&Layout, Tree.Root, true);
+    });
+    TestCheck(Computed == Tree.Nodes.size() - 1);
+
+    tree_node *Node = Tree.Root->LeftChild;
+    TestBenchmark("resize, split below the root", 10000,
+    {
+        Node->SplitRatio = (Iteration % 2) ? 0.4 : 0.6;
+        Computed = ResizeNodeContainers(&Layout, Node);
+    });
+    printf("  %-48s %12u\n", "containers computed by the resize", Computed);
+}
+
+int main(int Count, char **Args)
+{
+    TestRandomTreesTileTheRoot();
+    TestResizeRecomputesTheSubtree();
+
+    if(TestWantsBenchmarks(Count, Args))
+        BenchmarkLayout();
+
+    return TestReport("container_test");
+}
@@ -0,0 +1,803 @@
+#include "test.h"
+#include "daemon.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* NOTE(koekeishiya): Runs the daemon in a child process with an interpreter that answers every
+ *                    command with 'reply:<command>', and talks to it the way kwmc does. It also
+ *                    knows 'subscribe <topic>...', 'subscribed <topic>', which tells whether anyone
+ *                    is subscribed to the topic yet, and 'publish <topic> <count> <name> [size]',
+ *                    which publishes <count> records '<name> <index>', padded to [size] bytes,
+ *                    and 'large <size>', which is answered with <size> bytes. */
+static uint32_t
+TopicFromName(std::string Name)
+{
+    if(Name == "focus")
+        return KwmTopic_Focus;
+    else if(Name == "space")
+        return KwmTopic_Space;
+    else if(Name == "window")
+        return KwmTopic_Window;
+    else if(Name == "mode")
+        return KwmTopic_Mode;
+    else if(Name == "tree")
+        return KwmTopic_Tree;
+
+    return 0;
+}
+
+void KwmInterpretCommand(std::string Message, int ClientSockFD)
+{
+    char Command[32], Topic[32], Name[32];
+    int Records = 0, Size = 0;
+
+    if(Message.compare(0, 10, "subscribe ") == 0)
+    {
+        uint32_t Topics = 0;
+        std::size_t Start = 10;
+        while(Start < Message.size())
+        {
+            std::size_t End = Message.find(' ', Start);
+            if(End == std::string::npos)
+                End = Message.size();
+
+            Topics |= TopicFromName(Message.substr(Start, End - Start));
+            Start = End + 1;
+        }
+
+        KwmSubscribe(ClientSockFD, Topics);
+    }
+    else if(sscanf(Message.c_str(), "%31s %31s", Command, Topic) == 2 &&
+            strcmp(Command, "subscribed") == 0)
+    {
+        KwmWriteToSocket(KwmIsSubscribed((kwm_topic) TopicFromName(Topic)) ? "true" : "false", ClientSockFD);
+    }
+    else if(sscanf(Message.c_str(), "%31s %31s %d %31s %d", Command, Topic, &Records, Name, &Size) >= 4 &&
+            strcmp(Command, "publish") == 0)
+    {
+        for(int Index = 0; Index < Records; ++Index)
+        {
+            std::string Record = std::string(Name) + " " + std::to_string(Index);
+            if(Size > (int) Record.size())
+                Record += " " + std::string(Size - Record.size() - 1, '.');
+
+            KwmPublishEvent((kwm_topic) TopicFromName(Topic), Record);
+        }
+
+        KwmWriteToSocket("published", ClientSockFD);
+    }
+    else if(sscanf(Message.c_str(), "%31s %d", Command, &Size) == 2 &&
+            strcmp(Command, "large") == 0)
+    {
+        KwmWriteToSocket(std::string(Size, 'x'), ClientSockFD);
+    }
+    else
+    {
+        KwmWriteToSocket("reply:" + Message, ClientSockFD);
+    }
+}
+
+#define TEST_PORT 30221
+
+static char TestDirectory[] = "/tmp/kwm_test.XXXXXX";
+static std::string TestSocketPath;
+
+static int
+ConnectToDaemon(std::string Path)
+{
+    struct sockaddr_un Addr;
+    memset(&Addr, 0, sizeof(Addr));
+    Addr.sun_family = AF_UNIX;
+    strncpy(Addr.sun_path, Path.c_str(), sizeof(Addr.sun_path) - 1);
+
+    int SockFD = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(connect(SockFD, (struct sockaddr *) &Addr, sizeof(Addr)) == -1)
+    {
+        close(SockFD);
+        return -1;
+    }
+
+    return SockFD;
+}
+
+static int
+ConnectToTCPDaemon(int Port)
+{
+    struct sockaddr_in Addr;
+    memset(&Addr, 0, sizeof(Addr));
+    Addr.sin_family = AF_INET;
+    Addr.sin_port = htons(Port);
+    Addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int SockFD = socket(PF_INET, SOCK_STREAM, 0);
+    if(connect(SockFD, (struct sockaddr *) &Addr, sizeof(Addr)) == -1)
+    {
+        close(SockFD);
+        return -1;
+    }
+
+    return SockFD;
+}
+
+static volatile sig_atomic_t TerminateRequested;
+
+static void
+RequestTerminate(int Signal)
+{
+    TerminateRequested = 1;
+}
+
+/* NOTE(koekeishiya): A Port of 0 selects the unix domain socket at Path. The daemon is terminated
+ *                    from the main thread of the child on SIGUSR1, the way kwm terminates it, and
+ *                    the child lives on afterwards. */
+static pid_t
+StartDaemonProcess(std::string Path, int Port = 0)
+{
+    pid_t PID = fork();
+    if(PID == 0)
+    {
+        sigset_t Signals;
+        sigemptyset(&Signals);
+        sigaddset(&Signals, SIGUSR1);
+        pthread_sigmask(SIG_BLOCK, &Signals, NULL);
+        signal(SIGUSR1, RequestTerminate);
+
+        if(Port)
+            KwmSetDaemonPort(Port);
+        else
+            KwmSetDaemonSocketPath(Path);
+
+        if(!KwmStartDaemon())
+            _exit(1);
+
+        pthread_sigmask(SIG_UNBLOCK, &Signals, NULL);
+
+        for(;;)
+        {
+            pause();
+            if(TerminateRequested)
+            {
+                TerminateRequested = 0;
+                KwmTerminateDaemon();
+            }
+        }
+    }
+
+    double Deadline = TestSeconds() + 5;
+    while(TestSeconds() < Deadline)
+    {
+        int SockFD = Port ? ConnectToTCPDaemon(Port) : ConnectToDaemon(Path);
+        if(SockFD != -1)
+        {
+            close(SockFD);
+            return PID;
+        }
+
+        usleep(1000);
+    }
+
+    kill(PID, SIGKILL);
+    waitpid(PID, NULL, 0);
+    return -1;
+}
+
+/* NOTE(koekeishiya): Whether a daemon would start on the given path; the child exits right away. */
+static bool
+DaemonStarts(std::string Path)
+{
+    pid_t PID = fork();
+    if(PID == 0)
+    {
+        KwmSetDaemonSocketPath(Path);
+        _exit(KwmStartDaemon() ? 0 : 1);
+    }
+
+    int Status = 0;
+    waitpid(PID, &Status, 0);
+    return WIFEXITED(Status) && WEXITSTATUS(Status) == 0;
+}
+
+/* NOTE(koekeishiya): Leaves a socket file at Path that nobody listens on. */
+static void
+CreateStaleSocket(std::string Path)
+{
+    struct sockaddr_un Addr;
+    memset(&Addr, 0, sizeof(Addr));
+    Addr.sun_family = AF_UNIX;
+    strncpy(Addr.sun_path, Path.c_str(), sizeof(Addr.sun_path) - 1);
+
+    int SockFD = socket(AF_UNIX, SOCK_STREAM, 0);
+    bind(SockFD, (struct sockaddr *) &Addr, sizeof(Addr));
+    close(SockFD);
+}
+
+static void
+StopDaemonProcess(pid_t PID)
+{
+    kill(PID, SIGKILL);
+    waitpid(PID, NULL, 0);
+}
+
+static void
+SendString(int SockFD, std::string Data)
+{
+    const char *Bytes = Data.c_str();
+    size_t Size = Data.size();
+    while(Size > 0)
+    {
+        ssize_t Sent = send(SockFD, Bytes, Size, 0);
+        if(Sent <= 0)
+            break;
+
+        Bytes += Sent;
+        Size -= Sent;
+    }
+}
+
+static std::string
+ReadUntilClosed(int SockFD)
+{
+    std::string Result;
+    char Chunk[4096];
+    ssize_t Received;
+    while((Received = recv(SockFD, Chunk, sizeof(Chunk), 0)) > 0)
+        Result.append(Chunk, Received);
+
+    return Result;
+}
+
+/* NOTE(koekeishiya): Reads one '#<id> <length>\n<body>' reply, keeping whatever follows it. */
+static bool
+ReadReply(int SockFD, std::string &Buffer, std::string *RequestID, std::string *Body)
+{
+    char Chunk[4096];
+    for(;;)
+    {
+        std::size_t Newline = Buffer.find('\n');
+        if(Newline != std::string::npos && Buffer[0] == '#')
+        {
+            std::size_t Space = Buffer.find(' ');
+            size_t Length = strtoul(Buffer.c_str() + Space + 1, NULL, 10);
+            if(Buffer.size() >= Newline + 1 + Length)
+            {
+                *RequestID = Buffer.substr(1, Space - 1);
+                *Body = Buffer.substr(Newline + 1, Length);
+                Buffer.erase(0, Newline + 1 + Length);
+                return true;
+            }
+        }
+
+        ssize_t Received = recv(SockFD, Chunk, sizeof(Chunk), 0);
+        if(Received <= 0)
+            return false;
+
+        Buffer.append(Chunk, Received);
+    }
+}
+
+static void
+TestSingleShotCommandClosesConnection()
+{
+    int SockFD = ConnectToDaemon(TestSocketPath);
+    TestCheck(SockFD != -1);
+
+    SendString(SockFD, "query tiling mode\n");
+    TestCheck(ReadUntilClosed(SockFD) == "reply:query tiling mode");
+    close(SockFD);
+}
+
+static void
+TestPipelinedRequestsAreAnsweredInOrder()
+{
+    int SockFD = ConnectToDaemon(TestSocketPath);
+    TestCheck(SockFD != -1);
+
+    std::string Requests;
+    for(int Index = 0; Index < 200; ++Index)
+        Requests += "#" + std::to_string(Index) + " command " + std::to_string(Index) + "\n";
+
+    SendString(SockFD, Requests);
+
+    std::string Buffer, RequestID, Body;
+    for(int Index = 0; Index < 200; ++Index)
+    {
+        bool Read = ReadReply(SockFD, Buffer, &RequestID, &Body);
+        TestCheck(Read);
+        if(!Read)
+            break;
+
+        TestCheck(RequestID == std::to_string(Index));
+        TestCheck(Body == "reply:command " + std::to_string(Index));
+    }
+
+    close(SockFD);
+}
+
+static void
+TestRequestSplitAcrossWrites()
+{
+    int SockFD = ConnectToDaemon(TestSocketPath);
+    TestCheck(SockFD != -1);
+
+    SendString(SockFD, "#7 sp");
+    usleep(10000);
+    SendString(SockFD, "lit\r\n#8 \n");
+
+    std::string Buffer, RequestID, Body;
+    TestCheck(ReadReply(SockFD, Buffer, &RequestID, &Body));
+    TestCheck(RequestID == "7" && Body == "reply:split");
+    TestCheck(ReadReply(SockFD, Buffer, &RequestID, &Body));
+    TestCheck(RequestID == "8" && Body.empty());
+    close(SockFD);
+}
+
+static int NextRequestID;
+
+static std::string
+SendCommand(int SockFD, std::string &Buffer, std::string Command)
+{
+    std::string RequestID, Body;
+    SendString(SockFD, "#" + std::to_string(++NextRequestID) + " " + Command + "\n");
+    ReadReply(SockFD, Buffer, &RequestID, &Body);
+    return Body;
+}
+
+/* NOTE(koekeishiya): Subscribing is not acknowledged, so we ask until the daemon knows about it. */
+static int
+Subscribe(int Control, std::string &Buffer, std::string Topics)
+{
+    int SockFD = ConnectToDaemon(TestSocketPath);
+    SendString(SockFD, "subscribe " + Topics + "\n");
+
+    std::string Topic = Topics.substr(0, Topics.find(' '));
+    double Deadline = TestSeconds() + 5;
+    while((SendCommand(Control, Buffer, "subscribed " + Topic) != "true") &&
+          (TestSeconds() < Deadline))
+        usleep(1000);
+
+    return SockFD;
+}
+
+/* NOTE(koekeishiya): Reads one record, or returns false if the connection is closed or nothing
+ *                    arrives within Seconds. */
+static bool
+ReadRecord(int SockFD, std::string &Buffer, std::string *Record, double Seconds = 5)
+{
+    char Chunk[4096];
+    double Deadline = TestSeconds() + Seconds;
+    for(;;)
+    {
+        std::size_t Newline = Buffer.find('\n');
+        if(Newline != std::string::npos)
+        {
+            *Record = Buffer.substr(0, Newline);
+            Buffer.erase(0, Newline + 1);
+            return true;
+        }
+
+        struct pollfd PollFD = { SockFD, POLLIN, 0 };
+        int Timeout = (int) ((Deadline - TestSeconds()) * 1000);
+        if((Timeout <= 0) || (poll(&PollFD, 1, Timeout) <= 0))
+            return false;
+
+        ssize_t Received = recv(SockFD, Chunk, sizeof(Chunk), 0);
+        if(Received <= 0)
+            return false;
+
+        Buffer.append(Chunk, Received);
+    }
+}
+
+static void
+TestSubscribersOnlyReceiveTheirTopics()
+{
+    int Control = ConnectToDaemon(TestSocketPath);
+    std::string Buffer;
+
+    std::string FocusBuffer, OtherBuffer;
+    int Focus = Subscribe(Control, Buffer, "focus");
+    int Other = Subscribe(Control, Buffer, "space window");
+
+    TestCheck(SendCommand(Control, Buffer, "publish focus 2 f") == "published");
+    TestCheck(SendCommand(Control, Buffer, "publish space 1 s") == "published");
+    TestCheck(SendCommand(Control, Buffer, "publish mode 1 m") == "published");
+    TestCheck(SendCommand(Control, Buffer, "publish window 1 w") == "published");
+    TestCheck(SendCommand(Control, Buffer, "publish focus 1 end") == "published");
+    TestCheck(SendCommand(Control, Buffer, "publish space 1 end") == "published");
+
+    const char *FocusRecords[] = { "f 0", "f 1", "end 0" };
+    const char *OtherRecords[] = { "s 0", "w 0", "end 0" };
+
+    std::string Record;
+    for(int Index = 0; Index < 3; ++Index)
+    {
+        TestCheck(ReadRecord(Focus, FocusBuffer, &Record) && Record == FocusRecords[Index]);
+        TestCheck(ReadRecord(Other, OtherBuffer, &Record) && Record == OtherRecords[Index]);
+    }
+
+    close(Focus);
+    close(Other);
+    close(Control);
+}
+
+/* NOTE(koekeishiya): Records published in a single command are queued before the daemon gets to
+ *                    write any of them, so only the latest KWM_SUBSCRIBER_QUEUE_SIZE remain. */
+static void
+TestQueueDropsOldestRecords()
+{
+    int Control = ConnectToDaemon(TestSocketPath);
+    std::string Buffer, SubscriberBuffer, Record;
+    int Subscriber = Subscribe(Control, Buffer, "tree");
+
+    TestCheck(SendCommand(Control, Buffer, "publish tree 1000 r") == "published");
+    TestCheck(ReadRecord(Subscriber, SubscriberBuffer, &Record) && Record == "dropped 744");
+    for(int Index = 744; Index < 1000; ++Index)
+    {
+        bool Read = ReadRecord(Subscriber, SubscriberBuffer, &Record);
+        TestCheck(Read && Record == "r " + std::to_string(Index));
+        if(!Read)
+            break;
+    }
+
+    TestCheck(SendCommand(Control, Buffer, "publish tree 1 end") == "published");
+    TestCheck(ReadRecord(Subscriber, SubscriberBuffer, &Record) && Record == "end 0");
+
+    close(Subscriber);
+    close(Control);
+}
+
+/* NOTE(koekeishiya): A subscriber that stops reading fills its socket and then its queue, while
+ *                    commands on other connections are answered as before. Once it reads again
+ *                    it gets the records that were kept, in order, with the gaps reported. */
+static void
+TestSlowSubscriberDoesNotStallTheDaemon()
+{
+    const int Rounds = 64;
+
+    int Control = ConnectToDaemon(TestSocketPath);
+    std::string Buffer, SubscriberBuffer, Record;
+    int Subscriber = Subscribe(Control, Buffer, "window");
+
+    double Slowest = 0;
+    for(int Round = 0; Round < Rounds; ++Round)
+    {
+        double Start = TestSeconds();
+        TestCheck(SendCommand(Control, Buffer, "publish window 256 w" + std::to_string(Round) + " 1024") == "published");
+        TestCheck(SendCommand(Control, Buffer, "ping") == "reply:ping");
+
+        double Elapsed = TestSeconds() - Start;
+        if(Elapsed > Slowest)
+            Slowest = Elapsed;
+    }
+    TestCheck(Slowest < 1);
+
+    long Last = -1;
+    bool Ordered = true;
+    uint64_t Dropped = 0;
+    while(ReadRecord(Subscriber, SubscriberBuffer, &Record, 1))
+    {
+        int Round, Index;
+        if(sscanf(Record.c_str(), "dropped %d", &Index) == 1)
+        {
+            Dropped += Index;
+        }
+        else if(sscanf(Record.c_str(), "w%d %d", &Round, &Index) == 2)
+        {
+            long Position = (long) Round * 256 + Index;
+            Ordered = Ordered && Position > Last;
+            Last = Position;
+        }
+    }
+
+    TestCheck(Ordered);
+    TestCheck(Dropped > 0);
+    TestCheck(Last == (long) Rounds * 256 - 1);
+
+    close(Subscriber);
+    close(Control);
+}
+
+/* NOTE(koekeishiya): Terminating the daemon from another thread wakes it up, and subscribers get
+ *                    what was queued for them before their connection is closed. The control
+ *                    connection stays open, so that nothing else wakes the daemon. */
+static void
+TestTerminateClosesSubscribers()
+{
+    std::string Path = std::string(TestDirectory) + "/terminate.socket";
+    pid_t Daemon = StartDaemonProcess(Path);
+    TestCheck(Daemon != -1);
+    if(Daemon == -1)
+        return;
+
+    std::string SocketPath = TestSocketPath;
+    TestSocketPath = Path;
+
+    int Control = ConnectToDaemon(Path);
+    std::string Buffer, SubscriberBuffer, Record;
+    int Subscriber = Subscribe(Control, Buffer, "focus");
+    TestCheck(SendCommand(Control, Buffer, "publish focus 3 t") == "published");
+    TestCheck(ReadRecord(Subscriber, SubscriberBuffer, &Record) && Record == "t 0");
+
+    kill(Daemon, SIGUSR1);
+    TestCheck(ReadRecord(Subscriber, SubscriberBuffer, &Record) && Record == "t 1");
+    TestCheck(ReadRecord(Subscriber, SubscriberBuffer, &Record) && Record == "t 2");
+
+    char Byte;
+    struct pollfd PollFD = { Subscriber, POLLIN, 0 };
+    TestCheck(poll(&PollFD, 1, 5000) == 1 && recv(Subscriber, &Byte, 1, 0) == 0);
+
+    close(Subscriber);
+    close(Control);
+    StopDaemonProcess(Daemon);
+    TestSocketPath = SocketPath;
+}
+
+/* NOTE(koekeishiya): Whether a reply to Command arrives on SockFD within five seconds. */
+static bool
+AnswersWithin(int SockFD, std::string &Buffer, std::string Command)
+{
+    SendString(SockFD, "#" + std::to_string(++NextRequestID) + " " + Command + "\n");
+
+    struct pollfd PollFD = { SockFD, POLLIN, 0 };
+    std::string RequestID, Body;
+    return (poll(&PollFD, 1, 5000) == 1) &&
+           ReadReply(SockFD, Buffer, &RequestID, &Body) &&
+           (Body == "reply:" + Command);
+}
+
+/* NOTE(koekeishiya): A client that sends requests but does not read the replies, which are far
+ *                    more than its socket buffer holds, must not stall the daemon; once it reads,
+ *                    every reply arrives whole and in order. */
+static void
+TestUnreadRepliesDoNotStallTheDaemon()
+{
+    const int Requests = 96;
+    const int Size = 8192;
+
+    int Client = ConnectToDaemon(TestSocketPath);
+    int Control = ConnectToDaemon(TestSocketPath);
+    std::string ControlBuffer, Buffer, RequestID, Body;
+    TestCheck(SendCommand(Client, Buffer, "hello") == "reply:hello");
+
+    std::string Batch;
+    for(int Index = 0; Index < Requests; ++Index)
+        Batch += "#" + std::to_string(Index) + " large " + std::to_string(Size) + "\n";
+
+    SendString(Client, Batch);
+    TestCheck(AnswersWithin(Control, ControlBuffer, "first"));
+
+    SendString(Client, "#" + std::to_string(Requests) + " last\n");
+    TestCheck(AnswersWithin(Control, ControlBuffer, "second"));
+
+    bool Whole = true;
+    for(int Index = 0; Index < Requests; ++Index)
+    {
+        Whole = Whole && ReadReply(Client, Buffer, &RequestID, &Body) &&
+                (RequestID == std::to_string(Index)) && (Body == std::string(Size, 'x'));
+    }
+
+    TestCheck(Whole);
+    TestCheck(ReadReply(Client, Buffer, &RequestID, &Body) &&
+              RequestID == std::to_string(Requests) && Body == "reply:last");
+
+    close(Client);
+    close(Control);
+}
+
+/* NOTE(koekeishiya): A client whose unread replies pile up beyond what the daemon buffers for it
+ *                    is disconnected; it sees fewer replies than it asked for, and the end of
+ *                    the stream. The client is known to the daemon and its requests fit in one
+ *                    read, so the daemon has handled all of them once it answers a control
+ *                    request that was sent after them. */
+static void
+TestClientThatFallsBehindIsDisconnected()
+{
+    const int Requests = 128;
+    const int Size = 32768;
+
+    int Client = ConnectToDaemon(TestSocketPath);
+    int Control = ConnectToDaemon(TestSocketPath);
+    std::string ControlBuffer, Buffer, RequestID, Body;
+    TestCheck(SendCommand(Client, Buffer, "hello") == "reply:hello");
+
+    std::string Batch;
+    for(int Index = 0; Index < Requests; ++Index)
+        Batch += "#" + std::to_string(Index) + " large " + std::to_string(Size) + "\n";
+
+    SendString(Client, Batch);
+    TestCheck(AnswersWithin(Control, ControlBuffer, "first"));
+    TestCheck(AnswersWithin(Control, ControlBuffer, "second"));
+
+    int Replies = 0;
+    while(ReadReply(Client, Buffer, &RequestID, &Body))
+        ++Replies;
+
+    TestCheck(Replies < Requests);
+    TestCheck(AnswersWithin(Control, ControlBuffer, "third"));
+
+    close(Client);
+    close(Control);
+}
+
+static void
+TestSocketIsPrivate()
+{
+    struct stat Info;
+    TestCheck(lstat(TestSocketPath.c_str(), &Info) == 0);
+    TestCheck(S_ISSOCK(Info.st_mode));
+    TestCheck((Info.st_mode & (S_IRWXG | S_IRWXO)) == 0);
+}
+
+static void
+TestLiveSocketIsNotTakenOver()
+{
+    TestCheck(!DaemonStarts(TestSocketPath));
+
+    int SockFD = ConnectToDaemon(TestSocketPath);
+    TestCheck(SockFD != -1);
+    SendString(SockFD, "ping\n");
+    TestCheck(ReadUntilClosed(SockFD) == "reply:ping");
+    close(SockFD);
+}
+
+static void
+TestForeignPathsAreRefused()
+{
+    std::string Path = std::string(TestDirectory) + "/foreign.socket";
+
+    FILE *File = fopen(Path.c_str(), "w");
+    fclose(File);
+    TestCheck(!DaemonStarts(Path));
+    TestCheck(access(Path.c_str(), F_OK) == 0);
+    unlink(Path.c_str());
+
+    /* NOTE(koekeishiya): Handing a file to another user requires root. */
+    if(getuid() == 0)
+    {
+        CreateStaleSocket(Path);
+        TestCheck(chown(Path.c_str(), 1, 1) == 0);
+        TestCheck(!DaemonStarts(Path));
+        TestCheck(access(Path.c_str(), F_OK) == 0);
+        unlink(Path.c_str());
+    }
+}
+
+static void
+TestStaleSocketIsReplaced()
+{
+    std::string Path = std::string(TestDirectory) + "/stale.socket";
+    CreateStaleSocket(Path);
+    TestCheck(DaemonStarts(Path));
+    unlink(Path.c_str());
+}
+
+static void
+TestDefaultPathPrefersTempDirectory()
+{
+    unsetenv("KWM_SOCKET");
+    setenv("USER", "tester", 1);
+
+    setenv("TMPDIR", "/var/folders/xy/T/", 1);
+    TestCheck(KwmDefaultDaemonSocketPath() == "/var/folders/xy/T/kwm_tester.socket");
+
+    setenv("TMPDIR", "/var/folders/xy/T", 1);
+    TestCheck(KwmDefaultDaemonSocketPath() == "/var/folders/xy/T/kwm_tester.socket");
+
+    unsetenv("TMPDIR");
+    TestCheck(KwmDefaultDaemonSocketPath() == "/tmp/kwm_tester.socket");
+
+    setenv("KWM_SOCKET", "/run/kwm.socket", 1);
+    TestCheck(KwmDefaultDaemonSocketPath() == "/run/kwm.socket");
+}
+
+/* NOTE(koekeishiya): Round trips of a single-shot command, the way 'kwmc query' sends it, over
+ *                    the unix domain socket and over TCP on the loopback interface. */
+static void
+BenchmarkTransports()
+{
+    const int Commands = 2000;
+
+    TestBenchmark("unix socket, kwmc query round trip", Commands,
+    {
+        int SockFD = ConnectToDaemon(TestSocketPath);
+        SendString(SockFD, "query tiling mode\n");
+        ReadUntilClosed(SockFD);
+        close(SockFD);
+    });
+
+    pid_t Daemon = StartDaemonProcess("", TEST_PORT);
+    if(Daemon == -1)
+    {
+        printf("  could not listen on port %d, skipping tcp\n", TEST_PORT);
+        return;
+    }
+
+    TestBenchmark("tcp loopback, kwmc query round trip", Commands,
+    {
+        int SockFD = ConnectToTCPDaemon(TEST_PORT);
+        SendString(SockFD, "query tiling mode\n");
+        ReadUntilClosed(SockFD);
+        close(SockFD);
+    });
+
+    StopDaemonProcess(Daemon);
+}
+
+/* NOTE(koekeishiya): Many commands on a single connection, either pipelined or waiting for
+ *                    every reply, as opposed to one connection per command above. */
+static void
+BenchmarkCommands()
+{
+    const int Commands = 2000;
+
+    int SockFD = ConnectToDaemon(TestSocketPath);
+    std::string Buffer, RequestID, Body;
+    TestBenchmark("persistent connection, request/reply", Commands,
+    {
+        SendString(SockFD, "#" + std::to_string(Iteration) + " query tiling mode\n");
+        ReadReply(SockFD, Buffer, &RequestID, &Body);
+    });
+
+    std::string Requests;
+    for(int Index = 0; Index < Commands; ++Index)
+        Requests += "#" + std::to_string(Index) + " query tiling mode\n";
+
+    double Start = TestSeconds();
+    SendString(SockFD, Requests);
+    for(int Index = 0; Index < Commands; ++Index)
+        ReadReply(SockFD, Buffer, &RequestID, &Body);
+
+    double Elapsed = TestSeconds() - Start;
+    printf("  %-48s %12.3f us\n", "persistent connection, pipelined", (Elapsed * 1e6) / Commands);
+    close(SockFD);
+}
+
+int main(int Count, char **Args)
+{
+    signal(SIGPIPE, SIG_IGN);
+    if(!mkdtemp(TestDirectory))
+    {
+        printf("daemon_test: could not create %s\n", TestDirectory);
+        return 1;
+    }
+
+    TestSocketPath = std::string(TestDirectory) + "/kwm.socket";
+    pid_t Daemon = StartDaemonProcess(TestSocketPath);
+    TestCheck(Daemon != -1);
+
+    if(Daemon != -1)
+    {
+        TestSingleShotCommandClosesConnection();
+        TestPipelinedRequestsAreAnsweredInOrder();
+        TestRequestSplitAcrossWrites();
+        TestSocketIsPrivate();
+        TestLiveSocketIsNotTakenOver();
+        TestSubscribersOnlyReceiveTheirTopics();
+        TestQueueDropsOldestRecords();
+        TestSlowSubscriberDoesNotStallTheDaemon();
+        TestTerminateClosesSubscribers();
+        TestUnreadRepliesDoNotStallTheDaemon();
+        TestClientThatFallsBehindIsDisconnected();
+
+        if(TestWantsBenchmarks(Count, Args))
+        {
+            BenchmarkTransports();
+            BenchmarkCommands();
+        }
+
+        StopDaemonProcess(Daemon);
+    }
+
+    TestForeignPathsAreRefused();
+    TestStaleSocketIsReplaced();
+    TestDefaultPathPrefersTempDirectory();
+
+    unlink(TestSocketPath.c_str());
+    rmdir(TestDirectory);
+    return TestReport("daemon_test");
+}
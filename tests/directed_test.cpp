@@ -0,0 +1,204 @@
+#include "test.h"
+#include "fake/fake.h"
+#include "tree.h"
+#include "node.h"
+#include "space.h"
+#include "window.h"
+#include "container.h"
+
+#include <set>
+
+extern ax_application *FocusedApplication;
+extern kwm_settings KWMSettings;
+extern ax_state AXState;
+
+/* NOTE(koekeishiya): Windows belong to the fake display unless they are placed on another one, and
+ *                    windows can be hidden from the list of visible windows that the window server
+ *                    reports, which is what decides between windows stacked in the same leaf. */
+static std::map<uint32_t, ax_display *> WindowDisplays;
+static std::set<uint32_t> HiddenWindows;
+
+ax_display *AXLibWindowDisplay(ax_window *Window)
+{
+    std::map<uint32_t, ax_display *>::iterator It = WindowDisplays.find(Window->ID);
+    return It != WindowDisplays.end() ? It->second : FakeDisplay();
+}
+
+bool AXLibSpaceHasWindow(ax_window *Window, CGSSpaceID SpaceID)
+{
+    return AXLibWindowDisplay(Window)->Space->ID == SpaceID;
+}
+
+std::vector<ax_window *> AXLibGetAllVisibleWindows()
+{
+    std::vector<ax_window *> Windows;
+    std::vector<ax_window *> Known = AXLibGetAllKnownWindows();
+    for(std::size_t Index = 0; Index < Known.size(); ++Index)
+    {
+        if(HiddenWindows.find(Known[Index]->ID) == HiddenWindows.end())
+            Windows.push_back(Known[Index]);
+    }
+
+    return Windows;
+}
+
+static void
+Focus(uint32_t WindowID)
+{
+    FocusedApplication = FakeApplication();
+    FocusedApplication->Focus = GetWindowByID(WindowID);
+}
+
+static uint32_t
+ClosestWindowID(int Degrees)
+{
+    ax_window *Window = NULL;
+    return FindClosestWindow(Degrees, &Window, false) ? Window->ID : 0;
+}
+
+/* NOTE(koekeishiya): Window 1 fills the left half of the display. The right half is split in a short
+ *                    leaf at the top that holds window 2, and a tall leaf below it that holds Lower,
+ *                    which is the leaf closest to the east of window 1. */
+static tree_node *
+CreateLayout(uint32_t Lower)
+{
+    FakeReset();
+    WindowDisplays.clear();
+    HiddenWindows.clear();
+    KWMSettings.Cycle = CycleModeDisabled;
+
+    FakeAddWindow(1);
+    FakeAddWindow(2);
+    ax_display *Display = FakeDisplay();
+    AddWindowToNodeTree(Display, 1);
+    space_info *Space = GetSpaceInfo(Display->Space);
+
+    if(Lower != 0)
+        FakeAddWindow(Lower);
+
+    tree_node *Node = GetTreeNodeFromWindowID(Space, 2);
+    CreateLeafNodePair(Display, Node, 2, Lower, SPLIT_HORIZONTAL);
+    Node->SplitRatio = 0.2;
+    ResizeNodeContainer(Display, Node);
+    ApplyTreeNodeContainer(Node);
+
+    Focus(1);
+    return Node->RightChild;
+}
+
+static void
+TestPseudoLeafIsPassedOver()
+{
+    tree_node *Lower = CreateLayout(0);
+    TestCheck(IsPseudoNode(Lower));
+    TestCheck(ClosestWindowID(90) == 2);
+
+    Focus(2);
+    TestCheck(ClosestWindowID(180) == 0);
+    TestCheck(ClosestWindowID(270) == 1);
+}
+
+static void
+TestUnmanagedLeafIsPassedOver()
+{
+    CreateLayout(3);
+    TestCheck(ClosestWindowID(90) == 3);
+
+    AXLibAddFlags(GetWindowByID(3), AXWindow_Minimized);
+    TestCheck(ClosestWindowID(90) == 2);
+
+    FakeRemoveWindow(3);
+    TestCheck(ClosestWindowID(90) == 2);
+}
+
+/* NOTE(koekeishiya): Window 4 is stacked on window 3 through a link-node; the window server decides
+ *                    which of them is visible. */
+static void
+TestStackedLeafFollowsTheWindowServer()
+{
+    tree_node *Lower = CreateLayout(3);
+    space_info *Space = GetSpaceInfo(FakeDisplay()->Space);
+
+    FakeAddWindow(4);
+    Lower->Type = NodeTypeLink;
+    Lower->List = CreateLinkNode(Space);
+    Lower->List->Container = Lower->Container;
+    Lower->List->WindowID = 4;
+    AddLinkNodeToIndex(Space, Lower, Lower->List);
+    TestCheck(CheckNodeIndex(Space));
+
+    TestCheck(ClosestWindowID(90) == 3);
+
+    HiddenWindows.insert(3);
+    TestCheck(ClosestWindowID(90) == 4);
+
+    HiddenWindows.insert(4);
+    TestCheck(ClosestWindowID(90) == 2);
+
+    HiddenWindows.clear();
+    Focus(4);
+    TestCheck(ClosestWindowID(270) == 1);
+    TestCheck(ClosestWindowID(0) == 2);
+}
+
+/* NOTE(koekeishiya): A second display to the right of the fake display, with window 10 as the only
+ *                    window of its active space. */
+static ax_display *
+AddSecondDisplay()
+{
+    ax_display *Display = &AXState.Displays[2];
+    Display->ArrangementID = 2;
+    Display->ID = 2;
+    Display->Frame = { { 1440, 0 }, { 1440, 900 } };
+
+    ax_space *Space = &Display->Spaces[2];
+    Space->Identifier = "second";
+    Space->Handle = -1;
+    Space->ID = 2;
+    Space->Type = kCGSSpaceUser;
+    Display->Space = Space;
+    Display->PrevSpace = Space;
+
+    FakeAddWindow(10);
+    WindowDisplays[10] = Display;
+    AddWindowToNodeTree(Display, 10);
+    return Display;
+}
+
+static void
+TestSearchReachesOtherDisplays()
+{
+    CreateLayout(3);
+    ax_display *Second = AddSecondDisplay();
+    space_info *SecondSpace = GetSpaceInfo(Second->Space);
+    TestCheck(GetTreeNodeFromWindowID(SecondSpace, 10) != NULL);
+
+    TestCheck(ClosestWindowID(90) == 3);
+
+    Focus(2);
+    TestCheck(ClosestWindowID(90) == 10);
+
+    Focus(10);
+    TestCheck(ClosestWindowID(270) == 3);
+    TestCheck(ClosestWindowID(90) == 0);
+
+    Focus(2);
+    SwapFocusedWindowDirected(90);
+    space_info *Space = GetSpaceInfo(FakeDisplay()->Space);
+    TestCheck(GetTreeNodeFromWindowID(SecondSpace, 2) != NULL);
+    TestCheck(GetTreeNodeFromWindowID(Space, 10) != NULL);
+    TestCheck(GetTreeNodeFromWindowID(Space, 2) == NULL);
+    TestCheck(GetTreeNodeFromWindowID(SecondSpace, 10) == NULL);
+    TestCheck(CheckNodeIndex(Space));
+    TestCheck(CheckNodeIndex(SecondSpace));
+}
+
+int main(int Count, char **Args)
+{
+    TestPseudoLeafIsPassedOver();
+    TestUnmanagedLeafIsPassedOver();
+    TestStackedLeafFollowsTheWindowServer();
+    TestSearchReachesOtherDisplays();
+
+    return TestReport("directed_test");
+}
@@ -0,0 +1,526 @@
+#include "test.h"
+#include "axlib/event.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+/* NOTE(koekeishiya): Runs the real event loop with several producer threads. Every event carries
+ *                    its producer and a per-producer sequence number in the WindowID payload, and
+ *                    the handler checks that the events of each producer arrive in order. The
+ *                    handler stalls now and then so that the ring fills up and events spill into
+ *                    the overflow queue, or are dropped once that is full too, and producers pause
+ *                    so that the worker goes to sleep in between. */
+#define PRODUCERS 8
+#define PRODUCER_SHIFT 24
+#define SEQUENCE_MASK ((1 << PRODUCER_SHIFT) - 1)
+
+static uint32_t Expected[PRODUCERS];
+static uint64_t Received[PRODUCERS];
+static uint64_t OutOfOrder;
+static uint32_t StallEvery;
+
+static EVENT_CALLBACK(Callback_TestEvent)
+{
+    uint32_t Producer = Event->WindowID >> PRODUCER_SHIFT;
+    uint32_t Sequence = Event->WindowID & SEQUENCE_MASK;
+    if(Sequence < Expected[Producer])
+        ++OutOfOrder;
+
+    Expected[Producer] = Sequence + 1;
+    uint64_t Count = __atomic_add_fetch(&Received[Producer], 1, __ATOMIC_RELEASE);
+    if(StallEvery && (Count % StallEvery) == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+static void
+PushTestEvent(uint32_t Producer, uint32_t Sequence)
+{
+    ax_event Event = {};
+    Event.Type = AXEvent_User;
+    Event.Payload = AXPayload_WindowID;
+    Event.WindowID = (Producer << PRODUCER_SHIFT) | Sequence;
+    Event.Handle = &Callback_TestEvent;
+    AXLibAddEvent(Event);
+}
+
+static void
+ResetReceived()
+{
+    AXLibPauseEventLoop();
+    for(int Producer = 0; Producer < PRODUCERS; ++Producer)
+    {
+        Expected[Producer] = 0;
+        __atomic_store_n(&Received[Producer], 0, __ATOMIC_RELAXED);
+    }
+
+    OutOfOrder = 0;
+    AXLibResumeEventLoop();
+}
+
+static bool
+WaitForReceived(uint32_t Producer, uint64_t Count, double Seconds)
+{
+    double Deadline = TestSeconds() + Seconds;
+    while(__atomic_load_n(&Received[Producer], __ATOMIC_ACQUIRE) < Count)
+    {
+        if(TestSeconds() > Deadline)
+            return false;
+
+        std::this_thread::yield();
+    }
+
+    return true;
+}
+
+static void
+TestProducersKeepTheirOrder()
+{
+    const uint32_t Events = 100000;
+    ResetReceived();
+    StallEvery = 4096;
+
+    ax_event_stats Before;
+    AXLibGetEventStats(&Before);
+
+    std::vector<std::thread> Producers;
+    for(uint32_t Producer = 0; Producer < PRODUCERS; ++Producer)
+    {
+        Producers.push_back(std::thread([Producer, Events]()
+        {
+            for(uint32_t Sequence = 0; Sequence < Events; ++Sequence)
+            {
+                PushTestEvent(Producer, Sequence);
+                if((Sequence % 25000) == 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        }));
+    }
+
+    for(std::size_t Index = 0; Index < Producers.size(); ++Index)
+        Producers[Index].join();
+
+    ax_event_stats After;
+    double Deadline = TestSeconds() + 30;
+    do
+    {
+        std::this_thread::yield();
+        AXLibGetEventStats(&After);
+    } while((After.Dispatched[AXEvent_User] - Before.Dispatched[AXEvent_User]) +
+            (After.Dropped - Before.Dropped) < PRODUCERS * Events && TestSeconds() < Deadline);
+
+    StallEvery = 0;
+    AXLibPauseEventLoop();
+    TestCheck(OutOfOrder == 0);
+    AXLibResumeEventLoop();
+
+    TestCheck(After.Spilled > Before.Spilled);
+    TestCheck((After.Dispatched[AXEvent_User] - Before.Dispatched[AXEvent_User]) +
+              (After.Dropped - Before.Dropped) == PRODUCERS * Events);
+}
+
+/* NOTE(koekeishiya): Every producer waits for its previous event before it sends the next one, so
+ *                    the worker is asleep, or about to be, whenever an event is published. A lost
+ *                    wakeup leaves an event undelivered and shows up as a timeout. */
+static void
+TestProducersWakeTheWorker()
+{
+    const uint32_t Rounds = 5000;
+    ResetReceived();
+
+    uint32_t Timeouts = 0;
+    std::vector<std::thread> Producers;
+    for(uint32_t Producer = 0; Producer < 4; ++Producer)
+    {
+        Producers.push_back(std::thread([Producer, Rounds, &Timeouts]()
+        {
+            for(uint32_t Sequence = 0; Sequence < Rounds; ++Sequence)
+            {
+                PushTestEvent(Producer, Sequence);
+                if(!WaitForReceived(Producer, Sequence + 1, 2))
+                {
+                    __atomic_add_fetch(&Timeouts, 1, __ATOMIC_RELAXED);
+                    return;
+                }
+            }
+        }));
+    }
+
+    for(std::size_t Index = 0; Index < Producers.size(); ++Index)
+        Producers[Index].join();
+
+    TestCheck(Timeouts == 0);
+    TestCheck(OutOfOrder == 0);
+}
+
+/* NOTE(koekeishiya): The worker is held in the handler of a gate event while a batch is queued
+ *                    behind it, so that the whole batch is pulled off the queue at once. */
+static bool GateEntered;
+static bool GateOpen;
+static bool BatchDone;
+static std::vector<ax_event> Dispatched;
+
+static EVENT_CALLBACK(Callback_TestGate)
+{
+    __atomic_store_n(&GateEntered, true, __ATOMIC_RELEASE);
+    while(!__atomic_load_n(&GateOpen, __ATOMIC_ACQUIRE))
+        std::this_thread::yield();
+}
+
+static EVENT_CALLBACK(Callback_TestBatchDone)
+{
+    __atomic_store_n(&BatchDone, true, __ATOMIC_RELEASE);
+}
+
+static EVENT_CALLBACK(Callback_TestRecord)
+{
+    Dispatched.push_back(*Event);
+    if((Event->Payload == AXPayload_Context) && (Event->Context))
+    {
+        Dispatched.back().WindowID = *(uint32_t *) Event->Context;
+        free(Event->Context);
+    }
+}
+
+static void
+PushEvent(ax_event_type Type, EventCallback *Handle, uint32_t WindowID, bool Intrinsic)
+{
+    ax_event Event = {};
+    Event.Type = Type;
+    Event.Payload = AXPayload_WindowID;
+    Event.WindowID = WindowID;
+    Event.Intrinsic = Intrinsic;
+    Event.Handle = Handle;
+    AXLibAddEvent(Event);
+}
+
+/* NOTE(koekeishiya): Cursor events carry a context here, large enough to be given back to the
+ *                    system when it is freed, so that a dropped context that leaks shows up. */
+#define TEST_CONTEXT_SIZE (256 * 1024)
+
+static void
+PushContextEvent(ax_event_type Type, uint32_t Value)
+{
+    uint32_t *Context = (uint32_t *) malloc(TEST_CONTEXT_SIZE);
+    *Context = Value;
+
+    ax_event Event = {};
+    Event.Type = Type;
+    Event.Payload = AXPayload_Context;
+    Event.Context = Context;
+    Event.Handle = &Callback_TestRecord;
+    AXLibAddEvent(Event);
+}
+
+static size_t
+MappedBlocks()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().hblks;
+#else
+    return 0;
+#endif
+}
+
+/* NOTE(koekeishiya): Within a batch, the latest move or resize of a window replaces the earlier
+ *                    ones and is dispatched where it was queued; the latest cursor movement replaces
+ *                    every earlier one. Events of another window or type, and events that are never
+ *                    coalesced, are left alone. */
+static void
+TestBatchIsCoalesced()
+{
+#if defined(__GLIBC__)
+    mallopt(M_MMAP_THRESHOLD, TEST_CONTEXT_SIZE / 2);
+#endif
+    size_t Blocks = MappedBlocks();
+
+    ax_event_stats Before;
+    AXLibGetEventStats(&Before);
+
+    Dispatched.clear();
+    GateEntered = GateOpen = BatchDone = false;
+    PushEvent(AXEvent_User, &Callback_TestGate, 0, false);
+    while(!__atomic_load_n(&GateEntered, __ATOMIC_ACQUIRE))
+        std::this_thread::yield();
+
+    PushEvent(AXEvent_WindowMoved, &Callback_TestRecord, 1, true);
+    PushEvent(AXEvent_WindowMoved, &Callback_TestRecord, 2, true);
+    PushEvent(AXEvent_WindowResized, &Callback_TestRecord, 1, false);
+    PushContextEvent(AXEvent_MouseMoved, 1);
+    PushEvent(AXEvent_WindowMoved, &Callback_TestRecord, 1, false);
+    PushEvent(AXEvent_WindowFocused, &Callback_TestRecord, 1, false);
+    PushContextEvent(AXEvent_MouseMoved, 2);
+    PushEvent(AXEvent_WindowMoved, &Callback_TestRecord, 1, true);
+    PushEvent(AXEvent_WindowResized, &Callback_TestRecord, 1, true);
+    PushEvent(AXEvent_WindowFocused, &Callback_TestRecord, 1, false);
+    PushContextEvent(AXEvent_MouseMoved, 3);
+    PushEvent(AXEvent_WindowMoved, &Callback_TestRecord, 2, true);
+    PushEvent(AXEvent_User, &Callback_TestBatchDone, 0, false);
+
+    __atomic_store_n(&GateOpen, true, __ATOMIC_RELEASE);
+    double Deadline = TestSeconds() + 5;
+    while(!__atomic_load_n(&BatchDone, __ATOMIC_ACQUIRE) && TestSeconds() < Deadline)
+        std::this_thread::yield();
+
+    struct expected_event
+    {
+        ax_event_type Type;
+        uint32_t WindowID;
+        bool Intrinsic;
+    } Expected[] =
+    {
+        { AXEvent_WindowFocused, 1, false },
+        { AXEvent_WindowMoved, 1, false },
+        { AXEvent_WindowResized, 1, false },
+        { AXEvent_WindowFocused, 1, false },
+        { AXEvent_MouseMoved, 3, false },
+        { AXEvent_WindowMoved, 2, true },
+    };
+
+    const size_t ExpectedCount = sizeof(Expected) / sizeof(Expected[0]);
+    TestCheck(Dispatched.size() == ExpectedCount);
+    for(size_t Index = 0; Index < ExpectedCount && Index < Dispatched.size(); ++Index)
+    {
+        TestCheck(Dispatched[Index].Type == Expected[Index].Type);
+        TestCheck(Dispatched[Index].WindowID == Expected[Index].WindowID);
+        TestCheck(Dispatched[Index].Intrinsic == Expected[Index].Intrinsic);
+    }
+
+    ax_event_stats After;
+    AXLibGetEventStats(&After);
+    TestCheck(After.Coalesced[AXEvent_WindowMoved] - Before.Coalesced[AXEvent_WindowMoved] == 3);
+    TestCheck(After.Coalesced[AXEvent_WindowResized] - Before.Coalesced[AXEvent_WindowResized] == 1);
+    TestCheck(After.Coalesced[AXEvent_MouseMoved] - Before.Coalesced[AXEvent_MouseMoved] == 2);
+    TestCheck(After.Coalesced[AXEvent_WindowFocused] == Before.Coalesced[AXEvent_WindowFocused]);
+    TestCheck(After.Dispatched[AXEvent_WindowMoved] - Before.Dispatched[AXEvent_WindowMoved] == 2);
+    TestCheck(After.Dispatched[AXEvent_MouseMoved] - Before.Dispatched[AXEvent_MouseMoved] == 1);
+    TestCheck(After.Dispatched[AXEvent_WindowFocused] - Before.Dispatched[AXEvent_WindowFocused] == 2);
+
+    TestCheck(MappedBlocks() == Blocks);
+}
+
+static uint64_t Counted;
+
+static EVENT_CALLBACK(Callback_TestCount)
+{
+    __atomic_add_fetch(&Counted, 1, __ATOMIC_RELEASE);
+}
+
+/* NOTE(koekeishiya): With the worker held at the gate, the ring and then the overflow queue fill
+ *                    up, and every event after that is dropped, counted, and its context freed.
+ *                    Once the worker has caught up, events are queued again. */
+static void
+TestFullOverflowDropsEvents()
+{
+#if defined(__GLIBC__)
+    mallopt(M_MMAP_THRESHOLD, TEST_CONTEXT_SIZE / 2);
+#endif
+    size_t Blocks = MappedBlocks();
+    const uint64_t Queued = AX_EVENT_RING_SIZE + AX_EVENT_OVERFLOW_SIZE;
+    const uint64_t Extra = 100;
+
+    ax_event_stats Before;
+    AXLibGetEventStats(&Before);
+
+    Dispatched.clear();
+    Counted = 0;
+    GateEntered = GateOpen = BatchDone = false;
+    PushEvent(AXEvent_User, &Callback_TestGate, 0, false);
+    while(!__atomic_load_n(&GateEntered, __ATOMIC_ACQUIRE))
+        std::this_thread::yield();
+
+    for(uint64_t Index = 0; Index < Queued + Extra; ++Index)
+        PushEvent(AXEvent_User, &Callback_TestCount, 0, false);
+    PushContextEvent(AXEvent_MouseMoved, 1);
+
+    ax_event_stats Full;
+    AXLibGetEventStats(&Full);
+    TestCheck(Full.Spilled - Before.Spilled == AX_EVENT_OVERFLOW_SIZE);
+    TestCheck(Full.Dropped - Before.Dropped == Extra + 1);
+    TestCheck(MappedBlocks() == Blocks);
+
+    __atomic_store_n(&GateOpen, true, __ATOMIC_RELEASE);
+    double Deadline = TestSeconds() + 10;
+    while(__atomic_load_n(&Counted, __ATOMIC_ACQUIRE) < Queued && TestSeconds() < Deadline)
+        std::this_thread::yield();
+    TestCheck(Counted == Queued);
+
+    PushEvent(AXEvent_User, &Callback_TestBatchDone, 0, false);
+    Deadline = TestSeconds() + 5;
+    while(!__atomic_load_n(&BatchDone, __ATOMIC_ACQUIRE) && TestSeconds() < Deadline)
+        std::this_thread::yield();
+    TestCheck(BatchDone);
+    TestCheck(Dispatched.empty());
+
+    ax_event_stats After;
+    AXLibGetEventStats(&After);
+    TestCheck(After.Dropped == Full.Dropped);
+}
+
+/* NOTE(koekeishiya): Replaces the fake, so that a space transition can be held in progress. Every
+ *                    check is counted: the worker must sleep through the transition rather than
+ *                    poll, and the space change that ends it must wake the worker right away. The
+ *                    space change is posted just after the worker woke up on its fallback timeout,
+ *                    so that only the signal can wake it before the next one. */
+static bool Transition;
+static uint64_t TransitionChecks;
+
+bool AXLibIsSpaceTransitionInProgress()
+{
+    __atomic_add_fetch(&TransitionChecks, 1, __ATOMIC_RELAXED);
+    return __atomic_load_n(&Transition, __ATOMIC_ACQUIRE);
+}
+
+static void
+TestSpaceChangeEndsTheTransition()
+{
+    Dispatched.clear();
+    BatchDone = false;
+    __atomic_store_n(&Transition, true, __ATOMIC_RELEASE);
+    uint64_t Checks = __atomic_load_n(&TransitionChecks, __ATOMIC_RELAXED);
+
+    PushEvent(AXEvent_User, &Callback_TestBatchDone, 0, false);
+    double Deadline = TestSeconds() + 5;
+    while(__atomic_load_n(&TransitionChecks, __ATOMIC_RELAXED) < Checks + 2 && TestSeconds() < Deadline)
+        std::this_thread::yield();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    TestCheck(!__atomic_load_n(&BatchDone, __ATOMIC_ACQUIRE));
+    TestCheck(__atomic_load_n(&TransitionChecks, __ATOMIC_RELAXED) - Checks == 2);
+
+    while(__atomic_load_n(&TransitionChecks, __ATOMIC_RELAXED) < Checks + 3 && TestSeconds() < Deadline)
+        std::this_thread::yield();
+
+    __atomic_store_n(&Transition, false, __ATOMIC_RELEASE);
+    double Start = TestSeconds();
+    PushEvent(AXEvent_SpaceChanged, &Callback_TestRecord, 0, false);
+    Deadline = Start + 5;
+    while(!__atomic_load_n(&BatchDone, __ATOMIC_ACQUIRE) && TestSeconds() < Deadline)
+        std::this_thread::yield();
+
+    TestCheck(BatchDone);
+    TestCheck(TestSeconds() - Start < 0.1);
+    TestCheck(__atomic_load_n(&TransitionChecks, __ATOMIC_RELAXED) - Checks == 5);
+}
+
+/* NOTE(koekeishiya): The queue the ring replaced: a mutex-protected std::queue, and a condition
+ *                    variable that is signalled for every event. Handlers run under a state lock,
+ *                    like they do in the event loop. */
+struct locked_queue
+{
+    std::mutex StateLock;
+    std::mutex Lock;
+    std::condition_variable Work;
+    std::queue<ax_event> Events;
+    bool Running;
+};
+
+static void
+BenchmarkThroughput()
+{
+    const uint32_t Producers = 4;
+    const uint32_t Events = 250000;
+    StallEvery = 0;
+
+    TestBenchmark("4 producers x 250k events, event ring", 4,
+    {
+        ResetReceived();
+        std::vector<std::thread> Threads;
+        for(uint32_t Producer = 0; Producer < Producers; ++Producer)
+        {
+            Threads.push_back(std::thread([Producer, Events]()
+            {
+                for(uint32_t Sequence = 0; Sequence < Events; ++Sequence)
+                    PushTestEvent(Producer, Sequence);
+            }));
+        }
+
+        for(std::size_t Index = 0; Index < Threads.size(); ++Index)
+            Threads[Index].join();
+
+        for(uint32_t Producer = 0; Producer < Producers; ++Producer)
+            WaitForReceived(Producer, Events, 30);
+    });
+
+    TestBenchmark("4 producers x 250k events, locked queue", 4,
+    {
+        ResetReceived();
+        locked_queue Queue;
+        Queue.Running = true;
+
+        std::thread Worker([&Queue]()
+        {
+            std::unique_lock<std::mutex> Guard(Queue.Lock);
+            while(Queue.Running || !Queue.Events.empty())
+            {
+                if(Queue.Events.empty())
+                {
+                    Queue.Work.wait(Guard);
+                    continue;
+                }
+
+                ax_event Event = Queue.Events.front();
+                Queue.Events.pop();
+                Guard.unlock();
+                {
+                    std::lock_guard<std::mutex> State(Queue.StateLock);
+                    (*Event.Handle)(&Event);
+                }
+                Guard.lock();
+            }
+        });
+
+        std::vector<std::thread> Threads;
+        for(uint32_t Producer = 0; Producer < Producers; ++Producer)
+        {
+            Threads.push_back(std::thread([Producer, Events, &Queue]()
+            {
+                for(uint32_t Sequence = 0; Sequence < Events; ++Sequence)
+                {
+                    ax_event Event = {};
+                    Event.Type = AXEvent_User;
+                    Event.Payload = AXPayload_WindowID;
+                    Event.WindowID = (Producer << PRODUCER_SHIFT) | Sequence;
+                    Event.Handle = &Callback_TestEvent;
+
+                    std::lock_guard<std::mutex> Guard(Queue.Lock);
+                    Queue.Events.push(Event);
+                    Queue.Work.notify_one();
+                }
+            }));
+        }
+
+        for(std::size_t Index = 0; Index < Threads.size(); ++Index)
+            Threads[Index].join();
+
+        {
+            std::lock_guard<std::mutex> Guard(Queue.Lock);
+            Queue.Running = false;
+            Queue.Work.notify_one();
+        }
+
+        Worker.join();
+    });
+}
+
+int main(int Count, char **Args)
+{
+    TestCheck(AXLibStartEventLoop());
+
+    TestProducersKeepTheirOrder();
+    TestProducersWakeTheWorker();
+    TestBatchIsCoalesced();
+    TestFullOverflowDropsEvents();
+    TestSpaceChangeEndsTheTransition();
+
+    if(TestWantsBenchmarks(Count, Args))
+        BenchmarkThroughput();
+
+    AXLibStopEventLoop();
+    return TestReport("event_ring_test");
+}
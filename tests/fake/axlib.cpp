@@ -0,0 +1,456 @@
+#include "fake.h"
+#include "test.h"
+
+#include <mutex>
+#include <set>
+#include <thread>
+
+/* NOTE(koekeishiya): Windows are identified by their WindowID, which doubles as their AXUIElementRef
+ *                    so that the fake can find the geometry that belongs to a reference. The element
+ *                    functions are also called from the placement workers, so the state they touch
+ *                    is guarded by FakeLock. */
+#define FAKE_PID 1
+
+struct fake_window
+{
+    pid_t PID;
+    CGRect Rect;
+    CGSize MinimumSize;
+};
+
+struct fake_application
+{
+    int LatencyMicroseconds;
+    bool Refuses;
+};
+
+fake_ax_calls FakeAXCalls = {};
+TEST_FAKE ax_state AXState = {};
+
+static std::mutex FakeLock;
+static ax_display *FakeAXDisplay = NULL;
+static std::map<uint32_t, fake_window> FakeWindows;
+static std::map<pid_t, fake_application> FakeApplications;
+static std::vector<ax_event> FakeEvents;
+static std::set<std::string> FakeStrings;
+
+static inline AXUIElementRef
+FakeRefFromWindowID(uint32_t WindowID)
+{
+    return (AXUIElementRef)(uintptr_t)WindowID;
+}
+
+static inline uint32_t
+FakeWindowIDFromRef(AXUIElementRef Ref)
+{
+    return (uint32_t)(uintptr_t)Ref;
+}
+
+ax_display *FakeDisplay()
+{
+    return FakeAXDisplay;
+}
+
+ax_application *FakeApplication()
+{
+    return &AXState.Applications[FAKE_PID];
+}
+
+ax_window *FakeAddWindow(uint32_t WindowID)
+{
+    return FakeAddApplicationWindow(FAKE_PID, WindowID);
+}
+
+ax_window *FakeAddApplicationWindow(pid_t PID, uint32_t WindowID)
+{
+    ax_application *Application = &AXState.Applications[PID];
+    Application->PID = PID;
+
+    ax_window *Window = new ax_window();
+    Window->Application = Application;
+    Window->Ref = FakeRefFromWindowID(WindowID);
+    Window->ID = WindowID;
+    Window->Flags = AXWindow_Movable | AXWindow_Resizable;
+    Application->Windows[WindowID] = Window;
+
+    std::lock_guard<std::mutex> Guard(FakeLock);
+    fake_window *FakeWindow = &FakeWindows[WindowID];
+    FakeWindow->PID = PID;
+    FakeWindow->Rect = { { 0, 0 }, { 100, 100 } };
+    FakeWindow->MinimumSize = { 0, 0 };
+    return Window;
+}
+
+void FakeRemoveWindow(uint32_t WindowID)
+{
+    std::map<pid_t, ax_application>::iterator It;
+    for(It = AXState.Applications.begin(); It != AXState.Applications.end(); ++It)
+    {
+        ax_application *Application = &It->second;
+        std::map<uint32_t, ax_window *>::iterator WindowIt = Application->Windows.find(WindowID);
+        if(WindowIt != Application->Windows.end())
+        {
+            if(Application->Focus == WindowIt->second)
+                Application->Focus = NULL;
+
+            delete WindowIt->second;
+            Application->Windows.erase(WindowIt);
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> Guard(FakeLock);
+    FakeWindows.erase(WindowID);
+}
+
+void FakeSetMinimumSize(uint32_t WindowID, int Width, int Height)
+{
+    std::lock_guard<std::mutex> Guard(FakeLock);
+    FakeWindows[WindowID].MinimumSize = { (double) Width, (double) Height };
+}
+
+void FakeMoveWindow(uint32_t WindowID, int X, int Y)
+{
+    std::lock_guard<std::mutex> Guard(FakeLock);
+    CGRect *Rect = &FakeWindows[WindowID].Rect;
+    Rect->origin.x = X;
+    Rect->origin.y = Y;
+}
+
+CGRect FakeWindowRect(uint32_t WindowID)
+{
+    std::lock_guard<std::mutex> Guard(FakeLock);
+    return FakeWindows[WindowID].Rect;
+}
+
+void FakeSetApplicationLatency(pid_t PID, int Microseconds)
+{
+    std::lock_guard<std::mutex> Guard(FakeLock);
+    FakeApplications[PID].LatencyMicroseconds = Microseconds;
+}
+
+void FakeSetApplicationRefuses(pid_t PID, bool Refuses)
+{
+    std::lock_guard<std::mutex> Guard(FakeLock);
+    FakeApplications[PID].Refuses = Refuses;
+}
+
+/* NOTE(koekeishiya): Strings are interned and never freed, so that two strings are equal exactly
+ *                    when they are the same reference. */
+CFStringRef FakeString(const char *String)
+{
+    std::lock_guard<std::mutex> Guard(FakeLock);
+    return (CFStringRef) &*FakeStrings.insert(String).first;
+}
+
+int FakeDispatchEvents()
+{
+    std::vector<ax_event> Events;
+    {
+        std::lock_guard<std::mutex> Guard(FakeLock);
+        Events.swap(FakeEvents);
+    }
+
+    for(std::size_t Index = 0; Index < Events.size(); ++Index)
+        (*Events[Index].Handle)(&Events[Index]);
+
+    return Events.size();
+}
+
+void FakeResetAXLib()
+{
+    std::map<pid_t, ax_application>::iterator It;
+    for(It = AXState.Applications.begin(); It != AXState.Applications.end(); ++It)
+    {
+        std::map<uint32_t, ax_window *>::iterator WindowIt;
+        for(WindowIt = It->second.Windows.begin(); WindowIt != It->second.Windows.end(); ++WindowIt)
+            delete WindowIt->second;
+    }
+
+    AXState.Applications.clear();
+    {
+        std::lock_guard<std::mutex> Guard(FakeLock);
+        FakeWindows.clear();
+        FakeApplications.clear();
+        FakeEvents.clear();
+        FakeAXCalls = {};
+    }
+
+    ax_application *Application = FakeApplication();
+    Application->PID = FAKE_PID;
+    Application->Name = "fake";
+
+    AXState.Displays.clear();
+    FakeAXDisplay = &AXState.Displays[1];
+    FakeAXDisplay->ArrangementID = 1;
+    FakeAXDisplay->ID = 1;
+    FakeAXDisplay->Frame = { { 0, 0 }, { 1440, 900 } };
+
+    ax_space *Space = &FakeAXDisplay->Spaces[1];
+    Space->Identifier = "fake";
+    Space->Handle = -1;
+    Space->ID = 1;
+    Space->Type = kCGSSpaceUser;
+    FakeAXDisplay->Space = Space;
+    FakeAXDisplay->PrevSpace = Space;
+}
+
+/* NOTE(koekeishiya): Blocks for the latency of the application that owns the window, the way a
+ *                    synchronous AX round trip does, and returns whether the application accepts it. */
+static bool
+FakeRoundTrip(uint32_t WindowID)
+{
+    fake_application Application = {};
+    {
+        std::lock_guard<std::mutex> Guard(FakeLock);
+        std::map<uint32_t, fake_window>::iterator It = FakeWindows.find(WindowID);
+        if(It != FakeWindows.end())
+            Application = FakeApplications[It->second.PID];
+    }
+
+    if(Application.LatencyMicroseconds)
+        std::this_thread::sleep_for(std::chrono::microseconds(Application.LatencyMicroseconds));
+
+    return !Application.Refuses;
+}
+
+TEST_FAKE void AXLibAddEvent(ax_event Event)
+{
+    std::lock_guard<std::mutex> Guard(FakeLock);
+    FakeEvents.push_back(Event);
+}
+
+TEST_FAKE ax_display *AXLibMainDisplay() { return FakeAXDisplay; }
+TEST_FAKE ax_display *AXLibCursorDisplay() { return FakeAXDisplay; }
+TEST_FAKE ax_display *AXLibWindowDisplay(ax_window *Window) { return FakeAXDisplay; }
+TEST_FAKE ax_space *AXLibGetActiveSpace(ax_display *Display) { return Display->Space; }
+TEST_FAKE unsigned int AXLibDisplaySpacesCount(ax_display *Display) { return 1; }
+TEST_FAKE unsigned int AXLibDesktopIDFromCGSSpaceID(ax_display *Display, CGSSpaceID SpaceID) { return 1; }
+TEST_FAKE CGSSpaceID AXLibCGSSpaceIDFromDesktopID(ax_display *Display, unsigned int DesktopID) { return 1; }
+TEST_FAKE bool AXLibIsSpaceTransitionInProgress() { return false; }
+TEST_FAKE void AXLibSpaceTransition(ax_display *Display, CGSSpaceID SpaceID) { }
+TEST_FAKE void AXLibSpaceAddWindow(CGSSpaceID SpaceID, uint32_t WindowID) { }
+TEST_FAKE void AXLibSpaceRemoveWindow(CGSSpaceID SpaceID, uint32_t WindowID) { }
+TEST_FAKE bool AXLibSpaceHasWindow(ax_window *Window, CGSSpaceID SpaceID) { return true; }
+TEST_FAKE bool AXLibStickyWindow(ax_window *Window) { return false; }
+TEST_FAKE void AXLibInvalidateOnScreenWindows() { }
+TEST_FAKE void AXLibInvalidateWindowStack() { }
+TEST_FAKE void AXLibGetOnScreenStats(ax_onscreen_stats *Stats) { *Stats = ax_onscreen_stats(); }
+TEST_FAKE void AXLibGetEventStats(ax_event_stats *Stats) { *Stats = ax_event_stats(); }
+TEST_FAKE const char *AXLibEventTypeName(ax_event_type Type) { return "AXEvent"; }
+TEST_FAKE uint64_t AXLibEventGeneration() { return 0; }
+TEST_FAKE ax_display *AXLibNextDisplay(ax_display *Display) { return Display; }
+TEST_FAKE ax_display *AXLibPreviousDisplay(ax_display *Display) { return Display; }
+
+TEST_FAKE ax_application *AXLibGetApplicationByPID(pid_t PID)
+{
+    std::map<pid_t, ax_application>::iterator It = AXState.Applications.find(PID);
+    return It != AXState.Applications.end() ? &It->second : NULL;
+}
+
+TEST_FAKE ax_application *AXLibGetFocusedApplication() { return FakeApplication(); }
+TEST_FAKE ax_window *AXLibGetFocusedWindow(ax_application *Application) { return Application->Focus; }
+TEST_FAKE void AXLibSetFocusedWindow(ax_window *Window) { Window->Application->Focus = Window; }
+TEST_FAKE void AXLibRunningApplications() { }
+TEST_FAKE void AXLibDestroyApplication(ax_application *Application) { }
+TEST_FAKE void AXLibDestroyWindow(ax_window *Window) { }
+TEST_FAKE bool AXLibIsWindowStandard(ax_window *Window) { return true; }
+TEST_FAKE bool AXLibIsWindowCustom(ax_window *Window) { return false; }
+TEST_FAKE char *AXLibGetWindowTitle(AXUIElementRef WindowRef) { return NULL; }
+
+TEST_FAKE ax_window *AXLibFindApplicationWindow(ax_application *Application, uint32_t WID)
+{
+    std::map<uint32_t, ax_window *>::iterator It = Application->Windows.find(WID);
+    return It != Application->Windows.end() ? It->second : NULL;
+}
+
+TEST_FAKE void AXLibRemoveApplicationWindow(ax_application *Application, uint32_t WID)
+{
+    Application->Windows.erase(WID);
+}
+
+TEST_FAKE std::vector<ax_window *> AXLibGetAllKnownWindows()
+{
+    std::vector<ax_window *> Windows;
+    std::map<pid_t, ax_application>::iterator It;
+    for(It = AXState.Applications.begin(); It != AXState.Applications.end(); ++It)
+    {
+        std::map<uint32_t, ax_window *>::iterator WindowIt;
+        for(WindowIt = It->second.Windows.begin(); WindowIt != It->second.Windows.end(); ++WindowIt)
+            Windows.push_back(WindowIt->second);
+    }
+
+    return Windows;
+}
+
+TEST_FAKE std::vector<ax_window *> AXLibGetAllVisibleWindows()
+{
+    return AXLibGetAllKnownWindows();
+}
+
+TEST_FAKE bool AXLibSetWindowPosition(AXUIElementRef WindowRef, int X, int Y)
+{
+    uint32_t WindowID = FakeWindowIDFromRef(WindowRef);
+    bool Accepted = FakeRoundTrip(WindowID);
+
+    std::lock_guard<std::mutex> Guard(FakeLock);
+    ++FakeAXCalls.SetPosition;
+    if(Accepted)
+    {
+        CGRect *Rect = &FakeWindows[WindowID].Rect;
+        Rect->origin.x = X;
+        Rect->origin.y = Y;
+    }
+
+    return Accepted;
+}
+
+TEST_FAKE bool AXLibSetWindowSize(AXUIElementRef WindowRef, int Width, int Height)
+{
+    uint32_t WindowID = FakeWindowIDFromRef(WindowRef);
+    bool Accepted = FakeRoundTrip(WindowID);
+
+    std::lock_guard<std::mutex> Guard(FakeLock);
+    ++FakeAXCalls.SetSize;
+    if(Accepted)
+    {
+        fake_window *Window = &FakeWindows[WindowID];
+        Window->Rect.size.width = std::max((double) Width, Window->MinimumSize.width);
+        Window->Rect.size.height = std::max((double) Height, Window->MinimumSize.height);
+    }
+
+    return Accepted;
+}
+
+TEST_FAKE CGPoint AXLibGetWindowPosition(AXUIElementRef WindowRef)
+{
+    std::lock_guard<std::mutex> Guard(FakeLock);
+    ++FakeAXCalls.GetPosition;
+    return FakeWindows[FakeWindowIDFromRef(WindowRef)].Rect.origin;
+}
+
+TEST_FAKE CGSize AXLibGetWindowSize(AXUIElementRef WindowRef)
+{
+    std::lock_guard<std::mutex> Guard(FakeLock);
+    ++FakeAXCalls.GetSize;
+    return FakeWindows[FakeWindowIDFromRef(WindowRef)].Rect.size;
+}
+
+TEST_FAKE bool AXLibWindowHasRole(ax_window *Window, CFTypeRef Role)
+{
+    return CFEqual(Window->Type.Role, Role) || CFEqual(Window->Type.Subrole, Role);
+}
+
+TEST_FAKE bool AXLibWindowHasCustomRole(ax_window *Window, CFTypeRef Role)
+{
+    return Window->Type.CustomRole && CFEqual(Role, Window->Type.CustomRole);
+}
+
+TEST_FAKE ax_display *AXLibArrangementDisplay(unsigned int ArrangementID)
+{
+    return ArrangementID == FakeAXDisplay->ArrangementID ? FakeAXDisplay : NULL;
+}
+
+TEST_FAKE CFStringRef CFStringCreateWithCString(CFAllocatorRef Allocator, const char *String, CFStringEncoding Encoding)
+{
+    return FakeString(String);
+}
+
+TEST_FAKE const char *CFStringGetCStringPtr(CFStringRef String, CFStringEncoding Encoding)
+{
+    return ((const std::string *) String)->c_str();
+}
+
+TEST_FAKE bool CFStringGetCString(CFStringRef String, char *Buffer, CFIndex Size, CFStringEncoding Encoding)
+{
+    const std::string *Value = (const std::string *) String;
+    if(Value->size() >= (std::size_t) Size)
+        return false;
+
+    memcpy(Buffer, Value->c_str(), Value->size() + 1);
+    return true;
+}
+
+TEST_FAKE CFStringRef __CFStringMakeConstantString(const char *String)
+{
+    return FakeString(String);
+}
+
+TEST_FAKE Boolean CFEqual(CFTypeRef A, CFTypeRef B) { return A && A == B; }
+TEST_FAKE CFTypeRef CFRetain(CFTypeRef Ref) { return Ref; }
+TEST_FAKE void CFRelease(CFTypeRef Ref) { }
+TEST_FAKE CGPoint CGPointMake(double X, double Y) { CGPoint Point = { X, Y }; return Point; }
+TEST_FAKE CGSize CGSizeMake(double Width, double Height) { CGSize Size = { Width, Height }; return Size; }
+TEST_FAKE CGError CGWarpMouseCursorPosition(CGPoint Point) { return kCGErrorSuccess; }
+TEST_FAKE CGEventFlags CGEventGetFlags(CGEventRef Event) { return 0; }
+TEST_FAKE int64_t CGEventGetIntegerValueField(CGEventRef Event, int Field) { return 0; }
+
+/* NOTE(koekeishiya): The keyboard layout and synthesized key presses. Tests bind keycodes directly,
+ *                    so no layout is ever translated and no key press is posted. */
+TEST_FAKE CFAllocatorRef kCFAllocatorDefault = NULL;
+TEST_FAKE CFStringRef kTISPropertyUnicodeKeyLayoutData = NULL;
+TEST_FAKE extern const CFDictionaryKeyCallBacks kCFCopyStringDictionaryKeyCallBacks = {};
+TEST_FAKE TISInputSourceRef TISCopyCurrentASCIICapableKeyboardLayoutInputSource() { return NULL; }
+TEST_FAKE void *TISGetInputSourceProperty(TISInputSourceRef Source, CFStringRef Property) { return NULL; }
+TEST_FAKE const uint8_t *CFDataGetBytePtr(CFDataRef Data) { return NULL; }
+TEST_FAKE uint8_t LMGetKbdType() { return 0; }
+TEST_FAKE OSStatus UCKeyTranslate(const UCKeyboardLayout *Layout, uint16_t Keycode, uint16_t Action, uint32_t Modifiers, uint32_t Type,
+                                  uint32_t Options, UInt32 *DeadKeyState, UniCharCount Size, UniCharCount *Length, UniChar *Characters) { return -1; }
+TEST_FAKE CFRange CFRangeMake(CFIndex Location, CFIndex Length) { CFRange Range = { Location, Length }; return Range; }
+TEST_FAKE CFStringRef CFStringCreateWithCharacters(CFAllocatorRef Allocator, const UniChar *Characters, CFIndex Length) { return NULL; }
+TEST_FAKE void CFStringGetCharacters(CFStringRef String, CFRange Range, UniChar *Characters) { }
+TEST_FAKE CFMutableDictionaryRef CFDictionaryCreateMutable(CFAllocatorRef Allocator, CFIndex Capacity, const CFDictionaryKeyCallBacks *Keys,
+                                                           const CFDictionaryValueCallBacks *Values) { return NULL; }
+TEST_FAKE void CFDictionaryAddValue(CFMutableDictionaryRef Dictionary, const void *Key, const void *Value) { }
+TEST_FAKE Boolean CFDictionaryGetValueIfPresent(CFDictionaryRef Dictionary, const void *Key, const void **Value) { return false; }
+TEST_FAKE CGEventRef CGEventCreateKeyboardEvent(void *Source, CGKeyCode Keycode, bool Down) { return NULL; }
+TEST_FAKE void CGEventKeyboardSetUnicodeString(CGEventRef Event, UniCharCount Length, const UniChar *Characters) { }
+TEST_FAKE void CGEventSetFlags(CGEventRef Event, CGEventFlags Flags) { }
+TEST_FAKE void CGEventPost(int Tap, CGEventRef Event) { }
+
+/* NOTE(koekeishiya): There is no main queue; work scheduled on it never runs. */
+TEST_FAKE dispatch_queue_t dispatch_get_main_queue() { return NULL; }
+TEST_FAKE dispatch_time_t dispatch_time(dispatch_time_t When, int64_t Delta) { return When + Delta; }
+TEST_FAKE void dispatch_after_f(dispatch_time_t When, dispatch_queue_t Queue, void *Context, dispatch_function_t Work) { }
+
+/* NOTE(koekeishiya): The rest of the platform that kwm/axlib/axlib.cpp calls into, for the tests that
+ *                    link it. AXLibInit finds no displays and no running applications, the window
+ *                    server reports no window on screen, and accessibility requests do nothing. */
+TEST_FAKE CFStringRef kAXFocusedApplicationAttribute = NULL;
+TEST_FAKE CFStringRef kAXFocusedWindowAttribute = NULL;
+TEST_FAKE CFStringRef kAXFocusedAttribute = NULL;
+TEST_FAKE CFStringRef kAXMainAttribute = NULL;
+TEST_FAKE CFStringRef kAXRaiseAction = NULL;
+TEST_FAKE CFBooleanRef kCFBooleanTrue = NULL;
+
+TEST_FAKE bool AXLibInitializeCarbonEventHandler(carbon_event_handler *Carbon, std::map<pid_t, ax_application> *AXApplications) { return true; }
+TEST_FAKE void SharedWorkspaceInitialize(std::map<pid_t, ax_application> *Apps) { }
+TEST_FAKE std::map<pid_t, std::string> SharedWorkspaceRunningApplications() { return std::map<pid_t, std::string>(); }
+TEST_FAKE void AXLibInitializeDisplays(std::map<CGDirectDisplayID, ax_display> *AXDisplays) { }
+TEST_FAKE ax_application AXLibConstructApplication(pid_t PID, std::string Name) { ax_application Application = {}; return Application; }
+TEST_FAKE bool AXLibInitializeApplication(pid_t PID) { return false; }
+TEST_FAKE void AXLibAddApplicationWindows(ax_application *Application) { }
+TEST_FAKE bool AXLibIsApplicationActive(ax_application *Application) { return false; }
+TEST_FAKE bool AXLibIsApplicationHidden(ax_application *Application) { return false; }
+TEST_FAKE uint32_t AXLibGetWindowID(AXUIElementRef WindowRef) { return FakeWindowIDFromRef(WindowRef); }
+TEST_FAKE CFTypeRef AXLibGetWindowProperty(AXUIElementRef WindowRef, CFStringRef Property) { return NULL; }
+TEST_FAKE AXError AXLibSetWindowProperty(AXUIElementRef WindowRef, CFStringRef Property, CFTypeRef Value) { return kAXErrorSuccess; }
+TEST_FAKE AXUIElementRef AXUIElementCreateSystemWide() { return NULL; }
+TEST_FAKE AXError AXUIElementSetMessagingTimeout(AXUIElementRef Element, float Timeout) { return kAXErrorSuccess; }
+TEST_FAKE AXError AXUIElementGetPid(AXUIElementRef Element, int *PID) { return kAXErrorSuccess; }
+TEST_FAKE AXError AXUIElementPerformAction(AXUIElementRef Element, CFStringRef Action) { return kAXErrorSuccess; }
+TEST_FAKE OSStatus SetFrontProcessWithOptions(const ProcessSerialNumber *PSN, uint32_t Options) { return noErr; }
+
+extern "C" TEST_FAKE int _CGSDefaultConnection(void) { return 0; }
+extern "C" TEST_FAKE CGError CGSGetOnScreenWindowCount(const int CID, int TID, int *Count) { *Count = 0; return kCGErrorSuccess; }
+extern "C" TEST_FAKE CGError CGSGetOnScreenWindowList(const int CID, int TID, int Count, int *List, int *OutCount) { *OutCount = 0; return kCGErrorSuccess; }
+TEST_FAKE CFArrayRef CGWindowListCopyWindowInfo(CGWindowListOption Option, CGWindowID WindowID) { return NULL; }
+TEST_FAKE CFIndex CFArrayGetCount(CFArrayRef Array) { return 0; }
+TEST_FAKE const void *CFArrayGetValueAtIndex(CFArrayRef Array, CFIndex Index) { return NULL; }
+TEST_FAKE const void *CFDictionaryGetValue(CFDictionaryRef Dictionary, const void *Key) { return NULL; }
+TEST_FAKE bool CFNumberGetValue(CFNumberRef Number, int Type, void *Value) { return false; }
+TEST_FAKE int CFStringCompare(CFStringRef A, CFStringRef B, int Options) { return A == B ? kCFCompareEqualTo : 1; }
+TEST_FAKE bool CGRectMakeWithDictionaryRepresentation(CFDictionaryRef Dictionary, CGRect *Rect) { return false; }
+TEST_FAKE CFAbsoluteTime CFAbsoluteTimeGetCurrent() { return TestSeconds(); }
+TEST_FAKE CGEventRef CGEventCreate(void *Source) { return NULL; }
+TEST_FAKE CGPoint CGEventGetLocation(CGEventRef Event) { return CGPointMake(0, 0); }
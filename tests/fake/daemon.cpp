@@ -0,0 +1,60 @@
+#include "fake.h"
+#include "test.h"
+#include "daemon.h"
+
+/* NOTE(koekeishiya): The reply handles of the daemon. Every handle collects what is written to it,
+ *                    with its prefix, and is finished by the first reply. */
+struct fake_reply
+{
+    std::string Prefix;
+    std::string Output;
+    bool Finished;
+};
+
+static std::map<int, fake_reply> FakeReplies;
+
+TEST_FAKE void KwmWriteToSocket(std::string Msg, int ClientSockFD)
+{
+    fake_reply *Reply = &FakeReplies[ClientSockFD];
+    if(Reply->Finished)
+        return;
+
+    Reply->Output = Reply->Prefix + Msg;
+    Reply->Finished = true;
+}
+
+TEST_FAKE void KwmFinishReply(int ClientSockFD)
+{
+    KwmWriteToSocket("", ClientSockFD);
+}
+
+TEST_FAKE void KwmSetReplyPrefix(int ClientSockFD, std::string Prefix)
+{
+    FakeReplies[ClientSockFD].Prefix = Prefix;
+}
+
+TEST_FAKE bool KwmReplyPending(int ClientSockFD)
+{
+    return !FakeReplies[ClientSockFD].Finished;
+}
+
+TEST_FAKE bool KwmSubscribe(int ClientSockFD, uint32_t Topics) { return false; }
+TEST_FAKE bool KwmIsSubscribed(kwm_topic Topic) { return false; }
+TEST_FAKE void KwmPublishEvent(kwm_topic Topic, std::string Record) { }
+
+void FakeResetReplies()
+{
+    FakeReplies.clear();
+}
+
+bool FakeReplyFinished(int ClientSockFD)
+{
+    FakeDispatchEvents();
+    return FakeReplies[ClientSockFD].Finished;
+}
+
+std::string FakeReply(int ClientSockFD)
+{
+    FakeDispatchEvents();
+    return FakeReplies[ClientSockFD].Output;
+}
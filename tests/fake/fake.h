@@ -0,0 +1,42 @@
+#ifndef KWM_TEST_FAKE_H
+#define KWM_TEST_FAKE_H
+
+#include "types.h"
+#include "axlib/axlib.h"
+
+/* NOTE(koekeishiya): A single display with a single user space, applications that own the windows
+ *                    added to them, and an accessibility layer that records what kwm asks of it.
+ *                    Windows take any geometry they are sent, unless they are given a minimum size
+ *                    or their application is slow or refuses requests. Events that kwm posts are
+ *                    held until FakeDispatchEvents runs their handlers. Replies that kwm writes to
+ *                    a client are collected per handle. */
+struct fake_ax_calls
+{
+    uint64_t SetPosition;
+    uint64_t SetSize;
+    uint64_t GetPosition;
+    uint64_t GetSize;
+};
+
+extern fake_ax_calls FakeAXCalls;
+
+void FakeReset();
+void FakeResetAXLib();
+ax_display *FakeDisplay();
+ax_application *FakeApplication();
+ax_window *FakeAddWindow(uint32_t WindowID);
+ax_window *FakeAddApplicationWindow(pid_t PID, uint32_t WindowID);
+void FakeRemoveWindow(uint32_t WindowID);
+void FakeSetMinimumSize(uint32_t WindowID, int Width, int Height);
+void FakeMoveWindow(uint32_t WindowID, int X, int Y);
+CGRect FakeWindowRect(uint32_t WindowID);
+void FakeSetApplicationLatency(pid_t PID, int Microseconds);
+void FakeSetApplicationRefuses(pid_t PID, bool Refuses);
+int FakeDispatchEvents();
+CFStringRef FakeString(const char *String);
+
+void FakeResetReplies();
+bool FakeReplyFinished(int ClientSockFD);
+std::string FakeReply(int ClientSockFD);
+
+#endif
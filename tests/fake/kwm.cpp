@@ -0,0 +1,69 @@
+#include "fake.h"
+#include "test.h"
+#include "space.h"
+#include "display.h"
+#include "daemon.h"
+#include "rules.h"
+#include "serializer.h"
+#include "cursor.h"
+#include "scratchpad.h"
+#include "border.h"
+#include "config.h"
+#include "kwm.h"
+#include "axlib/carbon.h"
+
+/* NOTE(koekeishiya): The globals that kwm.cpp owns, and the kwm functions that a test does not
+ *                    link the real translation unit for. */
+TEST_FAKE space_table WindowTree;
+TEST_FAKE ax_display *FocusedDisplay = NULL;
+TEST_FAKE ax_application *FocusedApplication = NULL;
+TEST_FAKE ax_window *MarkedWindow = NULL;
+
+TEST_FAKE kwm_mach KWMMach = {};
+TEST_FAKE kwm_path KWMPath = {};
+TEST_FAKE kwm_settings KWMSettings = {};
+TEST_FAKE kwm_hotkeys KWMHotkeys = {};
+TEST_FAKE kwm_border FocusedBorder = {};
+TEST_FAKE kwm_border MarkedBorder = {};
+TEST_FAKE scratchpad Scratchpad = {};
+TEST_FAKE layout_stats LayoutStats = {};
+
+/* NOTE(koekeishiya): Settings get the same defaults as in KwmInit. */
+void FakeReset()
+{
+    FakeResetAXLib();
+    FakeResetReplies();
+
+    KWMSettings = kwm_settings();
+    KWMSettings.SplitRatio = 0.5;
+    KWMSettings.SplitMode = SPLIT_OPTIMAL;
+    KWMSettings.DefaultOffset = { 40, 20, 20, 20, 10, 10 };
+    KWMSettings.OptimalRatio = 1.618;
+    KWMSettings.Space = SpaceModeBSP;
+    KWMSettings.Focus = FocusModeAutoraise;
+    KWMSettings.Cycle = CycleModeScreen;
+
+    WindowTree.Handles.clear();
+    WindowTree.Spaces.clear();
+    LayoutStats = {};
+    FocusedDisplay = NULL;
+    FocusedApplication = NULL;
+    MarkedWindow = NULL;
+}
+
+TEST_FAKE bool ApplyWindowRules(ax_window *Window) { return false; }
+TEST_FAKE space_settings *GetSpaceSettingsForDisplay(unsigned int ScreenID) { return NULL; }
+TEST_FAKE void LoadBSPTreeFromFile(ax_display *Display, space_info *SpaceInfo, std::string Name) { }
+TEST_FAKE void MoveWindowToDisplay(ax_window *Window, int Shift, bool Relative) { }
+TEST_FAKE void AddWindowToScratchpad(ax_window *Window) { }
+TEST_FAKE int GetScratchpadSlotOfWindow(ax_window *Window) { return -1; }
+TEST_FAKE void HideScratchpadWindow(int Index) { }
+TEST_FAKE void MoveCursorToCenterOfFocusedWindow() { }
+TEST_FAKE void MoveCursorToCenterOfWindow(ax_window *Window) { }
+TEST_FAKE void RemoveWindowFromScratchpad(ax_window *Window) { }
+TEST_FAKE void UpdateBorder(kwm_border *Border, ax_window *Window) { }
+TEST_FAKE void FocusWindowBelowCursor() { }
+TEST_FAKE void CarbonWhitelistProcess(std::string Name) { }
+TEST_FAKE void KwmReloadConfig() { }
+TEST_FAKE void KwmQuit() { }
+TEST_FAKE void UpdateSpaceOfDisplay(ax_display *Display, space_info *Space) { }
@@ -0,0 +1,125 @@
+#include "test.h"
+#include "fake/fake.h"
+#include "tree.h"
+#include "space.h"
+#include "window.h"
+
+extern layout_stats LayoutStats;
+
+/* NOTE(koekeishiya): Lays out the windows of the fake space and counts the AX set calls that reach
+ *                    the stubbed element layer for every further pass. */
+static uint64_t
+AXSetCalls()
+{
+    return FakeAXCalls.SetPosition + FakeAXCalls.SetSize;
+}
+
+static space_info *
+CreateSpaceWithWindows(uint32_t Count)
+{
+    FakeReset();
+    for(uint32_t WindowID = 1; WindowID <= Count; ++WindowID)
+        FakeAddWindow(WindowID);
+
+    ax_display *Display = FakeDisplay();
+    AddWindowToNodeTree(Display, 1);
+    return GetSpaceInfo(Display->Space);
+}
+
+static void
+MoveWindowExternally(uint32_t WindowID, int X, int Y)
+{
+    ax_window *Window = GetWindowByID(WindowID);
+    FakeMoveWindow(WindowID, X, Y);
+    Window->Position = AXLibGetWindowPosition(Window->Ref);
+
+    ax_event Event = {};
+    Event.Type = AXEvent_WindowMoved;
+    Event.WindowID = WindowID;
+    Event.Intrinsic = false;
+    Callback_AXEvent_WindowMoved(&Event);
+}
+
+static void
+TestUnchangedLayoutIsElided()
+{
+    space_info *Space = CreateSpaceWithWindows(8);
+    TestCheck(AXSetCalls() > 0);
+
+    uint64_t Calls = AXSetCalls();
+    uint64_t Elided = LayoutStats.AXCallsElided;
+    ApplyTreeNodeContainer(Space->RootNode);
+
+    TestCheck(AXSetCalls() == Calls);
+    TestCheck(LayoutStats.AXCallsElided == Elided + 2 * 8);
+}
+
+static void
+TestRefusedGeometryIsElided()
+{
+    FakeReset();
+    FakeAddWindow(1);
+    FakeAddWindow(2);
+    FakeSetMinimumSize(2, 1000, 100);
+
+    ax_display *Display = FakeDisplay();
+    AddWindowToNodeTree(Display, 1);
+    space_info *Space = GetSpaceInfo(Display->Space);
+
+    ax_window *Window = GetWindowByID(2);
+    TestCheck(Window->Size.width == 1000);
+
+    uint64_t Calls = AXSetCalls();
+    ApplyTreeNodeContainer(Space->RootNode);
+    ApplyTreeNodeContainer(Space->RootNode);
+    TestCheck(AXSetCalls() == Calls);
+}
+
+static void
+TestExternalMoveInvalidates()
+{
+    space_info *Space = CreateSpaceWithWindows(4);
+    ax_window *Window = GetWindowByID(3);
+    CGPoint Position = Window->Position;
+
+    MoveWindowExternally(3, 5, 5);
+    TestCheck(!Window->Geometry.Valid);
+
+    uint64_t Calls = AXSetCalls();
+    ApplyTreeNodeContainer(Space->RootNode);
+    TestCheck(AXSetCalls() > Calls);
+    TestCheck(Window->Position.x == Position.x && Window->Position.y == Position.y);
+    TestCheck(Window->Geometry.Valid);
+
+    Calls = AXSetCalls();
+    ApplyTreeNodeContainer(Space->RootNode);
+    TestCheck(AXSetCalls() == Calls);
+}
+
+static void
+BenchmarkRelayout()
+{
+    space_info *Space = CreateSpaceWithWindows(50);
+    uint64_t Calls = AXSetCalls();
+    uint64_t Elided = LayoutStats.AXCallsElided;
+
+    TestBenchmark("relayout of 50 unchanged windows", 1000,
+    {
+        ApplyTreeNodeContainer(Space->RootNode);
+    });
+
+    printf("  %-48s %12llu\n", "AX set calls issued", (unsigned long long) (AXSetCalls() - Calls));
+    printf("  %-48s %12llu\n", "AX set calls elided", (unsigned long long) (LayoutStats.AXCallsElided - Elided));
+}
+
+int main(int Count, char **Args)
+{
+    TestUnchangedLayoutIsElided();
+    TestRefusedGeometryIsElided();
+    TestExternalMoveInvalidates();
+
+    if(TestWantsBenchmarks(Count, Args))
+        BenchmarkRelayout();
+
+    return TestReport("geometry_cache_test");
+}
@@ -0,0 +1,40 @@
+#include "test.h"
+#include "geometry.h"
+
+/* NOTE(koekeishiya): geometry.cpp is linked on its own, without the rest of kwm or any of the fakes,
+ *                    and geometry.h does not need the types of kwm or Carbon, so every setting
+ *                    that a layout depends on has to be passed in. */
+
+static void
+TestSplitCoversTheRect()
+{
+    geometry_rect Rect = { 10, 20, 1001, 601 };
+    geometry_rect First, Second;
+
+    GeometrySplitRect(Rect, GeometrySplit_Vertical, 0.5, 15, &First, &Second);
+    TestCheck(First.X == 10 && First.Width == 494);
+    TestCheck(Second.X == 519 && Second.Width == 492);
+    TestCheck(First.Width + 15 + Second.Width == Rect.Width);
+    TestCheck(First.Height == Rect.Height && Second.Y == Rect.Y);
+
+    GeometrySplitRect(Rect, GeometrySplit_Horizontal, 1.0 / 3.0, 10.4, &First, &Second);
+    TestCheck(First.Y == 20 && First.Height == 195);
+    TestCheck(Second.Y == 225 && Second.Height == 396);
+    TestCheck(First.Height + 10 + Second.Height == Rect.Height);
+
+    geometry_padding Padding = { 40.4, 19.6, 20.5, 20 };
+    geometry_rect Frame = { 0, 0, 1440, 900 };
+    geometry_rect Padded = GeometryPadRect(Frame, Padding);
+    TestCheck(Padded.X == 21 && Padded.Y == 40);
+    TestCheck(Padded.X + Padded.Width == 1420 && Padded.Y + Padded.Height == 880);
+
+    TestCheck(GeometryOptimalSplit(Frame, 1.618) == GeometrySplit_Horizontal);
+    TestCheck(GeometryOptimalSplit(Rect, 1.618) == GeometrySplit_Vertical);
+}
+
+int main(int Count, char **Args)
+{
+    TestSplitCoversTheRect();
+
+    return TestReport("geometry_test");
+}
@@ -0,0 +1,151 @@
+#include "test.h"
+#include "fake/fake.h"
+#include "interpreter.h"
+#include "daemon.h"
+#include "snapshot.h"
+
+extern kwm_settings KWMSettings;
+
+/* NOTE(koekeishiya): A compiled command runs every time its binding is pressed, and must leave its
+ *                    tokens as they were compiled. */
+static void
+TestCompiledQueryKeepsItsTokens()
+{
+    FakeReset();
+    KwmMarkStateChanged();
+
+    kwm_command Command = {};
+    TestCheck(KwmCompileCommand("query --since 0 tiling mode", &Command));
+    std::vector<std::string> Tokens = Command.Tokens;
+
+    KwmExecuteCommand(&Command);
+    FakeDispatchEvents();
+    TestCheck(Command.Tokens == Tokens);
+
+    KwmExecuteCommand(&Command);
+    FakeDispatchEvents();
+    TestCheck(Command.Tokens == Tokens);
+}
+
+static void
+TestQuerySinceVersion()
+{
+    FakeReset();
+    KwmMarkStateChanged();
+    std::string Version = std::to_string(KwmStateVersion());
+
+    KwmInterpretCommand("query --since 0 tiling mode", 1);
+    TestCheck(FakeReply(1) == Version + "\nbsp");
+
+    KwmInterpretCommand("query --since " + Version + " tiling mode", 2);
+    TestCheck(FakeReply(2) == Version);
+
+    KwmInterpretCommand("query --since 0", 3);
+    TestCheck(FakeReply(3) == "usage: query --since <version> <category> [option]");
+
+    KwmInterpretCommand("query tiling mode", 4);
+    TestCheck(FakeReply(4) == "bsp");
+}
+
+/* NOTE(koekeishiya): Every command is found through the registry, and one with too few tokens gets
+ *                    its usage string rather than reading past the end of the tokens. */
+static void
+TestRegistryDispatch()
+{
+    FakeReset();
+
+    KwmInterpretCommand("window -f", 1);
+    TestCheck(FakeReply(1) == "usage: window <-f|-fm|-s|-z|-t|-r|-c|-m|-mk> <argument>");
+
+    KwmInterpretCommand("bindsym", 2);
+    TestCheck(FakeReply(2) == "usage: bindsym <keysym> [command]");
+
+    KwmInterpretCommand("no-such-command argument", 3);
+    TestCheck(FakeReplyFinished(3) && FakeReply(3).empty());
+
+    KwmInterpretCommand("", 4);
+    TestCheck(FakeReplyFinished(4) && FakeReply(4).empty());
+
+    KwmInterpretCommand("help scratchpad", 5);
+    TestCheck(FakeReply(5) == "scratchpad <show|toggle|hide|add|remove> [index]");
+
+    KwmInterpretCommand("help frobnicate", 6);
+    TestCheck(FakeReply(6) == "unknown command: frobnicate");
+
+    KwmInterpretCommand("help", 7);
+    std::string Help = FakeReply(7);
+    TestCheck(Help.find("quit\n") == 0);
+    TestCheck(Help.find("\nhelp [command]") == Help.size() - strlen("\nhelp [command]"));
+
+    KwmInterpretCommand("config tiling monocle", 8);
+    TestCheck(FakeReplyFinished(8));
+    TestCheck(KWMSettings.Space == SpaceModeMonocle);
+}
+
+/* NOTE(koekeishiya): Sub-commands read further than their command requires, and are checked
+ *                    against their own number of tokens, also after '--since' is taken off. */
+static void
+TestSubCommandDispatch()
+{
+    FakeReset();
+    KwmMarkStateChanged();
+
+    KwmInterpretCommand("query window", 1);
+    TestCheck(FakeReply(1) == "usage: query window <focused|marked|parent|child|list> [option]");
+
+    KwmInterpretCommand("query window focused", 2);
+    TestCheck(FakeReply(2) == "usage: query window focused <id|name|split|float|north|east|south|west>");
+
+    KwmInterpretCommand("query --since 0 window parent 1", 3);
+    TestCheck(FakeReply(3) == "usage: query window parent <window> <window>");
+
+    KwmInterpretCommand("config space 0 1 padding 10 10", 4);
+    TestCheck(FakeReply(4) == "usage: config space <display> <space> padding <top> <bottom> <left> <right>");
+    TestCheck(KWMSettings.SpaceSettings.empty());
+
+    KwmInterpretCommand("config cycle-focus", 5);
+    TestCheck(FakeReply(5) == "usage: config cycle-focus <on|off>");
+
+    KwmInterpretCommand("tree save", 6);
+    TestCheck(FakeReply(6) == "usage: tree save <file>");
+
+    KwmInterpretCommand("query tiling mode", 7);
+    TestCheck(FakeReply(7) == "bsp");
+
+    KwmInterpretCommand("config cycle-focus on", 8);
+    TestCheck(FakeReplyFinished(8) && FakeReply(8).empty());
+    TestCheck(KWMSettings.Cycle == CycleModeScreen);
+}
+
+/* NOTE(koekeishiya): 'config' is the second entry of the registry and 'help' the last, which an
+ *                    if-chain would have reached after two and after twenty-one comparisons. */
+static void
+BenchmarkDispatch()
+{
+    FakeReset();
+
+    TestBenchmark("interpret 'config', usage reply", 100000,
+    {
+        FakeResetReplies();
+        KwmInterpretCommand("config", 1);
+    });
+
+    TestBenchmark("interpret 'help config'", 100000,
+    {
+        FakeResetReplies();
+        KwmInterpretCommand("help config", 1);
+    });
+}
+
+int main(int Count, char **Args)
+{
+    TestCompiledQueryKeepsItsTokens();
+    TestQuerySinceVersion();
+    TestRegistryDispatch();
+    TestSubCommandDispatch();
+
+    if(TestWantsBenchmarks(Count, Args))
+        BenchmarkDispatch();
+
+    return TestReport("interpreter_test");
+}
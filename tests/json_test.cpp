@@ -0,0 +1,326 @@
+#include "test.h"
+#include "fake/fake.h"
+#include "json.h"
+#include "window.h"
+#include "keys.h"
+#include "interpreter.h"
+#include "snapshot.h"
+
+#include <stdint.h>
+
+extern ax_window *MarkedWindow;
+
+/* NOTE(koekeishiya): Checks that Text is a single well-formed JSON value, as RFC 8259 defines it. */
+struct json_reader
+{
+    const char *At;
+    const char *End;
+};
+
+static bool JsonReadValue(json_reader *Reader);
+
+static void
+JsonSkipSpace(json_reader *Reader)
+{
+    while(Reader->At < Reader->End && strchr(" \t\r\n", *Reader->At))
+        ++Reader->At;
+}
+
+static bool
+JsonReadLiteral(json_reader *Reader, const char *Literal)
+{
+    std::size_t Length = strlen(Literal);
+    if((std::size_t) (Reader->End - Reader->At) < Length || strncmp(Reader->At, Literal, Length) != 0)
+        return false;
+
+    Reader->At += Length;
+    return true;
+}
+
+static bool
+JsonReadString(json_reader *Reader)
+{
+    if(Reader->At == Reader->End || *Reader->At++ != '"')
+        return false;
+
+    while(Reader->At < Reader->End)
+    {
+        unsigned char Char = *Reader->At++;
+        if(Char == '"')
+            return true;
+        if(Char < 0x20)
+            return false;
+        if(Char != '\\')
+            continue;
+        if(Reader->At == Reader->End)
+            return false;
+
+        char Escape = *Reader->At++;
+        if(Escape == 'u')
+        {
+            for(int Index = 0; Index < 4; ++Index)
+            {
+                if(Reader->At == Reader->End || !isxdigit(*Reader->At++))
+                    return false;
+            }
+        }
+        else if(!strchr("\"\\/bfnrt", Escape))
+        {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+static bool
+JsonReadDigits(json_reader *Reader)
+{
+    const char *Start = Reader->At;
+    while(Reader->At < Reader->End && isdigit(*Reader->At))
+        ++Reader->At;
+
+    return Reader->At != Start;
+}
+
+static bool
+JsonReadNumber(json_reader *Reader)
+{
+    if(Reader->At < Reader->End && *Reader->At == '-')
+        ++Reader->At;
+
+    if(Reader->At < Reader->End && *Reader->At == '0')
+        ++Reader->At;
+    else if(!JsonReadDigits(Reader))
+        return false;
+
+    if(Reader->At < Reader->End && *Reader->At == '.')
+    {
+        ++Reader->At;
+        if(!JsonReadDigits(Reader))
+            return false;
+    }
+
+    if(Reader->At < Reader->End && (*Reader->At == 'e' || *Reader->At == 'E'))
+    {
+        ++Reader->At;
+        if(Reader->At < Reader->End && (*Reader->At == '+' || *Reader->At == '-'))
+            ++Reader->At;
+        if(!JsonReadDigits(Reader))
+            return false;
+    }
+
+    return true;
+}
+
+static bool
+JsonReadContainer(json_reader *Reader, char Close, bool Keys)
+{
+    ++Reader->At;
+    JsonSkipSpace(Reader);
+    if(Reader->At < Reader->End && *Reader->At == Close)
+    {
+        ++Reader->At;
+        return true;
+    }
+
+    while(true)
+    {
+        JsonSkipSpace(Reader);
+        if(Keys)
+        {
+            if(!JsonReadString(Reader))
+                return false;
+
+            JsonSkipSpace(Reader);
+            if(Reader->At == Reader->End || *Reader->At++ != ':')
+                return false;
+        }
+
+        if(!JsonReadValue(Reader))
+            return false;
+
+        JsonSkipSpace(Reader);
+        if(Reader->At == Reader->End)
+            return false;
+
+        char Char = *Reader->At++;
+        if(Char == Close)
+            return true;
+        if(Char != ',')
+            return false;
+    }
+}
+
+static bool
+JsonReadValue(json_reader *Reader)
+{
+    JsonSkipSpace(Reader);
+    if(Reader->At == Reader->End)
+        return false;
+
+    switch(*Reader->At)
+    {
+        case '{': { return JsonReadContainer(Reader, '}', true); } break;
+        case '[': { return JsonReadContainer(Reader, ']', false); } break;
+        case '"': { return JsonReadString(Reader); } break;
+        case 't': { return JsonReadLiteral(Reader, "true"); } break;
+        case 'f': { return JsonReadLiteral(Reader, "false"); } break;
+        case 'n': { return JsonReadLiteral(Reader, "null"); } break;
+        default: { return JsonReadNumber(Reader); } break;
+    }
+}
+
+static bool
+IsValidJson(const std::string &Text)
+{
+    json_reader Reader = { Text.c_str(), Text.c_str() + Text.size() };
+    if(!JsonReadValue(&Reader))
+        return false;
+
+    JsonSkipSpace(&Reader);
+    return Reader.At == Reader.End;
+}
+
+static std::size_t
+CountOccurrences(const std::string &Text, const std::string &Pattern)
+{
+    std::size_t Count = 0;
+    for(std::size_t At = Text.find(Pattern); At != std::string::npos; At = Text.find(Pattern, At + 1))
+        ++Count;
+
+    return Count;
+}
+
+static void
+TestWriterOutput()
+{
+    json_writer Writer = {};
+    JsonBeginObject(&Writer);
+    JsonKey(&Writer, "empty"); JsonBeginArray(&Writer); JsonEndArray(&Writer);
+    JsonKey(&Writer, "object"); JsonBeginObject(&Writer); JsonEndObject(&Writer);
+    JsonKey(&Writer, "integers");
+    JsonBeginArray(&Writer);
+    JsonInteger(&Writer, 0);
+    JsonInteger(&Writer, -42);
+    JsonInteger(&Writer, INT64_MAX);
+    JsonInteger(&Writer, INT64_MIN);
+    JsonEndArray(&Writer);
+    JsonKey(&Writer, "doubles");
+    JsonBeginArray(&Writer);
+    JsonDouble(&Writer, 1440);
+    JsonDouble(&Writer, -0.5);
+    JsonDouble(&Writer, 0.618);
+    JsonDouble(&Writer, 1e300);
+    JsonDouble(&Writer, 0.0 / 0.0);
+    JsonEndArray(&Writer);
+    JsonKey(&Writer, "flags");
+    JsonBeginArray(&Writer);
+    JsonBool(&Writer, true);
+    JsonBool(&Writer, false);
+    JsonNull(&Writer);
+    JsonString(&Writer, (const char *) NULL);
+    JsonEndArray(&Writer);
+    JsonKey(&Writer, "quote\"key"); JsonString(&Writer, std::string("tab\tnew\nline \"\\ \x01 done"));
+    JsonEndObject(&Writer);
+
+    std::string Expected = "{\"empty\":[],\"object\":{},"
+                           "\"integers\":[0,-42,9223372036854775807,-9223372036854775808],"
+                           "\"doubles\":[1440,-0.5,0.618,1e+300,null],"
+                           "\"flags\":[true,false,null,null],"
+                           "\"quote\\\"key\":\"tab\\tnew\\nline \\\"\\\\ \\u0001 done\"}";
+    TestCheck(Writer.Buffer == Expected);
+    TestCheck(IsValidJson(Writer.Buffer));
+}
+
+static void
+TestReaderRejectsMalformedJson()
+{
+    TestCheck(!IsValidJson("{\"a\":1,}"));
+    TestCheck(!IsValidJson("[1 2]"));
+    TestCheck(!IsValidJson("{\"a\" 1}"));
+    TestCheck(!IsValidJson("\"tab\there\""));
+    TestCheck(!IsValidJson("[01]"));
+    TestCheck(!IsValidJson("{} {}"));
+    TestCheck(IsValidJson(" [ 1.5e-3 , {\"a\" : [null]} ] "));
+}
+
+/* NOTE(koekeishiya): Windows of ten applications, all of them tiled on the fake display, with
+ *                    titles that have to be escaped. */
+static void
+CreateState(uint32_t Count)
+{
+    FakeReset();
+    KwmClearHotkeys();
+    for(uint32_t WindowID = 1; WindowID <= Count; ++WindowID)
+    {
+        ax_window *Window = FakeAddApplicationWindow(1 + (WindowID % 10), WindowID);
+        Window->Application->Name = "Application \"" + std::to_string(Window->Application->PID) + "\"";
+
+        std::string Title = "Document " + std::to_string(WindowID) + "\t\\ draft";
+        Window->Name = strdup(Title.c_str());
+        if(WindowID % 7 == 0)
+            AXLibAddFlags(Window, AXWindow_Floating);
+    }
+
+    AddWindowToNodeTree(FakeDisplay(), 1);
+    MarkedWindow = GetWindowByID(2);
+}
+
+static void
+TestQueryState()
+{
+    CreateState(50);
+    KwmInterpretCommand("query state", 1);
+    std::string State = FakeReply(1);
+
+    TestCheck(IsValidJson(State));
+    TestCheck(State.find("\"mode\":\"default\"") != std::string::npos);
+    TestCheck(State.find("\"marked_window\":2") != std::string::npos);
+    TestCheck(State.find("\"name\":\"Document 7\\t\\\\ draft\"") != std::string::npos);
+    TestCheck(State.find("\"application\":\"Application \\\"3\\\"\"") != std::string::npos);
+    TestCheck(CountOccurrences(State, "\"pid\":") == 50);
+    TestCheck(CountOccurrences(State, "\"floating\":true") == 7);
+    TestCheck(CountOccurrences(State, "\"type\":\"bsp\"") == 2 * 50 - 1);
+}
+
+/* NOTE(koekeishiya): 'query window list' is the plain text reply that a client used to start from,
+ *                    before asking for the geometry and flags of every window on its own. The state
+ *                    is marked as changed before every query, so that neither reply comes from the
+ *                    snapshot of the previous one. */
+static void
+BenchmarkQueryState()
+{
+    CreateState(500);
+
+    std::size_t Size = 0;
+    TestBenchmark("query state, 500 windows", 200,
+    {
+        FakeResetReplies();
+        KwmMarkStateChanged();
+        KwmInterpretCommand("query state", 1);
+        Size = FakeReply(1).size();
+    });
+
+    TestBenchmark("query window list, 500 windows", 200,
+    {
+        FakeResetReplies();
+        KwmMarkStateChanged();
+        KwmInterpretCommand("query window list", 1);
+        FakeReply(1);
+    });
+
+    printf("  %-48s %12zu\n", "bytes of state", Size);
+}
+
+int main(int Count, char **Args)
+{
+    TestWriterOutput();
+    TestReaderRejectsMalformedJson();
+    TestQueryState();
+
+    if(TestWantsBenchmarks(Count, Args))
+        BenchmarkQueryState();
+
+    return TestReport("json_test");
+}
@@ -0,0 +1,269 @@
+#include "test.h"
+#include "fake/fake.h"
+#include "keys.h"
+#include "interpreter.h"
+#include "axlib/event.h"
+
+#include <random>
+
+extern kwm_hotkeys KWMHotkeys;
+
+/* NOTE(koekeishiya): A key press is the flags and keycode that the event tap reads from it. */
+struct __CGEvent
+{
+    CGEventFlags Flags;
+    CGKeyCode Keycode;
+};
+
+CGEventFlags CGEventGetFlags(CGEventRef Event)
+{
+    return Event->Flags;
+}
+
+int64_t CGEventGetIntegerValueField(CGEventRef Event, int Field)
+{
+    return Event->Keycode;
+}
+
+bool KwmCompileCommand(std::string Text, kwm_command *Command) { return false; }
+void KwmExecuteCommand(kwm_command *Command) { }
+
+/* NOTE(koekeishiya): The state of one of cmd, shift and alt, in a binding or a key press. A key press
+ *                    has the generic flag set together with at most one of the side flags. A binding
+ *                    can name both sides, which no key press produces. */
+enum modifier_state
+{
+    Modifier_None,
+    Modifier_Generic,
+    Modifier_Left,
+    Modifier_Right,
+    Modifier_Both,
+};
+
+struct modifier
+{
+    const char *Generic;
+    const char *Left;
+    const char *Right;
+    uint32_t EventGeneric;
+    uint32_t EventLeft;
+    uint32_t EventRight;
+    uint32_t FlagGeneric;
+    uint32_t FlagLeft;
+    uint32_t FlagRight;
+};
+
+static const modifier Modifiers[] =
+{
+    { "cmd", "lcmd", "rcmd", Hotkey_Modifier_Cmd, Hotkey_Modifier_LCmd, Hotkey_Modifier_RCmd,
+      Hotkey_Modifier_Flag_Cmd, Hotkey_Modifier_Flag_LCmd, Hotkey_Modifier_Flag_RCmd },
+    { "shift", "lshift", "rshift", Hotkey_Modifier_Shift, Hotkey_Modifier_LShift, Hotkey_Modifier_RShift,
+      Hotkey_Modifier_Flag_Shift, Hotkey_Modifier_Flag_LShift, Hotkey_Modifier_Flag_RShift },
+    { "alt", "lalt", "ralt", Hotkey_Modifier_Alt, Hotkey_Modifier_LAlt, Hotkey_Modifier_RAlt,
+      Hotkey_Modifier_Flag_Alt, Hotkey_Modifier_Flag_LAlt, Hotkey_Modifier_Flag_RAlt },
+};
+
+static std::string
+ModeName(int Mode)
+{
+    return Mode == 0 ? std::string("default") : "mode" + std::to_string(Mode);
+}
+
+static std::string
+CreateKeySym(int Mode, int *States, bool Control, CGKeyCode Keycode)
+{
+    std::string KeySym = Mode == 0 ? std::string() : ModeName(Mode);
+    for(int Index = 0; Index < 3; ++Index)
+    {
+        switch(States[Index])
+        {
+            case Modifier_Generic: { KeySym += std::string("+") + Modifiers[Index].Generic; } break;
+            case Modifier_Left: { KeySym += std::string("+") + Modifiers[Index].Left; } break;
+            case Modifier_Right: { KeySym += std::string("+") + Modifiers[Index].Right; } break;
+            case Modifier_Both: { KeySym += std::string("+") + Modifiers[Index].Left + "+" + Modifiers[Index].Right; } break;
+        }
+    }
+
+    if(Control)
+        KeySym += "+ctrl";
+
+    char Key[16];
+    snprintf(Key, sizeof(Key), "-0x%x", Keycode);
+    return KeySym + Key;
+}
+
+/* NOTE(koekeishiya): Builds the key press with the given modifiers, and the flags that the event tap
+ *                    derives from it. */
+static __CGEvent
+CreateKeyPress(int *States, bool Control, CGKeyCode Keycode, uint32_t *Flags)
+{
+    __CGEvent Event = { 0, Keycode };
+    *Flags = 0;
+    for(int Index = 0; Index < 3; ++Index)
+    {
+        const modifier *Modifier = &Modifiers[Index];
+        switch(States[Index])
+        {
+            case Modifier_Generic: { Event.Flags |= Modifier->EventGeneric; *Flags |= Modifier->FlagGeneric; } break;
+            case Modifier_Left: { Event.Flags |= Modifier->EventGeneric | Modifier->EventLeft; *Flags |= Modifier->FlagLeft; } break;
+            case Modifier_Right: { Event.Flags |= Modifier->EventGeneric | Modifier->EventRight; *Flags |= Modifier->FlagRight; } break;
+        }
+    }
+
+    if(Control)
+    {
+        Event.Flags |= Hotkey_Modifier_Control;
+        *Flags |= Hotkey_Modifier_Flag_Control;
+    }
+
+    return Event;
+}
+
+static void
+BindRandomHotkeys(std::mt19937 *Random, int Modes, int Bindings, CGKeyCode Keycodes)
+{
+    KwmClearHotkeys();
+    for(int Binding = 0; Binding < Bindings; ++Binding)
+    {
+        int States[3];
+        for(int Index = 0; Index < 3; ++Index)
+            States[Index] = ((*Random)() % 8) == 0 ? Modifier_Both : (*Random)() % 4;
+
+        std::string KeySym = CreateKeySym(Binding % Modes, States, (*Random)() % 2, (*Random)() % Keycodes);
+        KwmAddHotkey(KeySym, "binding " + std::to_string(Binding), false, true);
+    }
+}
+
+/* NOTE(koekeishiya): Every key press that can be made with the keycodes in use, in every mode, must
+ *                    resolve to the binding that the linear scan with HotkeysAreEqual finds first. */
+static void
+TestLookupMatchesLinearScan()
+{
+    const int Modes = 4;
+    const CGKeyCode Keycodes = 8;
+
+    uint32_t Mismatches = 0;
+    uint32_t Matches = 0;
+    for(uint32_t Seed = 1; Seed <= 20; ++Seed)
+    {
+        std::mt19937 Random(Seed);
+        BindRandomHotkeys(&Random, Modes, 120, Keycodes);
+
+        for(int Mode = 0; Mode < Modes; ++Mode)
+        {
+            std::string Name = ModeName(Mode);
+            KWMHotkeys.ActiveMode = GetBindingMode(Name);
+            for(CGKeyCode Keycode = 0; Keycode < Keycodes; ++Keycode)
+            {
+                for(int Combination = 0; Combination < 128; ++Combination)
+                {
+                    int States[3] = { Combination & 3, (Combination >> 2) & 3, (Combination >> 4) & 3 };
+                    bool Control = Combination & 64;
+
+                    uint32_t Flags;
+                    __CGEvent Event = CreateKeyPress(States, Control, Keycode, &Flags);
+
+                    ax_event_key Key = {};
+                    bool Passthrough = false;
+                    bool Found = HotkeyForCGEvent(&Event, &Key, &Passthrough);
+
+                    hotkey Expected = {};
+                    bool Exists = HotkeyExists(Flags, Keycode, &Expected, Name);
+
+                    if(Found != Exists)
+                        ++Mismatches;
+                    else if(Found && (Key.Mode != KWMHotkeys.ActiveMode ||
+                                      KWMHotkeys.ActiveMode->Hotkeys[Key.Binding].Command != Expected.Command))
+                        ++Mismatches;
+
+                    Matches += Found;
+                }
+            }
+        }
+    }
+
+    TestCheck(Matches > 0);
+    TestCheck(Mismatches == 0);
+}
+
+static void
+TestRemovedHotkeyIsNotFound()
+{
+    KwmClearHotkeys();
+    KwmAddHotkey("cmd+shift-0x12", "first", false, true);
+    KwmAddHotkey("lcmd-0x12", "second", false, true);
+    KwmAddHotkey("cmd-0x13", "third", false, true);
+
+    int LeftCmd[3] = { Modifier_Left, Modifier_None, Modifier_None };
+    uint32_t Flags;
+    __CGEvent Event = CreateKeyPress(LeftCmd, false, 0x12, &Flags);
+
+    ax_event_key Key = {};
+    bool Passthrough;
+    TestCheck(HotkeyForCGEvent(&Event, &Key, &Passthrough));
+    TestCheck(KWMHotkeys.ActiveMode->Hotkeys[Key.Binding].Command == "second");
+
+    uint32_t Generation = KWMHotkeys.Generation;
+    KwmRemoveHotkey("lcmd-0x12", true);
+    TestCheck(KWMHotkeys.Generation != Generation);
+    TestCheck(!HotkeyForCGEvent(&Event, &Key, &Passthrough));
+
+    Event.Keycode = 0x13;
+    TestCheck(HotkeyForCGEvent(&Event, &Key, &Passthrough));
+    TestCheck(KWMHotkeys.ActiveMode->Hotkeys[Key.Binding].Command == "third");
+}
+
+/* NOTE(koekeishiya): 500 bindings across 10 modes, and 1000 key presses of which about half are bound.
+ *                    The previous path looked the active mode up by name and scanned its bindings. */
+static void
+BenchmarkLookup()
+{
+    const int Modes = 10;
+    const CGKeyCode Keycodes = 50;
+
+    std::mt19937 Random(1);
+    BindRandomHotkeys(&Random, Modes, 500, Keycodes);
+
+    std::vector<__CGEvent> Events;
+    std::vector<uint32_t> Flags;
+    for(int Index = 0; Index < 1000; ++Index)
+    {
+        int States[3] = { (int) (Random() % 4), (int) (Random() % 4), (int) (Random() % 4) };
+        uint32_t EventFlags;
+        Events.push_back(CreateKeyPress(States, Random() % 2, Random() % Keycodes, &EventFlags));
+        Flags.push_back(EventFlags);
+    }
+
+    std::string Name = ModeName(3);
+    KWMHotkeys.ActiveMode = GetBindingMode(Name);
+
+    uint32_t Found = 0;
+    TestBenchmark("1000 key presses, 500 bindings, hash lookup", 1000,
+    {
+        for(std::size_t Index = 0; Index < Events.size(); ++Index)
+        {
+            ax_event_key Key;
+            bool Passthrough;
+            Found += HotkeyForCGEvent(&Events[Index], &Key, &Passthrough);
+        }
+    });
+
+    TestBenchmark("1000 key presses, 500 bindings, mode name + scan", 1000,
+    {
+        for(std::size_t Index = 0; Index < Events.size(); ++Index)
+            Found += HotkeyExists(Flags[Index], Events[Index].Keycode, NULL, Name);
+    });
+
+    TestCheck(Found > 0);
+}
+
+int main(int Count, char **Args)
+{
+    TestLookupMatchesLinearScan();
+    TestRemovedHotkeyIsNotFound();
+
+    if(TestWantsBenchmarks(Count, Args))
+        BenchmarkLookup();
+
+    return TestReport("keys_test");
+}
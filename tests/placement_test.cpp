@@ -0,0 +1,144 @@
+#include "test.h"
+#include "fake/fake.h"
+#include "tree.h"
+#include "space.h"
+#include "window.h"
+#include "placement.h"
+
+#include <thread>
+
+extern layout_stats LayoutStats;
+
+/* NOTE(koekeishiya): Places windows of several applications against a fake accessibility layer in
+ *                    which every set request blocks for the latency of the application that owns
+ *                    the window, so that a slow application overruns the placement deadline. */
+#define SLOW_PID 2
+#define SLOW_LATENCY_US 150000
+
+static space_info *
+CreateSpaceWithApplications(pid_t Applications, uint32_t WindowsPerApplication)
+{
+    FakeReset();
+    for(pid_t PID = 1; PID <= Applications; ++PID)
+    {
+        for(uint32_t Index = 0; Index < WindowsPerApplication; ++Index)
+            FakeAddApplicationWindow(PID, (PID * 100) + Index);
+    }
+
+    ax_display *Display = FakeDisplay();
+    AddWindowToNodeTree(Display, 100);
+    return GetSpaceInfo(Display->Space);
+}
+
+/* NOTE(koekeishiya): Dispatches the events that the workers post for abandoned placements until
+ *                    Done returns true, or gives up after a few seconds. */
+template<typename Predicate> static bool
+WaitForPlacements(Predicate Done)
+{
+    double Deadline = TestSeconds() + 5;
+    while(TestSeconds() < Deadline)
+    {
+        FakeDispatchEvents();
+        if(Done())
+            return true;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    return false;
+}
+
+static void
+TestAbandonedPlacementDoesNotOverwriteNewerGeometry()
+{
+    CreateSpaceWithApplications(2, 1);
+    FakeSetApplicationLatency(SLOW_PID, SLOW_LATENCY_US);
+
+    ax_window *Window = GetWindowByID(SLOW_PID * 100);
+    SetWindowDimensions(Window, 10, 10, 300, 300);
+    TestCheck(LayoutStats.PlacementsAbandoned == 1);
+
+    SetWindowDimensions(Window, 20, 20, 400, 400);
+    TestCheck(LayoutStats.PlacementsAbandoned == 2);
+
+    bool Completed = WaitForPlacements([Window]() { return Window->Size.width == 400; });
+    TestCheck(Completed);
+
+    std::this_thread::sleep_for(std::chrono::microseconds(4 * SLOW_LATENCY_US));
+    FakeDispatchEvents();
+
+    CGRect Rect = FakeWindowRect(Window->ID);
+    TestCheck(Rect.origin.x == 20 && Rect.origin.y == 20);
+    TestCheck(Rect.size.width == 400 && Rect.size.height == 400);
+    TestCheck(Window->Position.x == 20 && Window->Position.y == 20);
+    TestCheck(Window->Size.width == 400 && Window->Size.height == 400);
+}
+
+static void
+TestAbandonedPlacementIsCompleted()
+{
+    CreateSpaceWithApplications(2, 1);
+    FakeSetApplicationLatency(SLOW_PID, SLOW_LATENCY_US);
+    FakeSetApplicationRefuses(SLOW_PID, true);
+
+    ax_window *Window = GetWindowByID(SLOW_PID * 100);
+    CGRect Rect = FakeWindowRect(Window->ID);
+    Window->Position = CGPointMake(-1, -1);
+    Window->Size = CGSizeMake(1, 1);
+
+    SetWindowDimensions(Window, 10, 10, 300, 300);
+    TestCheck(LayoutStats.PlacementsAbandoned == 1);
+    TestCheck(AXLibHasFlags(Window, AXWindow_MoveIntrinsic));
+    TestCheck(AXLibHasFlags(Window, AXWindow_SizeIntrinsic));
+
+    bool Completed = WaitForPlacements([Window]() { return !AXLibHasFlags(Window, AXWindow_MoveIntrinsic) &&
+                                                           !AXLibHasFlags(Window, AXWindow_SizeIntrinsic); });
+    TestCheck(Completed);
+    TestCheck(Window->Position.x == Rect.origin.x && Window->Position.y == Rect.origin.y);
+    TestCheck(Window->Size.width == Rect.size.width && Window->Size.height == Rect.size.height);
+}
+
+static void
+BenchmarkPlacement(pid_t Applications, uint32_t WindowsPerApplication, int LatencyMicroseconds)
+{
+    CreateSpaceWithApplications(Applications, WindowsPerApplication);
+    for(pid_t PID = 1; PID <= Applications; ++PID)
+        FakeSetApplicationLatency(PID, LatencyMicroseconds);
+
+    std::vector<ax_window *> Windows = AXLibGetAllKnownWindows();
+    char Name[64];
+
+    /* NOTE(koekeishiya): The previous path, one synchronous placement after the other. */
+    snprintf(Name, sizeof(Name), "%d apps x %u windows, sequential", Applications, WindowsPerApplication);
+    TestBenchmark(Name, 5,
+    {
+        for(std::size_t Index = 0; Index < Windows.size(); ++Index)
+        {
+            ax_window *Window = Windows[Index];
+            AXLibSetWindowPosition(Window->Ref, Index, Index);
+            AXLibSetWindowSize(Window->Ref, 200, 200 + (Iteration % 2));
+            AXLibGetWindowPosition(Window->Ref);
+            AXLibGetWindowSize(Window->Ref);
+        }
+    });
+
+    snprintf(Name, sizeof(Name), "%d apps x %u windows, placement batch", Applications, WindowsPerApplication);
+    TestBenchmark(Name, 5,
+    {
+        BeginWindowPlacementBatch();
+        for(std::size_t Index = 0; Index < Windows.size(); ++Index)
+            SetWindowDimensions(Windows[Index], Index + 1 + (Iteration % 2), Index, 300, 300 + (Iteration % 2));
+        CommitWindowPlacementBatch();
+    });
+}
+
+int main(int Count, char **Args)
+{
+    TestAbandonedPlacementDoesNotOverwriteNewerGeometry();
+    TestAbandonedPlacementIsCompleted();
+
+    if(TestWantsBenchmarks(Count, Args))
+        BenchmarkPlacement(4, 8, 2000);
+
+    return TestReport("placement_test");
+}
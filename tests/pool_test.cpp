@@ -0,0 +1,150 @@
+#include "test.h"
+#include "pool.h"
+
+#include <set>
+
+/* NOTE(koekeishiya): Builds a tree with the given number of leaves the way CreateBSPTree does, by
+ *                    repeatedly splitting a leaf into two children, and returns its root. */
+typedef tree_node *(*tree_node_allocator)(void *Context);
+
+static tree_node *
+AllocateTreeNodeFromHeap(void *Context)
+{
+    tree_node *Node = (tree_node *) malloc(sizeof(tree_node));
+    memset(Node, 0, sizeof(tree_node));
+    return Node;
+}
+
+static tree_node *
+AllocateTreeNodeFromPool(void *Context)
+{
+    tree_node *Node = (tree_node *) NodePoolAllocate((node_pool *) Context, sizeof(tree_node));
+    memset(Node, 0, sizeof(tree_node));
+    return Node;
+}
+
+static tree_node *
+BuildTree(tree_node_allocator Allocate, void *Context, uint32_t Leafs, std::vector<tree_node *> &Queue)
+{
+    tree_node *Root = Allocate(Context);
+    Root->WindowID = 1;
+
+    Queue.clear();
+    Queue.push_back(Root);
+    for(uint32_t WindowID = 2, Head = 0; WindowID <= Leafs; ++WindowID, ++Head)
+    {
+        tree_node *Leaf = Queue[Head];
+        Leaf->LeftChild = Allocate(Context);
+        Leaf->LeftChild->Parent = Leaf;
+        Leaf->LeftChild->WindowID = Leaf->WindowID;
+
+        Leaf->RightChild = Allocate(Context);
+        Leaf->RightChild->Parent = Leaf;
+        Leaf->RightChild->WindowID = WindowID;
+
+        Leaf->WindowID = 0;
+        Queue.push_back(Leaf->LeftChild);
+        Queue.push_back(Leaf->RightChild);
+    }
+
+    return Root;
+}
+
+static void
+FreeHeapTree(tree_node *Node)
+{
+    if(Node)
+    {
+        FreeHeapTree(Node->LeftChild);
+        FreeHeapTree(Node->RightChild);
+        free(Node);
+    }
+}
+
+static void
+TestAllocationsAreDistinctAndAligned()
+{
+    node_pool Pool = {};
+    std::set<void *> Objects;
+    for(int Index = 0; Index < 1000; ++Index)
+    {
+        void *Object = NodePoolAllocate(&Pool, sizeof(tree_node));
+        TestCheck(Object != NULL);
+        TestCheck(((uintptr_t) Object % (sizeof(void *) * 2)) == 0);
+        Objects.insert(Object);
+    }
+
+    TestCheck(Objects.size() == 1000);
+    TestCheck(Pool.Allocations == 1000);
+    TestCheck(Pool.ObjectSize >= sizeof(tree_node));
+    TestCheck(NodePoolReservedBytes(&Pool) >= 1000 * sizeof(tree_node));
+}
+
+static void
+TestFreedObjectsAreReused()
+{
+    node_pool Pool = {};
+    void *First = NodePoolAllocate(&Pool, sizeof(link_node));
+    void *Second = NodePoolAllocate(&Pool, sizeof(link_node));
+    TestCheck(First != Second);
+
+    NodePoolFree(&Pool, First);
+    TestCheck(Pool.Allocations == 1);
+    TestCheck(NodePoolAllocate(&Pool, sizeof(link_node)) == First);
+    TestCheck(Pool.Allocations == 2);
+    TestCheck(Pool.TotalAllocations == 3);
+
+    NodePoolFree(&Pool, NULL);
+    TestCheck(Pool.Allocations == 2);
+}
+
+static void
+TestResetReusesSlabs()
+{
+    node_pool Pool = {};
+    std::vector<tree_node *> Queue;
+    BuildTree(AllocateTreeNodeFromPool, &Pool, 10000, Queue);
+
+    std::size_t Slabs = Pool.Slabs.size();
+    std::size_t Reserved = NodePoolReservedBytes(&Pool);
+    TestCheck(Pool.Allocations == 2 * 10000 - 1);
+
+    NodePoolReset(&Pool);
+    TestCheck(Pool.Allocations == 0);
+
+    BuildTree(AllocateTreeNodeFromPool, &Pool, 10000, Queue);
+    TestCheck(Pool.Slabs.size() == Slabs);
+    TestCheck(NodePoolReservedBytes(&Pool) == Reserved);
+}
+
+static void
+BenchmarkTreeChurn()
+{
+    std::vector<tree_node *> Queue;
+    Queue.reserve(2 * 10000);
+
+    TestBenchmark("build + destroy 10k-leaf tree (malloc/free)", 200,
+    {
+        tree_node *Root = BuildTree(AllocateTreeNodeFromHeap, NULL, 10000, Queue);
+        FreeHeapTree(Root);
+    });
+
+    node_pool Pool = {};
+    TestBenchmark("build + destroy 10k-leaf tree (node_pool)", 200,
+    {
+        BuildTree(AllocateTreeNodeFromPool, &Pool, 10000, Queue);
+        NodePoolReset(&Pool);
+    });
+}
+
+int main(int Count, char **Args)
+{
+    TestAllocationsAreDistinctAndAligned();
+    TestFreedObjectsAreReused();
+    TestResetReusesSlabs();
+
+    if(TestWantsBenchmarks(Count, Args))
+        BenchmarkTreeChurn();
+
+    return TestReport("pool_test");
+}
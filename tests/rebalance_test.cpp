@@ -0,0 +1,275 @@
+#include "test.h"
+#include "fake/fake.h"
+#include "tree.h"
+#include "node.h"
+#include "space.h"
+#include "window.h"
+
+#include <algorithm>
+#include <random>
+#include <set>
+
+/* NOTE(koekeishiya): Windows can be placed on another space or made sticky, which decides whether
+ *                    a rebalance may tile them. */
+static std::set<uint32_t> OtherSpaceWindows;
+static std::set<uint32_t> StickyWindows;
+
+bool AXLibSpaceHasWindow(ax_window *Window, CGSSpaceID SpaceID)
+{
+    return OtherSpaceWindows.find(Window->ID) == OtherSpaceWindows.end();
+}
+
+bool AXLibStickyWindow(ax_window *Window)
+{
+    return StickyWindows.find(Window->ID) != StickyWindows.end();
+}
+
+static std::vector<uint32_t>
+WindowIDsInTree(space_info *Space)
+{
+    std::vector<uint32_t> Windows;
+    if(!Space->RootNode)
+        return Windows;
+
+    tree_node *Node = NULL;
+    GetFirstLeafNode(Space->RootNode, (void**)&Node);
+    while(Node)
+    {
+        if(Node->WindowID != 0)
+            Windows.push_back(Node->WindowID);
+
+        for(link_node *Link = Node->List; Link; Link = Link->Next)
+            Windows.push_back(Link->WindowID);
+
+        Node = Space->Settings.Mode == SpaceModeBSP ? GetNearestTreeNodeToTheRight(Node) : NULL;
+    }
+
+    return Windows;
+}
+
+/* NOTE(koekeishiya): The diff as RebalanceNodeTree made it before it hashed the window ids: every
+ *                    id in the tree is looked for among the visible windows, and every visible
+ *                    window among the ids in the tree. */
+static void
+ReferenceDiff(std::vector<ax_window *> &VisibleWindows, std::vector<uint32_t> &WindowIDsInTree,
+              std::vector<uint32_t> *WindowsToRemove, std::vector<ax_window *> *WindowsToAdd)
+{
+    for(std::size_t IDIndex = 0; IDIndex < WindowIDsInTree.size(); ++IDIndex)
+    {
+        bool Found = false;
+        for(std::size_t WindowIndex = 0; WindowIndex < VisibleWindows.size(); ++WindowIndex)
+        {
+            if(VisibleWindows[WindowIndex]->ID == WindowIDsInTree[IDIndex])
+            {
+                Found = true;
+                break;
+            }
+        }
+
+        if(!Found)
+            WindowsToRemove->push_back(WindowIDsInTree[IDIndex]);
+    }
+
+    for(std::size_t WindowIndex = 0; WindowIndex < VisibleWindows.size(); ++WindowIndex)
+    {
+        bool Found = false;
+        ax_window *Window = VisibleWindows[WindowIndex];
+        for(std::size_t IDIndex = 0; IDIndex < WindowIDsInTree.size(); ++IDIndex)
+        {
+            if(Window->ID == WindowIDsInTree[IDIndex])
+            {
+                Found = true;
+                break;
+            }
+        }
+
+        if((!Found) &&
+           (AXLibSpaceHasWindow(Window, FakeDisplay()->Space->ID)) &&
+           (!AXLibStickyWindow(Window)))
+            WindowsToAdd->push_back(Window);
+    }
+}
+
+/* NOTE(koekeishiya): The windows that the tree holds after a rebalance, given the reference diff and
+ *                    the windows that TileWindow turns away. */
+static std::vector<uint32_t>
+ReferenceRebalance(space_info *Space)
+{
+    std::vector<uint32_t> Windows = WindowIDsInTree(Space);
+    if(!Space->RootNode || (Space->Settings.Mode == SpaceModeMonocle && !Space->RootNode->List))
+        return Windows;
+
+    std::vector<ax_window *> VisibleWindows = AXLibGetAllVisibleWindows();
+    std::vector<uint32_t> WindowsToRemove;
+    std::vector<ax_window *> WindowsToAdd;
+    ReferenceDiff(VisibleWindows, Windows, &WindowsToRemove, &WindowsToAdd);
+
+    for(std::size_t Index = 0; Index < WindowsToRemove.size(); ++Index)
+        Windows.erase(std::find(Windows.begin(), Windows.end(), WindowsToRemove[Index]));
+
+    for(std::size_t Index = 0; Index < WindowsToAdd.size(); ++Index)
+    {
+        if(!AXLibHasFlags(WindowsToAdd[Index], AXWindow_Floating))
+            Windows.push_back(WindowsToAdd[Index]->ID);
+    }
+
+    std::sort(Windows.begin(), Windows.end());
+    return Windows;
+}
+
+/* NOTE(koekeishiya): A new window is one that a rebalance should tile, or one that is on another
+ *                    space, sticky or floating, and must be left alone. */
+static void
+AddRandomWindow(std::mt19937 &Random, uint32_t WindowID)
+{
+    ax_window *Window = FakeAddWindow(WindowID);
+    switch(Random() % 6)
+    {
+        case 0: { OtherSpaceWindows.insert(WindowID); } break;
+        case 1: { StickyWindows.insert(WindowID); } break;
+        case 2: { AXLibAddFlags(Window, AXWindow_Floating); } break;
+    }
+}
+
+static std::vector<uint32_t>
+KnownWindowIDs()
+{
+    std::vector<uint32_t> Windows;
+    std::vector<ax_window *> Known = AXLibGetAllKnownWindows();
+    for(std::size_t Index = 0; Index < Known.size(); ++Index)
+        Windows.push_back(Known[Index]->ID);
+
+    return Windows;
+}
+
+/* NOTE(koekeishiya): Windows appear and disappear behind the back of the tree, and every rebalance
+ *                    must leave the tree with the windows that the nested-loop diff would have. */
+static void
+TestRebalanceMatchesReference(unsigned int Seed, space_tiling_option Mode)
+{
+    FakeReset();
+    OtherSpaceWindows.clear();
+    StickyWindows.clear();
+
+    std::mt19937 Random(Seed);
+    ax_display *Display = FakeDisplay();
+    space_info *Space = GetSpaceInfo(Display->Space);
+
+    uint32_t NextWindowID = 1;
+    for(uint32_t Count = 2 + Random() % 40; Count > 0; --Count)
+    {
+        FakeAddWindow(NextWindowID);
+        AddWindowToNodeTree(Display, NextWindowID++);
+    }
+
+    if(Mode != SpaceModeBSP)
+        ResetWindowNodeTree(Display, Mode);
+
+    for(int Round = 0; Round < 20; ++Round)
+    {
+        std::vector<uint32_t> Known = KnownWindowIDs();
+        for(std::size_t Index = 0; Index < Known.size(); ++Index)
+        {
+            if(Random() % 5 == 0)
+                FakeRemoveWindow(Known[Index]);
+        }
+
+        for(uint32_t Count = Random() % 10; Count > 0; --Count)
+            AddRandomWindow(Random, NextWindowID++);
+
+        std::vector<uint32_t> Expected = ReferenceRebalance(Space);
+        RebalanceNodeTree(Display);
+
+        std::vector<uint32_t> Windows = WindowIDsInTree(Space);
+        std::sort(Windows.begin(), Windows.end());
+        TestCheck(Windows == Expected);
+        TestCheck(CheckNodeIndex(Space));
+        if(Windows != Expected)
+        {
+            printf("  seed %u, mode %d, round %d\n", Seed, Mode, Round);
+            return;
+        }
+    }
+}
+
+static void
+TestUnchangedTreeKeepsItsOrder()
+{
+    FakeReset();
+    OtherSpaceWindows.clear();
+    StickyWindows.clear();
+
+    ax_display *Display = FakeDisplay();
+    space_info *Space = GetSpaceInfo(Display->Space);
+    for(uint32_t WindowID = 1; WindowID <= 12; ++WindowID)
+    {
+        FakeAddWindow(WindowID);
+        AddWindowToNodeTree(Display, WindowID);
+    }
+
+    std::vector<uint32_t> Windows = WindowIDsInTree(Space);
+    tree_node *Root = Space->RootNode;
+    RebalanceNodeTree(Display);
+    TestCheck(Space->RootNode == Root);
+    TestCheck(WindowIDsInTree(Space) == Windows);
+}
+
+/* NOTE(koekeishiya): The rebalance that runs on every space change and application activation, over
+ *                    spaces of 50, 500 and 5000 tiled windows that have not changed since the last
+ *                    one. The nested-loop diff is timed on the same windows without the tree walk or
+ *                    the list of visible windows that the rebalance also pays for. */
+static void
+BenchmarkRebalance()
+{
+    const uint32_t Sizes[] = { 50, 500, 5000 };
+    for(std::size_t SizeIndex = 0; SizeIndex < 3; ++SizeIndex)
+    {
+        uint32_t Size = Sizes[SizeIndex];
+        FakeReset();
+        OtherSpaceWindows.clear();
+        StickyWindows.clear();
+
+        ax_display *Display = FakeDisplay();
+        space_info *Space = GetSpaceInfo(Display->Space);
+        for(uint32_t WindowID = 1; WindowID <= Size; ++WindowID)
+        {
+            FakeAddWindow(WindowID);
+            AddWindowToNodeTree(Display, WindowID);
+        }
+
+        long Iterations = 1000000 / (Size * 10);
+        std::string Name = "rebalance, " + std::to_string(Size) + " windows";
+        TestBenchmark(Name.c_str(), Iterations,
+        {
+            RebalanceNodeTree(Display);
+        });
+
+        std::vector<ax_window *> VisibleWindows = AXLibGetAllVisibleWindows();
+        std::vector<uint32_t> WindowIDs = WindowIDsInTree(Space);
+        TestCheck(WindowIDs.size() == Size);
+
+        Name = "nested-loop diff, " + std::to_string(Size) + " windows";
+        TestBenchmark(Name.c_str(), std::max(Iterations / Size, 2L),
+        {
+            std::vector<uint32_t> WindowsToRemove;
+            std::vector<ax_window *> WindowsToAdd;
+            ReferenceDiff(VisibleWindows, WindowIDs, &WindowsToRemove, &WindowsToAdd);
+        });
+    }
+}
+
+int main(int Count, char **Args)
+{
+    for(unsigned int Seed = 1; Seed <= 16; ++Seed)
+    {
+        TestRebalanceMatchesReference(Seed, SpaceModeBSP);
+        TestRebalanceMatchesReference(Seed, SpaceModeMonocle);
+    }
+
+    TestUnchangedTreeKeepsItsOrder();
+
+    if(TestWantsBenchmarks(Count, Args))
+        BenchmarkRebalance();
+
+    return TestReport("rebalance_test");
+}
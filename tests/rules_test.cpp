@@ -0,0 +1,328 @@
+#include "test.h"
+#include "fake/fake.h"
+#include "rules.h"
+#include "scratchpad.h"
+
+#include <regex>
+#include <random>
+
+extern kwm_settings KWMSettings;
+
+/* NOTE(koekeishiya): Window rules as they were matched before their patterns were compiled: every
+ *                    pattern is turned into a std::regex, and every role into a CFString, each
+ *                    time a rule is tested against a window. */
+static bool
+ReferenceMatchWindowRule(window_rule *Rule, ax_window *Window)
+{
+    bool Match = true;
+    if(!Rule->Owner.empty())
+    {
+        std::regex Exp(Rule->Owner);
+        Match = std::regex_match(Window->Application->Name, Exp);
+    }
+
+    if(!Rule->Name.empty() && Window->Name)
+    {
+        std::regex Exp(Rule->Name);
+        Match = Match && std::regex_match(Window->Name, Exp);
+    }
+
+    if(!Rule->Role.empty())
+    {
+        CFTypeRef AXRole = CFStringCreateWithCString(NULL, Rule->Role.c_str(), kCFStringEncodingMacRoman);
+        Match = Match && AXLibWindowHasRole(Window, AXRole);
+        CFRelease(AXRole);
+    }
+
+    if(!Rule->CustomRole.empty())
+    {
+        CFTypeRef AXRole = CFStringCreateWithCString(NULL, Rule->CustomRole.c_str(), kCFStringEncodingMacRoman);
+        Match = Match && AXLibWindowHasCustomRole(Window, AXRole);
+        CFRelease(AXRole);
+    }
+
+    if(!Rule->Except.empty() && Window->Name)
+    {
+        std::regex Exp(Rule->Except);
+        Match = Match && !std::regex_match(Window->Name, Exp);
+    }
+
+    return Match;
+}
+
+static bool
+ReferenceApplyWindowRules(ax_window *Window)
+{
+    bool Skip = false;
+    for(std::size_t Index = 0; Index < KWMSettings.WindowRules.size(); ++Index)
+    {
+        window_rule *Rule = &KWMSettings.WindowRules[Index];
+        if(ReferenceMatchWindowRule(Rule, Window))
+        {
+            if(Rule->Properties.Float == 1)
+                AXLibAddFlags(Window, AXWindow_Floating);
+
+            if(!Rule->Properties.Role.empty())
+                Window->Type.CustomRole = CFStringCreateWithCString(NULL, Rule->Properties.Role.c_str(),
+                                                                    kCFStringEncodingMacRoman);
+
+            if(Rule->Properties.Scratchpad != -1)
+            {
+                AddWindowToScratchpad(Window);
+                if(Rule->Properties.Scratchpad == 0)
+                {
+                    HideScratchpadWindow(GetScratchpadSlotOfWindow(Window));
+                    Skip = true;
+                }
+            }
+        }
+    }
+
+    return Skip;
+}
+
+static const char *Owners[] = { "Finder", "Safari", "iTerm2", "Mail", "Google Chrome", "Steam", "Photoshop", "Xcode" };
+static const char *Roles[] = { "AXWindow", "AXStandardWindow", "AXDialog", "AXFloatingWindow" };
+
+/* NOTE(koekeishiya): Records what the rules did to the scratchpad. */
+static std::vector<int> ScratchpadLog;
+
+void AddWindowToScratchpad(ax_window *Window)
+{
+    ScratchpadLog.push_back(Window->ID);
+}
+
+int GetScratchpadSlotOfWindow(ax_window *Window)
+{
+    return Window->ID;
+}
+
+void HideScratchpadWindow(int Index)
+{
+    ScratchpadLog.push_back(-Index);
+}
+
+static ax_window *
+CreateWindow(uint32_t WindowID, pid_t PID, const char *Title, const char *Subrole)
+{
+    ax_window *Window = FakeAddApplicationWindow(PID, WindowID);
+    Window->Application->Name = Owners[(PID - 1) % 8];
+    Window->Name = Title ? strdup(Title) : NULL;
+    Window->Type.Role = FakeString("AXWindow");
+    Window->Type.Subrole = FakeString(Subrole);
+    return Window;
+}
+
+static void
+TestInvalidPatternRejectsRule()
+{
+    FakeReset();
+    KwmClearRules();
+    KwmAddRule("owner=\"Safari(\" properties={float=\"true\"}");
+    KwmAddRule("owner=\"Safari\" name=\"[\" properties={float=\"true\"}");
+    TestCheck(KWMSettings.WindowRules.empty());
+
+    KwmAddRule("owner=\"Saf.*\" properties={float=\"true\"}");
+    TestCheck(KWMSettings.WindowRules.size() == 1);
+}
+
+static void
+TestRoleStringIsShared()
+{
+    FakeReset();
+    KwmClearRules();
+    KwmAddRule("owner=\"iTerm2\" properties={role=\"AXDialog\"}");
+
+    ax_window *First = CreateWindow(1, 3, "zsh", "AXStandardWindow");
+    ax_window *Second = CreateWindow(2, 3, "vim", "AXStandardWindow");
+    ApplyWindowRules(First);
+    ApplyWindowRules(Second);
+    TestCheck(First->Type.CustomRole != NULL);
+    TestCheck(First->Type.CustomRole == Second->Type.CustomRole);
+    TestCheck(First->Type.CustomRole == KWMSettings.WindowRules[0].Properties.AXRole);
+}
+
+static void
+ResetWindow(ax_window *Window)
+{
+    AXLibClearFlags(Window, AXWindow_Floating);
+    Window->Type.CustomRole = NULL;
+    ScratchpadLog.clear();
+}
+
+template<std::size_t Count> static const char *
+Pick(std::mt19937 *Random, const char *(&Values)[Count])
+{
+    return Values[(*Random)() % Count];
+}
+
+/* NOTE(koekeishiya): Every field of a rule is left out half of the time. Owners are either
+ *                    literal, and go into the owner index, or patterns shared by other rules. */
+static std::string
+CreateRandomRule(std::mt19937 *Random)
+{
+    static const char *OwnerPatterns[] = { "Saf.*", "(Mail|Finder)", "i.*2", "Google .*", ".*o.*" };
+    static const char *NamePatterns[] = { "Preferences", ".*Untitled.*", "Untitled [0-9]+", "vim .*", "(Inbox|Downloads)" };
+    static const char *ExceptPatterns[] = { ".*Draft", "zsh", "Preferences" };
+    static const char *CustomRoles[] = { "AXDialog", "AXFloatingWindow" };
+    static const char *Scratchpad[] = { "visible", "hidden" };
+
+    std::string Rule;
+    switch((*Random)() % 3)
+    {
+        case 0: { Rule += std::string("owner=\"") + Pick(Random, Owners) + "\" "; } break;
+        case 1: { Rule += std::string("owner=\"") + Pick(Random, OwnerPatterns) + "\" "; } break;
+    }
+
+    if((*Random)() % 2)
+        Rule += std::string("name=\"") + Pick(Random, NamePatterns) + "\" ";
+    if((*Random)() % 3 == 0)
+        Rule += std::string("except=\"") + Pick(Random, ExceptPatterns) + "\" ";
+    if((*Random)() % 3 == 0)
+        Rule += std::string("role=\"") + Pick(Random, Roles) + "\" ";
+    if((*Random)() % 3 == 0)
+        Rule += std::string("crole=\"") + Pick(Random, CustomRoles) + "\" ";
+
+    Rule += "properties={";
+    if((*Random)() % 2)
+        Rule += "float=\"true\";";
+    if((*Random)() % 2)
+        Rule += std::string("role=\"") + Pick(Random, CustomRoles) + "\";";
+    if((*Random)() % 4 == 0)
+        Rule += std::string("scratchpad=\"") + Pick(Random, Scratchpad) + "\";";
+    Rule += "}";
+
+    return Rule;
+}
+
+struct rule_result
+{
+    bool Skip;
+    bool Floating;
+    CFTypeRef CustomRole;
+    std::vector<int> Scratchpad;
+};
+
+template<typename Apply> static rule_result
+ApplyRules(ax_window *Window, Apply Function)
+{
+    ResetWindow(Window);
+    rule_result Result;
+    Result.Skip = Function(Window);
+    Result.Floating = AXLibHasFlags(Window, AXWindow_Floating);
+    Result.CustomRole = Window->Type.CustomRole;
+    Result.Scratchpad = ScratchpadLog;
+    return Result;
+}
+
+/* NOTE(koekeishiya): Builds random rule sets and windows, and checks that the owner index, the
+ *                    shared patterns and the rule cache give the same result as testing every
+ *                    rule in order. Every window is matched twice, the second time from the
+ *                    cache, and titles repeat across windows so that the cache is shared. */
+static void
+TestRulesMatchReference()
+{
+    static const char *Titles[] = { "Preferences", "Untitled 1", "Untitled 12 - Draft", "Downloads",
+                                    "Inbox", "zsh", "vim main.cpp", "Settings", NULL };
+
+    uint32_t Mismatches = 0;
+    for(uint32_t Seed = 1; Seed <= 50; ++Seed)
+    {
+        std::mt19937 Random(Seed);
+        FakeReset();
+        KwmClearRules();
+
+        for(int Index = 0; Index < 20; ++Index)
+            KwmAddRule(CreateRandomRule(&Random));
+
+        std::vector<ax_window *> Windows;
+        for(uint32_t WindowID = 1; WindowID <= 40; ++WindowID)
+        {
+            pid_t PID = 1 + (Random() % 8);
+            Windows.push_back(CreateWindow(WindowID, PID, Pick(&Random, Titles), Pick(&Random, Roles)));
+        }
+
+        for(int Pass = 0; Pass < 2; ++Pass)
+        {
+            for(std::size_t Index = 0; Index < Windows.size(); ++Index)
+            {
+                rule_result Result = ApplyRules(Windows[Index], ApplyWindowRules);
+                rule_result Reference = ApplyRules(Windows[Index], ReferenceApplyWindowRules);
+                if((Result.Skip != Reference.Skip) ||
+                   (Result.Floating != Reference.Floating) ||
+                   (Result.CustomRole != Reference.CustomRole) ||
+                   (Result.Scratchpad != Reference.Scratchpad))
+                    ++Mismatches;
+            }
+        }
+    }
+
+    TestCheck(Mismatches == 0);
+    TestCheck(KWMSettings.WindowRuleCache.Hits > 0);
+}
+
+/* NOTE(koekeishiya): 120 rules, a third of them with a literal owner, over 200 windows that all
+ *                    have a different title, so that no window is served from the rule cache. */
+static void
+BenchmarkWindowRules()
+{
+    FakeReset();
+    KwmClearRules();
+
+    std::vector<std::string> Rules;
+    for(int Index = 0; Index < 120; ++Index)
+    {
+        const char *Owner = Owners[Index % 8];
+        switch(Index % 3)
+        {
+            case 0: { Rules.push_back(std::string("owner=\"") + Owner + "\" properties={float=\"true\"}"); } break;
+            case 1: { Rules.push_back(std::string("owner=\"") + std::string(Owner, 3) + ".*\" name=\".*Preferences " + std::to_string(Index) + ".*\" properties={float=\"true\"}"); } break;
+            case 2: { Rules.push_back(std::string("name=\"^Untitled [0-9]+ ") + std::to_string(Index) + "$\" except=\".*- Draft\" role=\"AXDialog\""); } break;
+        }
+    }
+
+    for(std::size_t Index = 0; Index < Rules.size(); ++Index)
+        KwmAddRule(Rules[Index]);
+
+    std::vector<ax_window *> Windows;
+    for(uint32_t WindowID = 1; WindowID <= 200; ++WindowID)
+    {
+        std::string Title = "Document " + std::to_string(WindowID) + " - Edited";
+        Windows.push_back(CreateWindow(WindowID, 1 + (WindowID % 8), Title.c_str(), Roles[WindowID % 4]));
+    }
+
+    TestBenchmark("200 windows x 120 rules, regex per match", 3,
+    {
+        for(std::size_t Index = 0; Index < Windows.size(); ++Index)
+            ReferenceApplyWindowRules(Windows[Index]);
+    });
+
+    TestBenchmark("200 windows x 120 rules, compile + match", 3,
+    {
+        KwmClearRules();
+        for(std::size_t Index = 0; Index < Rules.size(); ++Index)
+            KwmAddRule(Rules[Index]);
+
+        for(std::size_t Index = 0; Index < Windows.size(); ++Index)
+            ApplyWindowRules(Windows[Index]);
+    });
+
+    TestBenchmark("200 windows x 120 rules, cached", 100,
+    {
+        for(std::size_t Index = 0; Index < Windows.size(); ++Index)
+            ApplyWindowRules(Windows[Index]);
+    });
+}
+
+int main(int Count, char **Args)
+{
+    TestInvalidPatternRejectsRule();
+    TestRoleStringIsShared();
+    TestRulesMatchReference();
+
+    if(TestWantsBenchmarks(Count, Args))
+        BenchmarkWindowRules();
+
+    KwmClearRules();
+    return TestReport("rules_test");
+}
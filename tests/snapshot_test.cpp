@@ -0,0 +1,141 @@
+#include "test.h"
+#include "fake/fake.h"
+#include "interpreter.h"
+#include "snapshot.h"
+#include "window.h"
+#include "event.h"
+
+#include <thread>
+
+extern ax_application *FocusedApplication;
+
+/* NOTE(koekeishiya): Runs the real event loop, so that the state version is bumped and the snapshot
+ *                    is published the way it is in kwm. Queries are sent from the test thread like
+ *                    the daemon thread sends them, and a fence event tells when the loop has run
+ *                    everything that was queued before it. */
+static uint64_t Fences;
+static uint64_t Handled;
+
+static EVENT_CALLBACK(Callback_TestFence)
+{
+    __atomic_add_fetch(&Fences, 1, __ATOMIC_RELEASE);
+}
+
+static EVENT_CALLBACK(Callback_TestEvent)
+{
+    ++Handled;
+}
+
+static EVENT_CALLBACK(Callback_TestFocusWindow)
+{
+    ++Handled;
+    FocusedApplication->Focus = GetWindowByID(Event->WindowID);
+}
+
+static void
+Drain()
+{
+    uint64_t Fence = __atomic_load_n(&Fences, __ATOMIC_ACQUIRE) + 1;
+    ax_event Event = {};
+    Event.Type = AXEvent_User;
+    Event.Handle = &Callback_TestFence;
+    AXLibAddEvent(Event);
+
+    double Deadline = TestSeconds() + 5;
+    while(__atomic_load_n(&Fences, __ATOMIC_ACQUIRE) < Fence && TestSeconds() < Deadline)
+        std::this_thread::yield();
+}
+
+static void
+PostEvent(ax_event_type Type, EventCallback *Handle, uint32_t WindowID, bool Intrinsic)
+{
+    ax_event Event = {};
+    Event.Type = Type;
+    Event.Payload = AXPayload_WindowID;
+    Event.WindowID = WindowID;
+    Event.Intrinsic = Intrinsic;
+    Event.Handle = Handle;
+    AXLibAddEvent(Event);
+    Drain();
+}
+
+static std::string
+Query(std::string Command, int Handle)
+{
+    KwmInterpretCommand(Command, Handle);
+    Drain();
+    return FakeReply(Handle);
+}
+
+/* NOTE(koekeishiya): Cursor movement, hotkeys and the echo of a move that kwm made itself do not
+ *                    change what a query reports, so a client that asks 'only if newer' is told that
+ *                    nothing changed, and the published answer keeps being served. */
+static void
+TestCursorEventsLeaveTheVersion()
+{
+    FakeResetReplies();
+    KwmMarkStateChanged();
+    Drain();
+    TestCheck(KwmSnapshotIsCurrent());
+
+    uint64_t Version = KwmStateVersion();
+    std::string Since = "query --since " + std::to_string(Version) + " window focused id";
+
+    PostEvent(AXEvent_MouseMoved, &Callback_TestEvent, 0, false);
+    PostEvent(AXEvent_LeftMouseDragged, &Callback_TestEvent, 0, false);
+    PostEvent(AXEvent_HotkeyPressed, &Callback_TestEvent, 0, false);
+    PostEvent(AXEvent_WindowMoved, &Callback_TestEvent, 1, true);
+    PostEvent(AXEvent_WindowResized, &Callback_TestEvent, 1, true);
+    TestCheck(Handled == 5);
+
+    TestCheck(KwmStateVersion() == Version);
+    TestCheck(KwmSnapshotIsCurrent());
+    TestCheck(Query(Since, 1) == std::to_string(Version));
+
+    TestCheck(KwmAnswerFromSnapshot(KWMEvent_QueryFocusedWindowId, 2));
+    TestCheck(FakeReply(2) == "1");
+
+    PostEvent(AXEvent_WindowMoved, &Callback_TestEvent, 1, false);
+    TestCheck(KwmStateVersion() == Version + 1);
+    TestCheck(Query(Since, 3) == std::to_string(Version + 1) + "\n1");
+}
+
+/* NOTE(koekeishiya): The snapshot is published by the event loop after the change, before anyone
+ *                    asked, so the next query is answered from it. */
+static void
+TestChangesArePublished()
+{
+    FakeResetReplies();
+    uint64_t Version = KwmStateVersion();
+
+    PostEvent(AXEvent_WindowFocused, &Callback_TestFocusWindow, 2, false);
+    TestCheck(KwmStateVersion() == Version + 1);
+    TestCheck(KwmSnapshotIsCurrent());
+    TestCheck(KwmAnswerFromSnapshot(KWMEvent_QueryFocusedWindowId, 1));
+    TestCheck(FakeReply(1) == "2");
+    TestCheck(KwmAnswerFromSnapshot(KWMEvent_QueryWindowList, 2));
+    TestCheck(FakeReply(2) == "1, fake\n2, fake");
+
+    KwmInterpretCommand("config cycle-focus off", 3);
+    Drain();
+    TestCheck(KwmStateVersion() == Version + 2);
+    TestCheck(KwmSnapshotIsCurrent());
+}
+
+int main(int Count, char **Args)
+{
+    FakeReset();
+    FakeAddWindow(1);
+    FakeAddWindow(2);
+    FocusedApplication = FakeApplication();
+    FocusedApplication->Focus = GetWindowByID(1);
+
+    AXLibSetStateChangedCallback(&Callback_KWMEvent_PublishSnapshot);
+    AXLibStartEventLoop();
+
+    TestCursorEventsLeaveTheVersion();
+    TestChangesArePublished();
+
+    AXLibStopEventLoop();
+    return TestReport("snapshot_test");
+}
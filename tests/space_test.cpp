@@ -0,0 +1,181 @@
+#include "test.h"
+#include "fake/fake.h"
+#include "tree.h"
+#include "space.h"
+#include "window.h"
+#include "container.h"
+
+#include <map>
+#include <random>
+
+extern space_table WindowTree;
+
+/* NOTE(koekeishiya): Space identifiers are the uuids that the window server gives its spaces. */
+static std::string
+CreateIdentifier(std::mt19937 *Random)
+{
+    static const char *Digits = "0123456789ABCDEF";
+    std::string Identifier;
+    for(int Index = 0; Index < 36; ++Index)
+    {
+        if(Index == 8 || Index == 13 || Index == 18 || Index == 23)
+            Identifier += '-';
+        else
+            Identifier += Digits[(*Random)() % 16];
+    }
+
+    return Identifier;
+}
+
+static ax_space
+CreateSpace(const std::string &Identifier)
+{
+    ax_space Space = {};
+    Space.Identifier = Identifier;
+    Space.Handle = -1;
+    return Space;
+}
+
+/* NOTE(koekeishiya): axlib rebuilds its ax_space structs when displays change, with the handle unset,
+ *                    and the rebuilt space must find the space_info that the identifier had. */
+static void
+TestRebuiltSpaceKeepsItsInfo()
+{
+    FakeReset();
+    ax_space First = CreateSpace("first");
+    ax_space Second = CreateSpace("second");
+
+    space_info *Info = GetSpaceInfo(&First);
+    TestCheck(First.Handle >= 0);
+    TestCheck(GetSpaceInfo(&First) == Info);
+    TestCheck(GetSpaceInfo(&Second) != Info);
+    TestCheck(Second.Handle != First.Handle);
+
+    Info->Settings.Mode = SpaceModeMonocle;
+    ax_space Rebuilt = CreateSpace("first");
+    TestCheck(GetSpaceInfo(&Rebuilt) == Info);
+    TestCheck(Rebuilt.Handle == First.Handle);
+    TestCheck(GetSpaceInfo(&Rebuilt)->Settings.Mode == SpaceModeMonocle);
+
+    ax_space Unknown = CreateSpace("unknown");
+    std::size_t Size = WindowTree.Spaces.size();
+    TestCheck(FindSpaceInfo(&Unknown) == NULL);
+    TestCheck(Unknown.Handle == -1);
+    TestCheck(WindowTree.Spaces.size() == Size);
+
+    ax_space Found = CreateSpace("second");
+    TestCheck(FindSpaceInfo(&Found) == GetSpaceInfo(&Second));
+    TestCheck(Found.Handle == Second.Handle);
+}
+
+/* NOTE(koekeishiya): Spaces are looked up, rebuilt and searched for in random order, and must resolve
+ *                    to the same space_info as a map from identifier to the first one handed out.
+ *                    Every space_info must stay where it is while the table grows. */
+static void
+TestTableMatchesReference()
+{
+    for(uint32_t Seed = 1; Seed <= 20; ++Seed)
+    {
+        FakeReset();
+        std::mt19937 Random(Seed);
+
+        std::vector<std::string> Identifiers;
+        for(int Index = 0; Index < 64; ++Index)
+            Identifiers.push_back(CreateIdentifier(&Random));
+
+        std::map<std::string, space_info *> Reference;
+        std::map<std::string, ax_space> Spaces;
+        uint32_t Mismatches = 0;
+        for(int Step = 0; Step < 2000; ++Step)
+        {
+            const std::string &Identifier = Identifiers[Random() % Identifiers.size()];
+            std::map<std::string, ax_space>::iterator It = Spaces.find(Identifier);
+            if(It == Spaces.end())
+                It = Spaces.insert(std::make_pair(Identifier, CreateSpace(Identifier))).first;
+            else if(Random() % 4 == 0)
+                It->second = CreateSpace(Identifier);
+
+            std::map<std::string, space_info *>::iterator Expected = Reference.find(Identifier);
+            if(Random() % 3 == 0)
+            {
+                space_info *Info = FindSpaceInfo(&It->second);
+                if(Info != (Expected == Reference.end() ? NULL : Expected->second))
+                    ++Mismatches;
+            }
+            else
+            {
+                space_info *Info = GetSpaceInfo(&It->second);
+                if(Expected == Reference.end())
+                    Reference[Identifier] = Info;
+                else if(Info != Expected->second)
+                    ++Mismatches;
+            }
+        }
+
+        TestCheck(Mismatches == 0);
+        TestCheck(WindowTree.Spaces.size() == Reference.size());
+        TestCheck(WindowTree.Handles.size() == Reference.size());
+    }
+}
+
+/* NOTE(koekeishiya): Before the table, every container that a relayout computed looked the space up
+ *                    by its identifier, once for the root and once for every other node. Those
+ *                    lookups are timed on their own, in a map of 16 spaces and in the table, next to
+ *                    the relayout of a space of 200 windows that now makes a single lookup. */
+static void
+BenchmarkRelayout()
+{
+    FakeReset();
+    const uint32_t Windows = 200;
+    for(uint32_t WindowID = 1; WindowID <= Windows; ++WindowID)
+        FakeAddWindow(WindowID);
+
+    ax_display *Display = FakeDisplay();
+    AddWindowToNodeTree(Display, 1);
+    space_info *Info = GetSpaceInfo(Display->Space);
+
+    TestBenchmark("relayout, 200 windows", 2000,
+    {
+        SetRootNodeContainer(Display, Info->RootNode);
+        CreateNodeContainers(Display, Info->RootNode, false);
+        ApplyTreeNodeContainer(Info->RootNode);
+    });
+
+    std::mt19937 Random(1);
+    std::map<std::string, space_info> Map;
+    std::vector<ax_space> Spaces;
+    for(int Index = 0; Index < 16; ++Index)
+    {
+        Spaces.push_back(CreateSpace(CreateIdentifier(&Random)));
+        Map[Spaces.back().Identifier] = space_info();
+        GetSpaceInfo(&Spaces.back());
+    }
+
+    const uint32_t Lookups = 2 * Windows - 1;
+    ax_space *Space = &Spaces[7];
+    space_info *Result = NULL;
+    TestBenchmark("399 lookups, std::map<std::string, space_info>", 2000,
+    {
+        for(uint32_t Lookup = 0; Lookup < Lookups; ++Lookup)
+            Result = &Map[Space->Identifier];
+    });
+
+    TestBenchmark("399 lookups, space table", 2000,
+    {
+        for(uint32_t Lookup = 0; Lookup < Lookups; ++Lookup)
+            Result = GetSpaceInfo(Space);
+    });
+
+    TestCheck(Result == GetSpaceInfo(Space));
+}
+
+int main(int Count, char **Args)
+{
+    TestRebuiltSpaceKeepsItsInfo();
+    TestTableMatchesReference();
+
+    if(TestWantsBenchmarks(Count, Args))
+        BenchmarkRelayout();
+
+    return TestReport("space_test");
+}
@@ -0,0 +1,105 @@
+#ifndef KWM_TEST_STUB_CARBON_H
+#define KWM_TEST_STUB_CARBON_H
+
+/* NOTE(koekeishiya): Declarations of the parts of Carbon, ApplicationServices and libdispatch that kwm
+ *                    uses, so that the portable parts of kwm can be compiled on Linux for tests/.
+ *                    Only types and prototypes live here; the tests link fake definitions from
+ *                    tests/fake for the functions they actually reach. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+typedef const void *CFTypeRef;
+typedef const struct __CFString *CFStringRef;
+typedef const struct __CFArray *CFArrayRef;
+typedef const struct __CFBoolean *CFBooleanRef;
+typedef const struct __CFData *CFDataRef;
+typedef const struct __CFDictionary *CFDictionaryRef;
+typedef struct __CFDictionary *CFMutableDictionaryRef;
+typedef const struct __CFNumber *CFNumberRef;
+typedef struct __CFRunLoopSource *CFRunLoopSourceRef;
+typedef struct __CFRunLoop *CFRunLoopRef;
+typedef struct __CFMachPort *CFMachPortRef;
+typedef struct __CFAllocator *CFAllocatorRef;
+typedef struct __AXUIElement *AXUIElementRef;
+typedef struct __AXObserver *AXObserverRef;
+typedef const struct __AXValue *AXValueRef;
+typedef struct __CGEvent *CGEventRef;
+typedef struct __CGEventTapProxy *CGEventTapProxy;
+typedef struct __TISInputSource *TISInputSourceRef;
+typedef long CFIndex;
+typedef double CFAbsoluteTime; typedef uint32_t CFStringEncoding; typedef int32_t AXError; typedef int32_t CGError;
+typedef uint32_t CGDirectDisplayID; typedef uint32_t CGWindowID; typedef uint32_t CGEventType; typedef uint64_t CGEventMask;
+typedef uint64_t CGEventFlags; typedef uint16_t CGKeyCode; typedef uint32_t CGWindowListOption; typedef unsigned char Boolean;
+typedef uint32_t UInt32; typedef int32_t OSStatus; typedef uint16_t UniChar; typedef unsigned long UniCharCount;
+struct ProcessSerialNumber { uint32_t high, low; };
+struct CGPoint { double x, y; }; struct CGSize { double width, height; }; struct CGRect { CGPoint origin; CGSize size; };
+struct CFRange { CFIndex location, length; }; struct UCKeyboardLayout {};
+struct CFDictionaryKeyCallBacks {}; struct CFDictionaryValueCallBacks {};
+typedef long dispatch_once_t; typedef uint64_t dispatch_time_t; typedef struct dispatch_queue_s *dispatch_queue_t;
+typedef CGEventRef (*CGEventTapCallBack)(CGEventTapProxy, CGEventType, CGEventRef, void *);
+enum { kAXErrorSuccess = 0, kCGErrorSuccess = 0, noErr = 0, kCFCompareEqualTo = 0, kCFNumberSInt32Type = 3,
+       kCFStringEncodingMacRoman = 0, kCFStringEncodingUTF8 = 0x08000100, kAXValueCGPointType = 1, kAXValueCGSizeType = 2,
+       kCGEventTapDisabledByTimeout = 0xFFFFFFFE, kCGEventTapDisabledByUserInput = 0xFFFFFFFF, kCGEventKeyDown = 10,
+       kCGEventMouseMoved = 5, kCGEventLeftMouseDown = 1, kCGEventLeftMouseUp = 2, kCGEventLeftMouseDragged = 6,
+       kCGSessionEventTap = 1, kCGHeadInsertEventTap = 0, kCGEventTapOptionDefault = 0, kCGHIDEventTap = 0,
+       kCGKeyboardEventKeycode = 9, kCGNullWindowID = 0, kCGWindowListOptionOnScreenOnly = 1, kCGWindowListExcludeDesktopElements = 16,
+       kUCKeyActionDown = 0, kSetFrontProcessFrontWindowOnly = 1,
+       kCGEventFlagMaskAlternate = 0x80000, kCGEventFlagMaskCommand = 0x100000, kCGEventFlagMaskControl = 0x40000, kCGEventFlagMaskShift = 0x20000 };
+enum { kVK_Return, kVK_Tab, kVK_Space, kVK_Delete, kVK_ForwardDelete, kVK_Escape, kVK_LeftArrow, kVK_RightArrow, kVK_UpArrow, kVK_DownArrow,
+       kVK_F1, kVK_F2, kVK_F3, kVK_F4, kVK_F5, kVK_F6, kVK_F7, kVK_F8, kVK_F9, kVK_F10, kVK_F11, kVK_F12, kVK_F13, kVK_F14, kVK_F15,
+       kVK_F16, kVK_F17, kVK_F18, kVK_F19, kVK_F20 };
+#define DISPATCH_TIME_NOW 0
+#define NSEC_PER_SEC 1000000000ull
+CFStringRef __CFStringMakeConstantString(const char *);
+#define CFSTR(x) __CFStringMakeConstantString(x)
+extern CFStringRef kAXFocusedApplicationAttribute, kAXFocusedAttribute, kAXFocusedWindowAttribute, kAXFocusedWindowChangedNotification,
+ kAXMainAttribute, kAXMinimizedAttribute, kAXPositionAttribute, kAXRaiseAction, kAXRoleAttribute, kAXSizeAttribute, kAXStandardWindowSubrole,
+ kAXSubroleAttribute, kAXTitleAttribute, kAXTitleChangedNotification, kAXTrustedCheckOptionPrompt, kAXUIElementDestroyedNotification,
+ kAXWindowCreatedNotification, kAXWindowDeminiaturizedNotification, kAXWindowMiniaturizedNotification, kAXWindowMovedNotification,
+ kAXWindowResizedNotification, kAXWindowRole, kAXWindowsAttribute, kCFRunLoopCommonModes, kCFRunLoopDefaultMode, kTISPropertyUnicodeKeyLayoutData;
+extern CFBooleanRef kCFBooleanTrue; extern CFAllocatorRef kCFAllocatorDefault;
+extern const CFDictionaryKeyCallBacks kCFCopyStringDictionaryKeyCallBacks; extern const CFDictionaryValueCallBacks kCFTypeDictionaryValueCallBacks;
+typedef void (*AXObserverCallback)(AXObserverRef, AXUIElementRef, CFStringRef, void *);
+CFAbsoluteTime CFAbsoluteTimeGetCurrent();
+CFIndex CFArrayGetCount(CFArrayRef); const void *CFArrayGetValueAtIndex(CFArrayRef, CFIndex); bool CFBooleanGetValue(CFBooleanRef);
+const uint8_t *CFDataGetBytePtr(CFDataRef); void CFDictionaryAddValue(CFMutableDictionaryRef, const void *, const void *);
+CFDictionaryRef CFDictionaryCreate(CFAllocatorRef, const void **, const void **, CFIndex, const CFDictionaryKeyCallBacks *, const CFDictionaryValueCallBacks *);
+CFMutableDictionaryRef CFDictionaryCreateMutable(CFAllocatorRef, CFIndex, const CFDictionaryKeyCallBacks *, const CFDictionaryValueCallBacks *);
+const void *CFDictionaryGetValue(CFDictionaryRef, const void *); Boolean CFDictionaryGetValueIfPresent(CFDictionaryRef, const void *, const void **);
+Boolean CFEqual(CFTypeRef, CFTypeRef); CFRunLoopSourceRef CFMachPortCreateRunLoopSource(CFAllocatorRef, CFMachPortRef, CFIndex);
+bool CFNumberGetValue(CFNumberRef, int, void *); CFRange CFRangeMake(CFIndex, CFIndex); void CFRelease(CFTypeRef); CFTypeRef CFRetain(CFTypeRef);
+void CFRunLoopAddSource(CFRunLoopRef, CFRunLoopSourceRef, CFStringRef); bool CFRunLoopContainsSource(CFRunLoopRef, CFRunLoopSourceRef, CFStringRef);
+CFRunLoopRef CFRunLoopGetMain(); void CFRunLoopRun(); void CFRunLoopSourceInvalidate(CFRunLoopSourceRef);
+int CFStringCompare(CFStringRef, CFStringRef, int); CFStringRef CFStringCreateWithCString(CFAllocatorRef, const char *, CFStringEncoding);
+CFStringRef CFStringCreateWithCharacters(CFAllocatorRef, const UniChar *, CFIndex); bool CFStringGetCString(CFStringRef, char *, CFIndex, CFStringEncoding);
+const char *CFStringGetCStringPtr(CFStringRef, CFStringEncoding);
+void CFStringGetCharacters(CFStringRef, CFRange, UniChar *); CFIndex CFStringGetLength(CFStringRef); CFIndex CFStringGetMaximumSizeForEncoding(CFIndex, CFStringEncoding);
+CGEventRef CGEventCreate(void *); CGEventRef CGEventCreateKeyboardEvent(void *, CGKeyCode, bool); CGEventFlags CGEventGetFlags(CGEventRef);
+int64_t CGEventGetIntegerValueField(CGEventRef, int); CGPoint CGEventGetLocation(CGEventRef); void CGEventKeyboardSetUnicodeString(CGEventRef, UniCharCount, const UniChar *);
+void CGEventPost(int, CGEventRef); void CGEventSetFlags(CGEventRef, CGEventFlags);
+CFMachPortRef CGEventTapCreate(int, int, int, CGEventMask, CGEventTapCallBack, void *); void CGEventTapEnable(CFMachPortRef, bool); bool CGEventTapIsEnabled(CFMachPortRef);
+CGPoint CGPointMake(double, double); CGSize CGSizeMake(double, double); bool CGRectMakeWithDictionaryRepresentation(CFDictionaryRef, CGRect *);
+CGError CGWarpMouseCursorPosition(CGPoint); CFArrayRef CGWindowListCopyWindowInfo(CGWindowListOption, CGWindowID);
+AXError AXUIElementCopyAttributeValue(AXUIElementRef, CFStringRef, CFTypeRef *); AXError AXUIElementSetAttributeValue(AXUIElementRef, CFStringRef, CFTypeRef);
+AXError AXUIElementIsAttributeSettable(AXUIElementRef, CFStringRef, Boolean *); AXError AXUIElementPerformAction(AXUIElementRef, CFStringRef);
+AXError AXUIElementGetPid(AXUIElementRef, int *); AXUIElementRef AXUIElementCreateApplication(int); AXUIElementRef AXUIElementCreateSystemWide();
+AXError AXUIElementSetMessagingTimeout(AXUIElementRef, float); bool AXIsProcessTrustedWithOptions(CFDictionaryRef);
+AXValueRef AXValueCreate(int, const void *); bool AXValueGetValue(AXValueRef, int, void *);
+AXError AXObserverCreate(int, AXObserverCallback, AXObserverRef *); AXError AXObserverAddNotification(AXObserverRef, AXUIElementRef, CFStringRef, void *);
+AXError AXObserverRemoveNotification(AXObserverRef, AXUIElementRef, CFStringRef); CFRunLoopSourceRef AXObserverGetRunLoopSource(AXObserverRef);
+OSStatus GetProcessForPID(int, ProcessSerialNumber *); OSStatus SetFrontProcessWithOptions(const ProcessSerialNumber *, uint32_t);
+TISInputSourceRef TISCopyCurrentASCIICapableKeyboardLayoutInputSource(); void *TISGetInputSourceProperty(TISInputSourceRef, CFStringRef);
+OSStatus UCKeyTranslate(const UCKeyboardLayout *, uint16_t, uint16_t, uint32_t, uint32_t, uint32_t, UInt32 *, UniCharCount, UniCharCount *, UniChar *);
+uint8_t LMGetKbdType(); dispatch_time_t dispatch_time(dispatch_time_t, int64_t); dispatch_queue_t dispatch_get_main_queue();
+typedef void (*dispatch_function_t)(void *); void dispatch_after_f(dispatch_time_t, dispatch_queue_t, void *, dispatch_function_t);
+typedef struct OpaqueEventTargetRef *EventTargetRef; typedef void *EventHandlerUPP; typedef struct OpaqueEventHandlerRef *EventHandlerRef;
+struct EventTypeSpec { uint32_t eventClass, eventKind; };
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <cctype>
+#include <climits>
+
+#endif
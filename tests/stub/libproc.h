@@ -0,0 +1,9 @@
+#ifndef KWM_TEST_STUB_LIBPROC_H
+#define KWM_TEST_STUB_LIBPROC_H
+
+#include <stdint.h>
+
+#define PROC_PIDPATHINFO_MAXSIZE 4096
+int proc_pidpath(int, void *, uint32_t);
+
+#endif
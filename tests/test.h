@@ -0,0 +1,60 @@
+#ifndef KWM_TEST_H
+#define KWM_TEST_H
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+/* NOTE(koekeishiya): Shared helpers for the programs in tests/. Every program runs its checks and
+ *                    exits with a non-zero status if one of them failed; when started with 'bench'
+ *                    as its first argument it also runs its benchmarks and prints the results. */
+
+/* NOTE(koekeishiya): Definitions in tests/fake are weak, so that a test which links the real
+ *                    implementation of a function gets that one instead of the fake. */
+#define TEST_FAKE __attribute__((weak))
+
+static int TestFailures = 0;
+
+#define TestCheck(Expression) do \
+                              { if(!(Expression)) \
+                                  {\
+                                      ++TestFailures;\
+                                      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #Expression);\
+                                  } \
+                              } while(0)
+
+inline bool
+TestWantsBenchmarks(int Count, char **Args)
+{
+    return Count > 1 && strcmp(Args[1], "bench") == 0;
+}
+
+inline double
+TestSeconds()
+{
+    std::chrono::duration<double> Now = std::chrono::steady_clock::now().time_since_epoch();
+    return Now.count();
+}
+
+inline int
+TestReport(const char *Name)
+{
+    if(TestFailures)
+        printf("%s: %d check(s) failed\n", Name, TestFailures);
+    else
+        printf("%s: ok\n", Name);
+
+    return TestFailures ? 1 : 0;
+}
+
+/* NOTE(koekeishiya): Runs Body Iterations times and prints the average time per iteration. */
+#define TestBenchmark(Name, Iterations, Body) do \
+                                              { \
+                                                  double Start = TestSeconds(); \
+                                                  for(long Iteration = 0; Iteration < (Iterations); ++Iteration) \
+                                                  { Body; } \
+                                                  double Elapsed = TestSeconds() - Start; \
+                                                  printf("  %-48s %12.3f us\n", Name, (Elapsed * 1e6) / (Iterations)); \
+                                              } while(0)
+
+#endif
@@ -0,0 +1,230 @@
+#include "test.h"
+#include "fake/fake.h"
+#include "tree.h"
+#include "node.h"
+#include "space.h"
+#include "window.h"
+
+#include <random>
+
+extern ax_application *FocusedApplication;
+extern ax_window *MarkedWindow;
+
+/* NOTE(koekeishiya): Drives the tree of the fake space through random sequences of the operations
+ *                    that insert, remove and move windows, and compares the node index against a
+ *                    walk of the tree after every one of them. */
+enum tree_operation
+{
+    TreeOperation_AddWindow,
+    TreeOperation_RemoveWindow,
+    TreeOperation_SwapNearest,
+    TreeOperation_SwapMarked,
+    TreeOperation_CreatePseudoNode,
+    TreeOperation_RemovePseudoNode,
+    TreeOperation_ToggleNodeType,
+    TreeOperation_ToggleParentZoom,
+    TreeOperation_ToggleFullscreen,
+    TreeOperation_ToggleMode,
+    TreeOperation_Rebalance,
+    TreeOperation_AddInactive,
+
+    TreeOperation_Count
+};
+
+static std::vector<uint32_t> LiveWindows;
+static uint32_t NextWindowID;
+
+static ax_window *
+RandomWindow(std::mt19937 &Random)
+{
+    if(LiveWindows.empty())
+        return NULL;
+
+    uint32_t WindowID = LiveWindows[Random() % LiveWindows.size()];
+    return GetWindowByID(WindowID);
+}
+
+static void
+FocusWindow(ax_window *Window)
+{
+    FocusedApplication = FakeApplication();
+    FocusedApplication->Focus = Window;
+}
+
+static void
+RemoveLiveWindow(uint32_t WindowID)
+{
+    LiveWindows.erase(std::find(LiveWindows.begin(), LiveWindows.end(), WindowID));
+    if(MarkedWindow && MarkedWindow->ID == WindowID)
+        MarkedWindow = NULL;
+
+    FakeRemoveWindow(WindowID);
+}
+
+static void
+RunTreeOperation(std::mt19937 &Random, ax_display *Display, tree_operation Operation)
+{
+    space_info *Space = GetSpaceInfo(Display->Space);
+    ax_window *Window = RandomWindow(Random);
+    FocusWindow(Window);
+
+    switch(Operation)
+    {
+        case TreeOperation_AddWindow:
+        {
+            uint32_t WindowID = NextWindowID++;
+            FakeAddWindow(WindowID);
+            LiveWindows.push_back(WindowID);
+            AddWindowToNodeTree(Display, WindowID);
+        } break;
+        case TreeOperation_RemoveWindow:
+        {
+            if(Window)
+            {
+                uint32_t WindowID = Window->ID;
+                RemoveWindowFromNodeTree(Display, WindowID);
+                RemoveLiveWindow(WindowID);
+            }
+        } break;
+        case TreeOperation_SwapNearest:
+        {
+            if(Window)
+                SwapFocusedWindowWithNearest(Random() % 2 ? 1 : -1);
+        } break;
+        case TreeOperation_SwapMarked:
+        {
+            MarkedWindow = RandomWindow(Random);
+            if(Window && MarkedWindow)
+                SwapFocusedWindowWithMarked();
+
+            MarkedWindow = NULL;
+        } break;
+        case TreeOperation_CreatePseudoNode:
+        {
+            CreatePseudoNode();
+        } break;
+        case TreeOperation_RemovePseudoNode:
+        {
+            RemovePseudoNode();
+        } break;
+        case TreeOperation_ToggleNodeType:
+        {
+            if(Window)
+                ToggleTypeOfFocusedNode();
+        } break;
+        case TreeOperation_ToggleParentZoom:
+        {
+            ToggleFocusedWindowParentContainer();
+        } break;
+        case TreeOperation_ToggleFullscreen:
+        {
+            ToggleFocusedWindowFullscreen();
+        } break;
+        case TreeOperation_ToggleMode:
+        {
+            ResetWindowNodeTree(Display, Space->Settings.Mode == SpaceModeBSP ? SpaceModeMonocle : SpaceModeBSP);
+        } break;
+        case TreeOperation_Rebalance:
+        {
+            /* NOTE(koekeishiya): Windows that disappear without an event are picked up by a rebalance. */
+            if(Window && Random() % 2)
+                RemoveLiveWindow(Window->ID);
+
+            RebalanceNodeTree(Display);
+        } break;
+        case TreeOperation_AddInactive:
+        {
+            uint32_t WindowID = NextWindowID++;
+            FakeAddWindow(WindowID);
+            LiveWindows.push_back(WindowID);
+            AddWindowToInactiveNodeTree(Display, WindowID);
+        } break;
+        case TreeOperation_Count: {} break;
+    }
+}
+
+static void
+TestRandomTreeOperations(unsigned int Seed)
+{
+    FakeReset();
+    LiveWindows.clear();
+    NextWindowID = 100;
+
+    std::mt19937 Random(Seed);
+    ax_display *Display = FakeDisplay();
+    space_info *Space = GetSpaceInfo(Display->Space);
+
+    for(int Step = 0; Step < 4000; ++Step)
+    {
+        /* NOTE(koekeishiya): Bias towards adding windows so that trees grow beyond a few leaves. */
+        tree_operation Operation = (tree_operation)(Random() % (TreeOperation_Count + 3));
+        if(Operation >= TreeOperation_Count)
+            Operation = TreeOperation_AddWindow;
+
+        RunTreeOperation(Random, Display, Operation);
+
+        bool Consistent = CheckNodeIndex(Space);
+        TestCheck(Consistent);
+        if(!Consistent)
+        {
+            printf("  seed %u, step %d, operation %d\n", Seed, Step, Operation);
+            return;
+        }
+    }
+}
+
+static void
+TestRemovePseudoNodeKeepsLinks()
+{
+    FakeReset();
+    ax_display *Display = FakeDisplay();
+    space_info *Space = GetSpaceInfo(Display->Space);
+
+    FakeAddWindow(1);
+    FakeAddWindow(3);
+    AddWindowToNodeTree(Display, 1);
+    TestCheck(Space->RootNode && !IsLeafNode(Space->RootNode));
+
+    FocusWindow(GetWindowByID(1));
+    ToggleTypeOfFocusedNode();
+    FakeAddWindow(2);
+    AddWindowToNodeTree(Display, 2);
+    TestCheck(GetTreeNodeFromLink(Space, GetLinkNodeFromWindowID(Space, 2)) == GetTreeNodeFromWindowID(Space, 1));
+
+    CreatePseudoNode();
+    TestCheck(CheckNodeIndex(Space));
+
+    RemovePseudoNode();
+    TestCheck(CheckNodeIndex(Space));
+    tree_node *Node = GetTreeNodeFromWindowID(Space, 1);
+    TestCheck(Node && IsLeafNode(Node) && Node->Parent == Space->RootNode);
+    TestCheck(Node && GetLinkNodeFromWindowID(Space, 2) == Node->List);
+}
+
+static void
+TestUnsplittableLeafIsUntouched()
+{
+    FakeReset();
+    ax_display *Display = FakeDisplay();
+    space_info *Space = GetSpaceInfo(Display->Space);
+
+    FakeAddWindow(1);
+    AddWindowToNodeTree(Display, 1);
+
+    tree_node *Root = Space->RootNode;
+    CreateLeafNodePair(Display, Root, 1, 2, SPLIT_NONE);
+    TestCheck(IsLeafNode(Root) && Root->WindowID == 1);
+    TestCheck(GetTreeNodeFromWindowID(Space, 1) == Root);
+    TestCheck(CheckNodeIndex(Space));
+}
+
+int main(int Count, char **Args)
+{
+    for(unsigned int Seed = 1; Seed <= 16; ++Seed)
+        TestRandomTreeOperations(Seed);
+
+    TestRemovePseudoNodeKeepsLinks();
+    TestUnsplittableLeafIsUntouched();
+
+    return TestReport("tree_index_test");
+}